@@ -0,0 +1,96 @@
+#include <string.h>
+#include "core/hash.h"
+
+/*
+ * xxh64, see https://github.com/Cyan4973/xxHash for the reference
+ * implementation
+ */
+#define PRIME64_1 UINT64_C(0x9e3779b185ebca87)
+#define PRIME64_2 UINT64_C(0xc2b2ae3d27d4eb4f)
+#define PRIME64_3 UINT64_C(0x165667b19e3779f9)
+#define PRIME64_4 UINT64_C(0x85ebca77c2b2ae63)
+#define PRIME64_5 UINT64_C(0x27d4eb2f165667c5)
+
+static inline uint64_t rotl64(uint64_t v, int n) {
+  return (v << n) | (v >> (64 - n));
+}
+
+static inline uint64_t read64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+  acc += input * PRIME64_2;
+  acc = rotl64(acc, 31);
+  return acc * PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t v) {
+  acc ^= xxh64_round(0, v);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t hash_data(const void *data, int size, uint64_t seed) {
+  const uint8_t *p = data;
+  const uint8_t *end = p + size;
+  uint64_t h;
+
+  if (size >= 32) {
+    const uint8_t *limit = end - 32;
+    uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+    uint64_t v2 = seed + PRIME64_2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - PRIME64_1;
+
+    do {
+      v1 = xxh64_round(v1, read64(p + 0));
+      v2 = xxh64_round(v2, read64(p + 8));
+      v3 = xxh64_round(v3, read64(p + 16));
+      v4 = xxh64_round(v4, read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+
+    h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    h = xxh64_merge(h, v1);
+    h = xxh64_merge(h, v2);
+    h = xxh64_merge(h, v3);
+    h = xxh64_merge(h, v4);
+  } else {
+    h = seed + PRIME64_5;
+  }
+
+  h += (uint64_t)size;
+
+  for (; p + 8 <= end; p += 8) {
+    h ^= xxh64_round(0, read64(p));
+    h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+  }
+
+  if (p + 4 <= end) {
+    h ^= (uint64_t)read32(p) * PRIME64_1;
+    h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
+  }
+
+  for (; p < end; p++) {
+    h ^= (uint64_t)*p * PRIME64_5;
+    h = rotl64(h, 11) * PRIME64_1;
+  }
+
+  /* avalanche */
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+
+  return h;
+}
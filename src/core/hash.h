@@ -1,6 +1,7 @@
 #ifndef REDREAM_HASH_H
 #define REDREAM_HASH_H
 
+#include <stdint.h>
 #include "core/list.h"
 #include "core/math.h"
 
@@ -32,4 +33,7 @@
 #define hash_bkt_for_each_entry(it, bkt, type, member) \
   list_for_each_entry(it, bkt, type, member)
 
+/* fast non-cryptographic hash of a block of data */
+uint64_t hash_data(const void *data, int size, uint64_t seed);
+
 #endif
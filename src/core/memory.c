@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include "core/memory.h"
 #include "core/core.h"
 #include "core/exception_handler.h"
@@ -11,6 +12,10 @@ struct memory_watch {
   enum memory_watch_type type;
   memory_watch_cb cb;
   void *data;
+  /* per-page written flags for page write watches */
+  uint8_t *written;
+  int num_pages;
+  int num_written;
   struct interval_node tree_it;
   struct list_node list_it;
 };
@@ -46,8 +51,63 @@ static void watcher_destroy() {
   watcher = NULL;
 }
 
+static int watcher_page_needed(uintptr_t page, size_t page_size) {
+  if (!watcher) {
+    return 0;
+  }
+
+  struct interval_tree_it it;
+  struct interval_node *n = interval_tree_iter_first(
+      &watcher->tree, page, page + page_size - 1, &it);
+
+  while (n) {
+    struct memory_watch *watch = container_of(n, struct memory_watch, tree_it);
+
+    if (watch->type == WATCH_SINGLE_WRITE) {
+      return 1;
+    }
+
+    int idx = (int)((page - n->low) / page_size);
+    if (!watch->written[idx]) {
+      return 1;
+    }
+
+    n = interval_tree_iter_next(&it);
+  }
+
+  return 0;
+}
+
+static void watcher_restore_pages(uintptr_t begin, uintptr_t end) {
+  /* restore write access to each page in the range which isn't still needed
+     by another live watch, coalescing adjacent pages into a single call */
+  size_t page_size = get_page_size();
+  uintptr_t run_begin = 0;
+  size_t run_size = 0;
+
+  for (uintptr_t page = begin; page < end; page += page_size) {
+    if (watcher_page_needed(page, page_size)) {
+      if (run_size) {
+        CHECK(protect_pages((void *)run_begin, run_size, ACC_READWRITE));
+        run_size = 0;
+      }
+      continue;
+    }
+
+    if (!run_size) {
+      run_begin = page;
+    }
+    run_size += page_size;
+  }
+
+  if (run_size) {
+    CHECK(protect_pages((void *)run_begin, run_size, ACC_READWRITE));
+  }
+}
+
 static int watcher_handle_exception(void *ctx, struct exception_state *ex) {
   int handled = 0;
+  size_t page_size = get_page_size();
 
   struct interval_tree_it it;
   struct interval_node *n = interval_tree_iter_first(
@@ -59,29 +119,35 @@ static int watcher_handle_exception(void *ctx, struct exception_state *ex) {
     struct interval_node *next = interval_tree_iter_next(&it);
     struct memory_watch *watch = container_of(n, struct memory_watch, tree_it);
 
-    /* call callback for this access watch */
-    watch->cb(ex, watch->data);
-
     if (watch->type == WATCH_SINGLE_WRITE) {
-      /* restore page permissions */
-      uintptr_t aligned_begin = n->low;
-      size_t aligned_size = (n->high - n->low) + 1;
-      CHECK(protect_pages((void *)aligned_begin, aligned_size, ACC_READWRITE));
+      /* call callback for this access watch */
+      watch->cb(ex, watch->data);
 
+      /* removing the watch restores the page permissions */
       remove_memory_watch(watch);
+    } else if (watch->type == WATCH_PAGE_WRITE) {
+      uintptr_t page = ALIGN_DOWN(ex->fault_addr, page_size);
+      int idx = (int)((page - n->low) / page_size);
+
+      if (!watch->written[idx]) {
+        watch->written[idx] = 1;
+        watch->num_written++;
+        watch->cb(ex, watch->data);
+      }
+
+      watcher_restore_pages(page, page + page_size);
     }
 
     n = next;
   }
 
-  if (watcher && !watcher->tree.root) {
-    watcher_destroy();
-  }
-
   return handled;
 }
 
 void remove_memory_watch(struct memory_watch *watch) {
+  uintptr_t begin = watch->tree_it.low;
+  uintptr_t end = watch->tree_it.high + 1;
+
   /* remove from interval tree */
   interval_tree_remove(&watcher->tree, &watch->tree_it);
 
@@ -91,13 +157,22 @@ void remove_memory_watch(struct memory_watch *watch) {
   /* add to free list */
   list_add(&watcher->free_watches, &watch->list_it);
 
+  free(watch->written);
+  watch->written = NULL;
+  watch->num_pages = 0;
+  watch->num_written = 0;
+
+  /* restore permissions for any pages no longer being watched */
+  watcher_restore_pages(begin, end);
+
   if (!watcher->tree.root) {
     watcher_destroy();
   }
 }
 
-struct memory_watch *add_single_write_watch(const void *ptr, size_t size,
-                                            memory_watch_cb cb, void *data) {
+static struct memory_watch *add_memory_watch(enum memory_watch_type type,
+                                             const void *ptr, size_t size,
+                                             memory_watch_cb cb, void *data) {
   if (!watcher) {
     watcher_create();
   }
@@ -115,10 +190,15 @@ struct memory_watch *add_single_write_watch(const void *ptr, size_t size,
   struct memory_watch *watch =
       list_first_entry(&watcher->free_watches, struct memory_watch, list_it);
   CHECK_NOTNULL(watch);
-  watch->type = WATCH_SINGLE_WRITE;
+  watch->type = type;
   watch->cb = cb;
   watch->data = data;
 
+  if (type == WATCH_PAGE_WRITE) {
+    watch->num_pages = (int)(aligned_size / page_size);
+    watch->written = calloc(watch->num_pages, 1);
+  }
+
   /* remove from free list */
   list_remove(&watcher->free_watches, &watch->list_it);
 
@@ -133,3 +213,30 @@ struct memory_watch *add_single_write_watch(const void *ptr, size_t size,
 
   return watch;
 }
+
+void reset_page_write_watch(struct memory_watch *watch) {
+  CHECK_EQ(watch->type, WATCH_PAGE_WRITE);
+
+  uintptr_t aligned_begin = watch->tree_it.low;
+  size_t aligned_size = (watch->tree_it.high - watch->tree_it.low) + 1;
+
+  /* only reprotect the range if a page was actually written since the last
+     reset, keeping the per-frame cost near zero for untouched mirrors */
+  if (!watch->num_written) {
+    return;
+  }
+
+  CHECK(protect_pages((void *)aligned_begin, aligned_size, ACC_READONLY));
+  memset(watch->written, 0, watch->num_pages);
+  watch->num_written = 0;
+}
+
+struct memory_watch *add_page_write_watch(const void *ptr, size_t size,
+                                          memory_watch_cb cb, void *data) {
+  return add_memory_watch(WATCH_PAGE_WRITE, ptr, size, cb, data);
+}
+
+struct memory_watch *add_single_write_watch(const void *ptr, size_t size,
+                                            memory_watch_cb cb, void *data) {
+  return add_memory_watch(WATCH_SINGLE_WRITE, ptr, size, cb, data);
+}
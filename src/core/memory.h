@@ -42,12 +42,23 @@ struct memory_watch;
 
 enum memory_watch_type {
   WATCH_SINGLE_WRITE,
+  WATCH_PAGE_WRITE,
 };
 
 typedef void (*memory_watch_cb)(const struct exception_state *, void *);
 
+/* single write watches fire once on the first write to any page in the range,
+   and are then removed */
 struct memory_watch *add_single_write_watch(const void *ptr, size_t size,
                                             memory_watch_cb cb, void *data);
+
+/* page write watches fire once for each page in the range on the first write
+   to it, and stay live until removed. reset_page_write_watch rearms each page
+   in the range */
+struct memory_watch *add_page_write_watch(const void *ptr, size_t size,
+                                          memory_watch_cb cb, void *data);
+void reset_page_write_watch(struct memory_watch *watch);
+
 void remove_memory_watch(struct memory_watch *watch);
 
 #endif
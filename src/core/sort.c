@@ -44,3 +44,67 @@ void msort(void *data, int num, size_t size, sort_cmp cmp) {
   msort_noalloc(data, tmp, num, size, cmp);
   free(tmp);
 }
+
+void rsort_noalloc(uint32_t *keys, int *values, uint32_t *tmp_keys,
+                   int *tmp_values, int num) {
+  if (num < 2) {
+    return;
+  }
+
+  /* build the histograms for each 8-bit digit in a single pass */
+  int counts[4][256];
+  memset(counts, 0, sizeof(counts));
+
+  for (int i = 0; i < num; i++) {
+    uint32_t key = keys[i];
+    counts[0][key & 0xff]++;
+    counts[1][(key >> 8) & 0xff]++;
+    counts[2][(key >> 16) & 0xff]++;
+    counts[3][key >> 24]++;
+  }
+
+  uint32_t *src_keys = keys;
+  uint32_t *dst_keys = tmp_keys;
+  int *src_values = values;
+  int *dst_values = tmp_values;
+
+  for (int pass = 0; pass < 4; pass++) {
+    int *count = counts[pass];
+    int shift = pass * 8;
+
+    /* skip the pass if every key shares the same digit, which is common for
+       the high bits */
+    if (count[(src_keys[0] >> shift) & 0xff] == num) {
+      continue;
+    }
+
+    /* convert the counts to the offset of each digit's first entry */
+    int offset = 0;
+    for (int i = 0; i < 256; i++) {
+      int n = count[i];
+      count[i] = offset;
+      offset += n;
+    }
+
+    for (int i = 0; i < num; i++) {
+      uint32_t key = src_keys[i];
+      int j = count[(key >> shift) & 0xff]++;
+      dst_keys[j] = key;
+      dst_values[j] = src_values[i];
+    }
+
+    uint32_t *swap_keys = src_keys;
+    src_keys = dst_keys;
+    dst_keys = swap_keys;
+
+    int *swap_values = src_values;
+    src_values = dst_values;
+    dst_values = swap_values;
+  }
+
+  /* an odd number of passes leaves the results in the temporary arrays */
+  if (src_keys != keys) {
+    memcpy(keys, src_keys, num * sizeof(uint32_t));
+    memcpy(values, src_values, num * sizeof(int));
+  }
+}
@@ -2,6 +2,7 @@
 #define SORT_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 /* returns if a is <= b */
 typedef int (*sort_cmp)(const void *, const void *);
@@ -10,4 +11,23 @@ typedef int (*sort_cmp)(const void *, const void *);
 void msort_noalloc(void *data, void *tmp, int num, size_t size, sort_cmp cmp);
 void msort(void *data, int num, size_t size, sort_cmp cmp);
 
+/* stable lsd radix sort of values by their corresponding 32-bit keys, both
+   arrays are reordered in place. tmp_keys and tmp_values must each be large
+   enough to hold num entries */
+void rsort_noalloc(uint32_t *keys, int *values, uint32_t *tmp_keys,
+                   int *tmp_values, int num);
+
+/* maps a float to a key which sorts in the same order */
+static inline uint32_t rsort_float_key(float f) {
+  union {
+    float f;
+    uint32_t i;
+  } u;
+  u.f = f;
+
+  /* flip all bits for negative numbers, reversing their order, and only the
+     sign bit for positive numbers, moving them above the negatives */
+  return (u.i & 0x80000000) ? ~u.i : (u.i | 0x80000000);
+}
+
 #endif
@@ -27,6 +27,7 @@ cond_t cond_create();
 void cond_wait(cond_t cond, mutex_t mutex);
 int cond_timedwait(cond_t cond, mutex_t mutex, int ms);
 void cond_signal(cond_t cond);
+void cond_broadcast(cond_t cond);
 void cond_destroy(cond_t cond);
 
 /*
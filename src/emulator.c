@@ -26,6 +26,7 @@
 #include "guest/pvr/pvr.h"
 #include "guest/pvr/ta.h"
 #include "guest/pvr/tr.h"
+#include "guest/rewind.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
 #include "host/host.h"
@@ -61,11 +62,19 @@ struct emu_framebuffer {
   int height;
 };
 
+/* entries beyond this many live textures are recycled from the least recently
+   used end of the cache, leaving room for the entries waiting on the video
+   thread to release their handles */
+#define EMU_MAX_TEXTURES 8192
+#define EMU_MAX_LIVE_TEXTURES (EMU_MAX_TEXTURES * 3 / 4)
+
 struct emu_texture {
   struct tr_texture;
   struct emu *emu;
   struct list_node free_it;
   struct rb_node live_it;
+  struct list_node lru_it;
+  int size;
 
   struct memory_watch *texture_watch;
   struct memory_watch *palette_watch;
@@ -99,19 +108,45 @@ struct emu {
   /* latest video state pushed by the dreamcast */
   volatile int vid_disabled;
   volatile int vid_source;
+  struct tr *vid_tr;
   struct tr_context vid_rc;
-  struct emu_framebuffer vid_fb;
+
+  /* the pvr converts its framebuffer directly into the back buffer, which is
+     then flipped to the front to be drawn by the video thread */
+  struct emu_framebuffer vid_fbs[2];
+  volatile int vid_fb;
 
   /* latest context submitted to emu_start_render */
   struct ta_context *pending_ctx;
 
+  /* a snapshot is pushed to the rewind buffer each frame, or popped while
+     rewinding */
+  struct rewind *rewind;
+  volatile int rewinding;
+
+  /* when running ahead, the frames leading up to the presented one are ran
+     hidden, with their video output discarded. the audio output of all but the
+     first frame is also discarded, as those frames will be ran again */
+  int runahead_hidden;
+  int runahead_muted;
+  int runahead_vblank;
+
   /* texture cache. the dreamcast interface calls into us when new contexts are
      available to be rendered. parsing the contexts, uploading their textures to
      the render backend, and managing the texture cache is our responsibility */
-  struct emu_texture textures[8192];
+  struct emu_texture textures[EMU_MAX_TEXTURES];
   struct list free_textures;
   struct rb_tree live_textures;
 
+  /* live textures are ordered from least to most recently used, and evicted
+     once the cache exceeds its budget. the handles of evicted textures are
+     released by the video thread the next time a context is converted, after
+     which the entries are returned to the free list */
+  struct list lru_textures;
+  struct list evicted_textures;
+  int num_live_textures;
+  int64_t live_texture_bytes;
+
   /* textures for the current context are uploaded to the render backend by the
      video thread in parallel to the emulation thread executing. normally, this
      is safe as the real hardware also rendered asynchronously. unfortunately,
@@ -150,6 +185,18 @@ static int emu_texture_cmp(const struct rb_node *rb_lhs,
 
 static struct rb_callbacks emu_texture_cb = {&emu_texture_cmp, NULL, NULL};
 
+static void emu_dirty_texture(struct emu_texture *tex, int begin, int end) {
+  /* grow the range of bytes needing to be reconverted */
+  if (tex->dirty) {
+    begin = MIN(begin, tex->dirty_begin);
+    end = MAX(end, tex->dirty_end);
+  }
+
+  tex->dirty = 1;
+  tex->dirty_begin = begin;
+  tex->dirty_end = end;
+}
+
 static void emu_dirty_textures(struct emu *emu) {
   LOG_INFO("emu_dirty_textures");
 
@@ -159,22 +206,12 @@ static void emu_dirty_textures(struct emu *emu) {
     struct rb_node *next = rb_next(it);
     struct emu_texture *tex = rb_entry(it, struct emu_texture, live_it);
 
-    tex->dirty = 1;
+    emu_dirty_texture(tex, 0, tex->texture_size);
 
     it = next;
   }
 }
 
-static void emu_dirty_modified_textures(struct emu *emu) {
-  list_for_each_entry(tex, &emu->modified_textures, struct emu_texture,
-                      modified_it) {
-    tex->dirty = 1;
-    tex->modified = 0;
-  }
-
-  list_clear(&emu->modified_textures);
-}
-
 static void emu_texture_modified(const struct exception_state *ex, void *data) {
   struct emu_texture *tex = data;
   tex->texture_watch = NULL;
@@ -195,16 +232,134 @@ static void emu_palette_modified(const struct exception_state *ex, void *data) {
   }
 }
 
-static void emu_free_texture(struct emu *emu, struct emu_texture *tex) {
+static void emu_watch_texture(struct emu *emu, struct emu_texture *tex) {
+#ifdef NDEBUG
+  /* add write callback in order to invalidate on future writes. the pvr and
+     ta write through their own mapping of vram which isn't watched, so the
+     callback only fires for writes the pvr doesn't track */
+  if (!tex->texture_watch) {
+    tex->texture_watch = add_single_write_watch(
+        tex->texture, tex->texture_size, &emu_texture_modified, tex);
+  }
+
+  if (tex->palette && !tex->palette_watch) {
+    tex->palette_watch = add_single_write_watch(
+        tex->palette, tex->palette_size, &emu_palette_modified, tex);
+  }
+#endif
+}
+
+static void emu_dirty_modified_textures(struct emu *emu) {
+  struct pvr *pvr = emu->dc->pvr;
+
+  /* the watch is removed by the first fault, so the rest of an untracked
+     write can't be seen. conservatively dirty the entire texture */
+  list_for_each_entry(tex, &emu->modified_textures, struct emu_texture,
+                      modified_it) {
+    emu_dirty_texture(tex, 0, tex->texture_size);
+    tex->modified = 0;
+  }
+
+  list_clear(&emu->modified_textures);
+
+  /* writes tracked by the pvr leave the watches armed, dirty just the range
+     written of each texture they overlap */
+  if (pvr->num_vram_dirty_pages) {
+    struct rb_node *it = rb_first(&emu->live_textures);
+
+    while (it) {
+      struct emu_texture *tex = rb_entry(it, struct emu_texture, live_it);
+      uint32_t addr = (uint32_t)(tex->texture - pvr->vram);
+      uint32_t begin, end;
+
+      if (tex->texture && pvr_vram_dirty_range(pvr, addr, tex->texture_size,
+                                               &begin, &end)) {
+        emu_dirty_texture(tex, begin - addr, end - addr);
+      }
+
+      it = rb_next(it);
+    }
+  }
+
+  /* every texture overlapping the writes made since the last frame has been
+     processed, start tracking anew */
+  pvr_vram_reset_dirty(pvr);
+}
+
+static void emu_unlink_texture(struct emu *emu, struct emu_texture *tex) {
   /* remove from live tree */
   rb_unlink(&emu->live_textures, &tex->live_it, &emu_texture_cb);
+  list_remove(&emu->lru_textures, &tex->lru_it);
+
+  emu->num_live_textures--;
+  emu->live_texture_bytes -= tex->size;
+}
+
+static void emu_free_texture(struct emu *emu, struct emu_texture *tex) {
+  emu_unlink_texture(emu, tex);
 
   /* add back to free list */
   list_add(&emu->free_textures, &tex->free_it);
 }
 
+static void emu_release_evicted_textures(struct emu *emu) {
+  list_for_each_entry_safe(tex, &emu->evicted_textures, struct emu_texture,
+                           free_it) {
+    tr_release_texture(emu->vid_tr, (struct tr_texture *)tex);
+
+    list_remove(&emu->evicted_textures, &tex->free_it);
+    list_add(&emu->free_textures, &tex->free_it);
+  }
+}
+
+static void emu_evict_texture(struct emu *emu, struct emu_texture *tex) {
+  emu_unlink_texture(emu, tex);
+
+  /* the entry's memory is recycled once released, stop watching its source */
+  if (tex->texture_watch) {
+    remove_memory_watch(tex->texture_watch);
+    tex->texture_watch = NULL;
+  }
+
+  if (tex->palette_watch) {
+    remove_memory_watch(tex->palette_watch);
+    tex->palette_watch = NULL;
+  }
+
+  if (tex->modified) {
+    list_remove(&emu->modified_textures, &tex->modified_it);
+    tex->modified = 0;
+  }
+
+  list_add(&emu->evicted_textures, &tex->free_it);
+
+  prof_counter_add(COUNTER_texture_evictions, 1);
+}
+
+static void emu_evict_textures(struct emu *emu, int size) {
+  int64_t budget = (int64_t)OPTION_texture_cache * 1024 * 1024;
+
+  while (emu->num_live_textures >= EMU_MAX_LIVE_TEXTURES ||
+         (budget && emu->live_texture_bytes + size > budget)) {
+    struct emu_texture *tex =
+        list_first_entry(&emu->lru_textures, struct emu_texture, lru_it);
+
+    /* textures referenced by the current context must stay resident, even if
+       that means going over budget */
+    if (!tex || tex->frame == emu->frame) {
+      break;
+    }
+
+    emu_evict_texture(emu, tex);
+  }
+}
+
 static struct emu_texture *emu_alloc_texture(struct emu *emu, union tsp tsp,
                                              union tcw tcw) {
+  int size = ta_texture_width(tsp, tcw) * ta_texture_height(tsp, tcw) * 4;
+
+  emu_evict_textures(emu, size);
+
   /* remove from free list */
   struct emu_texture *tex =
       list_first_entry(&emu->free_textures, struct emu_texture, free_it);
@@ -216,9 +371,14 @@ static struct emu_texture *emu_alloc_texture(struct emu *emu, union tsp tsp,
   tex->emu = emu;
   tex->tsp = tsp;
   tex->tcw = tcw;
+  tex->size = size;
 
   /* add to live tree */
   rb_insert(&emu->live_textures, &tex->live_it, &emu_texture_cb);
+  list_add(&emu->lru_textures, &tex->lru_it);
+
+  emu->num_live_textures++;
+  emu->live_texture_bytes += size;
 
   return tex;
 }
@@ -237,8 +397,9 @@ static struct tr_texture *emu_find_texture(void *userdata, union tsp tsp,
   return (struct tr_texture *)tex;
 }
 
-static void emu_register_texture_source(struct emu *emu, union tsp tsp,
-                                        union tcw tcw) {
+static void emu_register_texture_source(struct emu *emu,
+                                        const struct ta_context *ctx,
+                                        union tsp tsp, union tcw tcw) {
   struct emu_texture *entry =
       (struct emu_texture *)emu_find_texture(emu, tsp, tcw);
 
@@ -251,6 +412,16 @@ static void emu_register_texture_source(struct emu *emu, union tsp tsp,
   int first_registration_this_frame = entry->frame != emu->frame;
   entry->frame = emu->frame;
 
+  if (first_registration_this_frame) {
+    /* move to the most recently used end of the cache */
+    list_remove(&emu->lru_textures, &entry->lru_it);
+    list_add(&emu->lru_textures, &entry->lru_it);
+
+    prof_counter_add(entry->dirty ? COUNTER_texture_misses
+                                  : COUNTER_texture_hits,
+                     1);
+  }
+
   /* set texture address */
   if (!entry->texture || !entry->palette) {
     ta_texture_info(emu->dc->ta, tsp, tcw, &entry->texture,
@@ -258,20 +429,13 @@ static void emu_register_texture_source(struct emu *emu, union tsp tsp,
                     &entry->palette_size);
   }
 
-#ifdef NDEBUG
-  /* add write callback in order to invalidate on future writes. the callback
-     address will be page aligned, therefore it will be triggered falsely in
-     some cases. over invalidate in these cases */
-  if (!entry->texture_watch) {
-    entry->texture_watch = add_single_write_watch(
-        entry->texture, entry->texture_size, &emu_texture_modified, entry);
-  }
+  emu_watch_texture(emu, entry);
 
-  if (entry->palette && !entry->palette_watch) {
-    entry->palette_watch = add_single_write_watch(
-        entry->palette, entry->palette_size, &emu_palette_modified, entry);
+  /* start decoding the texture while the emulation thread runs on, only the
+     upload is left to do when the context is converted */
+  if (emu->vid_tr && entry->dirty && first_registration_this_frame) {
+    tr_stage_texture(emu->vid_tr, ctx, (struct tr_texture *)entry);
   }
-#endif
 
   if (emu->trace_writer && entry->dirty && first_registration_this_frame) {
     trace_writer_insert_texture(emu->trace_writer, tsp, tcw, entry->frame,
@@ -282,34 +446,14 @@ static void emu_register_texture_source(struct emu *emu, union tsp tsp,
 
 static void emu_register_texture_sources(struct emu *emu,
                                          struct ta_context *ctx) {
-  const uint8_t *data = ctx->params;
-  const uint8_t *end = ctx->params + ctx->size;
-  int vert_type = 0;
-
   if (ctx->bg_isp.texture) {
-    emu_register_texture_source(emu, ctx->bg_tsp, ctx->bg_tcw);
+    emu_register_texture_source(emu, ctx, ctx->bg_tsp, ctx->bg_tcw);
   }
 
-  while (data < end) {
-    union pcw pcw = *(union pcw *)data;
-
-    switch (pcw.para_type) {
-      case TA_PARAM_POLY_OR_VOL:
-      case TA_PARAM_SPRITE: {
-        const union poly_param *param = (const union poly_param *)data;
-
-        vert_type = ta_vert_type(param->type0.pcw);
-
-        if (param->type0.pcw.texture) {
-          emu_register_texture_source(emu, param->type0.tsp, param->type0.tcw);
-        }
-      } break;
-
-      default:
-        break;
-    }
-
-    data += ta_param_size(pcw, vert_type);
+  /* the ta records each texture reference as the parameters are received */
+  for (int i = 0; i < ctx->num_textures; i++) {
+    struct ta_texture_ref *ref = &ctx->textures[i];
+    emu_register_texture_source(emu, ctx, ref->tsp, ref->tcw);
   }
 }
 
@@ -355,6 +499,10 @@ static void emu_start_tracing(struct emu *emu) {
 static void emu_vblank_in(void *userdata, int vid_disabled) {
   struct emu *emu = userdata;
 
+  if (emu->runahead_hidden) {
+    return;
+  }
+
   if (emu->multi_threaded) {
     mutex_lock(emu->res_mutex);
   }
@@ -371,6 +519,11 @@ static void emu_vblank_in(void *userdata, int vid_disabled) {
 static void emu_vblank_out(void *userdata) {
   struct emu *emu = userdata;
 
+  if (emu->runahead_hidden) {
+    emu->runahead_vblank = 1;
+    return;
+  }
+
   emu->state = EMU_ENDFRAME;
 }
 
@@ -395,6 +548,10 @@ static void emu_finish_render(void *userdata) {
 static void emu_start_render(void *userdata, struct ta_context *ctx) {
   struct emu *emu = userdata;
 
+  if (emu->runahead_hidden) {
+    return;
+  }
+
   /* incement internal frame number. this frame number is assigned to the each
      texture source registered to assert synchronization between the emulator
      and video thread is working as expected */
@@ -427,18 +584,39 @@ static void emu_start_render(void *userdata, struct ta_context *ctx) {
   }
 }
 
+static uint8_t *emu_map_pixels(void *userdata, int w, int h) {
+  struct emu *emu = userdata;
+
+  /* no need to convert pixels which will never be seen */
+  if (emu->runahead_hidden) {
+    return NULL;
+  }
+
+  return emu->vid_fbs[!emu->vid_fb].data;
+}
+
 static void emu_push_pixels(void *userdata, const uint8_t *data, int w, int h) {
   struct emu *emu = userdata;
 
-  memcpy(emu->vid_fb.data, data, w * h * 4);
-  emu->vid_fb.width = w;
-  emu->vid_fb.height = h;
+  if (emu->runahead_hidden) {
+    return;
+  }
 
+  struct emu_framebuffer *fb = &emu->vid_fbs[!emu->vid_fb];
+  CHECK_EQ(data, fb->data);
+  fb->width = w;
+  fb->height = h;
+
+  emu->vid_fb = !emu->vid_fb;
   emu->vid_source = EMU_SOURCE_PXL;
 }
 
 static void emu_push_audio(void *userdata, const int16_t *data, int frames) {
   struct emu *emu = userdata;
+
+  if (emu->runahead_muted) {
+    return;
+  }
   audio_push(emu->host, data, frames);
 }
 
@@ -471,6 +649,38 @@ static void emu_set_aspect_ratio(struct emu *emu, const char *new_ratio) {
  */
 static void emu_run_until_vblank(struct emu *emu);
 
+static void emu_convert_pending_ctx(struct emu *emu) {
+  if (!emu->pending_ctx) {
+    return;
+  }
+
+  tr_convert_context(emu->vid_tr, emu->pending_ctx, &emu->vid_rc);
+  emu->pending_ctx = NULL;
+
+  /* the emulation thread is blocked from touching the cache until the
+     context is released, return any textures it evicted */
+  emu_release_evicted_textures(emu);
+
+  emu->vid_source = EMU_SOURCE_CTX;
+}
+
+static void emu_release_pending_ctx(struct emu *emu) {
+  /* the pending context and the textures it references live in guest memory,
+     and must be converted before the machine is rolled back */
+  if (!emu->multi_threaded) {
+    /* when single-threaded, this is the video thread, convert it now */
+    emu_convert_pending_ctx(emu);
+    return;
+  }
+
+  /* the video thread converts the context while holding the lock, acquiring
+     it waits out a conversion in progress. a context it hasn't started on is
+     skipped, the same as in emu_finish_render */
+  mutex_lock(emu->res_mutex);
+  emu->pending_ctx = NULL;
+  mutex_unlock(emu->res_mutex);
+}
+
 static void *emu_run_thread(void *data) {
   struct emu *emu = data;
 
@@ -497,7 +707,44 @@ static void *emu_run_thread(void *data) {
   return NULL;
 }
 
-static void emu_run_until_vblank(struct emu *emu) {
+static void emu_update_rewind(struct emu *emu) {
+  /* the rewind buffer is only ever accessed from the emulation thread, create
+     and destroy it here in response to the options changing */
+  if (OPTION_rewind_dirty || OPTION_runahead_dirty) {
+    if (emu->rewind) {
+      rewind_destroy(emu->rewind);
+      emu->rewind = NULL;
+    }
+    OPTION_rewind_dirty = 0;
+    OPTION_runahead_dirty = 0;
+  }
+
+  /* run-ahead only needs the newest snapshot, so it works without a budget */
+  if (!emu->rewind && (OPTION_rewind > 0 || OPTION_runahead > 0)) {
+    emu->rewind = rewind_create(emu->dc, MAX(OPTION_rewind, 0) * 1024 * 1024);
+  }
+}
+
+static void emu_snapshot_done(int64_t start) {
+  int64_t end = time_nanoseconds();
+  prof_counter_add(COUNTER_snapshots, 1);
+  prof_counter_add(COUNTER_snapshot_us, (end - start) / 1000);
+}
+
+static void emu_run_hidden_frame(struct emu *emu) {
+  const int64_t MACHINE_STEP = HZ_TO_NANO(1000);
+
+  emu->runahead_hidden = 1;
+  emu->runahead_vblank = 0;
+
+  while (!emu->runahead_vblank) {
+    dc_tick(emu->dc, MACHINE_STEP);
+  }
+
+  emu->runahead_hidden = 0;
+}
+
+static void emu_run_frame(struct emu *emu) {
   const int64_t MACHINE_STEP = HZ_TO_NANO(1000);
 
   emu->state = EMU_RUNFRAME;
@@ -507,6 +754,58 @@ static void emu_run_until_vblank(struct emu *emu) {
   }
 }
 
+static void emu_run_until_vblank(struct emu *emu) {
+  emu_update_rewind(emu);
+
+  if (!emu->rewind) {
+    emu_run_frame(emu);
+    return;
+  }
+
+  int64_t start = time_nanoseconds();
+
+  if (emu->rewinding) {
+    emu_release_pending_ctx(emu);
+    rewind_pop(emu->rewind);
+    emu_snapshot_done(start);
+    emu_run_frame(emu);
+    return;
+  }
+
+  if (OPTION_runahead <= 0) {
+    rewind_push(emu->rewind);
+    emu_snapshot_done(start);
+    emu_run_frame(emu);
+    return;
+  }
+
+  /* run the real frame hidden and snapshot the result, then speculatively
+     run ahead to present a frame which already reflects the latest input, and
+     roll back to the real state. this hides the frames of latency introduced
+     by games buffering their input and rendering */
+  emu_run_hidden_frame(emu);
+
+  start = time_nanoseconds();
+  rewind_push(emu->rewind);
+  emu_snapshot_done(start);
+
+  emu->runahead_muted = 1;
+
+  for (int i = 1; i < OPTION_runahead; i++) {
+    emu_run_hidden_frame(emu);
+  }
+
+  emu_run_frame(emu);
+
+  emu->runahead_muted = 0;
+
+  emu_release_pending_ctx(emu);
+
+  start = time_nanoseconds();
+  rewind_restore(emu->rewind);
+  emu_snapshot_done(start);
+}
+
 void emu_render_frame(struct emu *emu) {
   prof_counter_add(COUNTER_frames, 1);
 
@@ -566,7 +865,7 @@ void emu_render_frame(struct emu *emu) {
      pending_ctx to be set              |
      ---------------------------------------------------------------------------
                                         | emu_start_render sets pending_ctx or
-                                        | emu_push_pixels copies off framebuffer
+                                        | emu_push_pixels flips framebuffer
      ---------------------------------------------------------------------------
      convert pending_ctx if set         |
      ---------------------------------------------------------------------------
@@ -598,13 +897,7 @@ void emu_render_frame(struct emu *emu) {
     }
   }
 
-  if (emu->pending_ctx) {
-    tr_convert_context(emu->r, emu, &emu_find_texture, emu->pending_ctx,
-                       &emu->vid_rc);
-    emu->pending_ctx = NULL;
-
-    emu->vid_source = EMU_SOURCE_CTX;
-  }
+  emu_convert_pending_ctx(emu);
 
   if (emu->multi_threaded) {
     mutex_unlock(emu->res_mutex);
@@ -624,10 +917,15 @@ void emu_render_frame(struct emu *emu) {
   /* render the latest video source */
   if (!emu->vid_disabled) {
     if (emu->vid_source == EMU_SOURCE_PXL) {
-      r_draw_pixels(emu->r, emu->vid_fb.data, 0, 0, emu->vid_fb.width,
-                    emu->vid_fb.height);
+      struct emu_framebuffer *fb = &emu->vid_fbs[emu->vid_fb];
+      r_draw_pixels(emu->r, fb->data, 0, 0, fb->width, fb->height);
     } else if (emu->vid_source == EMU_SOURCE_CTX) {
       tr_render_context(emu->r, &emu->vid_rc);
+
+      struct render_stats stats;
+      r_stats(emu->r, &stats);
+      prof_counter_add(COUNTER_gl_calls, stats.api_calls);
+      prof_counter_add(COUNTER_gl_skipped_calls, stats.skipped_api_calls);
     }
   }
 
@@ -676,8 +974,38 @@ void emu_debug_menu(struct emu *emu) {
     int arm7_instrs =
         (int)(prof_counter_load(COUNTER_arm7_instrs) / 1000000.0f);
 
-    snprintf(status, sizeof(status), "FPS %3d RPS %3d VBS %3d SH4 %4d ARM %d",
-             frames, ta_renders, pvr_vblanks, sh4_instrs, arm7_instrs);
+    int snapshots = (int)prof_counter_load(COUNTER_snapshots);
+    int snapshot_us = (int)prof_counter_load(COUNTER_snapshot_us);
+
+    int len = snprintf(status, sizeof(status),
+                       "FPS %3d RPS %3d VBS %3d SH4 %4d ARM %d", frames,
+                       ta_renders, pvr_vblanks, sh4_instrs, arm7_instrs);
+
+    /* average cost of each rewind / run-ahead snapshot */
+    if (snapshots) {
+      len += snprintf(status + len, sizeof(status) - len, " SNAP %4dus",
+                      snapshot_us / snapshots);
+    }
+
+    /* per-frame texture cache activity */
+    if (frames) {
+      int hits = (int)prof_counter_load(COUNTER_texture_hits);
+      int misses = (int)prof_counter_load(COUNTER_texture_misses);
+      int evictions = (int)prof_counter_load(COUNTER_texture_evictions);
+      int upload_kb =
+          (int)(prof_counter_load(COUNTER_texture_upload_bytes) / 1024);
+
+      len += snprintf(status + len, sizeof(status) - len,
+                      " TEX %d/%d/%d %dKB", hits / frames, misses / frames,
+                      evictions / frames, upload_kb / frames);
+
+      /* per-frame gl calls issued and skipped by the render backend */
+      int gl_calls = (int)prof_counter_load(COUNTER_gl_calls);
+      int gl_skipped = (int)prof_counter_load(COUNTER_gl_skipped_calls);
+
+      snprintf(status + len, sizeof(status) - len, " GL %d/%d",
+               gl_calls / frames, gl_skipped / frames);
+    }
 
     /* right align */
     struct ImVec2 content;
@@ -692,11 +1020,59 @@ void emu_debug_menu(struct emu *emu) {
 #endif
 }
 
+int emu_load_state(struct emu *emu, const void *data, int size) {
+  /* wait for the emulation thread to finish executing the previous frame */
+  if (emu->multi_threaded) {
+    mutex_lock(emu->req_mutex);
+  }
+
+  int res = dc_load_state(emu->dc, data, size);
+
+  if (res) {
+    /* any pending context references the old machine state, and the texture
+       cache's sources may have been overwritten */
+    emu->pending_ctx = NULL;
+    emu_dirty_textures(emu);
+  }
+
+  if (emu->multi_threaded) {
+    mutex_unlock(emu->req_mutex);
+  }
+
+  return res;
+}
+
+int emu_save_state(struct emu *emu, void *data, int size) {
+  /* wait for the emulation thread to finish executing the previous frame */
+  if (emu->multi_threaded) {
+    mutex_lock(emu->req_mutex);
+  }
+
+  int res = dc_save_state(emu->dc, data, size);
+
+  if (emu->multi_threaded) {
+    mutex_unlock(emu->req_mutex);
+  }
+
+  return res;
+}
+
+int emu_state_size(struct emu *emu) {
+  return dc_state_size(emu->dc);
+}
+
 int emu_load(struct emu *emu, const char *path) {
   return dc_load(emu->dc, path);
 }
 
 int emu_keydown(struct emu *emu, int port, int key, int16_t value) {
+  /* only consume backspace while rewinding is available, it's otherwise
+     needed by the debug ui's text fields */
+  if (key == K_BACKSPACE && emu->rewind) {
+    emu->rewinding = value ? 1 : 0;
+    return 1;
+  }
+
   if (key >= K_CONT_C && key <= K_CONT_RTRIG) {
     dc_input(emu->dc, port, key - K_CONT_C, value);
   }
@@ -707,15 +1083,23 @@ int emu_keydown(struct emu *emu, int port, int key, int16_t value) {
 void emu_vid_destroyed(struct emu *emu) {
   rb_for_each_entry_safe(tex, &emu->live_textures, struct emu_texture,
                          live_it) {
-    r_destroy_texture(emu->r, tex->handle);
+    tr_release_texture(emu->vid_tr, (struct tr_texture *)tex);
     emu_free_texture(emu, tex);
   }
 
+  emu_release_evicted_textures(emu);
+
+  if (emu->vid_tr) {
+    tr_destroy(emu->vid_tr);
+    emu->vid_tr = NULL;
+  }
+
   emu->r = NULL;
 }
 
 void emu_vid_created(struct emu *emu, struct render_backend *r) {
   emu->r = r;
+  emu->vid_tr = tr_create(r, emu, &emu_find_texture);
 }
 
 void emu_destroy(struct emu *emu) {
@@ -737,6 +1121,10 @@ void emu_destroy(struct emu *emu) {
 
   emu_stop_tracing(emu);
   emu_vid_destroyed(emu);
+  tr_free_context(&emu->vid_rc);
+  if (emu->rewind) {
+    rewind_destroy(emu->rewind);
+  }
   dc_destroy(emu->dc);
   free(emu);
 }
@@ -750,6 +1138,7 @@ struct emu *emu_create(struct host *host) {
   emu->dc = dc_create();
   emu->dc->userdata = emu;
   emu->dc->push_audio = &emu_push_audio;
+  emu->dc->map_pixels = &emu_map_pixels;
   emu->dc->push_pixels = &emu_push_pixels;
   emu->dc->start_render = &emu_start_render;
   emu->dc->finish_render = &emu_finish_render;
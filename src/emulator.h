@@ -15,6 +15,9 @@ void emu_vid_destroyed(struct emu *emu);
 int emu_keydown(struct emu *emu, int port, int key, int16_t value);
 
 int emu_load(struct emu *emu, const char *path);
+int emu_state_size(struct emu *emu);
+int emu_save_state(struct emu *emu, void *data, int size);
+int emu_load_state(struct emu *emu, const void *data, int size);
 void emu_debug_menu(struct emu *emu);
 void emu_render_frame(struct emu *emu);
 
@@ -8,6 +8,7 @@
 #include "guest/memory.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
+#include "guest/state.h"
 #include "imgui.h"
 #include "stats.h"
 
@@ -868,6 +869,46 @@ static void aica_toggle_recording(struct aica *aica) {
   }
 }
 
+static void aica_serialize(struct device *dev, struct state *s) {
+  struct aica *aica = (struct aica *)dev;
+  struct scheduler *sched = aica->dc->sched;
+
+  STATE_FIELD(s, aica->reg);
+  STATE_FIELD(s, aica->arm_resetting);
+  STATE_FIELD(s, aica->rtc_write);
+  STATE_FIELD(s, aica->rtc);
+
+  for (int i = 0; i < AICA_NUM_CHANNELS; i++) {
+    struct aica_channel *ch = &aica->channels[i];
+
+    /* the sound source is saved as an offset into aram */
+    int32_t base = ch->base ? (int32_t)(ch->base - aica->aram) : -1;
+
+    STATE_FIELD(s, ch->active);
+    STATE_FIELD(s, base);
+    STATE_FIELD(s, ch->phase);
+    STATE_FIELD(s, ch->phasefrc);
+    STATE_FIELD(s, ch->phaseinc);
+    STATE_FIELD(s, ch->prev_sample);
+    STATE_FIELD(s, ch->prev_quant);
+    STATE_FIELD(s, ch->next_sample);
+    STATE_FIELD(s, ch->next_quant);
+    STATE_FIELD(s, ch->loop_sample);
+    STATE_FIELD(s, ch->loop_quant);
+    STATE_FIELD(s, ch->looped);
+
+    if (state_loading(s)) {
+      ch->base = base >= 0 ? aica->aram + base : NULL;
+    }
+  }
+
+  state_timer(s, sched, &aica->timers[0], &aica_timer_expire_0, aica);
+  state_timer(s, sched, &aica->timers[1], &aica_timer_expire_1, aica);
+  state_timer(s, sched, &aica->timers[2], &aica_timer_expire_2, aica);
+  state_timer(s, sched, &aica->rtc_timer, &aica_rtc_timer, aica);
+  state_timer(s, sched, &aica->sample_timer, &aica_next_sample, aica);
+}
+
 static int aica_init(struct device *dev) {
   struct aica *aica = (struct aica *)dev;
   struct memory *mem = aica->dc->mem;
@@ -1039,5 +1080,9 @@ struct aica *aica_create(struct dreamcast *dc) {
     ch->id = i;
   }
 
+  /* setup state interface */
+  aica->stateif.enabled = 1;
+  aica->stateif.serialize = &aica_serialize;
+
   return aica;
 }
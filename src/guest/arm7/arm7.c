@@ -4,6 +4,7 @@
 #include "guest/dreamcast.h"
 #include "guest/memory.h"
 #include "guest/scheduler.h"
+#include "guest/state.h"
 #include "imgui.h"
 #include "jit/frontend/armv3/armv3_context.h"
 #include "jit/frontend/armv3/armv3_fallback.h"
@@ -227,6 +228,34 @@ static struct jit_guest *arm7_guest_create(struct arm7 *arm) {
   return (struct jit_guest *)guest;
 }
 
+static void arm7_serialize(struct device *dev, struct state *s) {
+  struct arm7 *arm = (struct arm7 *)dev;
+
+  STATE_FIELD(s, arm->runif.running);
+  STATE_FIELD(s, arm->ctx.r);
+  STATE_FIELD(s, arm->ctx.pending_interrupts);
+  STATE_FIELD(s, arm->ctx.run_cycles);
+  STATE_FIELD(s, arm->ctx.ran_instrs);
+  STATE_FIELD(s, arm->requested_interrupts);
+
+  /* as with the sh4, keep compiled code across loads which leave memory in
+     place, unless it was invalidated since the state was saved */
+  uint32_t code_gen = arm->jit->code_gen;
+  STATE_FIELD(s, code_gen);
+
+  if (state_loading(s) && !s->error) {
+    if (s->with_mem || code_gen != arm->jit->code_gen) {
+      jit_free_code(arm->jit);
+    }
+
+    /* rebuild pointers to the user bank for the current mode */
+    int mode = arm->ctx.r[CPSR] & M_MASK;
+    for (int n = 0; n < 16; n++) {
+      arm->ctx.rusr[n] = &arm->ctx.r[armv3_reg_table[mode][n]];
+    }
+  }
+}
+
 static int arm7_init(struct device *dev) {
   struct arm7 *arm = (struct arm7 *)dev;
 
@@ -276,5 +305,9 @@ struct arm7 *arm7_create(struct dreamcast *dc) {
   arm->runif.enabled = 1;
   arm->runif.run = &arm7_run;
 
+  /* setup state interface */
+  arm->stateif.enabled = 1;
+  arm->stateif.serialize = &arm7_serialize;
+
   return arm;
 }
@@ -12,6 +12,7 @@
 #include "guest/rom/boot.h"
 #include "guest/rom/flash.h"
 #include "guest/sh4/sh4.h"
+#include "guest/state.h"
 #include "options.h"
 
 /* address of syscall vectors */
@@ -371,8 +372,23 @@ void bios_destroy(struct bios *bios) {
   free(bios);
 }
 
+static void bios_serialize(struct device *dev, struct state *s) {
+  struct bios *bios = (struct bios *)dev;
+
+  STATE_FIELD(s, bios->status);
+  STATE_FIELD(s, bios->cmd_id);
+  STATE_FIELD(s, bios->cmd_code);
+  STATE_FIELD(s, bios->params);
+  STATE_FIELD(s, bios->result);
+}
+
 struct bios *bios_create(struct dreamcast *dc) {
   struct bios *bios =
       dc_create_device(dc, sizeof(struct bios), "bios", NULL, &bios_post_init);
+
+  /* setup state interface */
+  bios->stateif.enabled = 1;
+  bios->stateif.serialize = &bios_serialize;
+
   return bios;
 }
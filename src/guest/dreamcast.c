@@ -14,6 +14,24 @@
 #include "guest/rom/flash.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
+#include "guest/state.h"
+
+/* states begin with a small header, followed by a section for memory, the
+   scheduler and each device implementing the state interface. each section
+   is tagged with its name and size, enabling mismatched states to be rejected
+   before any machine state is modified */
+#define DC_STATE_MAGIC 0x54534452 /* RDST */
+#define DC_STATE_VERSION 5
+
+struct dc_state_header {
+  uint32_t magic;
+  uint32_t version;
+};
+
+struct dc_state_section {
+  char name[16];
+  int32_t size;
+};
 
 void dc_vblank_out(struct dreamcast *dc) {
   if (!dc->vblank_out) {
@@ -47,6 +65,14 @@ void dc_start_render(struct dreamcast *dc, struct ta_context *ctx) {
   dc->start_render(dc->userdata, ctx);
 }
 
+uint8_t *dc_map_pixels(struct dreamcast *dc, int w, int h) {
+  if (!dc->map_pixels) {
+    return NULL;
+  }
+
+  return dc->map_pixels(dc->userdata, w, h);
+}
+
 void dc_push_pixels(struct dreamcast *dc, const uint8_t *data, int w, int h) {
   if (!dc->push_pixels) {
     return;
@@ -92,6 +118,220 @@ void *dc_create_device(struct dreamcast *dc, size_t size, const char *name,
   return dev;
 }
 
+static int dc_begin_section(struct state *s, const char *name) {
+  struct dc_state_section section = {0};
+  int offset = s->offset;
+
+  if (!state_loading(s)) {
+    strncpy(section.name, name, sizeof(section.name) - 1);
+  }
+
+  STATE_FIELD(s, section);
+
+  if (state_loading(s) && strncmp(section.name, name, sizeof(section.name))) {
+    s->error = 1;
+  }
+
+  return offset;
+}
+
+static void dc_end_section(struct state *s, int offset) {
+  if (s->error || s->mode == STATE_MEASURE) {
+    return;
+  }
+
+  struct dc_state_section *section =
+      (struct dc_state_section *)(s->data + offset);
+  int32_t size = s->offset - offset - (int)sizeof(*section);
+
+  if (s->mode == STATE_SAVE) {
+    memcpy(&section->size, &size, sizeof(size));
+  } else if (memcmp(&section->size, &size, sizeof(size))) {
+    s->error = 1;
+  }
+}
+
+static void dc_serialize(struct dreamcast *dc, struct state *s, int with_mem) {
+  struct dc_state_header header = {DC_STATE_MAGIC, DC_STATE_VERSION};
+  s->with_mem = with_mem;
+  STATE_FIELD(s, header);
+
+  /* memory and the scheduler are serialized before the devices, the scheduler
+     must be loaded before any device rearms its timers */
+  int offset;
+
+  if (with_mem) {
+    offset = dc_begin_section(s, "mem");
+    mem_serialize(dc->mem, s);
+    dc_end_section(s, offset);
+  }
+
+  offset = dc_begin_section(s, "sched");
+  sched_serialize(dc->sched, s);
+  dc_end_section(s, offset);
+
+  list_for_each_entry(dev, &dc->devices, struct device, it) {
+    if (!dev->stateif.enabled) {
+      continue;
+    }
+
+    offset = dc_begin_section(s, dev->name);
+    dev->stateif.serialize(dev, s);
+    dc_end_section(s, offset);
+  }
+}
+
+static int dc_validate_section(const uint8_t *data, int size, int *offset,
+                               const char *name) {
+  struct dc_state_section section;
+
+  if (*offset + (int)sizeof(section) > size) {
+    return 0;
+  }
+
+  memcpy(&section, data + *offset, sizeof(section));
+  *offset += (int)sizeof(section);
+
+  if (strncmp(section.name, name, sizeof(section.name)) || section.size < 0 ||
+      section.size > size - *offset) {
+    return 0;
+  }
+
+  *offset += section.size;
+
+  return 1;
+}
+
+static int dc_validate_state(struct dreamcast *dc, const uint8_t *data,
+                             int size, int with_mem) {
+  struct dc_state_header header;
+  int offset = (int)sizeof(header);
+
+  if (size < offset) {
+    return 0;
+  }
+
+  memcpy(&header, data, sizeof(header));
+
+  if (header.magic != DC_STATE_MAGIC || header.version != DC_STATE_VERSION) {
+    LOG_WARNING("dc_validate_state unsupported state version %d",
+                header.version);
+    return 0;
+  }
+
+  if ((with_mem && !dc_validate_section(data, size, &offset, "mem")) ||
+      !dc_validate_section(data, size, &offset, "sched")) {
+    return 0;
+  }
+
+  list_for_each_entry(dev, &dc->devices, struct device, it) {
+    if (!dev->stateif.enabled) {
+      continue;
+    }
+
+    if (!dc_validate_section(data, size, &offset, dev->name)) {
+      LOG_WARNING("dc_validate_state invalid section for '%s'", dev->name);
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static int dc_save_state_ex(struct dreamcast *dc, void *data, int size,
+                            int with_mem) {
+  struct state s;
+  state_init(&s, STATE_SAVE, data, size);
+  dc_serialize(dc, &s, with_mem);
+
+  if (s.error) {
+    LOG_WARNING("dc_save_state buffer too small");
+    return 0;
+  }
+
+  return s.offset;
+}
+
+/* returns the maximum size of a saved state */
+static int dc_state_size_ex(struct dreamcast *dc, int with_mem) {
+  struct state s;
+  state_init(&s, STATE_MEASURE, NULL, 0);
+  dc_serialize(dc, &s, with_mem);
+  return s.offset;
+}
+
+static int dc_load_state_ex(struct dreamcast *dc, const void *data, int size,
+                            int with_mem) {
+  if (!dc_validate_state(dc, data, size, with_mem)) {
+    LOG_WARNING("dc_load_state invalid state");
+    return 0;
+  }
+
+  /* the state has been validated, but individual sections may still fail to
+     load if a device's state layout changed without the version being bumped.
+     states loaded with memory come from outside of the process, back up the
+     current state so a bad one can be backed out of. states without memory
+     are only ever produced by this process, and are expected to load */
+  uint8_t *backup = NULL;
+  int backup_size = 0;
+
+  if (with_mem) {
+    backup_size = dc_state_size_ex(dc, with_mem);
+    backup = malloc(backup_size);
+    CHECK_NOTNULL(backup);
+    CHECK(dc_save_state_ex(dc, backup, backup_size, with_mem));
+  }
+
+  struct state s;
+  state_init(&s, STATE_LOAD, (void *)data, size);
+  dc_serialize(dc, &s, with_mem);
+
+  int res = !s.error;
+
+  if (!res) {
+    if (!backup) {
+      LOG_FATAL("dc_load_state failed to load state, machine state is corrupt");
+    }
+
+    LOG_WARNING("dc_load_state failed to load state, restoring previous state");
+
+    state_init(&s, STATE_LOAD, backup, backup_size);
+    dc_serialize(dc, &s, with_mem);
+    CHECK(!s.error);
+  }
+
+  free(backup);
+
+  return res;
+}
+
+/* device states omit physical memory, leaving the caller to track it
+   separately (e.g. as page-level deltas) */
+int dc_load_device_state(struct dreamcast *dc, const void *data, int size) {
+  return dc_load_state_ex(dc, data, size, 0);
+}
+
+int dc_save_device_state(struct dreamcast *dc, void *data, int size) {
+  return dc_save_state_ex(dc, data, size, 0);
+}
+
+int dc_device_state_size(struct dreamcast *dc) {
+  return dc_state_size_ex(dc, 0);
+}
+
+int dc_load_state(struct dreamcast *dc, const void *data, int size) {
+  return dc_load_state_ex(dc, data, size, 1);
+}
+
+int dc_save_state(struct dreamcast *dc, void *data, int size) {
+  return dc_save_state_ex(dc, data, size, 1);
+}
+
+int dc_state_size(struct dreamcast *dc) {
+  return dc_state_size_ex(dc, 1);
+}
+
+
 void dc_remove_serial_device(struct dreamcast *dc) {
   dc->serial = NULL;
 }
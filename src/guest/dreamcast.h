@@ -22,6 +22,7 @@ struct memory;
 struct pvr;
 struct scheduler;
 struct sh4;
+struct state;
 struct ta;
 struct ta_context;
 
@@ -74,11 +75,22 @@ struct dbgif {
 
 /* run interface */
 typedef void (*device_run_cb)(struct device *, int64_t);
+typedef int64_t (*device_elapsed_cb)(struct device *);
 
 struct runif {
   int enabled;
   int running;
   device_run_cb run;
+  /* optional, returns the time executed so far by the current run call */
+  device_elapsed_cb elapsed;
+};
+
+/* state interface */
+typedef void (*device_serialize_cb)(struct device *, struct state *);
+
+struct stateif {
+  int enabled;
+  device_serialize_cb serialize;
 };
 
 /*
@@ -103,6 +115,7 @@ struct device {
   /* optional interfaces */
   struct dbgif dbgif;
   struct runif runif;
+  struct stateif stateif;
 
   struct list_node it;
 };
@@ -111,6 +124,7 @@ struct device {
  * machine
  */
 typedef void (*push_audio_cb)(void *, const int16_t *, int);
+typedef uint8_t *(*map_pixels_cb)(void *, int, int);
 typedef void (*push_pixels_cb)(void *, const uint8_t *, int, int);
 typedef void (*start_render_cb)(void *, struct ta_context *);
 typedef void (*finish_render_cb)(void *);
@@ -143,6 +157,7 @@ struct dreamcast {
   /* client callbacks */
   void *userdata;
   push_audio_cb push_audio;
+  map_pixels_cb map_pixels;
   push_pixels_cb push_pixels;
   start_render_cb start_render;
   finish_render_cb finish_render;
@@ -163,6 +178,14 @@ void dc_input(struct dreamcast *dc, int port, int button, int16_t value);
 void dc_add_serial_device(struct dreamcast *dc, struct serial *serial);
 void dc_remove_serial_device(struct dreamcast *dc);
 
+/* machine state snapshots */
+int dc_state_size(struct dreamcast *dc);
+int dc_save_state(struct dreamcast *dc, void *data, int size);
+int dc_load_state(struct dreamcast *dc, const void *data, int size);
+int dc_device_state_size(struct dreamcast *dc);
+int dc_save_device_state(struct dreamcast *dc, void *data, int size);
+int dc_load_device_state(struct dreamcast *dc, const void *data, int size);
+
 /* device registration */
 void *dc_create_device(struct dreamcast *dc, size_t size, const char *name,
                        device_init_cb init, device_post_init_cb post_init);
@@ -171,6 +194,7 @@ void dc_destroy_device(struct device *dev);
 
 /* client interface */
 void dc_push_audio(struct dreamcast *dc, const int16_t *data, int frames);
+uint8_t *dc_map_pixels(struct dreamcast *dc, int w, int h);
 void dc_push_pixels(struct dreamcast *dc, const uint8_t *data, int w, int h);
 void dc_start_render(struct dreamcast *dc, struct ta_context *ctx);
 void dc_finish_render(struct dreamcast *dc);
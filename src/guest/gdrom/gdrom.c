@@ -4,6 +4,7 @@
 #include "guest/gdrom/gdrom_replies.inc"
 #include "guest/gdrom/gdrom_types.h"
 #include "guest/holly/holly.h"
+#include "guest/state.h"
 #include "imgui.h"
 
 #if 0
@@ -118,20 +119,11 @@ static void gdrom_spi_cdread(struct gdrom *gd) {
   struct holly *hl = gd->dc->holly;
 
   if (gd->cdr_dma) {
-    int max_dma_sectors = sizeof(gd->dma_buffer) / DISC_MAX_SECTOR_SIZE;
-
-    /* fill DMA buffer with as many sectors as possible */
-    int num_sectors = MIN(gd->cdr_num_sectors, max_dma_sectors);
-    int res = gdrom_read_sectors(gd, gd->cdr_first_sector, num_sectors,
-                                 gd->cdr_secfmt, gd->cdr_secmask,
-                                 gd->dma_buffer, sizeof(gd->dma_buffer));
-    gd->dma_size = res;
+    /* sectors are read on demand as the dma transfer consumes them, enabling
+       them to be decoded straight into the transfer's destination */
+    gd->dma_size = 0;
     gd->dma_head = 0;
 
-    /* update sector read state */
-    gd->cdr_first_sector += num_sectors;
-    gd->cdr_num_sectors -= num_sectors;
-
     /* gdrom state won't be updated until DMA transfer is completed */
     gd->state = STATE_WRITE_DMA_DATA;
   } else {
@@ -605,6 +597,33 @@ static void gdrom_event(struct gdrom *gd, enum gd_event ev, int arg) {
   cb(gd, arg);
 }
 
+static void gdrom_serialize(struct device *dev, struct state *s) {
+  struct gdrom *gd = (struct gdrom *)dev;
+
+  /* the disc itself isn't saved, the state is expected to be loaded with the
+     same disc inserted */
+  STATE_FIELD(s, gd->state);
+  STATE_FIELD(s, gd->hw_info);
+  STATE_FIELD(s, gd->error);
+  STATE_FIELD(s, gd->features);
+  STATE_FIELD(s, gd->ireason);
+  STATE_FIELD(s, gd->sectnum);
+  STATE_FIELD(s, gd->byte_count);
+  STATE_FIELD(s, gd->status);
+  STATE_FIELD(s, gd->cdr_dma);
+  STATE_FIELD(s, gd->cdr_secfmt);
+  STATE_FIELD(s, gd->cdr_secmask);
+  STATE_FIELD(s, gd->cdr_first_sector);
+  STATE_FIELD(s, gd->cdr_num_sectors);
+  STATE_FIELD(s, gd->pio_buffer);
+  STATE_FIELD(s, gd->pio_head);
+  STATE_FIELD(s, gd->pio_size);
+  STATE_FIELD(s, gd->pio_offset);
+  STATE_FIELD(s, gd->dma_buffer);
+  STATE_FIELD(s, gd->dma_head);
+  STATE_FIELD(s, gd->dma_size);
+}
+
 static int gdrom_init(struct device *dev) {
   struct gdrom *gd = (struct gdrom *)dev;
 
@@ -791,29 +810,57 @@ void gdrom_dma_end(struct gdrom *gd) {
 }
 
 int gdrom_dma_read(struct gdrom *gd, uint8_t *data, int n) {
-  /* read more if the current dma buffer has been completely exhausted */
-  if (gd->dma_head >= gd->dma_size) {
-    if (gd->cdr_num_sectors) {
-      gdrom_spi_cdread(gd);
-    } else {
-      gdrom_spi_end(gd);
-    }
-  }
+  /* drain any partially consumed sector first */
+  if (gd->dma_head < gd->dma_size) {
+    n = MIN(n, gd->dma_size - gd->dma_head);
 
-  int remaining = gd->dma_size - gd->dma_head;
-  n = MIN(n, remaining);
-
-  if (n) {
     LOG_GDROM("gdrom_dma_read %d / %d bytes", gd->dma_head + n, gd->dma_size);
     memcpy(data, &gd->dma_buffer[gd->dma_head], n);
     gd->dma_head += n;
+
+    return n;
   }
 
-  return n;
+  if (!gd->cdr_num_sectors) {
+    gdrom_spi_end(gd);
+    return 0;
+  }
+
+  if (!n || !gd->disc) {
+    return 0;
+  }
+
+  /* decode as many whole sectors as requested directly into the destination */
+  struct track *track = disc_lookup_track(gd->disc, gd->cdr_first_sector);
+  CHECK_NOTNULL(track);
+
+  int num_sectors = MIN(n / track->data_size, gd->cdr_num_sectors);
+
+  if (num_sectors) {
+    int res = gdrom_read_sectors(gd, gd->cdr_first_sector, num_sectors,
+                                 gd->cdr_secfmt, gd->cdr_secmask, data, n);
+
+    gd->cdr_first_sector += num_sectors;
+    gd->cdr_num_sectors -= num_sectors;
+
+    return res;
+  }
+
+  /* less than a sector was requested, buffer the sector and consume it over
+     multiple reads */
+  gd->dma_size = gdrom_read_sectors(gd, gd->cdr_first_sector, 1,
+                                    gd->cdr_secfmt, gd->cdr_secmask,
+                                    gd->dma_buffer, sizeof(gd->dma_buffer));
+  gd->dma_head = 0;
+
+  gd->cdr_first_sector += 1;
+  gd->cdr_num_sectors -= 1;
+
+  return gdrom_dma_read(gd, data, n);
 }
 
 void gdrom_dma_begin(struct gdrom *gd) {
-  CHECK(gd->dma_size);
+  CHECK(gd->dma_head < gd->dma_size || gd->cdr_num_sectors);
 
   LOG_GDROM("gd_dma_begin");
 }
@@ -860,6 +907,11 @@ void gdrom_destroy(struct gdrom *gd) {
 struct gdrom *gdrom_create(struct dreamcast *dc) {
   struct gdrom *gd =
       dc_create_device(dc, sizeof(struct gdrom), "gdrom", &gdrom_init, NULL);
+
+  /* setup state interface */
+  gd->stateif.enabled = 1;
+  gd->stateif.serialize = &gdrom_serialize;
+
   return gd;
 }
 
@@ -5,6 +5,7 @@
 #include "guest/memory.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
+#include "guest/state.h"
 #include "imgui.h"
 
 #if 0
@@ -18,69 +19,137 @@ struct reg_cb holly_cb[NUM_HOLLY_REGS];
 /*
  * ch2 dma
  */
-static void holly_ch2_dma(struct holly *hl) {
+#define HOLLY_CH2_DMA_CHUNK_SIZE 0x8000
+
+static void holly_ch2_dma_timer(void *data) {
+  struct holly *hl = data;
   struct sh4 *sh4 = hl->dc->sh4;
+  struct scheduler *sched = hl->dc->sched;
+  struct holly_ch2_dma *dma = &hl->ch2_dma;
+
+  dma->timer = NULL;
 
   struct sh4_dtr dtr = {0};
   dtr.channel = 2;
   dtr.dir = SH4_DMA_TO_ADDR;
-  dtr.addr = *hl->SB_C2DSTAT;
-  sh4_dmac_ddt(sh4, &dtr);
+  dtr.addr = dma->dst;
+  dtr.size = HOLLY_CH2_DMA_CHUNK_SIZE;
+  int n = sh4_dmac_ddt(sh4, &dtr);
+
+  if (!n) {
+    *hl->SB_C2DLEN = 0;
+    *hl->SB_C2DST = 0;
+    holly_raise_interrupt(hl, HOLLY_INT_DTDE2INT);
+    return;
+  }
+
+  /* complete the transfer once the time the chunk takes has elapsed */
+  dma->dst += n;
+  dma->timer = sched_start_timer(sched, &holly_ch2_dma_timer, hl,
+                                 SH4_DMA_TRANSFER_TIME(n));
+}
+
+static void holly_ch2_dma(struct holly *hl) {
+  struct holly_ch2_dma *dma = &hl->ch2_dma;
+
+  if (dma->timer) {
+    return;
+  }
 
-  *hl->SB_C2DLEN = 0;
-  *hl->SB_C2DST = 0;
-  holly_raise_interrupt(hl, HOLLY_INT_DTDE2INT);
+  /* latch register state */
+  dma->dst = *hl->SB_C2DSTAT;
+
+  /* kick off async dma */
+  holly_ch2_dma_timer(hl);
 }
 
 /*
  * gdrom dma
  */
-static void holly_gdrom_dma(struct holly *hl) {
-  if (!*hl->SB_GDEN) {
-    *hl->SB_GDST = 0;
-    return;
-  }
+#define HOLLY_GDROM_DMA_CHUNK_SIZE 0x8000
 
+static void holly_gdrom_dma_timer(void *data) {
+  struct holly *hl = data;
   struct gdrom *gd = hl->dc->gdrom;
+  struct memory *mem = hl->dc->mem;
   struct sh4 *sh4 = hl->dc->sh4;
-
-  /* only gdrom -> sh4 supported for now */
-  CHECK_EQ(*hl->SB_GDDIR, 1);
-
-  int transfer_size = *hl->SB_GDLEN;
-  int remaining = transfer_size;
-  uint32_t addr = *hl->SB_GDSTAR;
+  struct scheduler *sched = hl->dc->sched;
+  struct holly_gdrom_dma *dma = &hl->gdrom_dma;
   uint8_t sector_data[DISC_MAX_SECTOR_SIZE];
+  int transferred = 0;
 
-  gdrom_dma_begin(gd);
+  dma->timer = NULL;
 
-  while (1) {
-    /* read a single sector at a time from the gdrom */
-    int n = MIN(remaining, (int)sizeof(sector_data));
-    n = gdrom_dma_read(gd, sector_data, n);
+  while (transferred < HOLLY_GDROM_DMA_CHUNK_SIZE) {
+    int n = MIN(dma->remaining, HOLLY_GDROM_DMA_CHUNK_SIZE - transferred);
+    int size;
+    uint8_t *ptr = sh4_translate(mem, dma->addr, &size);
+
+    if (ptr) {
+      /* when the destination is directly backed by memory, have the gdrom
+         decode the sectors straight into it. this is equivalent to a single
+         address mode transfer through the dmac, minus the copies */
+      n = gdrom_dma_read(gd, ptr, MIN(n, size));
+    } else {
+      /* otherwise, read a single sector at a time from the gdrom */
+      n = gdrom_dma_read(gd, sector_data, MIN(n, (int)sizeof(sector_data)));
+
+      if (n) {
+        struct sh4_dtr dtr = {0};
+        dtr.channel = 0;
+        dtr.dir = SH4_DMA_TO_ADDR;
+        dtr.data = sector_data;
+        dtr.addr = dma->addr;
+        dtr.size = n;
+        sh4_dmac_ddt(sh4, &dtr);
+      }
+    }
 
     if (!n) {
-      break;
+      gdrom_dma_end(gd);
+
+      *hl->SB_GDSTARD = dma->addr;
+      *hl->SB_GDLEND = dma->len;
+      *hl->SB_GDST = 0;
+      holly_raise_interrupt(hl, HOLLY_INT_G1DEINT);
+      return;
     }
 
-    struct sh4_dtr dtr = {0};
-    dtr.channel = 0;
-    dtr.dir = SH4_DMA_TO_ADDR;
-    dtr.data = sector_data;
-    dtr.addr = addr;
-    dtr.size = n;
-    sh4_dmac_ddt(sh4, &dtr);
+    dma->remaining -= n;
+    dma->addr += n;
+    transferred += n;
+  }
+
+  /* g1 bus runs at 16-bits x 25mhz, loosely simulate this */
+  int64_t end = CYCLES_TO_NANO(transferred / 2, UINT64_C(25000000));
+  dma->timer = sched_start_timer(sched, &holly_gdrom_dma_timer, hl, end);
+}
+
+static void holly_gdrom_dma(struct holly *hl) {
+  if (!*hl->SB_GDEN) {
+    *hl->SB_GDST = 0;
+    return;
+  }
+
+  struct gdrom *gd = hl->dc->gdrom;
+  struct holly_gdrom_dma *dma = &hl->gdrom_dma;
 
-    remaining -= n;
-    addr += n;
+  if (dma->timer) {
+    return;
   }
 
-  gdrom_dma_end(gd);
+  /* only gdrom -> sh4 supported for now */
+  CHECK_EQ(*hl->SB_GDDIR, 1);
+
+  /* latch register state */
+  dma->addr = *hl->SB_GDSTAR;
+  dma->len = *hl->SB_GDLEN;
+  dma->remaining = dma->len;
+
+  gdrom_dma_begin(gd);
 
-  *hl->SB_GDSTARD = addr;
-  *hl->SB_GDLEND = transfer_size;
-  *hl->SB_GDST = 0;
-  holly_raise_interrupt(hl, HOLLY_INT_G1DEINT);
+  /* kick off async dma */
+  holly_gdrom_dma_timer(hl);
 }
 
 /*
@@ -97,31 +166,42 @@ static void holly_maple_dma(struct holly *hl) {
   uint32_t addr = *hl->SB_MDSTAR;
 
   while (1) {
+    /* read the transfer descriptor along with the result address following
+       it in a single access */
+    uint32_t header[2];
+    sh4_memcpy_to_host(mem, header, addr, sizeof(header));
+
     union maple_transfer desc;
-    desc.full = sh4_read32(mem, addr);
+    desc.full = header[0];
     addr += 4;
 
     switch (desc.pattern) {
       case MAPLE_PATTERN_NORMAL: {
-        uint32_t result_addr = sh4_read32(mem, addr);
+        uint32_t result_addr = header[1];
         addr += 4;
 
-        /* read frame */
+        /* process the frame in place when it's directly backed by memory,
+           else copy it out in bulk */
         union maple_frame frame, res;
+        const union maple_frame *req = &frame;
+        int frame_size = (desc.length + 1) * 4;
+        int size;
+        uint8_t *ptr = sh4_translate(mem, addr, &size);
 
-        for (int i = 0; i < (int)desc.length + 1; i++) {
-          frame.data[i] = sh4_read32(mem, addr);
-          addr += 4;
+        if (ptr && size >= frame_size) {
+          req = (const union maple_frame *)ptr;
+        } else {
+          sh4_memcpy_to_host(mem, frame.data, addr, frame_size);
         }
 
+        addr += frame_size;
+
         /* process frame and write response */
-        int handled = maple_handle_frame(mp, desc.port, &frame, &res);
+        int handled = maple_handle_frame(mp, desc.port, req, &res);
 
         if (handled) {
-          for (int i = 0; i < (int)res.num_words + 1; i++) {
-            sh4_write32(mem, result_addr, res.data[i]);
-            result_addr += 4;
-          }
+          sh4_memcpy_to_guest(mem, result_addr, res.data,
+                              (res.num_words + 1) * 4);
         } else {
           sh4_write32(mem, result_addr, 0xffffffff);
         }
@@ -167,6 +247,7 @@ static void (*g2_timers[4])(void *);
     struct scheduler *sched = hl->dc->sched;                          \
     struct holly_g2_dma *dma = &hl->dma[ch];                          \
     int chunk_size = 0x1000;                                          \
+    dma->timer = NULL;                                                \
     int n = MIN(dma->len, chunk_size);                                \
     sh4_memcpy(mem, dma->dst, dma->src, n);                           \
     dma->dst += n;                                                    \
@@ -180,7 +261,7 @@ static void (*g2_timers[4])(void *);
     }                                                                 \
     /* g2 bus runs at 16-bits x 25mhz, loosely simulate this */       \
     int64_t end = CYCLES_TO_NANO(chunk_size / 2, UINT64_C(25000000)); \
-    sched_start_timer(sched, g2_timers[ch], hl, end);                 \
+    dma->timer = sched_start_timer(sched, g2_timers[ch], hl, end);    \
   }
 
 DEFINE_G2_DMA_TIMER(0);
@@ -277,6 +358,30 @@ static uint32_t *holly_interrupt_status(struct holly *hl,
   }
 }
 
+static void holly_serialize(struct device *dev, struct state *s) {
+  struct holly *hl = (struct holly *)dev;
+  struct scheduler *sched = hl->dc->sched;
+
+  STATE_FIELD(s, hl->reg);
+
+  for (int i = 0; i < HOLLY_G2_NUM_CHAN; i++) {
+    struct holly_g2_dma *dma = &hl->dma[i];
+    STATE_FIELD(s, dma->dst);
+    STATE_FIELD(s, dma->src);
+    STATE_FIELD(s, dma->restart);
+    STATE_FIELD(s, dma->len);
+    state_timer(s, sched, &dma->timer, g2_timers[i], hl);
+  }
+
+  STATE_FIELD(s, hl->ch2_dma.dst);
+  state_timer(s, sched, &hl->ch2_dma.timer, &holly_ch2_dma_timer, hl);
+
+  STATE_FIELD(s, hl->gdrom_dma.addr);
+  STATE_FIELD(s, hl->gdrom_dma.len);
+  STATE_FIELD(s, hl->gdrom_dma.remaining);
+  state_timer(s, sched, &hl->gdrom_dma.timer, &holly_gdrom_dma_timer, hl);
+}
+
 static int holly_init(struct device *dev) {
   struct holly *hl = (struct holly *)dev;
   return 1;
@@ -395,6 +500,10 @@ struct holly *holly_create(struct dreamcast *dc) {
 #include "guest/holly/holly_regs.inc"
 #undef HOLLY_REG
 
+  /* setup state interface */
+  hl->stateif.enabled = 1;
+  hl->stateif.serialize = &holly_serialize;
+
   return hl;
 }
 
@@ -7,6 +7,7 @@
 struct gdrom;
 struct maple;
 struct sh4;
+struct timer;
 
 #define HOLLY_G2_NUM_CHAN 4
 #define HOLLY_G2_NUM_REGS 8
@@ -16,6 +17,19 @@ struct holly_g2_dma {
   uint32_t src;
   int restart;
   int len;
+  struct timer *timer;
+};
+
+struct holly_ch2_dma {
+  uint32_t dst;
+  struct timer *timer;
+};
+
+struct holly_gdrom_dma {
+  uint32_t addr;
+  int len;
+  int remaining;
+  struct timer *timer;
 };
 
 struct holly {
@@ -27,6 +41,8 @@ struct holly {
 #undef HOLLY_REG
 
   struct holly_g2_dma dma[HOLLY_G2_NUM_CHAN];
+  struct holly_ch2_dma ch2_dma;
+  struct holly_gdrom_dma gdrom_dma;
 
   /* debug */
   int log_regs;
@@ -3,11 +3,66 @@
 #include "guest/holly/holly.h"
 #include "guest/sh4/sh4.h"
 
+/* max number of words in a request whose response may be cached */
+#define MAPLE_CACHE_MAX_WORDS 4
+
+/* responses to requests without side effects are cached for each port, and
+   reused until either the request or the state of the port's devices change.
+   this avoids rebuilding the same condition response for each port every
+   frame while the controller is idle.
+
+   input is delivered from the host's thread, possibly while a response is
+   being built from the previous state. rather than clearing the cache, input
+   bumps the port's generation, and entries are only valid for the generation
+   that was current before their response was built */
+struct maple_cache {
+  int valid;
+  unsigned gen;
+  int num_words;
+  uint32_t req[MAPLE_CACHE_MAX_WORDS];
+  union maple_frame res;
+};
+
 struct maple {
   struct device;
   struct maple_device *devs[MAPLE_NUM_PORTS][MAPLE_MAX_UNITS];
+  struct maple_cache cache[MAPLE_NUM_PORTS];
+  volatile unsigned input_gen[MAPLE_NUM_PORTS];
 };
 
+static int maple_cacheable(const union maple_frame *req) {
+  if (req->num_words + 1 > MAPLE_CACHE_MAX_WORDS) {
+    return 0;
+  }
+
+  return req->cmd == MAPLE_REQ_DEVINFO || req->cmd == MAPLE_REQ_GETCOND;
+}
+
+static int maple_cache_lookup(struct maple_cache *cache, unsigned gen,
+                              const union maple_frame *req,
+                              union maple_frame *res) {
+  int num_words = req->num_words + 1;
+
+  if (!cache->valid || cache->gen != gen || cache->num_words != num_words ||
+      memcmp(cache->req, req->data, num_words * 4)) {
+    return 0;
+  }
+
+  memcpy(res->data, cache->res.data, (cache->res.num_words + 1) * 4);
+
+  return 1;
+}
+
+static void maple_cache_insert(struct maple_cache *cache, unsigned gen,
+                               const union maple_frame *req,
+                               const union maple_frame *res) {
+  cache->valid = 1;
+  cache->gen = gen;
+  cache->num_words = req->num_words + 1;
+  memcpy(cache->req, req->data, cache->num_words * 4);
+  memcpy(cache->res.data, res->data, (res->num_words + 1) * 4);
+}
+
 static void maple_unregister_dev(struct maple *mp, int port, int unit) {
   struct maple_device **dev = &mp->devs[port][unit];
 
@@ -37,16 +92,31 @@ static void maple_register_dev(struct maple *mp, const char *device_type,
   }
 }
 
-int maple_handle_frame(struct maple *mp, int port, union maple_frame *req,
-                       union maple_frame *res) {
+int maple_handle_frame(struct maple *mp, int port,
+                       const union maple_frame *req, union maple_frame *res) {
   CHECK(port >= 0 && port < MAPLE_NUM_PORTS);
 
   struct maple_device *dev = mp->devs[port][MAPLE_MAX_UNITS - 1];
+  struct maple_cache *cache = &mp->cache[port];
 
   if (!dev) {
     return 0;
   }
 
+  /* sample the generation before the device reads its input state, so a
+     response built from stale input is never considered valid */
+  unsigned gen = mp->input_gen[port];
+  int cacheable = maple_cacheable(req);
+
+  if (cacheable) {
+    if (maple_cache_lookup(cache, gen, req, res)) {
+      return 1;
+    }
+  } else {
+    /* the request may change the device's state */
+    cache->valid = 0;
+  }
+
   /* initialize response */
   memset(res, 0, sizeof(*res));
   res->dst_addr = req->src_addr;
@@ -62,6 +132,10 @@ int maple_handle_frame(struct maple *mp, int port, union maple_frame *req,
     LOG_WARNING("maple_handle_frame port=%d error=0x%x", port, res->cmd);
   }
 
+  if (cacheable) {
+    maple_cache_insert(cache, gen, req, res);
+  }
+
   return 1;
 }
 
@@ -74,6 +148,10 @@ void maple_handle_input(struct maple *mp, int port, int button, int16_t value) {
   if (dev && dev->input) {
     dev->input(dev, button, value);
   }
+
+  /* cached responses may reflect the previous input state. the cache itself
+     is owned by the emulation thread, so only the generation is touched */
+  mp->input_gen[port]++;
 }
 
 struct maple_device *maple_get_device(struct maple *mp, int port, int unit) {
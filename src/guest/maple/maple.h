@@ -23,8 +23,8 @@ void maple_destroy(struct maple *mp);
 
 struct maple_device *maple_get_device(struct maple *mp, int port, int unit);
 void maple_handle_input(struct maple *mp, int port, int button, int16_t value);
-int maple_handle_frame(struct maple *mp, int port, union maple_frame *frame,
-                       union maple_frame *res);
+int maple_handle_frame(struct maple *mp, int port,
+                       const union maple_frame *frame, union maple_frame *res);
 
 struct maple_device *controller_create(struct maple *mp, int port);
 struct maple_device *vmu_create(struct maple *mp, int port);
@@ -6,7 +6,12 @@
  * the arm7 and sh4 address spaces
  *
  * the code generates a page table for each address space, where each page
- * is backed by a read and write callback that can handle each access
+ * is backed by a read and write callback that can handle each access. the
+ * table has two levels, the first dividing the address space into 2mb pages.
+ * most regions are mapped at this granularity, however, when a region smaller
+ * than a page is mapped, the page is split into 4kb subpages using a second
+ * level table. this enables small mmio regions to coexist with directly mapped
+ * memory, without forcing the rest of the page through the slow path
  *
  * if HAVE_FASTMEM is defined, the code will use mmap to create 32-bit address
  * spaces on the host machine that directly map to both the sh4 and arm7
@@ -25,9 +30,11 @@
 #include <stdint.h>
 #include "guest/memory.h"
 #include "core/core.h"
+#include "core/exception_handler.h"
 #include "guest/arm7/arm7.h"
 #include "guest/dreamcast.h"
 #include "guest/sh4/sh4.h"
+#include "guest/state.h"
 
 /* physical memory constants */
 #define RAM_SIZE 16 * 1024 * 1024
@@ -43,39 +50,94 @@
 #define MEM_OFFSET_BITS 21
 #define MEM_MAX_PAGES (1 << MEM_PAGE_BITS)
 #define MEM_PAGE_SHIFT MEM_OFFSET_BITS
+#define MEM_PAGE_SIZE (1 << MEM_PAGE_SHIFT)
 #define MEM_OFFSET_MASK ((1 << MEM_OFFSET_BITS) - 1)
 
+#define MEM_SUBPAGE_BITS 9
+#define MEM_SUBPAGE_OFFSET_BITS 12
+#define MEM_MAX_SUBPAGES (1 << MEM_SUBPAGE_BITS)
+#define MEM_SUBPAGE_SHIFT MEM_SUBPAGE_OFFSET_BITS
+#define MEM_SUBPAGE_SIZE (1 << MEM_SUBPAGE_SHIFT)
+#define MEM_SUBPAGE_MASK (MEM_MAX_SUBPAGES - 1)
+#define MEM_SUBPAGE_OFFSET_MASK ((1 << MEM_SUBPAGE_OFFSET_BITS) - 1)
+
+/* each host mapping of physical memory that is write tracked */
+#define MEM_MAX_MIRRORS 64
+
+/* each page is either directly backed by memory, or by mmio callbacks */
+struct page_entry {
+  uint8_t *ptr;
+  mmio_read_cb read;
+  mmio_write_cb write;
+  mmio_read_string_cb read_string;
+  mmio_write_string_cb write_string;
+
+  /* second level table, only allocated for pages split into subpages */
+  struct page_entry *subpages;
+};
+
 /* address spaces provide different views of the same physical memory */
 struct address_space {
   uint8_t *base;
 
   /* page table */
-  uint8_t *ptrs[MEM_MAX_PAGES];
-  mmio_read_cb read[MEM_MAX_PAGES];
-  mmio_write_cb write[MEM_MAX_PAGES];
-  mmio_read_string_cb read_string[MEM_MAX_PAGES];
-  mmio_write_string_cb write_string[MEM_MAX_PAGES];
+  struct page_entry pages[MEM_MAX_PAGES];
+};
+
+/* host mapping of a physical memory region */
+struct mirror {
+  struct memory *mem;
+  uint8_t *ptr;
+  int offset;
+  int size;
+  struct memory_watch *watch;
 };
 
 struct memory {
   struct dreamcast *dc;
 
-#ifdef HAVE_FASTMEM
-  /* shared memory object that backs the ram / vram / aram when using
-     fastmem */
+  /* shared memory object that backs the ram / vram / aram */
   shmem_handle_t shmem;
-#endif
+
+  /* physical memory is written through each of its mirrors, so when tracking
+     dirty pages, each mirror is watched and writes are resolved back to the
+     physical page they modify */
+  struct mirror mirrors[MEM_MAX_MIRRORS];
+  int num_mirrors;
+  int tracking;
+  int page_size;
+  uint8_t *dirty;
+  int *dirty_pages;
+  int num_dirty;
 
   /* the machine's physical memory */
   uint8_t *ram;
   uint8_t *vram;
   uint8_t *aram;
 
+  /* second mapping of vram for writes made through the pvr and ta, which mark
+     the blocks they write themselves. page protections placed on vram, e.g.
+     by texture watches, don't cover this mapping, leaving them armed for
+     the writes which aren't marked */
+  uint8_t *tracked_vram;
+
   /* each cpu has a different address space */
   struct address_space arm7;
   struct address_space sh4;
 };
 
+#ifdef HAVE_FASTMEM
+static void mem_add_mirror(struct memory *mem, uint8_t *ptr, int offset,
+                           int size) {
+  CHECK_LT(mem->num_mirrors, MEM_MAX_MIRRORS);
+  struct mirror *mirror = &mem->mirrors[mem->num_mirrors++];
+  mirror->mem = mem;
+  mirror->ptr = ptr;
+  mirror->offset = offset;
+  mirror->size = size;
+}
+#endif
+
 static int reserve_address_space(uint8_t **base) {
   /* find a contiguous 32-bit range of memory to map an address space to */
   const uint64_t ADDRESS_SPACE_SIZE = UINT64_C(1) << 32;
@@ -102,6 +164,23 @@ static int reserve_address_space(uint8_t **base) {
   return 0;
 }
 
+/* resolves the entry for an address, descending into the second level table
+   if the page has been split. offset is set to the address's offset into the
+   entry */
+static inline const struct page_entry *as_lookup_entry(
+    const struct address_space *space, uint32_t addr, uint32_t *offset) {
+  const struct page_entry *entry = &space->pages[addr >> MEM_PAGE_SHIFT];
+
+  if (entry->subpages) {
+    entry = &entry->subpages[(addr >> MEM_SUBPAGE_SHIFT) & MEM_SUBPAGE_MASK];
+    *offset = addr & MEM_SUBPAGE_OFFSET_MASK;
+  } else {
+    *offset = addr & MEM_OFFSET_MASK;
+  }
+
+  return entry;
+}
+
 static uint32_t mem_unhandled_read(struct memory *mem, uint32_t addr,
                                    uint32_t data_mask) {
   LOG_WARNING("mem_unhandled_read addr=0x%08x", addr);
@@ -126,6 +205,7 @@ enum {
 #define DEFINE_ADDRESS_SPACE(space)             \
   define_lookup_ex(space);                      \
   define_lookup(space);                         \
+  define_translate(space);                      \
   define_memcpy(space);                         \
   define_memcpy_to_host(space);                 \
   define_memcpy_to_guest(space);                \
@@ -142,24 +222,26 @@ enum {
       struct memory *mem, uint32_t addr, void **userdata, uint8_t **ptr,      \
       mmio_read_cb *read, mmio_write_cb *write,                               \
       mmio_read_string_cb *read_string, mmio_write_string_cb *write_string) { \
-    int page = addr >> MEM_PAGE_SHIFT;                                        \
+    uint32_t offset;                                                          \
+    const struct page_entry *entry = as_lookup_entry(&mem->space, addr,       \
+                                                     &offset);                \
     if (userdata) {                                                           \
       *userdata = mem->dc->space;                                             \
     }                                                                         \
-    if (ptr && (*ptr = mem->space.ptrs[page])) {                              \
-      *ptr += (addr & MEM_OFFSET_MASK);                                       \
+    if (ptr && (*ptr = entry->ptr)) {                                         \
+      *ptr += offset;                                                         \
     }                                                                         \
     if (read) {                                                               \
-      *read = mem->space.read[page];                                          \
+      *read = entry->read;                                                    \
     }                                                                         \
     if (write) {                                                              \
-      *write = mem->space.write[page];                                        \
+      *write = entry->write;                                                  \
     }                                                                         \
     if (read_string) {                                                        \
-      *read_string = mem->space.read_string[page];                            \
+      *read_string = entry->read_string;                                      \
     }                                                                         \
     if (write_string) {                                                       \
-      *write_string = mem->space.write_string[page];                          \
+      *write_string = entry->write_string;                                    \
     }                                                                         \
   }
 
@@ -170,6 +252,22 @@ enum {
     space##_lookup_ex(mem, addr, userdata, ptr, read, write, NULL, NULL); \
   }
 
+/* resolves addr to a host pointer when it's directly backed by memory, along
+   with the number of bytes contiguously backed from it */
+#define define_translate(space)                                                \
+  uint8_t *space##_translate(struct memory *mem, uint32_t addr, int *size) {   \
+    const struct page_entry *page = &mem->space.pages[addr >> MEM_PAGE_SHIFT]; \
+    int entry_size = page->subpages ? MEM_SUBPAGE_SIZE : MEM_PAGE_SIZE;        \
+    uint32_t offset;                                                           \
+    const struct page_entry *entry = as_lookup_entry(&mem->space, addr,        \
+                                                     &offset);                 \
+    if (!entry->ptr) {                                                         \
+      return NULL;                                                             \
+    }                                                                          \
+    *size = entry_size - (int)offset;                                          \
+    return entry->ptr + offset;                                                \
+  }
+
 #define define_memcpy(space)                                                   \
   void space##_memcpy(struct memory *mem, uint32_t dst, uint32_t src,          \
                       int size) {                                              \
@@ -265,28 +363,37 @@ enum {
 #define define_write_bytes(space, name, data_type)                           \
   void space##_##name(struct memory *mem, uint32_t addr, data_type data) {   \
     int page = addr >> MEM_PAGE_SHIFT;                                       \
-    uint8_t *ptr = mem->space.ptrs[page];                                    \
+    uint8_t *ptr = mem->space.pages[page].ptr;                               \
     if (ptr) {                                                               \
-      addr &= MEM_OFFSET_MASK;                                               \
-      *(data_type *)(ptr + addr) = data;                                     \
+      *(data_type *)(ptr + (addr & MEM_OFFSET_MASK)) = data;                 \
+      return;                                                                \
+    }                                                                        \
+    uint32_t offset;                                                         \
+    const struct page_entry *entry =                                         \
+        as_lookup_entry(&mem->space, addr, &offset);                         \
+    if (entry->ptr) {                                                        \
+      *(data_type *)(entry->ptr + offset) = data;                            \
       return;                                                                \
     }                                                                        \
     const uint32_t data_mask = (UINT64_C(1) << (sizeof(data_type) * 8)) - 1; \
-    mmio_write_cb write = mem->space.write[page];                            \
-    write(mem->dc->space, addr, data, data_mask);                            \
+    entry->write(mem->dc->space, addr, data, data_mask);                     \
   }
 
 #define define_read_bytes(space, name, data_type)                            \
   data_type space##_##name(struct memory *mem, uint32_t addr) {              \
     int page = addr >> MEM_PAGE_SHIFT;                                       \
-    uint8_t *ptr = mem->space.ptrs[page];                                    \
+    uint8_t *ptr = mem->space.pages[page].ptr;                               \
     if (ptr) {                                                               \
-      addr &= MEM_OFFSET_MASK;                                               \
-      return *(data_type *)(ptr + addr);                                     \
+      return *(data_type *)(ptr + (addr & MEM_OFFSET_MASK));                 \
+    }                                                                        \
+    uint32_t offset;                                                         \
+    const struct page_entry *entry =                                         \
+        as_lookup_entry(&mem->space, addr, &offset);                         \
+    if (entry->ptr) {                                                        \
+      return *(data_type *)(entry->ptr + offset);                            \
     }                                                                        \
     const uint32_t data_mask = (UINT64_C(1) << (sizeof(data_type) * 8)) - 1; \
-    mmio_read_cb read = mem->space.read[page];                               \
-    return read(mem->dc->space, addr, data_mask);                            \
+    return entry->read(mem->dc->space, addr, data_mask);                     \
   }
 
 #define define_base(space)                    \
@@ -294,13 +401,31 @@ enum {
     return mem->space.base;                   \
   }
 
+static void as_split_page(struct page_entry *entry) {
+  if (entry->subpages) {
+    return;
+  }
+
+  /* each subpage inherits the page's current mapping */
+  entry->subpages = calloc(MEM_MAX_SUBPAGES, sizeof(struct page_entry));
+
+  for (int i = 0; i < MEM_MAX_SUBPAGES; i++) {
+    struct page_entry *subpage = &entry->subpages[i];
+    subpage->ptr = entry->ptr ? entry->ptr + i * MEM_SUBPAGE_SIZE : NULL;
+    subpage->read = entry->read;
+    subpage->write = entry->write;
+    subpage->read_string = entry->read_string;
+    subpage->write_string = entry->write_string;
+  }
+
+  /* force lookups through the second level */
+  entry->ptr = NULL;
+}
+
 static void as_map(struct memory *mem, struct address_space *space,
                    uint32_t begin, uint32_t size, int type, mmio_read_cb read,
                    mmio_write_cb write, mmio_read_string_cb read_string,
                    mmio_write_string_cb write_string) {
-  uint32_t end = begin - 1 + size;
-  uint32_t page_size = 1 << MEM_PAGE_SHIFT;
-
   int offset = -1;
   uint8_t *ptr = NULL;
 
@@ -319,38 +444,61 @@ static void as_map(struct memory *mem, struct address_space *space,
       break;
   }
 
-  /* add entries to page table */
-  CHECK(size % page_size == 0);
+  /* add entries to page table. whole pages are mapped in the first level of
+     the table, while partial pages are split and mapped in the second */
+  CHECK(begin % MEM_SUBPAGE_SIZE == 0 && size % MEM_SUBPAGE_SIZE == 0);
+
+  uint32_t map_offset = 0;
+
+  while (map_offset < size) {
+    uint32_t addr = begin + map_offset;
+    struct page_entry *entry = &space->pages[addr >> MEM_PAGE_SHIFT];
+    uint32_t entry_size = MEM_PAGE_SIZE;
 
-  for (uint32_t page_offset = 0; page_offset < size; page_offset += page_size) {
-    uint32_t addr = begin + page_offset;
-    int page = addr >> MEM_PAGE_SHIFT;
+    if ((addr & MEM_OFFSET_MASK) || (size - map_offset) < MEM_PAGE_SIZE) {
+      as_split_page(entry);
+      entry = &entry->subpages[(addr >> MEM_SUBPAGE_SHIFT) & MEM_SUBPAGE_MASK];
+      entry_size = MEM_SUBPAGE_SIZE;
+    } else {
+      free(entry->subpages);
+      entry->subpages = NULL;
+    }
 
     if (ptr) {
-      space->ptrs[page] = ptr + page_offset;
-      space->read[page] = NULL;
-      space->write[page] = NULL;
-      space->read_string[page] = NULL;
-      space->write_string[page] = NULL;
+      entry->ptr = ptr + map_offset;
+      entry->read = NULL;
+      entry->write = NULL;
+      entry->read_string = NULL;
+      entry->write_string = NULL;
     } else {
-      space->ptrs[page] = NULL;
-      space->read[page] = read;
-      space->write[page] = write;
-      space->read_string[page] = read_string;
-      space->write_string[page] = write_string;
+      entry->ptr = NULL;
+      entry->read = read;
+      entry->write = write;
+      entry->read_string = read_string;
+      entry->write_string = write_string;
     }
+
+    map_offset += entry_size;
   }
 
 #ifdef HAVE_FASTMEM
   uint8_t *target = space->base + begin;
+  size_t host_page_size = get_page_size();
+  int host_aligned = begin % host_page_size == 0 && size % host_page_size == 0;
   void *res = NULL;
 
   if (offset >= 0) {
     /* map physical memory into the address space */
+    CHECK(host_aligned);
     res = map_shared_memory(mem->shmem, offset, target, size, ACC_READWRITE);
-  } else {
+
+    mem_add_mirror(mem, target, offset, size);
+  } else if (host_aligned) {
     /* disable access to mmio areas */
     res = map_shared_memory(mem->shmem, 0x0, target, size, ACC_NONE);
+  } else {
+    /* subpage mmio windows smaller than the host's pages are only mapped over
+       other mmio areas, whose access is already disabled */
   }
 
   CHECK_NE(res, SHMEM_MAP_FAILED);
@@ -359,11 +507,20 @@ static void as_map(struct memory *mem, struct address_space *space,
 #endif
 }
 
+static void as_destroy(struct address_space *space) {
+  for (int i = 0; i < MEM_MAX_PAGES; i++) {
+    struct page_entry *entry = &space->pages[i];
+    free(entry->subpages);
+    entry->subpages = NULL;
+  }
+}
+
 static int as_init(struct address_space *space) {
   /* bind default handler */
   for (int i = 0; i < MEM_MAX_PAGES; i++) {
-    space->read[i] = (mmio_read_cb)&mem_unhandled_read;
-    space->write[i] = (mmio_write_cb)&mem_unhandled_write;
+    struct page_entry *entry = &space->pages[i];
+    entry->read = (mmio_read_cb)&mem_unhandled_read;
+    entry->write = (mmio_write_cb)&mem_unhandled_write;
   }
 
 #ifdef HAVE_FASTMEM
@@ -475,6 +632,20 @@ int sh4_init(struct memory *mem) {
           (mmio_read_cb)&sh4_area0_read, (mmio_write_cb)&sh4_area0_write, NULL,
           NULL);
 
+  /* the register windows in area 0 are accessed constantly. rather than going
+     through the area 0 handler, they're mapped directly to their device at the
+     subpage granularity, splitting the pages they share with the rest of the
+     area. the area's 0x02000000 mirror is still handled by sh4_area0_read */
+  sh4_map(mem, SH4_HOLLY_REG_BEGIN, SH4_HOLLY_REG_END, P0 | P1 | P2 | P3,
+          MAP_MMIO, (mmio_read_cb)&sh4_holly_reg_read,
+          (mmio_write_cb)&sh4_holly_reg_write, NULL, NULL);
+  sh4_map(mem, SH4_PVR_REG_BEGIN, SH4_PVR_REG_END, P0 | P1 | P2 | P3, MAP_MMIO,
+          (mmio_read_cb)&sh4_pvr_reg_read, (mmio_write_cb)&sh4_pvr_reg_write,
+          NULL, NULL);
+  sh4_map(mem, SH4_AICA_REG_BEGIN, SH4_AICA_REG_END, P0 | P1 | P2 | P3,
+          MAP_MMIO, (mmio_read_cb)&sh4_aica_reg_read,
+          (mmio_write_cb)&sh4_aica_reg_write, NULL, NULL);
+
   /* area 1 */
   sh4_map(mem, SH4_AREA1_BEGIN, SH4_AREA1_END, P0 | P1 | P2 | P3 | P4, MAP_MMIO,
           (mmio_read_cb)&sh4_area1_read, (mmio_write_cb)&sh4_area1_write, NULL,
@@ -536,6 +707,10 @@ uint8_t *mem_vram(struct memory *mem, uint32_t offset) {
   return mem->vram + offset;
 }
 
+uint8_t *mem_tracked_vram(struct memory *mem, uint32_t offset) {
+  return mem->tracked_vram + offset;
+}
+
 uint8_t *mem_aram(struct memory *mem, uint32_t offset) {
   return mem->aram + offset;
 }
@@ -544,8 +719,117 @@ uint8_t *mem_ram(struct memory *mem, uint32_t offset) {
   return mem->ram + offset;
 }
 
-int mem_init(struct memory *mem) {
 #ifdef HAVE_FASTMEM
+static void mem_track_write(const struct exception_state *ex, void *data) {
+  struct mirror *mirror = data;
+  struct memory *mem = mirror->mem;
+
+  uint8_t *ptr = (uint8_t *)ex->fault_addr;
+  int page = (mirror->offset + (int)(ptr - mirror->ptr)) / mem->page_size;
+
+  if (mem->dirty[page]) {
+    return;
+  }
+
+  mem->dirty[page] = 1;
+  mem->dirty_pages[mem->num_dirty++] = page;
+}
+#endif
+
+int mem_num_pages(struct memory *mem) {
+  return PHYSICAL_SIZE / mem->page_size;
+}
+
+int mem_page_size(struct memory *mem) {
+  return mem->page_size;
+}
+
+uint8_t *mem_page(struct memory *mem, int page) {
+  int offset = page * mem->page_size;
+
+  if (offset >= ARAM_OFFSET) {
+    return mem->aram + (offset - ARAM_OFFSET);
+  } else if (offset >= VRAM_OFFSET) {
+    return mem->vram + (offset - VRAM_OFFSET);
+  }
+
+  return mem->ram + (offset - RAM_OFFSET);
+}
+
+int mem_dirty_pages(struct memory *mem, const int **pages) {
+  *pages = mem->dirty_pages;
+  return mem->num_dirty;
+}
+
+void mem_reset_tracking(struct memory *mem) {
+  if (!mem->tracking) {
+    return;
+  }
+
+  for (int i = 0; i < mem->num_dirty; i++) {
+    mem->dirty[mem->dirty_pages[i]] = 0;
+  }
+  mem->num_dirty = 0;
+
+  for (int i = 0; i < mem->num_mirrors; i++) {
+    reset_page_write_watch(mem->mirrors[i].watch);
+  }
+}
+
+void mem_stop_tracking(struct memory *mem) {
+  if (!mem->tracking) {
+    return;
+  }
+
+  for (int i = 0; i < mem->num_mirrors; i++) {
+    struct mirror *mirror = &mem->mirrors[i];
+    remove_memory_watch(mirror->watch);
+    mirror->watch = NULL;
+  }
+
+  free(mem->dirty);
+  free(mem->dirty_pages);
+  mem->dirty = NULL;
+  mem->dirty_pages = NULL;
+  mem->num_dirty = 0;
+  mem->tracking = 0;
+}
+
+int mem_start_tracking(struct memory *mem) {
+#ifdef HAVE_FASTMEM
+  if (mem->tracking) {
+    return 1;
+  }
+
+  int num_pages = mem_num_pages(mem);
+  mem->dirty = calloc(num_pages, sizeof(uint8_t));
+  mem->dirty_pages = calloc(num_pages, sizeof(int));
+  mem->num_dirty = 0;
+
+  for (int i = 0; i < mem->num_mirrors; i++) {
+    struct mirror *mirror = &mem->mirrors[i];
+    mirror->watch = add_page_write_watch(mirror->ptr, mirror->size,
+                                         &mem_track_write, mirror);
+  }
+
+  mem->tracking = 1;
+
+  return 1;
+#else
+  /* without fastmem, physical memory is written directly through its one
+     mapping by the interpreters, but also by the jit's inlined accesses which
+     have no means of being trapped */
+  return 0;
+#endif
+}
+
+void mem_serialize(struct memory *mem, struct state *s) {
+  state_bytes(s, mem->ram, RAM_SIZE);
+  state_bytes(s, mem->vram, VRAM_SIZE);
+  state_bytes(s, mem->aram, ARAM_SIZE);
+}
+
+int mem_init(struct memory *mem) {
   /* create the shared memory object to back the physical memory. note, because
      mmio regions also map this shared memory object when disabling permissions,
      the object has to at least be the size of an entire mmio region */
@@ -568,10 +852,16 @@ int mem_init(struct memory *mem) {
   mem->aram = map_shared_memory(mem->shmem, ARAM_OFFSET, NULL, ARAM_SIZE,
                                 ACC_READWRITE);
   CHECK_NE(mem->aram, SHMEM_MAP_FAILED);
-#else
-  mem->ram = calloc(RAM_SIZE, 1);
-  mem->vram = calloc(VRAM_SIZE, 1);
-  mem->aram = calloc(ARAM_SIZE, 1);
+
+  mem->tracked_vram = map_shared_memory(mem->shmem, VRAM_OFFSET, NULL,
+                                        VRAM_SIZE, ACC_READWRITE);
+  CHECK_NE(mem->tracked_vram, SHMEM_MAP_FAILED);
+
+#ifdef HAVE_FASTMEM
+  mem_add_mirror(mem, mem->ram, RAM_OFFSET, RAM_SIZE);
+  mem_add_mirror(mem, mem->vram, VRAM_OFFSET, VRAM_SIZE);
+  mem_add_mirror(mem, mem->aram, ARAM_OFFSET, ARAM_SIZE);
+  mem_add_mirror(mem, mem->tracked_vram, VRAM_OFFSET, VRAM_SIZE);
 #endif
 
   if (!sh4_init(mem)) {
@@ -586,13 +876,18 @@ int mem_init(struct memory *mem) {
 }
 
 void mem_destroy(struct memory *mem) {
-#ifdef HAVE_FASTMEM
-  destroy_shared_memory(mem->shmem);
-#else
-  free(mem->ram);
-  free(mem->vram);
-  free(mem->aram);
-#endif
+  mem_stop_tracking(mem);
+
+  as_destroy(&mem->arm7);
+  as_destroy(&mem->sh4);
+
+  if (mem->shmem != SHMEM_INVALID) {
+    unmap_shared_memory(mem->shmem, mem->ram, RAM_SIZE);
+    unmap_shared_memory(mem->shmem, mem->vram, VRAM_SIZE);
+    unmap_shared_memory(mem->shmem, mem->aram, ARAM_SIZE);
+    unmap_shared_memory(mem->shmem, mem->tracked_vram, VRAM_SIZE);
+    destroy_shared_memory(mem->shmem);
+  }
 
   free(mem);
 }
@@ -601,10 +896,9 @@ struct memory *mem_create(struct dreamcast *dc) {
   struct memory *mem = calloc(1, sizeof(struct memory));
 
   mem->dc = dc;
+  mem->page_size = (int)get_page_size();
 
-#ifdef HAVE_FASTMEM
   mem->shmem = SHMEM_INVALID;
-#endif
 
   return mem;
 }
@@ -6,6 +6,7 @@
 
 struct dreamcast;
 struct memory;
+struct state;
 
 /*
  * mmio callbacks and helpers
@@ -36,7 +37,8 @@ typedef void (*mmio_write_string_cb)(void *, uint32_t, const uint8_t *, int);
                       int size);                                           \
   void space##_lookup(struct memory *mem, uint32_t addr, void **userdata,  \
                       uint8_t **ptr, mmio_read_cb *read,                   \
-                      mmio_write_cb *write);
+                      mmio_write_cb *write);                               \
+  uint8_t *space##_translate(struct memory *mem, uint32_t addr, int *size);
 
 DECLARE_ADDRESS_SPACE(sh4);
 DECLARE_ADDRESS_SPACE(arm7);
@@ -45,9 +47,22 @@ struct memory *mem_create(struct dreamcast *dc);
 void mem_destroy(struct memory *mem);
 
 int mem_init(struct memory *mem);
+void mem_serialize(struct memory *mem, struct state *s);
+
+/* dirty page tracking. when supported, each write to a page of physical
+   memory marks it dirty until the next reset */
+int mem_start_tracking(struct memory *mem);
+void mem_stop_tracking(struct memory *mem);
+void mem_reset_tracking(struct memory *mem);
+int mem_dirty_pages(struct memory *mem, const int **pages);
+
+int mem_num_pages(struct memory *mem);
+int mem_page_size(struct memory *mem);
+uint8_t *mem_page(struct memory *mem, int page);
 
 uint8_t *mem_ram(struct memory *mem, uint32_t offset);
 uint8_t *mem_aram(struct memory *mem, uint32_t offset);
 uint8_t *mem_vram(struct memory *mem, uint32_t offset);
+uint8_t *mem_tracked_vram(struct memory *mem, uint32_t offset);
 
 #endif
@@ -6,8 +6,13 @@
 #include "guest/pvr/ta.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
+#include "guest/state.h"
 #include "stats.h"
 
+#if ARCH_X64
+#include <emmintrin.h>
+#endif
+
 static struct reg_cb pvr_cb[PVR_NUM_REGS];
 
 /* the dreamcast has 8MB of vram, split into two 4MB banks, with two ways of
@@ -101,6 +106,127 @@ static void pvr_mark_framebuffer(struct pvr *pvr, uint32_t addr) {
   }
 }
 
+/* lines of the framebuffer are read through the 32-bit access path. in the
+   interleaved layout, consecutive 32-bit words of a bank are 8 bytes apart,
+   so each line is first gathered into a linear buffer */
+static const uint8_t *pvr_read_line(struct pvr *pvr, uint32_t addr, int size,
+                                    uint32_t *line) {
+  const uint32_t bank_size = 0x00400000;
+  int skip = addr & 0x3;
+  int num_words = (skip + size + 3) >> 2;
+  int i = 0;
+
+  addr -= skip;
+
+  /* lines crossing into the other bank are gathered a word at a time */
+  if ((addr & (bank_size - 1)) + num_words * 4 <= bank_size) {
+    const uint8_t *src = &pvr->vram[VRAM64(addr)];
+
+#if ARCH_X64
+    const uint8_t *end = pvr->vram + PVR_VRAM_SIZE;
+
+    for (; i + 4 <= num_words && &src[i * 8 + 32] <= end; i += 4) {
+      __m128i a = _mm_loadu_si128((const __m128i *)&src[i * 8]);
+      __m128i b = _mm_loadu_si128((const __m128i *)&src[i * 8 + 16]);
+      a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+      b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+      _mm_storeu_si128((__m128i *)&line[i], _mm_unpacklo_epi64(a, b));
+    }
+#endif
+
+    for (; i < num_words; i++) {
+      line[i] = *(const uint32_t *)&src[i * 8];
+    }
+  } else {
+    for (; i < num_words; i++) {
+      line[i] = *(const uint32_t *)&pvr->vram[VRAM64(addr + i * 4)];
+    }
+  }
+
+  return (const uint8_t *)line + skip;
+}
+
+/* 16-bit pixels are converted by masking and shifting each component into
+   place, with blue always occupying the low 5 bits */
+static inline void pvr_convert_16bpp(const uint16_t *src, uint8_t *dst, int n,
+                                     uint16_t r_mask, int r_shift,
+                                     uint16_t g_mask, int g_shift) {
+  int i = 0;
+
+#if ARCH_X64
+  __m128i rm = _mm_set1_epi16(r_mask);
+  __m128i gm = _mm_set1_epi16(g_mask);
+  __m128i bm = _mm_set1_epi16(0x1f);
+  __m128i am = _mm_set1_epi16((short)0xff00);
+  __m128i rs = _mm_cvtsi32_si128(r_shift);
+  __m128i gs = _mm_cvtsi32_si128(g_shift);
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)&src[i]);
+    __m128i r = _mm_srl_epi16(_mm_and_si128(v, rm), rs);
+    __m128i g = _mm_srl_epi16(_mm_and_si128(v, gm), gs);
+    __m128i b = _mm_slli_epi16(_mm_and_si128(v, bm), 3);
+    __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+    __m128i ba = _mm_or_si128(b, am);
+    _mm_storeu_si128((__m128i *)&dst[i * 4], _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i *)&dst[i * 4 + 16], _mm_unpackhi_epi16(rg, ba));
+  }
+#endif
+
+  for (; i < n; i++) {
+    uint16_t rgb = src[i];
+    dst[i * 4 + 0] = (rgb & r_mask) >> r_shift;
+    dst[i * 4 + 1] = (rgb & g_mask) >> g_shift;
+    dst[i * 4 + 2] = (rgb & 0x1f) << 3;
+    dst[i * 4 + 3] = 0xff;
+  }
+}
+
+static void pvr_convert_rgb0555(const uint8_t *src, uint8_t *dst, int n) {
+  pvr_convert_16bpp((const uint16_t *)src, dst, n, 0x7c00, 7, 0x03e0, 2);
+}
+
+static void pvr_convert_rgb565(const uint8_t *src, uint8_t *dst, int n) {
+  pvr_convert_16bpp((const uint16_t *)src, dst, n, 0xf800, 8, 0x07e0, 3);
+}
+
+static void pvr_convert_rgb888(const uint8_t *src, uint8_t *dst, int n) {
+  for (int i = 0; i < n; i++) {
+    dst[i * 4 + 0] = src[i * 3 + 2];
+    dst[i * 4 + 1] = src[i * 3 + 1];
+    dst[i * 4 + 2] = src[i * 3 + 0];
+    dst[i * 4 + 3] = 0xff;
+  }
+}
+
+static void pvr_convert_krgb0888(const uint8_t *src, uint8_t *dst, int n) {
+  const uint32_t *src32 = (const uint32_t *)src;
+  int i = 0;
+
+#if ARCH_X64
+  __m128i gm = _mm_set1_epi32(0x0000ff00);
+  __m128i cm = _mm_set1_epi32(0x000000ff);
+  __m128i am = _mm_set1_epi32(0xff000000);
+
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)&src32[i]);
+    __m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), cm);
+    __m128i g = _mm_and_si128(v, gm);
+    __m128i b = _mm_slli_epi32(_mm_and_si128(v, cm), 16);
+    __m128i rgba = _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, am));
+    _mm_storeu_si128((__m128i *)&dst[i * 4], rgba);
+  }
+#endif
+
+  for (; i < n; i++) {
+    const uint8_t *krgb = (const uint8_t *)&src32[i];
+    dst[i * 4 + 0] = krgb[2];
+    dst[i * 4 + 1] = krgb[1];
+    dst[i * 4 + 2] = krgb[0];
+    dst[i * 4 + 3] = 0xff;
+  }
+}
+
 static int pvr_update_framebuffer(struct pvr *pvr) {
   uint32_t fields[2] = {*pvr->FB_R_SOF1, *pvr->FB_R_SOF2};
   int num_fields = pvr->SPG_CONTROL->interlace ? 2 : 1;
@@ -115,89 +241,58 @@ static int pvr_update_framebuffer(struct pvr *pvr) {
     return 0;
   }
 
-  pvr_framebuffer_size(pvr, &pvr->framebuffer_w, &pvr->framebuffer_h);
+  int width, height;
+  pvr_framebuffer_size(pvr, &width, &height);
+  CHECK_LE(width * height * 4, PVR_FRAMEBUFFER_SIZE);
+
+  /* convert the framebuffer directly into the client's buffer, if it doesn't
+     provide one the output isn't wanted */
+  uint8_t *pixels = dc_map_pixels(pvr->dc, width, height);
 
-  /* convert framebuffer into a 24-bit RGB pixel buffer */
-  uint8_t *dst = pvr->framebuffer;
-  uint8_t *src = pvr->vram;
+  if (!pixels) {
+    return 0;
+  }
+
+  void (*convert)(const uint8_t *, uint8_t *, int) = NULL;
+
+  switch (pvr->FB_R_CTRL->fb_depth) {
+    case 0:
+      convert = &pvr_convert_rgb0555;
+      break;
+    case 1:
+      convert = &pvr_convert_rgb565;
+      break;
+    case 2:
+      convert = &pvr_convert_rgb888;
+      break;
+    case 3:
+      convert = &pvr_convert_krgb0888;
+      break;
+    default:
+      LOG_FATAL("pvr_update_framebuffer unexpected fb_depth %d",
+                pvr->FB_R_CTRL->fb_depth);
+      break;
+  }
 
   /* values in FB_R_SIZE are in 32-bit units */
   int line_mod = (pvr->FB_R_SIZE->mod << 2) - 4;
   int x_size = (pvr->FB_R_SIZE->x + 1) << 2;
   int y_size = (pvr->FB_R_SIZE->y + 1);
+  uint32_t line[1025];
+  uint8_t *dst = pixels;
 
   /* TODO use fb_concat */
 
-  switch (pvr->FB_R_CTRL->fb_depth) {
-    case 0: {
-      for (int y = 0; y < y_size; y++) {
-        for (int n = 0; n < num_fields; n++) {
-          for (int x = 0; x < x_size; x += 2) {
-            uint16_t rgb = *(uint16_t *)&src[VRAM64(fields[n])];
-            dst[0] = (rgb & 0b0111110000000000) >> 7;
-            dst[1] = (rgb & 0b0000001111100000) >> 2;
-            dst[2] = (rgb & 0b0000000000011111) << 3;
-            fields[n] += 2;
-            dst += 3;
-          }
-          fields[n] += line_mod;
-        }
-      }
-    } break;
-
-    case 1: {
-      for (int y = 0; y < y_size; y++) {
-        for (int n = 0; n < num_fields; n++) {
-          for (int x = 0; x < x_size; x += 2) {
-            uint16_t rgb = *(uint16_t *)&src[VRAM64(fields[n])];
-            dst[0] = (rgb & 0b1111100000000000) >> 8;
-            dst[1] = (rgb & 0b0000011111100000) >> 3;
-            dst[2] = (rgb & 0b0000000000011111) << 3;
-            fields[n] += 2;
-            dst += 3;
-          }
-          fields[n] += line_mod;
-        }
-      }
-    } break;
-    case 2: {
-      for (int y = 0; y < y_size; y++) {
-        for (int n = 0; n < num_fields; n++) {
-          for (int x = 0; x < x_size; x += 3) {
-            uint8_t *rgb = &src[VRAM64(fields[n])];
-            dst[0] = rgb[2];
-            dst[1] = rgb[1];
-            dst[2] = rgb[0];
-            fields[n] += 3;
-            dst += 3;
-          }
-          fields[n] += line_mod;
-        }
-      }
-    } break;
-    case 3: {
-      for (int y = 0; y < y_size; y++) {
-        for (int n = 0; n < num_fields; n++) {
-          for (int x = 0; x < x_size; x += 4) {
-            uint8_t *krgb = &src[VRAM64(fields[n])];
-            dst[0] = krgb[2];
-            dst[1] = krgb[1];
-            dst[2] = krgb[0];
-            fields[n] += 4;
-            dst += 3;
-          }
-          fields[n] += line_mod;
-        }
-      }
-    } break;
-    default:
-      LOG_FATAL("pvr_push_framebuffer unexpected fb_depth %d",
-                pvr->FB_R_CTRL->fb_depth);
-      break;
+  for (int y = 0; y < y_size; y++) {
+    for (int n = 0; n < num_fields; n++) {
+      const uint8_t *src = pvr_read_line(pvr, fields[n], x_size, line);
+      convert(src, dst, width);
+      fields[n] += x_size + line_mod;
+      dst += width * 4;
+    }
   }
 
-  dc_push_pixels(pvr->dc, pvr->framebuffer, pvr->framebuffer_w,
-                 pvr->framebuffer_h);
+  dc_push_pixels(pvr->dc, pixels, width, height);
 
   return 1;
 }
@@ -227,13 +322,100 @@ static void pvr_vblank_in(struct pvr *pvr) {
   dc_vblank_in(pvr->dc, pvr->VO_CONTROL->blank_video);
 }
 
+static int64_t pvr_line_ns(struct pvr *pvr) {
+  return HZ_TO_NANO(pvr->line_clock);
+}
+
+static uint32_t pvr_num_lines(struct pvr *pvr) {
+  return pvr->SPG_LOAD->vcount + 1;
+}
+
+/* number of lines from the current line until the next time line is reached,
+   lines outside of the frame are never reached */
+static uint32_t pvr_line_distance(struct pvr *pvr, uint32_t line) {
+  uint32_t num_lines = pvr_num_lines(pvr);
+
+  if (line >= num_lines) {
+    return num_lines;
+  }
+
+  return (line + num_lines - pvr->current_line - 1) % num_lines + 1;
+}
+
+/* find the number of lines until the next line which raises an interrupt or
+   changes the vsync state, the lines in between don't need to be visited */
+static uint32_t pvr_next_event_distance(struct pvr *pvr) {
+  uint32_t lines = pvr_num_lines(pvr);
+
+  switch (pvr->SPG_HBLANK_INT->hblank_int_mode) {
+    case 0x0:
+      lines = MIN(lines,
+                  pvr_line_distance(pvr, pvr->SPG_HBLANK_INT->line_comp_val));
+      break;
+    default:
+      lines = 1;
+      break;
+  }
+
+  lines = MIN(lines, pvr_line_distance(
+                         pvr, pvr->SPG_VBLANK_INT->vblank_in_line_number));
+  lines = MIN(lines, pvr_line_distance(
+                         pvr, pvr->SPG_VBLANK_INT->vblank_out_line_number));
+  lines = MIN(lines, pvr_line_distance(pvr, pvr->SPG_VBLANK->vbstart));
+  lines = MIN(lines, pvr_line_distance(pvr, pvr->SPG_VBLANK->vbend));
+
+  return lines;
+}
+
+static void pvr_step_scanline(struct pvr *pvr, int64_t lines) {
+  pvr->current_line = (pvr->current_line + lines) % pvr_num_lines(pvr);
+  pvr->line_time += lines * pvr_line_ns(pvr);
+  pvr->SPG_STATUS->scanline = pvr->current_line;
+}
+
+/* the current line is only stepped when the line timer fires, catch it up to
+   the time the running device has reached. this is usually the sh4 partway
+   through its slice, with the scheduler's time already at the slice's end */
+static void pvr_sync_scanline(struct pvr *pvr) {
+  struct scheduler *sched = pvr->dc->sched;
+  int64_t now = sched_device_time(sched);
+  int64_t lines = MAX((now - pvr->line_time) / pvr_line_ns(pvr), 0);
+
+  /* never step onto the line of a pending event, it's left for the timer
+     callback to process */
+  if (pvr->line_timer) {
+    lines = MIN(lines, (int64_t)pvr_next_event_distance(pvr) - 1);
+  }
+
+  pvr_step_scanline(pvr, lines);
+}
+
+static void pvr_next_scanline(void *data);
+
+static void pvr_schedule_scanline(struct pvr *pvr) {
+  struct scheduler *sched = pvr->dc->sched;
+
+  if (pvr->line_timer) {
+    sched_cancel_timer(sched, pvr->line_timer);
+    pvr->line_timer = NULL;
+  }
+
+  /* when rescheduled partway through a slice, the event may already be due */
+  uint32_t lines = pvr_next_event_distance(pvr);
+  int64_t expire = pvr->line_time + lines * pvr_line_ns(pvr);
+  int64_t now = sched_current_time(sched);
+  pvr->line_timer = sched_start_timer(sched, &pvr_next_scanline, pvr,
+                                      MAX(expire - now, 0));
+}
+
 static void pvr_next_scanline(void *data) {
   struct pvr *pvr = data;
   struct holly *hl = pvr->dc->holly;
-  struct scheduler *sched = pvr->dc->sched;
 
-  uint32_t num_lines = pvr->SPG_LOAD->vcount + 1;
-  pvr->current_line = (pvr->current_line + 1) % num_lines;
+  /* step to the line the timer was scheduled for. the timer may fire later
+     than the line when it was scheduled partway through a slice */
+  pvr->line_timer = NULL;
+  pvr_step_scanline(pvr, pvr_next_event_distance(pvr));
 
   /* hblank in */
   switch (pvr->SPG_HBLANK_INT->hblank_int_mode) {
@@ -268,7 +450,6 @@ static void pvr_next_scanline(void *data) {
     pvr->SPG_STATUS->vsync = pvr->current_line >= pvr->SPG_VBLANK->vbstart ||
                              pvr->current_line < pvr->SPG_VBLANK->vbend;
   }
-  pvr->SPG_STATUS->scanline = pvr->current_line;
 
   if (!was_vsync && pvr->SPG_STATUS->vsync) {
     pvr_vblank_in(pvr);
@@ -277,8 +458,7 @@ static void pvr_next_scanline(void *data) {
   }
 
   /* reschedule */
-  pvr->line_timer = sched_start_timer(sched, &pvr_next_scanline, pvr,
-                                      HZ_TO_NANO(pvr->line_clock));
+  pvr_schedule_scanline(pvr);
 }
 
 static void pvr_reconfigure_spg(struct pvr *pvr) {
@@ -310,13 +490,23 @@ static void pvr_reconfigure_spg(struct pvr *pvr) {
       pvr->SPG_LOAD->hcount, pvr->SPG_HBLANK->hbstart, pvr->SPG_HBLANK->hbend,
       pvr->SPG_LOAD->vcount, pvr->SPG_VBLANK->vbstart, pvr->SPG_VBLANK->vbend);
 
-  if (pvr->line_timer) {
-    sched_cancel_timer(sched, pvr->line_timer);
-    pvr->line_timer = NULL;
-  }
+  /* restart the current line with the new clock */
+  pvr->current_line %= pvr_num_lines(pvr);
+  pvr->line_time = sched_device_time(sched);
 
-  pvr->line_timer = sched_start_timer(sched, &pvr_next_scanline, pvr,
-                                      HZ_TO_NANO(pvr->line_clock));
+  pvr_schedule_scanline(pvr);
+}
+
+static void pvr_serialize(struct device *dev, struct state *s) {
+  struct pvr *pvr = (struct pvr *)dev;
+  struct scheduler *sched = pvr->dc->sched;
+
+  STATE_FIELD(s, pvr->reg);
+  STATE_FIELD(s, pvr->line_clock);
+  STATE_FIELD(s, pvr->current_line);
+  STATE_FIELD(s, pvr->line_time);
+  STATE_FIELD(s, pvr->got_startrender);
+  state_timer(s, sched, &pvr->line_timer, &pvr_next_scanline, pvr);
 }
 
 static int pvr_init(struct device *dev) {
@@ -331,6 +521,7 @@ static int pvr_init(struct device *dev) {
 #undef PVR_REG
 
   pvr->vram = mem_vram(dc->mem, 0x0);
+  pvr->tracked_vram = mem_tracked_vram(dc->mem, 0x0);
 
   /* configure initial vsync interval */
   pvr_reconfigure_spg(pvr);
@@ -338,10 +529,80 @@ static int pvr_init(struct device *dev) {
   return 1;
 }
 
+/* mask of the blocks covered by [begin, end), which must lie within a page */
+static uint64_t pvr_vram_block_mask(uint32_t begin, uint32_t end) {
+  const uint32_t page_mask = (1 << PVR_VRAM_PAGE_SHIFT) - 1;
+  int first = (begin & page_mask) >> PVR_VRAM_BLOCK_SHIFT;
+  int last = ((end - 1) & page_mask) >> PVR_VRAM_BLOCK_SHIFT;
+  return (~UINT64_C(0) << first) & (~UINT64_C(0) >> (63 - last));
+}
+
+void pvr_vram_reset_dirty(struct pvr *pvr) {
+  for (int i = 0; i < pvr->num_vram_dirty_pages; i++) {
+    pvr->vram_dirty[pvr->vram_dirty_pages[i]] = 0;
+  }
+
+  pvr->num_vram_dirty_pages = 0;
+}
+
+/* find the block aligned range of dirty bytes in [addr, addr + size), clamped
+   to the range itself */
+int pvr_vram_dirty_range(struct pvr *pvr, uint32_t addr, int size,
+                         uint32_t *begin, uint32_t *end) {
+  const uint32_t page_size = 1 << PVR_VRAM_PAGE_SHIFT;
+  uint32_t range_end = MIN(addr + size, PVR_VRAM_SIZE);
+  int found = 0;
+
+  for (uint32_t it = addr; it < range_end;) {
+    int page = it >> PVR_VRAM_PAGE_SHIFT;
+    uint32_t page_begin = page << PVR_VRAM_PAGE_SHIFT;
+    uint32_t page_end = MIN(page_begin + page_size, range_end);
+    uint64_t mask = pvr_vram_block_mask(it, page_end);
+    uint64_t dirty = pvr->vram_dirty[page] & mask;
+
+    if (dirty) {
+      int first = ctz64(dirty);
+      int last = 63 - clz64(dirty);
+      uint32_t dirty_begin = page_begin + (first << PVR_VRAM_BLOCK_SHIFT);
+      uint32_t dirty_end = page_begin + ((last + 1) << PVR_VRAM_BLOCK_SHIFT);
+
+      if (!found) {
+        *begin = MAX(dirty_begin, addr);
+        found = 1;
+      }
+      *end = MIN(dirty_end, range_end);
+    }
+
+    it = page_end;
+  }
+
+  return found;
+}
+
+void pvr_vram_mark_dirty(struct pvr *pvr, uint32_t addr, int size) {
+  const uint32_t page_size = 1 << PVR_VRAM_PAGE_SHIFT;
+  uint32_t range_end = MIN(addr + size, PVR_VRAM_SIZE);
+
+  for (uint32_t it = addr; it < range_end;) {
+    int page = it >> PVR_VRAM_PAGE_SHIFT;
+    uint32_t page_begin = page << PVR_VRAM_PAGE_SHIFT;
+    uint32_t page_end = MIN(page_begin + page_size, range_end);
+    uint64_t mask = pvr_vram_block_mask(it, page_end);
+
+    if (!pvr->vram_dirty[page]) {
+      pvr->vram_dirty_pages[pvr->num_vram_dirty_pages++] = page;
+    }
+    pvr->vram_dirty[page] |= mask;
+
+    it = page_end;
+  }
+}
+
 void pvr_vram32_write(struct pvr *pvr, uint32_t addr, uint32_t data,
                       uint32_t mask) {
   addr = VRAM64(addr);
-  WRITE_DATA(&pvr->vram[addr]);
+  pvr_vram_mark_dirty(pvr, addr, 4);
+  WRITE_DATA(&pvr->tracked_vram[addr]);
 }
 
 uint32_t pvr_vram32_read(struct pvr *pvr, uint32_t addr, uint32_t mask) {
@@ -351,7 +612,8 @@ uint32_t pvr_vram32_read(struct pvr *pvr, uint32_t addr, uint32_t mask) {
 
 void pvr_vram64_write(struct pvr *pvr, uint32_t addr, uint32_t data,
                       uint32_t mask) {
-  WRITE_DATA(&pvr->vram[addr]);
+  pvr_vram_mark_dirty(pvr, addr, 4);
+  WRITE_DATA(&pvr->tracked_vram[addr]);
 }
 
 uint32_t pvr_vram64_read(struct pvr *pvr, uint32_t addr, uint32_t mask) {
@@ -427,6 +689,10 @@ struct pvr *pvr_create(struct dreamcast *dc) {
   struct pvr *pvr =
       dc_create_device(dc, sizeof(struct pvr), "pvr", &pvr_init, NULL);
 
+  /* setup state interface */
+  pvr->stateif.enabled = 1;
+  pvr->stateif.serialize = &pvr_serialize;
+
   return pvr;
 }
 
@@ -487,9 +753,43 @@ REG_W32(pvr_cb, TA_YUV_TEX_BASE) {
   ta_yuv_init(ta);
 }
 
+REG_W32(pvr_cb, SPG_HBLANK_INT) {
+  struct pvr *pvr = dc->pvr;
+
+  pvr_sync_scanline(pvr);
+  pvr->SPG_HBLANK_INT->full = value;
+  pvr_schedule_scanline(pvr);
+}
+
+REG_W32(pvr_cb, SPG_VBLANK_INT) {
+  struct pvr *pvr = dc->pvr;
+
+  pvr_sync_scanline(pvr);
+  pvr->SPG_VBLANK_INT->full = value;
+  pvr_schedule_scanline(pvr);
+}
+
+REG_W32(pvr_cb, SPG_VBLANK) {
+  struct pvr *pvr = dc->pvr;
+
+  pvr_sync_scanline(pvr);
+  pvr->SPG_VBLANK->full = value;
+  pvr_schedule_scanline(pvr);
+}
+
+REG_R32(pvr_cb, SPG_STATUS) {
+  struct pvr *pvr = dc->pvr;
+
+  /* the scanline is derived lazily, only when it's observed */
+  pvr_sync_scanline(pvr);
+
+  return pvr->SPG_STATUS->full;
+}
+
 REG_W32(pvr_cb, SPG_LOAD) {
   struct pvr *pvr = dc->pvr;
 
+  pvr_sync_scanline(pvr);
   pvr->SPG_LOAD->full = value;
 
   pvr_reconfigure_spg(pvr);
@@ -498,6 +798,7 @@ REG_W32(pvr_cb, SPG_LOAD) {
 REG_W32(pvr_cb, FB_R_CTRL) {
   struct pvr *pvr = dc->pvr;
 
+  pvr_sync_scanline(pvr);
   pvr->FB_R_CTRL->full = value;
 
   pvr_reconfigure_spg(pvr);
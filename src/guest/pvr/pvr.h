@@ -10,20 +10,33 @@ struct timer;
 
 #define PVR_FRAMEBUFFER_SIZE 640 * 640 * 4
 
+/* writes to vram are tracked in blocks much smaller than the host's pages,
+   enabling the texture cache to tell which textures, and which rows of them,
+   were actually written. each page has a mask of its dirty blocks */
+#define PVR_VRAM_SIZE 0x800000
+#define PVR_VRAM_PAGE_SHIFT 12
+#define PVR_VRAM_BLOCK_SHIFT 6
+#define PVR_VRAM_PAGES (PVR_VRAM_SIZE >> PVR_VRAM_PAGE_SHIFT)
+
 struct pvr {
   struct device;
   uint8_t *vram;
+  /* writes that are marked dirty go through this mapping of vram, see
+     mem_tracked_vram */
+  uint8_t *tracked_vram;
   uint32_t reg[PVR_NUM_REGS];
 
-  /* raster progress */
+  /* blocks of vram written since the last pvr_vram_reset_dirty */
+  uint64_t vram_dirty[PVR_VRAM_PAGES];
+  int vram_dirty_pages[PVR_VRAM_PAGES];
+  int num_vram_dirty_pages;
+
+  /* raster progress. the timer only fires on lines with an event, the
+     scanline in between is derived from the time elapsed since line_time */
   struct timer *line_timer;
   int line_clock;
   uint32_t current_line;
-
-  /* copy of deinterlaced framebuffer from texture memory */
-  uint8_t framebuffer[PVR_FRAMEBUFFER_SIZE];
-  int framebuffer_w;
-  int framebuffer_h;
+  int64_t line_time;
 
   /* tracks if a STARTRENDER was received for the current frame */
   int got_startrender;
@@ -50,4 +63,9 @@ uint32_t pvr_vram32_read(struct pvr *pvr, uint32_t addr, uint32_t mask);
 void pvr_vram32_write(struct pvr *pvr, uint32_t addr, uint32_t data,
                       uint32_t mask);
 
+void pvr_vram_mark_dirty(struct pvr *pvr, uint32_t addr, int size);
+int pvr_vram_dirty_range(struct pvr *pvr, uint32_t addr, int size,
+                         uint32_t *begin, uint32_t *end);
+void pvr_vram_reset_dirty(struct pvr *pvr);
+
 #endif
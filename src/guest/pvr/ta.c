@@ -29,11 +29,19 @@
 #include "guest/pvr/tr.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
+#include "guest/state.h"
 #include "stats.h"
 
+#if ARCH_X64
+#include <emmintrin.h>
+#endif
+
+#define TA_MAX_CONTEXTS 8
+
 struct ta {
   struct device;
   uint8_t *vram;
+  uint8_t *tracked_vram;
 
   /* yuv data converter state */
   uint8_t *yuv_data;
@@ -43,9 +51,12 @@ struct ta {
   int yuv_macroblock_count;
 
   /* tile context pool */
-  struct ta_context contexts[8];
+  struct ta_context contexts[TA_MAX_CONTEXTS];
   struct ta_context *curr_context;
   int num_contexts;
+
+  /* end of render timer for each context */
+  struct timer *render_timers[TA_MAX_CONTEXTS];
 };
 
 /*
@@ -386,10 +397,28 @@ static void ta_init_context(struct ta *ta, struct ta_context *ctx) {
 
   ctx->cursor = 0;
   ctx->size = 0;
+  ctx->num_textures = 0;
   ctx->list_type = TA_NUM_LISTS;
   ctx->vert_type = TA_NUM_VERTS;
 }
 
+static void ta_add_texture(struct ta_context *ctx, union tsp tsp,
+                           union tcw tcw) {
+  /* consecutive polygons commonly share the same texture */
+  if (ctx->num_textures) {
+    struct ta_texture_ref *last = &ctx->textures[ctx->num_textures - 1];
+
+    if (last->tsp.full == tsp.full && last->tcw.full == tcw.full) {
+      return;
+    }
+  }
+
+  CHECK_LT(ctx->num_textures, ARRAY_SIZE(ctx->textures));
+  struct ta_texture_ref *ref = &ctx->textures[ctx->num_textures++];
+  ref->tsp = tsp;
+  ref->tcw = tcw;
+}
+
 static void ta_write_context(struct ta *ta, struct ta_context *ctx,
                              const void *ptr, int size) {
   struct holly *hl = ta->dc->holly;
@@ -438,9 +467,15 @@ static void ta_write_context(struct ta *ta, struct ta_context *ctx,
 
       /* global params */
       case TA_PARAM_POLY_OR_VOL:
-      case TA_PARAM_SPRITE:
+      case TA_PARAM_SPRITE: {
+        const union poly_param *poly = param;
+
         ctx->vert_type = ta_vert_type(pcw);
-        break;
+
+        if (pcw.texture) {
+          ta_add_texture(ctx, poly->type0.tsp, poly->type0.tcw);
+        }
+      } break;
 
       /* vertex params */
       case TA_PARAM_VERTEX:
@@ -543,6 +578,8 @@ static void ta_render_context_end(void *data) {
   struct ta *ta = ctx->userdata;
   struct holly *hl = ta->dc->holly;
 
+  ta->render_timers[ctx - ta->contexts] = NULL;
+
   /* ensure the client has finished rendering */
   dc_finish_render(ta->dc);
 
@@ -572,7 +609,8 @@ static void ta_render_context(struct ta *ta, struct ta_context *ctx) {
      TODO figure out a heuristic involving the number of polygons rendered */
   int64_t end = INT64_C(10000000);
   ctx->userdata = ta;
-  sched_start_timer(sched, &ta_render_context_end, ctx, end);
+  ta->render_timers[ctx - ta->contexts] =
+      sched_start_timer(sched, &ta_render_context_end, ctx, end);
 }
 
 /*
@@ -596,7 +634,7 @@ static void ta_yuv_reset(struct ta *ta) {
   int v_size = pvr->TA_YUV_TEX_CTRL->v_size + 1;
 
   /* setup internal state for the data conversion */
-  ta->yuv_data = &ta->vram[pvr->TA_YUV_TEX_BASE->base_address];
+  ta->yuv_data = &ta->tracked_vram[pvr->TA_YUV_TEX_BASE->base_address];
   ta->yuv_width = u_size * 16;
   ta->yuv_height = v_size * 16;
   ta->yuv_macroblock_size = TA_YUV420_MACROBLOCK_SIZE;
@@ -606,42 +644,37 @@ static void ta_yuv_reset(struct ta *ta) {
   pvr->TA_YUV_TEX_CNT->num = 0;
 }
 
-static void ta_yuv_process_block(struct ta *ta, const uint8_t *in_uv,
-                                 const uint8_t *in_y, uint8_t *out_uyvy) {
-  uint8_t *out_row0 = out_uyvy;
-  uint8_t *out_row1 = out_uyvy + (ta->yuv_width << 1);
-
-  /* reencode 8x8 subblock of YUV420 data as UYVY422 */
-  for (int j = 0; j < 8; j += 2) {
-    for (int i = 0; i < 8; i += 2) {
-      uint8_t u = in_uv[0];
-      uint8_t v = in_uv[64];
-      uint8_t y0 = in_y[0];
-      uint8_t y1 = in_y[1];
-      uint8_t y2 = in_y[8];
-      uint8_t y3 = in_y[9];
-
-      out_row0[0] = u;
-      out_row0[1] = y0;
-      out_row0[2] = v;
-      out_row0[3] = y1;
-
-      out_row1[0] = u;
-      out_row1[1] = y2;
-      out_row1[2] = v;
-      out_row1[3] = y3;
-
-      in_uv += 1;
-      in_y += 2;
-      out_row0 += 4;
-      out_row1 += 4;
+/* each YUV420 macroblock starts with 8x8 blocks of U and V data, with each
+   sample shared by a 2x2 group of pixels, followed by four 8x8 blocks of Y
+   data for the top-left, top-right, bottom-left and bottom-right quadrants.
+   it's reencoded as 16 rows of UYVY422 data, where each pair of pixels on a
+   row shares the U and V samples */
+void ta_yuv_convert_macroblock(const uint8_t *in, uint8_t *out, int stride) {
+  for (int y = 0; y < 16; y++) {
+    const uint8_t *in_u = &in[(y >> 1) * 8];
+    const uint8_t *in_v = in_u + 64;
+    const uint8_t *in_y0 = &in[128 + (y >> 3) * 128 + (y & 7) * 8];
+    const uint8_t *in_y1 = in_y0 + 64;
+    uint8_t *row = &out[y * stride];
+
+#if ARCH_X64
+    __m128i u = _mm_loadl_epi64((const __m128i *)in_u);
+    __m128i v = _mm_loadl_epi64((const __m128i *)in_v);
+    __m128i y0 = _mm_loadl_epi64((const __m128i *)in_y0);
+    __m128i y1 = _mm_loadl_epi64((const __m128i *)in_y1);
+    __m128i uv = _mm_unpacklo_epi8(u, v);
+    __m128i yy = _mm_unpacklo_epi64(y0, y1);
+    _mm_storeu_si128((__m128i *)&row[0], _mm_unpacklo_epi8(uv, yy));
+    _mm_storeu_si128((__m128i *)&row[16], _mm_unpackhi_epi8(uv, yy));
+#else
+    for (int x = 0; x < 8; x++) {
+      const uint8_t *in_y = x < 4 ? &in_y0[x << 1] : &in_y1[(x - 4) << 1];
+      row[x * 4 + 0] = in_u[x];
+      row[x * 4 + 1] = in_y[0];
+      row[x * 4 + 2] = in_v[x];
+      row[x * 4 + 3] = in_y[1];
     }
-
-    /* skip past adjacent 8x8 subblock */
-    in_uv += 4;
-    in_y += 8;
-    out_row0 += (ta->yuv_width << 2) - 16;
-    out_row1 += (ta->yuv_width << 2) - 16;
+#endif
   }
 }
 
@@ -657,16 +690,13 @@ static void ta_yuv_process_macroblock(struct ta *ta, const void *data) {
   uint32_t out_y =
       (pvr->TA_YUV_TEX_CNT->num / (pvr->TA_YUV_TEX_CTRL->u_size + 1)) * 16;
   uint8_t *out = &ta->yuv_data[(out_y * ta->yuv_width + out_x) << 1];
+  int out_stride = ta->yuv_width << 1;
+
+  /* the macroblock spans 16 rows of the output texture */
+  int out_size = out_stride * 15 + 32;
+  pvr_vram_mark_dirty(pvr, (uint32_t)(out - ta->tracked_vram), out_size);
 
-  /* process each 8x8 subblock individually */
-  /* (0, 0) */
-  ta_yuv_process_block(ta, &in[0], &in[128], &out[0]);
-  /* (8, 0) */
-  ta_yuv_process_block(ta, &in[4], &in[192], &out[16]);
-  /* (0, 8) */
-  ta_yuv_process_block(ta, &in[32], &in[256], &out[ta->yuv_width * 16]);
-  /* (8, 8) */
-  ta_yuv_process_block(ta, &in[36], &in[320], &out[ta->yuv_width * 16 + 16]);
+  ta_yuv_convert_macroblock(in, out, out_stride);
 
   /* reset state once all macroblocks have been processed */
   pvr->TA_YUV_TEX_CNT->num++;
@@ -682,11 +712,103 @@ static void ta_yuv_process_macroblock(struct ta *ta, const void *data) {
 /*
  * ta device interface
  */
+static void ta_serialize(struct device *dev, struct state *s) {
+  struct ta *ta = (struct ta *)dev;
+  struct scheduler *sched = ta->dc->sched;
+
+  /* pointers are saved as offsets / indices */
+  int32_t yuv_data =
+      ta->yuv_data ? (int32_t)(ta->yuv_data - ta->tracked_vram) : -1;
+  int32_t curr_context =
+      ta->curr_context ? (int32_t)(ta->curr_context - ta->contexts) : -1;
+
+  STATE_FIELD(s, yuv_data);
+  STATE_FIELD(s, ta->yuv_width);
+  STATE_FIELD(s, ta->yuv_height);
+  STATE_FIELD(s, ta->yuv_macroblock_size);
+  STATE_FIELD(s, ta->yuv_macroblock_count);
+  int32_t num_contexts = ta->num_contexts;
+
+  STATE_FIELD(s, curr_context);
+  STATE_FIELD(s, num_contexts);
+
+  /* validate the count before it's assigned and used to index the contexts */
+  if (s->error || num_contexts < 0 || num_contexts > TA_MAX_CONTEXTS ||
+      curr_context >= num_contexts) {
+    s->error = 1;
+    return;
+  }
+
+  ta->num_contexts = num_contexts;
+
+  /* when measuring, report the worst case size so callers can allocate a
+     single buffer up front */
+  int measure = s->mode == STATE_MEASURE;
+
+  if (measure) {
+    num_contexts = TA_MAX_CONTEXTS;
+  }
+
+  for (int i = 0; i < num_contexts; i++) {
+    struct ta_context *ctx = &ta->contexts[i];
+
+    STATE_FIELD(s, ctx->addr);
+    STATE_FIELD(s, ctx->rendering);
+    STATE_FIELD(s, ctx->autosort);
+    STATE_FIELD(s, ctx->stride);
+    STATE_FIELD(s, ctx->palette_fmt);
+    STATE_FIELD(s, ctx->video_width);
+    STATE_FIELD(s, ctx->video_height);
+    STATE_FIELD(s, ctx->alpha_ref);
+    STATE_FIELD(s, ctx->bg_isp);
+    STATE_FIELD(s, ctx->bg_tsp);
+    STATE_FIELD(s, ctx->bg_tcw);
+    STATE_FIELD(s, ctx->bg_depth);
+    STATE_FIELD(s, ctx->bg_vertices);
+    STATE_FIELD(s, ctx->cursor);
+    STATE_FIELD(s, ctx->size);
+    STATE_FIELD(s, ctx->list_type);
+    STATE_FIELD(s, ctx->vert_type);
+
+    /* only the used portion of the parameter buffer is saved */
+    if (s->error || ctx->size < 0 || ctx->size > (int)sizeof(ctx->params)) {
+      s->error = 1;
+      return;
+    }
+    int params_size = measure ? (int)sizeof(ctx->params) : ctx->size;
+    state_bytes(s, ctx->params, params_size);
+
+    STATE_FIELD(s, ctx->num_textures);
+
+    if (s->error || ctx->num_textures < 0 ||
+        ctx->num_textures > ARRAY_SIZE(ctx->textures)) {
+      s->error = 1;
+      return;
+    }
+    int num_textures = measure ? ARRAY_SIZE(ctx->textures) : ctx->num_textures;
+    state_bytes(s, ctx->textures,
+                num_textures * (int)sizeof(struct ta_texture_ref));
+
+    ctx->userdata = ta;
+    state_timer(s, sched, &ta->render_timers[i], &ta_render_context_end, ctx);
+  }
+
+  if (state_loading(s)) {
+    ta->yuv_data = yuv_data >= 0 ? ta->tracked_vram + yuv_data : NULL;
+    ta->curr_context = curr_context >= 0 ? &ta->contexts[curr_context] : NULL;
+
+    for (int i = ta->num_contexts; i < TA_MAX_CONTEXTS; i++) {
+      ta->render_timers[i] = NULL;
+    }
+  }
+}
+
 static int ta_init(struct device *dev) {
   struct ta *ta = (struct ta *)dev;
   struct dreamcast *dc = ta->dc;
 
   ta->vram = mem_vram(dc->mem, 0x0);
+  ta->tracked_vram = mem_tracked_vram(dc->mem, 0x0);
 
   return 1;
 }
@@ -746,7 +868,8 @@ void ta_texture_write(struct ta *ta, uint32_t dst, const uint8_t *src,
   CHECK(*hl->SB_LMMODE0 == 0);
 
   dst &= 0xeeffffff;
-  memcpy(&ta->vram[dst], src, size);
+  pvr_vram_mark_dirty(ta->dc->pvr, dst, size);
+  memcpy(&ta->tracked_vram[dst], src, size);
 }
 
 void ta_yuv_write(struct ta *ta, uint32_t dst, const uint8_t *src, int size) {
@@ -828,5 +951,9 @@ struct ta *ta_create(struct dreamcast *dc) {
 
   struct ta *ta = dc_create_device(dc, sizeof(struct ta), "ta", &ta_init, NULL);
 
+  /* setup state interface */
+  ta->stateif.enabled = 1;
+  ta->stateif.serialize = &ta_serialize;
+
   return ta;
 }
@@ -24,6 +24,8 @@ void ta_yuv_write(struct ta *ta, uint32_t dst, const uint8_t *src, int size);
 void ta_texture_write(struct ta *ta, uint32_t dst, const uint8_t *src,
                       int size);
 
+void ta_yuv_convert_macroblock(const uint8_t *in, uint8_t *out, int stride);
+
 /*
  * parameter stream processing helpers, shared by both the ta and tr
  */
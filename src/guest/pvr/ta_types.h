@@ -416,6 +416,11 @@ union vert_param {
   } sprite1;
 };
 
+struct ta_texture_ref {
+  union tsp tsp;
+  union tcw tcw;
+};
+
 struct ta_context {
   uint32_t addr;
   void *userdata;
@@ -439,6 +444,11 @@ struct ta_context {
   int cursor;
   int size;
 
+  /* textures referenced by the parameters, recorded as each global param is
+     received so they can be registered without walking the parameters again */
+  struct ta_texture_ref textures[TA_MAX_PARAMS];
+  int num_textures;
+
   /* current global state */
   int list_type;
   int vert_type;
@@ -2,6 +2,18 @@
 #include "core/core.h"
 #include "render/render_backend.h"
 
+#if ARCH_X64
+#include <emmintrin.h>
+#endif
+
+/* gcc and clang can compile avx2 versions of the vector routines alongside
+   the sse2 ones, without requiring avx2 for the rest of the build */
+#if ARCH_X64 && (COMPILER_GCC || COMPILER_CLANG)
+#include <immintrin.h>
+#define HAVE_TEX_AVX2 1
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
 /*
  * pixel formats
  */
@@ -46,6 +58,22 @@ static inline uint8_t COLOR_EXTEND_6(uint8_t c) {
   return c | (c >> 6);
 }
 
+/* the vector routines work on 4 texels at a time, each zero-extended to 32
+   bits, and produce the same RGBA values as the scalar routines */
+#if ARCH_X64
+#define SHR_AND(v, n, mask) \
+  _mm_and_si128(_mm_srli_epi32(v, n), _mm_set1_epi32((int)(mask)))
+#define SHL_AND(v, n, mask) \
+  _mm_and_si128(_mm_slli_epi32(v, n), _mm_set1_epi32((int)(mask)))
+#endif
+
+#if HAVE_TEX_AVX2
+#define SHR_AND256(v, n, mask) \
+  _mm256_and_si256(_mm256_srli_epi32(v, n), _mm256_set1_epi32((int)(mask)))
+#define SHL_AND256(v, n, mask) \
+  _mm256_and_si256(_mm256_slli_epi32(v, n), _mm256_set1_epi32((int)(mask)))
+#endif
+
 /* ARGB1555 */
 typedef uint16_t ARGB1555_type;
 
@@ -56,14 +84,6 @@ static inline void ARGB1555_unpack(ARGB1555_type src, uint8_t *rgba) {
   rgba[3] = COLOR_EXTEND_1((src & 0b1000000000000000) >> 8);
 }
 
-static inline void ARGB1555_unpack_bitmap(const ARGB1555_type *src,
-                                          uint8_t *rgba) {
-  ARGB1555_unpack(src[0], rgba + 0x0);
-  ARGB1555_unpack(src[1], rgba + 0x4);
-  ARGB1555_unpack(src[2], rgba + 0x8);
-  ARGB1555_unpack(src[3], rgba + 0xc);
-}
-
 static inline void ARGB1555_unpack_twiddled(const ARGB1555_type *src,
                                             uint8_t *rgba) {
   ARGB1555_unpack(src[0], rgba + 0x0);
@@ -72,21 +92,29 @@ static inline void ARGB1555_unpack_twiddled(const ARGB1555_type *src,
   ARGB1555_unpack(src[3], rgba + 0xc);
 }
 
-static inline void ARGB1555_unpack_pal4(const uint8_t *src, const uint32_t *pal,
-                                        uint8_t *rgba) {
-  ARGB1555_unpack((ARGB1555_type)pal[src[0] & 15], rgba + 0x0);
-  ARGB1555_unpack((ARGB1555_type)pal[src[0] >> 4], rgba + 0x4);
-  ARGB1555_unpack((ARGB1555_type)pal[src[1] & 15], rgba + 0x8);
-  ARGB1555_unpack((ARGB1555_type)pal[src[1] >> 4], rgba + 0xc);
+#if ARCH_X64
+static inline __m128i ARGB1555_unpack_vec(__m128i v) {
+  __m128i r = _mm_or_si128(SHR_AND(v, 7, 0xf8), SHR_AND(v, 12, 0x7));
+  __m128i g = _mm_or_si128(SHL_AND(v, 6, 0xf800), SHL_AND(v, 1, 0x700));
+  __m128i b = _mm_or_si128(SHL_AND(v, 19, 0xf80000), SHL_AND(v, 14, 0x70000));
+  __m128i a = _mm_and_si128(_mm_srai_epi32(_mm_slli_epi32(v, 16), 31),
+                            _mm_set1_epi32((int)0xff000000));
+  return _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a));
 }
+#endif
 
-static inline void ARGB1555_unpack_pal8(const uint8_t *src, const uint32_t *pal,
-                                        uint8_t *rgba) {
-  ARGB1555_unpack((ARGB1555_type)pal[src[0]], rgba + 0x0);
-  ARGB1555_unpack((ARGB1555_type)pal[src[1]], rgba + 0x4);
-  ARGB1555_unpack((ARGB1555_type)pal[src[2]], rgba + 0x8);
-  ARGB1555_unpack((ARGB1555_type)pal[src[3]], rgba + 0xc);
+#if HAVE_TEX_AVX2
+static inline TARGET_AVX2 __m256i ARGB1555_unpack_vec256(__m256i v) {
+  __m256i r = _mm256_or_si256(SHR_AND256(v, 7, 0xf8), SHR_AND256(v, 12, 0x7));
+  __m256i g =
+      _mm256_or_si256(SHL_AND256(v, 6, 0xf800), SHL_AND256(v, 1, 0x700));
+  __m256i b = _mm256_or_si256(SHL_AND256(v, 19, 0xf80000),
+                              SHL_AND256(v, 14, 0x70000));
+  __m256i a = _mm256_and_si256(_mm256_srai_epi32(_mm256_slli_epi32(v, 16), 31),
+                               _mm256_set1_epi32((int)0xff000000));
+  return _mm256_or_si256(_mm256_or_si256(r, g), _mm256_or_si256(b, a));
 }
+#endif
 
 /* RGB565 */
 typedef uint16_t RGB565_type;
@@ -98,13 +126,6 @@ static inline void RGB565_unpack(const RGB565_type src, uint8_t *rgba) {
   rgba[3] = 0xff;
 }
 
-static inline void RGB565_unpack_bitmap(const RGB565_type *src, uint8_t *rgba) {
-  RGB565_unpack(src[0], rgba + 0x0);
-  RGB565_unpack(src[1], rgba + 0x4);
-  RGB565_unpack(src[2], rgba + 0x8);
-  RGB565_unpack(src[3], rgba + 0xc);
-}
-
 static inline void RGB565_unpack_twiddled(const RGB565_type *src,
                                           uint8_t *rgba) {
   RGB565_unpack(src[0], rgba + 0x0);
@@ -113,21 +134,27 @@ static inline void RGB565_unpack_twiddled(const RGB565_type *src,
   RGB565_unpack(src[3], rgba + 0xc);
 }
 
-static inline void RGB565_unpack_pal4(const uint8_t *src, const uint32_t *pal,
-                                      uint8_t *rgba) {
-  RGB565_unpack((RGB565_type)pal[src[0] & 15], rgba + 0x0);
-  RGB565_unpack((RGB565_type)pal[src[0] >> 4], rgba + 0x4);
-  RGB565_unpack((RGB565_type)pal[src[1] & 15], rgba + 0x8);
-  RGB565_unpack((RGB565_type)pal[src[1] >> 4], rgba + 0xc);
+#if ARCH_X64
+static inline __m128i RGB565_unpack_vec(__m128i v) {
+  __m128i r = _mm_or_si128(SHR_AND(v, 8, 0xf8), SHR_AND(v, 13, 0x7));
+  __m128i g = _mm_or_si128(SHL_AND(v, 5, 0xfc00), SHR_AND(v, 1, 0x300));
+  __m128i b = _mm_or_si128(SHL_AND(v, 19, 0xf80000), SHL_AND(v, 14, 0x70000));
+  __m128i a = _mm_set1_epi32((int)0xff000000);
+  return _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a));
 }
+#endif
 
-static inline void RGB565_unpack_pal8(const uint8_t *src, const uint32_t *pal,
-                                      uint8_t *rgba) {
-  RGB565_unpack((RGB565_type)pal[src[0]], rgba + 0x0);
-  RGB565_unpack((RGB565_type)pal[src[1]], rgba + 0x4);
-  RGB565_unpack((RGB565_type)pal[src[2]], rgba + 0x8);
-  RGB565_unpack((RGB565_type)pal[src[3]], rgba + 0xc);
+#if HAVE_TEX_AVX2
+static inline TARGET_AVX2 __m256i RGB565_unpack_vec256(__m256i v) {
+  __m256i r = _mm256_or_si256(SHR_AND256(v, 8, 0xf8), SHR_AND256(v, 13, 0x7));
+  __m256i g =
+      _mm256_or_si256(SHL_AND256(v, 5, 0xfc00), SHR_AND256(v, 1, 0x300));
+  __m256i b = _mm256_or_si256(SHL_AND256(v, 19, 0xf80000),
+                              SHL_AND256(v, 14, 0x70000));
+  __m256i a = _mm256_set1_epi32((int)0xff000000);
+  return _mm256_or_si256(_mm256_or_si256(r, g), _mm256_or_si256(b, a));
 }
+#endif
 
 /* UYVY422 */
 typedef uint16_t UYVY422_type;
@@ -163,18 +190,92 @@ static inline void UYVY422_unpack(UYVY422_type src0, UYVY422_type src1,
   b[3] = 0xff;
 }
 
-static inline void UYVY422_unpack_bitmap(const UYVY422_type *src,
-                                         uint8_t *rgba) {
-  UYVY422_unpack(src[0], src[1], rgba + 0x0, rgba + 0x4);
-  UYVY422_unpack(src[2], src[3], rgba + 0x8, rgba + 0xc);
-}
-
 static inline void UYVY422_unpack_twiddled(const UYVY422_type *src,
                                            uint8_t *rgba) {
   UYVY422_unpack(src[0], src[2], rgba + 0x0, rgba + 0x8);
   UYVY422_unpack(src[1], src[3], rgba + 0x4, rgba + 0xc);
 }
 
+#if ARCH_X64
+/* signed division by 1 << n, rounding towards zero like the scalar code */
+#define DIV_POW2_EPI16(v, n)                                         \
+  _mm_srai_epi16(                                                    \
+      _mm_add_epi16(v, _mm_and_si128(_mm_srai_epi16(v, 15),          \
+                                     _mm_set1_epi16((1 << (n)) - 1))), \
+      n)
+
+/* unlike the other formats, 8 texels (4 pairs sharing u and v) are unpacked
+   at a time, using 16-bit lanes */
+static inline void UYVY422_unpack_vec(__m128i v, __m128i *lo, __m128i *hi) {
+  __m128i bias = _mm_set1_epi16(128);
+  __m128i y = _mm_srli_epi16(v, 8);
+  __m128i c = _mm_sub_epi16(_mm_and_si128(v, _mm_set1_epi16(0xff)), bias);
+
+  /* broadcast the u and v of each pair to both of its texels */
+  __m128i cu = _mm_shufflelo_epi16(c, _MM_SHUFFLE(2, 2, 0, 0));
+  cu = _mm_shufflehi_epi16(cu, _MM_SHUFFLE(2, 2, 0, 0));
+  __m128i cv = _mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 1, 1));
+  cv = _mm_shufflehi_epi16(cv, _MM_SHUFFLE(3, 3, 1, 1));
+
+  __m128i r = _mm_mullo_epi16(cv, _mm_set1_epi16(11));
+  r = _mm_add_epi16(y, DIV_POW2_EPI16(r, 3));
+  __m128i g = _mm_add_epi16(_mm_mullo_epi16(cu, _mm_set1_epi16(11)),
+                            _mm_mullo_epi16(cv, _mm_set1_epi16(22)));
+  g = _mm_sub_epi16(y, DIV_POW2_EPI16(g, 5));
+  __m128i b = _mm_mullo_epi16(cu, _mm_set1_epi16(55));
+  b = _mm_add_epi16(y, DIV_POW2_EPI16(b, 5));
+
+  /* saturating to unsigned bytes clamps each channel to [0, 255] */
+  r = _mm_packus_epi16(r, r);
+  g = _mm_packus_epi16(g, g);
+  b = _mm_packus_epi16(b, b);
+  __m128i rg = _mm_unpacklo_epi8(r, g);
+  __m128i ba = _mm_unpacklo_epi8(b, _mm_set1_epi8(-1));
+  *lo = _mm_unpacklo_epi16(rg, ba);
+  *hi = _mm_unpackhi_epi16(rg, ba);
+}
+#endif
+
+#if HAVE_TEX_AVX2
+#define DIV_POW2_EPI16_256(v, n)                                      \
+  _mm256_srai_epi16(                                                  \
+      _mm256_add_epi16(                                               \
+          v, _mm256_and_si256(_mm256_srai_epi16(v, 15),               \
+                              _mm256_set1_epi16((1 << (n)) - 1))),    \
+      n)
+
+/* the same as UYVY422_unpack_vec for each 128-bit lane, unpacking 16 texels.
+   lo and hi each hold 4 texels of both lanes */
+static inline TARGET_AVX2 void UYVY422_unpack_vec256(__m256i v, __m256i *lo,
+                                                     __m256i *hi) {
+  __m256i bias = _mm256_set1_epi16(128);
+  __m256i y = _mm256_srli_epi16(v, 8);
+  __m256i c =
+      _mm256_sub_epi16(_mm256_and_si256(v, _mm256_set1_epi16(0xff)), bias);
+
+  __m256i cu = _mm256_shufflelo_epi16(c, _MM_SHUFFLE(2, 2, 0, 0));
+  cu = _mm256_shufflehi_epi16(cu, _MM_SHUFFLE(2, 2, 0, 0));
+  __m256i cv = _mm256_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 1, 1));
+  cv = _mm256_shufflehi_epi16(cv, _MM_SHUFFLE(3, 3, 1, 1));
+
+  __m256i r = _mm256_mullo_epi16(cv, _mm256_set1_epi16(11));
+  r = _mm256_add_epi16(y, DIV_POW2_EPI16_256(r, 3));
+  __m256i g = _mm256_add_epi16(_mm256_mullo_epi16(cu, _mm256_set1_epi16(11)),
+                               _mm256_mullo_epi16(cv, _mm256_set1_epi16(22)));
+  g = _mm256_sub_epi16(y, DIV_POW2_EPI16_256(g, 5));
+  __m256i b = _mm256_mullo_epi16(cu, _mm256_set1_epi16(55));
+  b = _mm256_add_epi16(y, DIV_POW2_EPI16_256(b, 5));
+
+  r = _mm256_packus_epi16(r, r);
+  g = _mm256_packus_epi16(g, g);
+  b = _mm256_packus_epi16(b, b);
+  __m256i rg = _mm256_unpacklo_epi8(r, g);
+  __m256i ba = _mm256_unpacklo_epi8(b, _mm256_set1_epi8(-1));
+  *lo = _mm256_unpacklo_epi16(rg, ba);
+  *hi = _mm256_unpackhi_epi16(rg, ba);
+}
+#endif
+
 /* ARGB4444 */
 typedef uint16_t ARGB4444_type;
 
@@ -185,14 +286,6 @@ static inline void ARGB4444_unpack(const ARGB4444_type src, uint8_t *rgba) {
   rgba[3] = COLOR_EXTEND_4((src & 0b1111000000000000) >> 8);
 }
 
-static inline void ARGB4444_unpack_bitmap(const ARGB4444_type *src,
-                                          uint8_t *rgba) {
-  ARGB4444_unpack(src[0], rgba + 0x0);
-  ARGB4444_unpack(src[1], rgba + 0x4);
-  ARGB4444_unpack(src[2], rgba + 0x8);
-  ARGB4444_unpack(src[3], rgba + 0xc);
-}
-
 static inline void ARGB4444_unpack_twiddled(const ARGB4444_type *src,
                                             uint8_t *rgba) {
   ARGB4444_unpack(src[0], rgba + 0x0);
@@ -201,21 +294,25 @@ static inline void ARGB4444_unpack_twiddled(const ARGB4444_type *src,
   ARGB4444_unpack(src[3], rgba + 0xc);
 }
 
-static inline void ARGB4444_unpack_pal4(const uint8_t *src, const uint32_t *pal,
-                                        uint8_t *rgba) {
-  ARGB4444_unpack((ARGB4444_type)pal[src[0] & 15], rgba + 0x0);
-  ARGB4444_unpack((ARGB4444_type)pal[src[0] >> 4], rgba + 0x4);
-  ARGB4444_unpack((ARGB4444_type)pal[src[1] & 15], rgba + 0x8);
-  ARGB4444_unpack((ARGB4444_type)pal[src[1] >> 4], rgba + 0xc);
+#if ARCH_X64
+static inline __m128i ARGB4444_unpack_vec(__m128i v) {
+  /* move each nibble to the top of its channel, then repeat it below */
+  __m128i t = _mm_or_si128(
+      _mm_or_si128(SHR_AND(v, 8, 0xf), SHL_AND(v, 4, 0xf00)),
+      _mm_or_si128(SHL_AND(v, 16, 0xf0000), SHL_AND(v, 12, 0xf000000)));
+  return _mm_or_si128(t, _mm_slli_epi32(t, 4));
 }
+#endif
 
-static inline void ARGB4444_unpack_pal8(const uint8_t *src, const uint32_t *pal,
-                                        uint8_t *rgba) {
-  ARGB4444_unpack((ARGB4444_type)pal[src[0]], rgba + 0x0);
-  ARGB4444_unpack((ARGB4444_type)pal[src[1]], rgba + 0x4);
-  ARGB4444_unpack((ARGB4444_type)pal[src[2]], rgba + 0x8);
-  ARGB4444_unpack((ARGB4444_type)pal[src[3]], rgba + 0xc);
+#if HAVE_TEX_AVX2
+static inline TARGET_AVX2 __m256i ARGB4444_unpack_vec256(__m256i v) {
+  __m256i t = _mm256_or_si256(
+      _mm256_or_si256(SHR_AND256(v, 8, 0xf), SHL_AND256(v, 4, 0xf00)),
+      _mm256_or_si256(SHL_AND256(v, 16, 0xf0000),
+                      SHL_AND256(v, 12, 0xf000000)));
+  return _mm256_or_si256(t, _mm256_slli_epi32(t, 4));
 }
+#endif
 
 /* ARGB8888 */
 typedef uint32_t ARGB8888_type;
@@ -227,72 +324,167 @@ static inline void ARGB8888_unpack(ARGB8888_type src, uint8_t *rgba) {
   rgba[3] = (src >> 24) & 0xff;
 }
 
-static inline void ARGB8888_unpack_bitmap(const ARGB8888_type *src,
-                                          uint8_t *rgba) {
-  ARGB8888_unpack(src[0], rgba + 0x0);
-  ARGB8888_unpack(src[1], rgba + 0x4);
-  ARGB8888_unpack(src[2], rgba + 0x8);
-  ARGB8888_unpack(src[3], rgba + 0xc);
-}
+/*
+ * pixel rows
+ *
+ * bitmaps and twiddled textures are converted a row at a time, once the row
+ * has been detwiddled. on x64, rows of 16-bit texels are unpacked with the
+ * widest vector instructions supported by the host, with the final few texels
+ * of each row falling back to the scalar routines. sse2 is supported by every
+ * x64 processor, avx2 is detected at runtime
+ */
+static int tex_simd = -1;
 
-static inline void ARGB8888_unpack_twiddled(const ARGB8888_type *src,
-                                            uint8_t *rgba) {
-  ARGB8888_unpack(src[0], rgba + 0x0);
-  ARGB8888_unpack(src[1], rgba + 0x4);
-  ARGB8888_unpack(src[2], rgba + 0x8);
-  ARGB8888_unpack(src[3], rgba + 0xc);
+static int pvr_tex_host_simd() {
+#if HAVE_TEX_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    return PVR_SIMD_AVX2;
+  }
+#endif
+#if ARCH_X64
+  return PVR_SIMD_SSE2;
+#else
+  return PVR_SIMD_NONE;
+#endif
 }
 
-static inline void ARGB8888_unpack_pal4(const uint8_t *src, const uint32_t *pal,
-                                        uint8_t *rgba) {
-  ARGB8888_unpack((ARGB8888_type)pal[src[0] & 15], rgba + 0x0);
-  ARGB8888_unpack((ARGB8888_type)pal[src[0] >> 4], rgba + 0x4);
-  ARGB8888_unpack((ARGB8888_type)pal[src[1] & 15], rgba + 0x8);
-  ARGB8888_unpack((ARGB8888_type)pal[src[1] >> 4], rgba + 0xc);
-}
+int pvr_tex_simd() {
+  if (tex_simd < 0) {
+    tex_simd = pvr_tex_host_simd();
+  }
+  return tex_simd;
+}
+
+void pvr_tex_set_simd(int simd) {
+  tex_simd = MIN(simd, pvr_tex_host_simd());
+}
+
+/* each vector routine returns the number of texels it unpacked */
+#if ARCH_X64
+#define define_unpack_row_sse2(FROM)                                     \
+  static inline int FROM##_unpack_row_sse2(const FROM##_type *src,       \
+                                           uint8_t *rgba, int n) {       \
+    __m128i zero = _mm_setzero_si128();                                  \
+    int i = 0;                                                           \
+                                                                         \
+    for (; i + 8 <= n; i += 8) {                                         \
+      __m128i v = _mm_loadu_si128((const __m128i *)&src[i]);             \
+      __m128i lo = FROM##_unpack_vec(_mm_unpacklo_epi16(v, zero));       \
+      __m128i hi = FROM##_unpack_vec(_mm_unpackhi_epi16(v, zero));       \
+      _mm_storeu_si128((__m128i *)&rgba[i * 4], lo);                     \
+      _mm_storeu_si128((__m128i *)&rgba[i * 4 + 16], hi);                \
+    }                                                                    \
+                                                                         \
+    return i;                                                            \
+  }
 
-static inline void ARGB8888_unpack_pal8(const uint8_t *src, const uint32_t *pal,
-                                        uint8_t *rgba) {
-  ARGB8888_unpack((ARGB8888_type)pal[src[0]], rgba + 0x0);
-  ARGB8888_unpack((ARGB8888_type)pal[src[1]], rgba + 0x4);
-  ARGB8888_unpack((ARGB8888_type)pal[src[2]], rgba + 0x8);
-  ARGB8888_unpack((ARGB8888_type)pal[src[3]], rgba + 0xc);
-}
+define_unpack_row_sse2(ARGB1555);
+define_unpack_row_sse2(RGB565);
+define_unpack_row_sse2(ARGB4444);
 
-/* RGBA */
-typedef uint32_t RGBA_type;
+static inline int UYVY422_unpack_row_sse2(const UYVY422_type *src,
+                                          uint8_t *rgba, int n) {
+  int i = 0;
 
-static inline void RGBA_pack(RGBA_type *dst, uint8_t *rgba) {
-  *(uint32_t *)dst = *(uint32_t *)rgba;
-}
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)&src[i]);
+    __m128i lo, hi;
+    UYVY422_unpack_vec(v, &lo, &hi);
+    _mm_storeu_si128((__m128i *)&rgba[i * 4], lo);
+    _mm_storeu_si128((__m128i *)&rgba[i * 4 + 16], hi);
+  }
 
-static inline void RGBA_pack_bitmap(RGBA_type *dst, int x, int y, int stride,
-                                    uint8_t *rgba) {
-  RGBA_pack(&dst[y * stride + (x + 0)], rgba + 0x0);
-  RGBA_pack(&dst[y * stride + (x + 1)], rgba + 0x4);
-  RGBA_pack(&dst[y * stride + (x + 2)], rgba + 0x8);
-  RGBA_pack(&dst[y * stride + (x + 3)], rgba + 0xc);
-}
+  return i;
+}
+#endif
+
+#if HAVE_TEX_AVX2
+#define define_unpack_row_avx2(FROM)                                     \
+  static TARGET_AVX2 int FROM##_unpack_row_avx2(const FROM##_type *src,  \
+                                                uint8_t *rgba, int n) {  \
+    int i = 0;                                                           \
+                                                                         \
+    for (; i + 8 <= n; i += 8) {                                         \
+      __m128i v = _mm_loadu_si128((const __m128i *)&src[i]);             \
+      __m256i c = FROM##_unpack_vec256(_mm256_cvtepu16_epi32(v));        \
+      _mm256_storeu_si256((__m256i *)&rgba[i * 4], c);                   \
+    }                                                                    \
+                                                                         \
+    return i;                                                            \
+  }
+
+define_unpack_row_avx2(ARGB1555);
+define_unpack_row_avx2(RGB565);
+define_unpack_row_avx2(ARGB4444);
+
+static TARGET_AVX2 int UYVY422_unpack_row_avx2(const UYVY422_type *src,
+                                               uint8_t *rgba, int n) {
+  int i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)&src[i]);
+    __m256i lo, hi;
+    UYVY422_unpack_vec256(v, &lo, &hi);
+
+    /* put the 4 texel groups of each lane back in order */
+    _mm256_storeu_si256((__m256i *)&rgba[i * 4],
+                        _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i *)&rgba[i * 4 + 32],
+                        _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+
+  return i + UYVY422_unpack_row_sse2(&src[i], &rgba[i * 4], n - i);
+}
+#endif
+
+#if HAVE_TEX_AVX2
+#define unpack_row_simd(FROM, src, rgba, n)                                  \
+  (tex_simd >= PVR_SIMD_AVX2                                                 \
+       ? FROM##_unpack_row_avx2(src, rgba, n)                                \
+       : tex_simd >= PVR_SIMD_SSE2 ? FROM##_unpack_row_sse2(src, rgba, n) \
+                                   : 0)
+#elif ARCH_X64
+#define unpack_row_simd(FROM, src, rgba, n) \
+  (tex_simd >= PVR_SIMD_SSE2 ? FROM##_unpack_row_sse2(src, rgba, n) : 0)
+#else
+#define unpack_row_simd(FROM, src, rgba, n) 0
+#endif
+
+#define define_unpack_row(FROM)                                          \
+  static inline void FROM##_unpack_row(const FROM##_type *src,           \
+                                       uint8_t *rgba, int n) {           \
+    int i = unpack_row_simd(FROM, src, rgba, n);                         \
+                                                                         \
+    for (; i < n; i++) {                                                 \
+      FROM##_unpack(src[i], &rgba[i * 4]);                               \
+    }                                                                    \
+  }
+
+define_unpack_row(ARGB1555);
+define_unpack_row(RGB565);
+define_unpack_row(ARGB4444);
+
+/* texels are unpacked in pairs sharing the same u and v. note, rows of odd
+   length still read the second texel of their final pair */
+static inline void UYVY422_unpack_row(const UYVY422_type *src, uint8_t *rgba,
+                                      int n) {
+  int i = unpack_row_simd(UYVY422, src, rgba, n);
 
-static inline void RGBA_pack_twiddled(RGBA_type *dst, int x, int y, int stride,
-                                      uint8_t *rgba) {
-  RGBA_pack(&dst[(y + 0) * stride + (x + 0)], rgba + 0x0);
-  RGBA_pack(&dst[(y + 1) * stride + (x + 0)], rgba + 0x4);
-  RGBA_pack(&dst[(y + 0) * stride + (x + 1)], rgba + 0x8);
-  RGBA_pack(&dst[(y + 1) * stride + (x + 1)], rgba + 0xc);
+  for (; i < n; i += 2) {
+    uint8_t last[4];
+    uint8_t *next = i + 1 < n ? &rgba[(i + 1) * 4] : last;
+    UYVY422_unpack(src[i], src[i + 1], &rgba[i * 4], next);
+  }
 }
 
 /*
  * texture formats
  *
  * functions for converting from twiddled, compressed and paletted textures into
- * bitmaps to be registered with the render backend
+ * RGBA bitmaps to be registered with the render backend
  *
- * note, all pixel pack routines operate on 4 texels at a time, optimizing and
- * simplifying the logic for converting from twidddled and compressed textures
- * which both fundamentally work with 4 texels at a time. further, this allows
- * the UYVY422 unpacking routines (which work on 2 texels at a time) to not
- * need any additional special casing
+ * note, palettes and vq codebooks are converted to RGBA up front, leaving only
+ * a lookup to be performed for each texel
  */
 
 /* twiddled-format textures are stored in a reverse N order like:
@@ -329,109 +521,129 @@ static int pvr_twiddle_pos(int x, int y) {
   return (twitbl[x] << 1) | twitbl[y];
 }
 
-#define define_convert_bitmap(FROM, TO)                                     \
-  void convert_bitmap_##FROM##_##TO(const FROM##_type *src, TO##_type *dst, \
-                                    int width, int height, int stride) {    \
-    uint8_t rgba[4 * 4];                                                    \
+#define define_convert_bitmap(FROM)                                     \
+  void convert_bitmap_##FROM(const FROM##_type *src, uint32_t *dst,     \
+                             int width, int height, int stride) {       \
+    for (int y = 0; y < height; y++) {                                  \
+      FROM##_unpack_row(&src[y * stride], (uint8_t *)&dst[y * width],   \
+                        width);                                         \
+    }                                                                   \
+  }
+
+/* each row of a twiddled block is gathered into a linear buffer before being
+   unpacked. rows are gathered in whole pairs, so the second texel of each
+   UYVY422 pair is available when the block is 1 texel wide */
+#define define_convert_twiddled(FROM)                                       \
+  void convert_twiddled_##FROM(const FROM##_type *src, uint32_t *dst,       \
+                               int width, int height) {                     \
+    pvr_init_twiddle_table();                                               \
+                                                                            \
+    FROM##_type row[ARRAY_SIZE(twitbl)];                                    \
+    int size = MIN(width, height);                                          \
+    int base = 0;                                                           \
                                                                             \
-    for (int y = 0; y < height; y++) {                                      \
-      for (int x = 0; x < width; x += 4) {                                  \
-        FROM##_unpack_bitmap(&src[y * stride + x], rgba);                   \
-        TO##_pack_bitmap(dst, x, y, width, rgba);                           \
+    for (int y = 0; y < height; y += size) {                                \
+      for (int x = 0; x < width; x += size) {                               \
+        for (int y2 = 0; y2 < size; y2++) {                                 \
+          const FROM##_type *col = &src[base + twitbl[y2]];                 \
+          for (int x2 = 0; x2 < ALIGN_UP(size, 2); x2++) {                  \
+            row[x2] = col[twitbl[x2] << 1];                                 \
+          }                                                                 \
+          FROM##_unpack_row(row, (uint8_t *)&dst[(y + y2) * width + x],     \
+                            size);                                          \
+        }                                                                   \
+        base += size * size;                                                \
       }                                                                     \
     }                                                                       \
   }
 
-#define define_convert_twiddled(FROM, TO)                                     \
-  void convert_twiddled_##FROM##_##TO(const FROM##_type *src, TO##_type *dst, \
-                                      int width, int height) {                \
-    pvr_init_twiddle_table();                                                 \
-                                                                              \
-    uint8_t rgba[4 * 4];                                                      \
-    int size = MIN(width, height);                                            \
-    int base = 0;                                                             \
-                                                                              \
-    for (int y = 0; y < height; y += size) {                                  \
-      for (int x = 0; x < width; x += size) {                                 \
-        for (int y2 = 0; y2 < size; y2 += 2) {                                \
-          for (int x2 = 0; x2 < size; x2 += 2) {                              \
-            int pos = base + pvr_twiddle_pos(x2, y2);                         \
-            FROM##_unpack_twiddled(&src[pos], rgba);                          \
-            TO##_pack_twiddled(dst, x + x2, y + y2, width, rgba);             \
-          }                                                                   \
-        }                                                                     \
-        base += size * size;                                                  \
-      }                                                                       \
-    }                                                                         \
-  }
-
-#define define_convert_pal4(FROM, TO)                                 \
-  void convert_pal4_##FROM##_##TO(const uint8_t *src, TO##_type *dst, \
-                                  const uint32_t *palette, int width, \
-                                  int height) {                       \
-    pvr_init_twiddle_table();                                         \
-                                                                      \
-    uint8_t rgba[4 * 4];                                              \
-    int size = MIN(width, height);                                    \
-    int base = 0;                                                     \
-                                                                      \
-    for (int y = 0; y < height; y += size) {                          \
-      for (int x = 0; x < width; x += size) {                         \
-        for (int y2 = 0; y2 < size; y2 += 2) {                        \
-          for (int x2 = 0; x2 < size; x2 += 2) {                      \
-            int pos = base + pvr_twiddle_pos(x2, y2);                 \
-            FROM##_unpack_pal4(&src[pos >> 1], palette, rgba);        \
-            TO##_pack_twiddled(dst, x + x2, y + y2, width, rgba);     \
-          }                                                           \
-        }                                                             \
-        base += size * size;                                          \
-      }                                                               \
-    }                                                                 \
+#define define_convert_pal4(FROM)                                           \
+  void convert_pal4_##FROM(const uint8_t *src, uint32_t *dst,               \
+                           const uint32_t *palette, int width, int height) { \
+    pvr_init_twiddle_table();                                               \
+                                                                            \
+    uint32_t pal[16];                                                       \
+    for (int i = 0; i < ARRAY_SIZE(pal); i++) {                             \
+      FROM##_unpack((FROM##_type)palette[i], (uint8_t *)&pal[i]);           \
+    }                                                                       \
+                                                                            \
+    int size = MIN(width, height);                                          \
+    int base = 0;                                                           \
+                                                                            \
+    for (int y = 0; y < height; y += size) {                                \
+      for (int x = 0; x < width; x += size) {                               \
+        for (int y2 = 0; y2 < size; y2++) {                                 \
+          uint32_t *row = &dst[(y + y2) * width + x];                       \
+          for (int x2 = 0; x2 < size; x2++) {                               \
+            int pos = base + pvr_twiddle_pos(x2, y2);                       \
+            int shift = (pos & 1) << 2;                                     \
+            row[x2] = pal[(src[pos >> 1] >> shift) & 0xf];                  \
+          }                                                                 \
+        }                                                                   \
+        base += size * size;                                                \
+      }                                                                     \
+    }                                                                       \
   }
 
-#define define_convert_pal8(FROM, TO)                                 \
-  void convert_pal8_##FROM##_##TO(const uint8_t *src, TO##_type *dst, \
-                                  const uint32_t *palette, int width, \
-                                  int height) {                       \
-    pvr_init_twiddle_table();                                         \
-                                                                      \
-    uint8_t rgba[4 * 4];                                              \
-    int size = MIN(width, height);                                    \
-    int base = 0;                                                     \
-                                                                      \
-    for (int y = 0; y < height; y += size) {                          \
-      for (int x = 0; x < width; x += size) {                         \
-        for (int y2 = 0; y2 < size; y2 += 2) {                        \
-          for (int x2 = 0; x2 < size; x2 += 2) {                      \
-            int pos = base + pvr_twiddle_pos(x2, y2);                 \
-            FROM##_unpack_pal8(&src[pos], palette, rgba);             \
-            TO##_pack_twiddled(dst, x + x2, y + y2, width, rgba);     \
-          }                                                           \
-        }                                                             \
-        base += size * size;                                          \
-      }                                                               \
-    }                                                                 \
+#define define_convert_pal8(FROM)                                           \
+  void convert_pal8_##FROM(const uint8_t *src, uint32_t *dst,               \
+                           const uint32_t *palette, int width, int height) { \
+    pvr_init_twiddle_table();                                               \
+                                                                            \
+    uint32_t pal[256];                                                      \
+    for (int i = 0; i < ARRAY_SIZE(pal); i++) {                             \
+      FROM##_unpack((FROM##_type)palette[i], (uint8_t *)&pal[i]);           \
+    }                                                                       \
+                                                                            \
+    int size = MIN(width, height);                                          \
+    int base = 0;                                                           \
+                                                                            \
+    for (int y = 0; y < height; y += size) {                                \
+      for (int x = 0; x < width; x += size) {                               \
+        for (int y2 = 0; y2 < size; y2++) {                                 \
+          const uint8_t *col = &src[base + twitbl[y2]];                     \
+          uint32_t *row = &dst[(y + y2) * width + x];                       \
+          for (int x2 = 0; x2 < size; x2++) {                               \
+            row[x2] = pal[col[twitbl[x2] << 1]];                            \
+          }                                                                 \
+        }                                                                   \
+        base += size * size;                                                \
+      }                                                                     \
+    }                                                                       \
   }
 
-#define define_convert_vq(FROM, TO)                                          \
-  void convert_vq_##FROM##_##TO(const uint8_t *src, const uint8_t *codebook, \
-                                TO##_type *dst, int width, int height) {     \
+/* each codebook entry is a twiddled 2x2 block of texels, 4x2 bytes long. the
+   entries are unpacked up front and stored in row order, so each index in the
+   texture expands to a pair of copies */
+#define define_convert_vq(FROM)                                              \
+  void convert_vq_##FROM(const uint8_t *src, const uint8_t *codebook,        \
+                         uint32_t *dst, int width, int height) {             \
     pvr_init_twiddle_table();                                                \
                                                                              \
-    uint8_t rgba[4 * 4];                                                     \
+    uint32_t codes[256][4];                                                  \
+    for (int i = 0; i < ARRAY_SIZE(codes); i++) {                            \
+      const FROM##_type *code = (const FROM##_type *)&codebook[i * 8];       \
+      uint8_t rgba[4 * 4];                                                   \
+      FROM##_unpack_twiddled(code, rgba);                                    \
+      memcpy(&codes[i][0], rgba + 0x0, 4);                                   \
+      memcpy(&codes[i][1], rgba + 0x8, 4);                                   \
+      memcpy(&codes[i][2], rgba + 0x4, 4);                                   \
+      memcpy(&codes[i][3], rgba + 0xc, 4);                                   \
+    }                                                                        \
+                                                                             \
     int size = MIN(width, height);                                           \
     int base = 0;                                                            \
                                                                              \
     for (int y = 0; y < height; y += size) {                                 \
       for (int x = 0; x < width; x += size) {                                \
         for (int y2 = 0; y2 < size; y2 += 2) {                               \
+          uint32_t *row0 = &dst[(y + y2) * width + x];                       \
+          uint32_t *row1 = row0 + width;                                     \
           for (int x2 = 0; x2 < size; x2 += 2) {                             \
             int pos = base + pvr_twiddle_pos(x2, y2);                        \
-            /* each codebook entry is 4x2 bytes long */                      \
-            int idx = src[pos / 4] * 8;                                      \
-            const FROM##_type *code = (const FROM##_type *)&codebook[idx];   \
-            FROM##_unpack_twiddled(code, rgba);                              \
-            TO##_pack_twiddled(dst, x + x2, y + y2, width, rgba);            \
+            const uint32_t *code = codes[src[pos / 4]];                      \
+            memcpy(&row0[x2], &code[0], 8);                                  \
+            memcpy(&row1[x2], &code[2], 8);                                  \
           }                                                                  \
         }                                                                    \
         base += size * size;                                                 \
@@ -439,30 +651,30 @@ static int pvr_twiddle_pos(int x, int y) {
     }                                                                        \
   }
 
-define_convert_bitmap(ARGB1555, RGBA);
-define_convert_bitmap(RGB565, RGBA);
-define_convert_bitmap(UYVY422, RGBA);
-define_convert_bitmap(ARGB4444, RGBA);
+define_convert_bitmap(ARGB1555);
+define_convert_bitmap(RGB565);
+define_convert_bitmap(UYVY422);
+define_convert_bitmap(ARGB4444);
 
-define_convert_twiddled(ARGB1555, RGBA);
-define_convert_twiddled(RGB565, RGBA);
-define_convert_twiddled(UYVY422, RGBA);
-define_convert_twiddled(ARGB4444, RGBA);
+define_convert_twiddled(ARGB1555);
+define_convert_twiddled(RGB565);
+define_convert_twiddled(UYVY422);
+define_convert_twiddled(ARGB4444);
 
-define_convert_pal4(ARGB1555, RGBA);
-define_convert_pal4(RGB565, RGBA);
-define_convert_pal4(ARGB4444, RGBA);
-define_convert_pal4(ARGB8888, RGBA);
+define_convert_pal4(ARGB1555);
+define_convert_pal4(RGB565);
+define_convert_pal4(ARGB4444);
+define_convert_pal4(ARGB8888);
 
-define_convert_pal8(ARGB1555, RGBA);
-define_convert_pal8(RGB565, RGBA);
-define_convert_pal8(ARGB4444, RGBA);
-define_convert_pal8(ARGB8888, RGBA);
+define_convert_pal8(ARGB1555);
+define_convert_pal8(RGB565);
+define_convert_pal8(ARGB4444);
+define_convert_pal8(ARGB8888);
 
-define_convert_vq(ARGB1555, RGBA);
-define_convert_vq(RGB565, RGBA);
-define_convert_vq(ARGB4444, RGBA);
-define_convert_vq(UYVY422, RGBA);
+define_convert_vq(ARGB1555);
+define_convert_vq(RGB565);
+define_convert_vq(ARGB4444);
+define_convert_vq(UYVY422);
 
 /*
  * texture loading
@@ -581,6 +793,9 @@ void pvr_tex_decode(const uint8_t *src, int width, int height, int stride,
   int compressed = pvr_tex_compressed(texture_fmt);
   int mipmaps = pvr_tex_mipmaps(texture_fmt);
 
+  /* pick the row routines before decoding */
+  pvr_tex_simd();
+
   /* used by vq compressed textures */
   const uint8_t *codebook = src;
   const uint8_t *index = src + PVR_CODEBOOK_SIZE;
@@ -612,41 +827,41 @@ void pvr_tex_decode(const uint8_t *src, int width, int height, int stride,
     case PVR_PXL_ARGB1555:
     case PVR_PXL_RESERVED:
       if (compressed) {
-        convert_vq_ARGB1555_RGBA(index, codebook, dst32, width, height);
+        convert_vq_ARGB1555(index, codebook, dst32, width, height);
       } else if (twiddled) {
-        convert_twiddled_ARGB1555_RGBA(src16, dst32, width, height);
+        convert_twiddled_ARGB1555(src16, dst32, width, height);
       } else {
-        convert_bitmap_ARGB1555_RGBA(src16, dst32, width, height, stride);
+        convert_bitmap_ARGB1555(src16, dst32, width, height, stride);
       }
       break;
 
     case PVR_PXL_RGB565:
       if (compressed) {
-        convert_vq_RGB565_RGBA(index, codebook, dst32, width, height);
+        convert_vq_RGB565(index, codebook, dst32, width, height);
       } else if (twiddled) {
-        convert_twiddled_RGB565_RGBA(src16, dst32, width, height);
+        convert_twiddled_RGB565(src16, dst32, width, height);
       } else {
-        convert_bitmap_RGB565_RGBA(src16, dst32, width, height, stride);
+        convert_bitmap_RGB565(src16, dst32, width, height, stride);
       }
       break;
 
     case PVR_PXL_ARGB4444:
       if (compressed) {
-        convert_vq_ARGB4444_RGBA(index, codebook, dst32, width, height);
+        convert_vq_ARGB4444(index, codebook, dst32, width, height);
       } else if (twiddled) {
-        convert_twiddled_ARGB4444_RGBA(src16, dst32, width, height);
+        convert_twiddled_ARGB4444(src16, dst32, width, height);
       } else {
-        convert_bitmap_ARGB4444_RGBA(src16, dst32, width, height, stride);
+        convert_bitmap_ARGB4444(src16, dst32, width, height, stride);
       }
       break;
 
     case PVR_PXL_YUV422:
       if (compressed) {
-        convert_vq_UYVY422_RGBA(index, codebook, dst32, width, height);
+        convert_vq_UYVY422(index, codebook, dst32, width, height);
       } else if (twiddled) {
-        convert_twiddled_UYVY422_RGBA(src16, dst32, width, height);
+        convert_twiddled_UYVY422(src16, dst32, width, height);
       } else {
-        convert_bitmap_UYVY422_RGBA(src16, dst32, width, height, stride);
+        convert_bitmap_UYVY422(src16, dst32, width, height, stride);
       }
       break;
 
@@ -654,19 +869,19 @@ void pvr_tex_decode(const uint8_t *src, int width, int height, int stride,
       CHECK(!compressed);
       switch (palette_fmt) {
         case PVR_PAL_ARGB1555:
-          convert_pal4_ARGB1555_RGBA(src, dst32, pal32, width, height);
+          convert_pal4_ARGB1555(src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_RGB565:
-          convert_pal4_RGB565_RGBA(src, dst32, pal32, width, height);
+          convert_pal4_RGB565(src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_ARGB4444:
-          convert_pal4_ARGB4444_RGBA(src, dst32, pal32, width, height);
+          convert_pal4_ARGB4444(src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_ARGB8888:
-          convert_pal4_ARGB8888_RGBA(src, dst32, pal32, width, height);
+          convert_pal4_ARGB8888(src, dst32, pal32, width, height);
           break;
 
         default:
@@ -680,19 +895,19 @@ void pvr_tex_decode(const uint8_t *src, int width, int height, int stride,
       CHECK(!compressed);
       switch (palette_fmt) {
         case PVR_PAL_ARGB1555:
-          convert_pal8_ARGB1555_RGBA(src, dst32, pal32, width, height);
+          convert_pal8_ARGB1555(src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_RGB565:
-          convert_pal8_RGB565_RGBA(src, dst32, pal32, width, height);
+          convert_pal8_RGB565(src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_ARGB4444:
-          convert_pal8_ARGB4444_RGBA(src, dst32, pal32, width, height);
+          convert_pal8_ARGB4444(src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_ARGB8888:
-          convert_pal8_ARGB8888_RGBA(src, dst32, pal32, width, height);
+          convert_pal8_ARGB8888(src, dst32, pal32, width, height);
           break;
 
         default:
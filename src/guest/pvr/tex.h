@@ -31,6 +31,13 @@ enum pvr_pixel_fmt {
   PVR_PXL_RESERVED, /* treated as ARGB1555 */
 };
 
+/* vector instructions used to unpack rows of texels */
+enum pvr_simd {
+  PVR_SIMD_NONE,
+  PVR_SIMD_SSE2,
+  PVR_SIMD_AVX2,
+};
+
 enum pvr_palette_fmt {
   PVR_PAL_ARGB1555,
   PVR_PAL_RGB565,
@@ -74,6 +81,11 @@ static inline int pvr_tex_mipmaps(int texture_fmt) {
 const struct pvr_tex_header *pvr_tex_header(const uint8_t *src);
 const uint8_t *pvr_tex_data(const uint8_t *src);
 
+/* the widest instructions supported by the host are used by default. they can
+   be lowered, e.g. to compare each path against the scalar routines */
+int pvr_tex_simd();
+void pvr_tex_set_simd(int simd);
+
 void pvr_tex_decode(const uint8_t *data, int width, int height, int stride,
                     int texture_fmt, int pixel_fmt, const uint8_t *palette,
                     int pal_pixel_fmt, uint8_t *out, int size);
@@ -7,14 +7,98 @@
 
 #include "guest/pvr/tr.h"
 #include "core/core.h"
+#include "core/hash.h"
 #include "core/sort.h"
+#include "core/thread.h"
 #include "guest/pvr/ta.h"
 #include "guest/pvr/tex.h"
+#include "stats.h"
+
+/* number of threads parsing the param stream alongside the calling thread */
+#define TR_MAX_WORKERS 3
+
+/* contexts smaller than this aren't worth splitting up */
+#define TR_PARALLEL_MIN_SIZE (64 * 1024)
+
+/* initial capacity of each of the context's arrays */
+#define TR_MIN_ENTRIES 1024
+
+#define TR_RESERVE(arr, max, num)                                  \
+  do {                                                             \
+    if ((num) > (max)) {                                           \
+      (arr) = tr_grow_array((arr), &(max), (num), sizeof(*(arr))); \
+    }                                                              \
+  } while (0)
+
+/* converted textures are also cached by the contents of their source data,
+   letting textures which are re-uploaded with identical data, or duplicated
+   at multiple addresses, share a single handle */
+#define TR_CACHE_BITS 12
+
+/* everything affecting the conversion of a texture besides its source data */
+struct tr_texture_desc {
+  int texture_fmt;
+  int pixel_fmt;
+  int palette_fmt;
+  int mipmaps;
+  int width;
+  int height;
+  int stride;
+  enum filter_mode filter;
+  enum wrap_mode wrap_u;
+  enum wrap_mode wrap_v;
+};
 
-struct tr {
-  struct render_backend *r;
-  void *userdata;
-  tr_find_texture_cb find_texture;
+struct tr_cached_texture {
+  struct list_node it;
+  uint64_t hash;
+  struct tr_texture_desc desc;
+
+  /* number of texture cache entries using the handle */
+  int refs;
+};
+
+/* dirty textures are decoded ahead of time by a pool of background threads,
+   leaving only the upload to be performed when the context is converted */
+#define TR_MAX_DECODERS 2
+#define TR_MAX_STAGED 128
+
+enum {
+  TR_STAGE_QUEUED,
+  TR_STAGE_DECODING,
+  TR_STAGE_DONE,
+};
+
+struct tr_staged_texture {
+  struct list_node it;
+  int state;
+
+  /* source info */
+  struct tr_texture_desc desc;
+  const uint8_t *texture;
+  int texture_size;
+  const uint8_t *palette;
+  int palette_size;
+
+  /* copy of the source data taken when staged. the guest keeps running while
+     the texture is decoded, so the hash and decoded output must both come
+     from this copy, not guest memory. the buffer is retained between uses */
+  uint8_t *source;
+  int source_size;
+
+  /* decoded output, the buffer is retained between uses */
+  uint64_t hash;
+  uint8_t *data;
+  int data_size;
+};
+
+/* state carried between params while parsing */
+struct tr_state {
+  struct tr *tr;
+
+  /* textures have already been converted by the calling thread, only look up
+     their handles */
+  int resolved;
 
   /* current global state */
   const union vert_param *last_vertex;
@@ -28,6 +112,76 @@ struct tr {
   uint8_t sprite_offset_color[4];
 };
 
+/* a range of the param stream which is parsed independently of the others.
+   each range begins after an end of list param, at which point the only state
+   carried over from the previous range are the colors latched by the last
+   global params */
+struct tr_job {
+  const struct ta_context *ctx;
+  struct tr_state st;
+  int begin;
+  int end;
+};
+
+struct tr_worker {
+  thread_t thread;
+  mutex_t mutex;
+  cond_t cond;
+  int pending;
+  int shutdown;
+
+  struct tr_job job;
+
+  /* surfaces, vertices and lists parsed for the job, merged into the final
+     context by the calling thread */
+  struct tr_context *rc;
+};
+
+struct tr {
+  struct render_backend *r;
+  void *userdata;
+  tr_find_texture_cb find_texture;
+
+  struct tr_worker workers[TR_MAX_WORKERS];
+  int num_workers;
+  int parallel;
+
+  /* cached textures, indexed by handle */
+  struct tr_cached_texture cache[MAX_TEXTURES];
+  DECLARE_HASHTABLE(cache_htab, TR_CACHE_BITS);
+
+  /* textures being decoded ahead of time */
+  thread_t decoders[TR_MAX_DECODERS];
+  int num_decoders;
+  int decoders_shutdown;
+  mutex_t stage_mutex;
+  cond_t stage_queued_cond;
+  cond_t stage_done_cond;
+  struct list stage_queue;
+  struct list stage_free;
+  struct tr_staged_texture staged[TR_MAX_STAGED];
+
+  /* scratch space for sorting surfaces */
+  uint32_t *sort_keys;
+  uint32_t *sort_tmp_keys;
+  int *sort_tmp;
+  int max_sort;
+};
+
+static void *tr_grow_array(void *data, int *max, int num, size_t size) {
+  int new_max = MAX(*max * 2, TR_MIN_ENTRIES);
+
+  while (new_max < num) {
+    new_max *= 2;
+  }
+
+  data = realloc(data, new_max * size);
+  CHECK_NOTNULL(data);
+  *max = new_max;
+
+  return data;
+}
+
 static int compressed_mipmap_offsets[] = {
     0x00006, /* 8 x 8 */
     0x00016, /* 16 x 16 */
@@ -109,6 +263,274 @@ static inline enum shade_mode translate_shade_mode(uint32_t shade_mode) {
   return shade_modes[shade_mode];
 }
 
+static void tr_init_texture_desc(struct tr_texture_desc *desc,
+                                 const struct ta_context *ctx, union tsp tsp,
+                                 union tcw tcw) {
+  memset(desc, 0, sizeof(*desc));
+  desc->texture_fmt = ta_texture_format(tcw);
+  desc->pixel_fmt = tcw.pixel_fmt;
+  desc->palette_fmt = ctx->palette_fmt;
+  desc->mipmaps = ta_texture_mipmaps(tcw);
+  desc->width = ta_texture_width(tsp, tcw);
+  desc->height = ta_texture_height(tsp, tcw);
+  desc->stride = ta_texture_stride(tsp, tcw, ctx->stride);
+
+  /* ignore trilinear filtering for now */
+  desc->filter = tsp.filter_mode == 0 ? FILTER_NEAREST : FILTER_BILINEAR;
+  desc->wrap_u = tsp.clamp_u
+                     ? WRAP_CLAMP_TO_EDGE
+                     : (tsp.flip_u ? WRAP_MIRRORED_REPEAT : WRAP_REPEAT);
+  desc->wrap_v = tsp.clamp_v
+                     ? WRAP_CLAMP_TO_EDGE
+                     : (tsp.flip_v ? WRAP_MIRRORED_REPEAT : WRAP_REPEAT);
+}
+
+static uint64_t tr_hash_texture(const uint8_t *texture, int texture_size,
+                                const uint8_t *palette, int palette_size) {
+  uint64_t hash = 0;
+
+  if (palette) {
+    hash = hash_data(palette, palette_size, hash);
+  }
+
+  return hash_data(texture, texture_size, hash);
+}
+
+static void tr_decode_staged(struct tr_staged_texture *staged) {
+  const struct tr_texture_desc *desc = &staged->desc;
+  int size = desc->width * desc->height * 4;
+
+  if (size > staged->data_size) {
+    staged->data = realloc(staged->data, size);
+    staged->data_size = size;
+  }
+
+  staged->hash = tr_hash_texture(staged->texture, staged->texture_size,
+                                 staged->palette, staged->palette_size);
+
+  pvr_tex_decode(staged->texture, desc->width, desc->height, desc->stride,
+                 desc->texture_fmt, desc->pixel_fmt, staged->palette,
+                 desc->palette_fmt, staged->data, staged->data_size);
+}
+
+static void *tr_decoder_thread(void *data) {
+  struct tr *tr = data;
+
+  mutex_lock(tr->stage_mutex);
+
+  while (1) {
+    while (list_empty(&tr->stage_queue) && !tr->decoders_shutdown) {
+      cond_wait(tr->stage_queued_cond, tr->stage_mutex);
+    }
+
+    if (tr->decoders_shutdown) {
+      break;
+    }
+
+    struct tr_staged_texture *staged = list_first_entry(
+        &tr->stage_queue, struct tr_staged_texture, it);
+    list_remove(&tr->stage_queue, &staged->it);
+    staged->state = TR_STAGE_DECODING;
+
+    mutex_unlock(tr->stage_mutex);
+
+    tr_decode_staged(staged);
+
+    mutex_lock(tr->stage_mutex);
+
+    staged->state = TR_STAGE_DONE;
+    cond_broadcast(tr->stage_done_cond);
+  }
+
+  mutex_unlock(tr->stage_mutex);
+
+  return NULL;
+}
+
+/* wait for a staged texture to finish decoding. if a decoder hasn't picked it
+   up yet, decode it on the calling thread instead */
+static void tr_finish_staged(struct tr *tr, struct tr_staged_texture *staged) {
+  mutex_lock(tr->stage_mutex);
+
+  if (staged->state == TR_STAGE_QUEUED) {
+    list_remove(&tr->stage_queue, &staged->it);
+    staged->state = TR_STAGE_DECODING;
+
+    mutex_unlock(tr->stage_mutex);
+    tr_decode_staged(staged);
+    mutex_lock(tr->stage_mutex);
+
+    staged->state = TR_STAGE_DONE;
+  }
+
+  while (staged->state != TR_STAGE_DONE) {
+    cond_wait(tr->stage_done_cond, tr->stage_mutex);
+  }
+
+  mutex_unlock(tr->stage_mutex);
+}
+
+static void tr_discard_staged(struct tr *tr, struct tr_texture *entry) {
+  struct tr_staged_texture *staged = entry->staged;
+
+  if (!staged) {
+    return;
+  }
+
+  mutex_lock(tr->stage_mutex);
+
+  /* a queued texture can be dropped immediately, but one being decoded must
+     finish before its buffer can be reused */
+  if (staged->state == TR_STAGE_QUEUED) {
+    list_remove(&tr->stage_queue, &staged->it);
+  }
+
+  while (staged->state == TR_STAGE_DECODING) {
+    cond_wait(tr->stage_done_cond, tr->stage_mutex);
+  }
+
+  list_add(&tr->stage_free, &staged->it);
+
+  mutex_unlock(tr->stage_mutex);
+
+  entry->staged = NULL;
+}
+
+/* bitmap textures are stored row by row. if only some of their rows were
+   written, just those rows need to be converted and uploaded to the existing
+   handle, as long as it isn't shared with other entries */
+static int tr_dirty_rows(struct tr *tr, const struct tr_texture *entry,
+                         const struct tr_texture_desc *desc, int *y,
+                         int *rows) {
+  if (!entry->handle || entry->dirty_end <= entry->dirty_begin) {
+    return 0;
+  }
+
+  if (desc->texture_fmt != PVR_TEX_BITMAP || desc->mipmaps) {
+    return 0;
+  }
+
+  struct tr_cached_texture *cached = &tr->cache[entry->handle];
+
+  if (cached->refs != 1 || memcmp(&cached->desc, desc, sizeof(*desc))) {
+    return 0;
+  }
+
+  int pitch = desc->stride * 2;
+  int y0 = entry->dirty_begin / pitch;
+  int y1 = MIN((entry->dirty_end + pitch - 1) / pitch, desc->height);
+
+  if (y1 - y0 >= desc->height) {
+    return 0;
+  }
+
+  *y = y0;
+  *rows = y1 - y0;
+  return 1;
+}
+
+void tr_stage_texture(struct tr *tr, const struct ta_context *ctx,
+                      struct tr_texture *entry) {
+  /* drop any data staged for a previous registration, it may be stale */
+  tr_discard_staged(tr, entry);
+
+  if (!tr->num_decoders) {
+    return;
+  }
+
+  /* partial updates are cheap enough to be done during conversion */
+  struct tr_texture_desc desc;
+  int y, rows;
+  tr_init_texture_desc(&desc, ctx, entry->tsp, entry->tcw);
+
+  if (tr_dirty_rows(tr, entry, &desc, &y, &rows)) {
+    return;
+  }
+
+  /* if there are no free slots, the texture is decoded during conversion */
+  mutex_lock(tr->stage_mutex);
+
+  struct tr_staged_texture *staged =
+      list_first_entry(&tr->stage_free, struct tr_staged_texture, it);
+
+  if (staged) {
+    list_remove(&tr->stage_free, &staged->it);
+  }
+
+  mutex_unlock(tr->stage_mutex);
+
+  if (!staged) {
+    return;
+  }
+
+  /* the slot is owned by this thread until it's queued, copy the source data
+     without holding the lock */
+  int size = entry->texture_size + (entry->palette ? entry->palette_size : 0);
+
+  if (size > staged->source_size) {
+    staged->source = realloc(staged->source, size);
+    staged->source_size = size;
+  }
+
+  memcpy(staged->source, entry->texture, entry->texture_size);
+
+  if (entry->palette) {
+    memcpy(staged->source + entry->texture_size, entry->palette,
+           entry->palette_size);
+  }
+
+  staged->desc = desc;
+  staged->texture = staged->source;
+  staged->texture_size = entry->texture_size;
+  staged->palette = entry->palette ? staged->source + entry->texture_size : NULL;
+  staged->palette_size = entry->palette_size;
+  staged->state = TR_STAGE_QUEUED;
+
+  mutex_lock(tr->stage_mutex);
+  list_add(&tr->stage_queue, &staged->it);
+  cond_signal(tr->stage_queued_cond);
+  mutex_unlock(tr->stage_mutex);
+
+  entry->staged = staged;
+}
+
+static struct tr_cached_texture *tr_find_cached_texture(
+    struct tr *tr, uint64_t hash, const struct tr_texture_desc *desc) {
+  struct list *bkt = hash_bkt(tr->cache_htab, hash);
+
+  hash_bkt_for_each_entry(cached, bkt, struct tr_cached_texture, it) {
+    if (cached->hash == hash && !memcmp(&cached->desc, desc, sizeof(*desc))) {
+      return cached;
+    }
+  }
+
+  return NULL;
+}
+
+static void tr_release_handle(struct tr *tr, texture_handle_t handle) {
+  if (!handle) {
+    return;
+  }
+
+  struct tr_cached_texture *cached = &tr->cache[handle];
+  CHECK_GT(cached->refs, 0);
+
+  if (--cached->refs) {
+    return;
+  }
+
+  struct list *bkt = hash_bkt(tr->cache_htab, cached->hash);
+  hash_del(bkt, &cached->it);
+
+  r_destroy_texture(tr->r, handle);
+}
+
+void tr_release_texture(struct tr *tr, struct tr_texture *entry) {
+  tr_discard_staged(tr, entry);
+  tr_release_handle(tr, entry->handle);
+  entry->handle = 0;
+}
+
 static texture_handle_t tr_convert_texture(struct tr *tr,
                                            const struct ta_context *ctx,
                                            union tsp tsp, union tcw tcw) {
@@ -124,59 +546,120 @@ static texture_handle_t tr_convert_texture(struct tr *tr,
     return entry->handle;
   }
 
-  /* if there's a dirty handle, destroy it before creating the new one */
-  if (entry->handle && entry->dirty) {
-    r_destroy_texture(tr->r, entry->handle);
-    entry->handle = 0;
+  static uint8_t converted[1024 * 1024 * 4];
+  struct tr_texture_desc desc;
+  tr_init_texture_desc(&desc, ctx, tsp, tcw);
+
+  /* update just the rows written since the last conversion */
+  int y, rows;
+
+  if (tr_dirty_rows(tr, entry, &desc, &y, &rows)) {
+    const uint8_t *src = entry->texture + y * desc.stride * 2;
+    pvr_tex_decode(src, desc.width, rows, desc.stride, desc.texture_fmt,
+                   desc.pixel_fmt, entry->palette, desc.palette_fmt,
+                   converted, sizeof(converted));
+    r_update_texture(tr->r, entry->handle, PXL_RGBA, 0, y, desc.width, rows,
+                     converted);
+    prof_counter_add(COUNTER_texture_upload_bytes, desc.width * rows * 4);
+
+    /* the handle's contents changed, rehash it for future lookups */
+    struct tr_cached_texture *cached = &tr->cache[entry->handle];
+    hash_del(hash_bkt(tr->cache_htab, cached->hash), &cached->it);
+    cached->hash = tr_hash_texture(entry->texture, entry->texture_size,
+                                   entry->palette, entry->palette_size);
+    hash_add(hash_bkt(tr->cache_htab, cached->hash), &cached->it);
+
+    tr_discard_staged(tr, entry);
+    entry->dirty = 0;
+
+    return entry->handle;
   }
 
-  static uint8_t converted[1024 * 1024 * 4];
-  const uint8_t *palette = entry->palette;
-  const uint8_t *texture = entry->texture;
+  /* use the data decoded ahead of time if it was staged */
+  struct tr_staged_texture *staged = entry->staged;
+  const uint8_t *data = NULL;
+  uint64_t hash;
 
-  /* get texture dimensions */
-  int texture_fmt = ta_texture_format(tcw);
-  int mipmaps = ta_texture_mipmaps(tcw);
-  int width = ta_texture_width(tsp, tcw);
-  int height = ta_texture_height(tsp, tcw);
-  int stride = ta_texture_stride(tsp, tcw, ctx->stride);
+  if (staged) {
+    tr_finish_staged(tr, staged);
+  }
 
-  /* figure out the texture format */
-  pvr_tex_decode(texture, width, height, stride, texture_fmt, tcw.pixel_fmt,
-                 palette, ctx->palette_fmt, converted, sizeof(converted));
+  if (staged && !memcmp(&staged->desc, &desc, sizeof(desc))) {
+    data = staged->data;
+    hash = staged->hash;
+  } else {
+    hash = tr_hash_texture(entry->texture, entry->texture_size,
+                           entry->palette, entry->palette_size);
+  }
 
-  /* ignore trilinear filtering for now */
-  enum filter_mode filter =
-      tsp.filter_mode == 0 ? FILTER_NEAREST : FILTER_BILINEAR;
-  enum wrap_mode wrap_u =
-      tsp.clamp_u ? WRAP_CLAMP_TO_EDGE
-                  : (tsp.flip_u ? WRAP_MIRRORED_REPEAT : WRAP_REPEAT);
-  enum wrap_mode wrap_v =
-      tsp.clamp_v ? WRAP_CLAMP_TO_EDGE
-                  : (tsp.flip_v ? WRAP_MIRRORED_REPEAT : WRAP_REPEAT);
-
-  entry->handle = r_create_texture(tr->r, PXL_RGBA, filter, wrap_u, wrap_v,
-                                   mipmaps, width, height, converted);
-  entry->filter = filter;
-  entry->wrap_u = wrap_u;
-  entry->wrap_v = wrap_v;
-  entry->format = texture_fmt;
-  entry->width = width;
-  entry->height = height;
+  /* reuse an existing handle if the source data hasn't changed */
+  struct tr_cached_texture *cached = tr_find_cached_texture(tr, hash, &desc);
+  texture_handle_t handle;
+
+  if (cached) {
+    handle = (texture_handle_t)(cached - tr->cache);
+  } else {
+    if (!data) {
+      pvr_tex_decode(entry->texture, desc.width, desc.height, desc.stride,
+                     desc.texture_fmt, desc.pixel_fmt, entry->palette,
+                     desc.palette_fmt, converted, sizeof(converted));
+      data = converted;
+    }
+
+    handle = r_create_texture(tr->r, PXL_RGBA, desc.filter, desc.wrap_u,
+                              desc.wrap_v, desc.mipmaps, desc.width,
+                              desc.height, data);
+    prof_counter_add(COUNTER_texture_upload_bytes,
+                     desc.width * desc.height * 4);
+
+    cached = &tr->cache[handle];
+    cached->hash = hash;
+    cached->desc = desc;
+    hash_add(hash_bkt(tr->cache_htab, hash), &cached->it);
+  }
+
+  /* acquire the new handle before releasing the old one, they're often the
+     same */
+  cached->refs++;
+  tr_release_handle(tr, entry->handle);
+  tr_discard_staged(tr, entry);
+
+  entry->handle = handle;
+  entry->filter = desc.filter;
+  entry->wrap_u = desc.wrap_u;
+  entry->wrap_v = desc.wrap_v;
+  entry->format = desc.texture_fmt;
+  entry->width = desc.width;
+  entry->height = desc.height;
   entry->dirty = 0;
 
   return entry->handle;
 }
 
-static struct ta_surface *tr_reserve_surf(struct tr *tr, struct tr_context *rc,
+static texture_handle_t tr_texture_handle(struct tr_state *st,
+                                          const struct ta_context *ctx,
+                                          union tsp tsp, union tcw tcw) {
+  struct tr *tr = st->tr;
+
+  if (!st->resolved) {
+    return tr_convert_texture(tr, ctx, tsp, tcw);
+  }
+
+  struct tr_texture *entry = tr->find_texture(tr->userdata, tsp, tcw);
+  CHECK_NOTNULL(entry);
+  return entry->handle;
+}
+
+static struct ta_surface *tr_reserve_surf(struct tr_state *st,
+                                          struct tr_context *rc,
                                           int copy_from_prev) {
   int surf_index = rc->num_surfs;
 
-  CHECK_LT(surf_index, ARRAY_SIZE(rc->surfs));
+  TR_RESERVE(rc->surfs, rc->max_surfs, surf_index + 1);
   struct ta_surface *surf = &rc->surfs[surf_index];
 
-  if (copy_from_prev) {
-    CHECK(rc->num_surfs);
+  /* a job's context may not have a previous surface to copy from yet */
+  if (copy_from_prev && rc->num_surfs) {
     *surf = rc->surfs[rc->num_surfs - 1];
   } else {
     memset(surf, 0, sizeof(*surf));
@@ -188,11 +671,23 @@ static struct ta_surface *tr_reserve_surf(struct tr *tr, struct tr_context *rc,
   return surf;
 }
 
-static struct ta_vertex *tr_reserve_vert(struct tr *tr, struct tr_context *rc) {
+/* make room for the vertices about to be added to the current surface up
+   front, so the pointers returned by tr_reserve_vert remain valid while they
+   are filled out */
+static void tr_reserve_verts(struct tr_state *st, struct tr_context *rc,
+                             int num) {
+  struct ta_surface *curr_surf = &rc->surfs[rc->num_surfs];
+
+  int num_verts = rc->num_verts + curr_surf->num_verts + num;
+  TR_RESERVE(rc->verts, rc->max_verts, num_verts);
+}
+
+static struct ta_vertex *tr_reserve_vert(struct tr_state *st,
+                                         struct tr_context *rc) {
   struct ta_surface *curr_surf = &rc->surfs[rc->num_surfs];
 
   int vert_index = rc->num_verts + curr_surf->num_verts;
-  CHECK_LT(vert_index, ARRAY_SIZE(rc->verts));
+  CHECK_LT(vert_index, rc->max_verts);
   struct ta_vertex *vert = &rc->verts[vert_index];
 
   memset(vert, 0, sizeof(*vert));
@@ -202,16 +697,16 @@ static struct ta_vertex *tr_reserve_vert(struct tr *tr, struct tr_context *rc) {
   return vert;
 }
 
-static void tr_commit_surf(struct tr *tr, struct tr_context *rc) {
-  struct tr_list *list = &rc->lists[tr->list_type];
+static void tr_commit_surf(struct tr_state *st, struct tr_context *rc) {
+  struct tr_list *list = &rc->lists[st->list_type];
   struct ta_surface *new_surf = &rc->surfs[rc->num_surfs];
 
   /* track original number of surfaces, before sorting, merging, etc. */
   list->num_orig_surfs++;
 
   /* for translucent lists, commit a surf for each tri to make sorting easier */
-  if (tr->list_type == TA_LIST_TRANSLUCENT ||
-      tr->list_type == TA_LIST_PUNCH_THROUGH) {
+  if (st->list_type == TA_LIST_TRANSLUCENT ||
+      st->list_type == TA_LIST_PUNCH_THROUGH) {
     /* ignore the last two verts as polygons are fed to the TA as tristrips */
     int num_verts = new_surf->num_verts;
 
@@ -220,7 +715,7 @@ static void tr_commit_surf(struct tr *tr, struct tr_context *rc) {
       if (i == 0) {
         surf = new_surf;
       } else {
-        surf = tr_reserve_surf(tr, rc, 1);
+        surf = tr_reserve_surf(st, rc, 1);
       }
 
       /* track triangle strip offset so winding order can be consistent when
@@ -230,6 +725,7 @@ static void tr_commit_surf(struct tr *tr, struct tr_context *rc) {
       surf->num_verts = 3;
 
       /* default sort the new surface */
+      TR_RESERVE(list->surfs, list->max_surfs, list->num_surfs + 1);
       list->surfs[list->num_surfs++] = rc->num_surfs;
 
       /* commit the new surface */
@@ -243,6 +739,7 @@ static void tr_commit_surf(struct tr *tr, struct tr_context *rc) {
   /* for opaque lists, commit surface as is */
   else {
     /* default sort the new surface */
+    TR_RESERVE(list->surfs, list->max_surfs, list->num_surfs + 1);
     list->surfs[list->num_surfs++] = rc->num_surfs;
 
     /* commit the new surface */
@@ -315,10 +812,10 @@ static inline uint8_t fmulu8(uint8_t a, uint8_t b) {
   }
 
 #define PARSE_BASE_INTENSITY(base_intensity, out) \
-  PARSE_INTENSITY(tr->face_color, base_intensity, out)
+  PARSE_INTENSITY(st->face_color, base_intensity, out)
 
 #define PARSE_OFFSET_INTENSITY(offset_intensity, out) \
-  PARSE_INTENSITY(tr->face_offset_color, offset_intensity, out)
+  PARSE_INTENSITY(st->face_offset_color, offset_intensity, out)
 
 static int tr_parse_bg_vert(const struct ta_context *ctx, struct tr_context *rc,
                             int offset, struct ta_vertex *v) {
@@ -344,16 +841,16 @@ static int tr_parse_bg_vert(const struct ta_context *ctx, struct tr_context *rc,
   return offset;
 }
 
-static void tr_parse_bg(struct tr *tr, const struct ta_context *ctx,
+static void tr_parse_bg(struct tr_state *st, const struct ta_context *ctx,
                         struct tr_context *rc) {
-  tr->list_type = TA_LIST_OPAQUE;
+  st->list_type = TA_LIST_OPAQUE;
 
   /* translate the surface */
-  struct ta_surface *surf = tr_reserve_surf(tr, rc, 0);
+  struct ta_surface *surf = tr_reserve_surf(st, rc, 0);
 
   surf->params.texture =
       ctx->bg_isp.texture
-          ? tr_convert_texture(tr, ctx, ctx->bg_tsp, ctx->bg_tcw)
+          ? tr_texture_handle(st, ctx, ctx->bg_tsp, ctx->bg_tcw)
           : 0;
   surf->params.depth_write = !ctx->bg_isp.z_write_disable;
   surf->params.depth_func =
@@ -363,10 +860,11 @@ static void tr_parse_bg(struct tr *tr, const struct ta_context *ctx,
   surf->params.dst_blend = BLEND_NONE;
 
   /* translate the first 3 vertices */
-  struct ta_vertex *va = tr_reserve_vert(tr, rc);
-  struct ta_vertex *vb = tr_reserve_vert(tr, rc);
-  struct ta_vertex *vd = tr_reserve_vert(tr, rc);
-  struct ta_vertex *vc = tr_reserve_vert(tr, rc);
+  tr_reserve_verts(st, rc, 4);
+  struct ta_vertex *va = tr_reserve_vert(st, rc);
+  struct ta_vertex *vb = tr_reserve_vert(st, rc);
+  struct ta_vertex *vd = tr_reserve_vert(st, rc);
+  struct ta_vertex *vc = tr_reserve_vert(st, rc);
 
   int offset = 0;
   offset = tr_parse_bg_vert(ctx, rc, offset, va);
@@ -437,26 +935,20 @@ static void tr_parse_bg(struct tr *tr, const struct ta_context *ctx,
   vd->color = va->color;
   vd->offset_color = va->offset_color;
 
-  tr_commit_surf(tr, rc);
+  tr_commit_surf(st, rc);
 
-  tr->list_type = TA_NUM_LISTS;
+  st->list_type = TA_NUM_LISTS;
 }
 
-/* this offset color implementation is not correct at all, see the
-   Texture/Shading Instruction in the union tsp instruction word */
-static void tr_parse_poly_param(struct tr *tr, const struct ta_context *ctx,
-                                struct tr_context *rc, const uint8_t *data) {
-  const union poly_param *param = (const union poly_param *)data;
-
-  /* reset state */
-  tr->last_vertex = NULL;
-  tr->vert_type = ta_vert_type(param->type0.pcw);
-
+/* latch the colors supplied by a global param for the vertices which follow,
+   returns 0 for modifier volumes which aren't handled */
+static int tr_parse_poly_colors(struct tr_state *st,
+                                const union poly_param *param) {
   int poly_type = ta_poly_type(param->type0.pcw);
 
   if (poly_type == 6) {
     /* FIXME handle modifier volumes */
-    return;
+    return 0;
   }
 
   switch (poly_type) {
@@ -466,17 +958,17 @@ static void tr_parse_poly_param(struct tr *tr, const struct ta_context *ctx,
     } break;
 
     case 1: {
-      PARSE_FLOAT_COLOR(param->type1.face_color, &tr->face_color);
+      PARSE_FLOAT_COLOR(param->type1.face_color, &st->face_color);
     } break;
 
     case 2: {
-      PARSE_FLOAT_COLOR(param->type2.face_color, &tr->face_color);
-      PARSE_FLOAT_COLOR(param->type2.face_offset_color, &tr->face_offset_color);
+      PARSE_FLOAT_COLOR(param->type2.face_color, &st->face_color);
+      PARSE_FLOAT_COLOR(param->type2.face_offset_color, &st->face_offset_color);
     } break;
 
     case 5: {
-      PARSE_PACKED_COLOR(param->sprite.base_color, &tr->sprite_color);
-      PARSE_PACKED_COLOR(param->sprite.offset_color, &tr->sprite_offset_color);
+      PARSE_PACKED_COLOR(param->sprite.base_color, &st->sprite_color);
+      PARSE_PACKED_COLOR(param->sprite.offset_color, &st->sprite_offset_color);
     } break;
 
     default:
@@ -484,12 +976,30 @@ static void tr_parse_poly_param(struct tr *tr, const struct ta_context *ctx,
       break;
   }
 
+  return 1;
+}
+
+/* this offset color implementation is not correct at all, see the
+   Texture/Shading Instruction in the union tsp instruction word */
+static void tr_parse_poly_param(struct tr_state *st,
+                                const struct ta_context *ctx,
+                                struct tr_context *rc, const uint8_t *data) {
+  const union poly_param *param = (const union poly_param *)data;
+
+  /* reset state */
+  st->last_vertex = NULL;
+  st->vert_type = ta_vert_type(param->type0.pcw);
+
+  if (!tr_parse_poly_colors(st, param)) {
+    return;
+  }
+
   /* setup the new surface
 
      note, bits 0-3 of the global pcw override the respective bits in the global
      isp/tsp instruction word, so use the pcw for the uv_16bit, gouraud, offset,
      and texture settings */
-  struct ta_surface *surf = tr_reserve_surf(tr, rc, 0);
+  struct ta_surface *surf = tr_reserve_surf(st, rc, 0);
   surf->params.depth_write = !param->type0.isp.z_write_disable;
   surf->params.depth_func =
       translate_depth_func(param->type0.isp.depth_compare_mode);
@@ -503,33 +1013,34 @@ static void tr_parse_poly_param(struct tr *tr, const struct ta_context *ctx,
   surf->params.ignore_alpha = !param->type0.tsp.use_alpha;
   surf->params.ignore_texture_alpha = param->type0.tsp.ignore_tex_alpha;
   surf->params.offset_color = param->type0.pcw.offset;
-  surf->params.alpha_test = tr->list_type == TA_LIST_PUNCH_THROUGH;
+  surf->params.alpha_test = st->list_type == TA_LIST_PUNCH_THROUGH;
   surf->params.alpha_ref = ctx->alpha_ref;
 
   /* override a few surface parameters based on the list type */
-  if (tr->list_type != TA_LIST_TRANSLUCENT &&
-      tr->list_type != TA_LIST_TRANSLUCENT_MODVOL) {
+  if (st->list_type != TA_LIST_TRANSLUCENT &&
+      st->list_type != TA_LIST_TRANSLUCENT_MODVOL) {
     surf->params.src_blend = BLEND_NONE;
     surf->params.dst_blend = BLEND_NONE;
-  } else if ((tr->list_type == TA_LIST_TRANSLUCENT ||
-              tr->list_type == TA_LIST_TRANSLUCENT_MODVOL) &&
+  } else if ((st->list_type == TA_LIST_TRANSLUCENT ||
+              st->list_type == TA_LIST_TRANSLUCENT_MODVOL) &&
              ctx->autosort) {
     surf->params.depth_func = DEPTH_LEQUAL;
-  } else if (tr->list_type == TA_LIST_PUNCH_THROUGH) {
+  } else if (st->list_type == TA_LIST_PUNCH_THROUGH) {
     surf->params.depth_func = DEPTH_GEQUAL;
   }
 
   surf->params.texture =
       param->type0.pcw.texture
-          ? tr_convert_texture(tr, ctx, param->type0.tsp, param->type0.tcw)
+          ? tr_texture_handle(st, ctx, param->type0.tsp, param->type0.tcw)
           : 0;
 }
 
-static void tr_parse_vert_param(struct tr *tr, const struct ta_context *ctx,
+static void tr_parse_vert_param(struct tr_state *st,
+                                const struct ta_context *ctx,
                                 struct tr_context *rc, const uint8_t *data) {
   const union vert_param *param = (const union vert_param *)data;
 
-  if (tr->vert_type == 17) {
+  if (st->vert_type == 17) {
     /* FIXME handle modifier volumes */
     return;
   }
@@ -537,32 +1048,35 @@ static void tr_parse_vert_param(struct tr *tr, const struct ta_context *ctx,
   /* if there is no need to change the Global Parameters, a Vertex Parameter
      for the next polygon may be input immediately after inputting a Vertex
      Parameter for which "End of Strip" was specified */
-  if (tr->last_vertex && tr->last_vertex->type0.pcw.end_of_strip) {
-    tr_reserve_surf(tr, rc, 1);
+  if (st->last_vertex && st->last_vertex->type0.pcw.end_of_strip) {
+    tr_reserve_surf(st, rc, 1);
   }
-  tr->last_vertex = param;
+  st->last_vertex = param;
+
+  /* sprites add the most vertices for a single param */
+  tr_reserve_verts(st, rc, 4);
 
-  switch (tr->vert_type) {
+  switch (st->vert_type) {
     case 0: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
+      struct ta_vertex *vert = tr_reserve_vert(st, rc);
       PARSE_XYZ(param->type0.xyz, vert->xyz);
       PARSE_PACKED_COLOR(param->type0.base_color, &vert->color);
     } break;
 
     case 1: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
+      struct ta_vertex *vert = tr_reserve_vert(st, rc);
       PARSE_XYZ(param->type1.xyz, vert->xyz);
       PARSE_FLOAT_COLOR(param->type1.base_color, &vert->color);
     } break;
 
     case 2: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
+      struct ta_vertex *vert = tr_reserve_vert(st, rc);
       PARSE_XYZ(param->type2.xyz, vert->xyz);
       PARSE_BASE_INTENSITY(param->type2.base_intensity, &vert->color);
     } break;
 
     case 3: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
+      struct ta_vertex *vert = tr_reserve_vert(st, rc);
       PARSE_XYZ(param->type3.xyz, vert->xyz);
       PARSE_UV(param->type3.uv, vert->uv);
       PARSE_PACKED_COLOR(param->type3.base_color, &vert->color);
@@ -570,7 +1084,7 @@ static void tr_parse_vert_param(struct tr *tr, const struct ta_context *ctx,
     } break;
 
     case 4: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
+      struct ta_vertex *vert = tr_reserve_vert(st, rc);
       PARSE_XYZ(param->type4.xyz, vert->xyz);
       PARSE_UV16(param->type4.uv, vert->uv);
       PARSE_PACKED_COLOR(param->type4.base_color, &vert->color);
@@ -578,7 +1092,7 @@ static void tr_parse_vert_param(struct tr *tr, const struct ta_context *ctx,
     } break;
 
     case 5: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
+      struct ta_vertex *vert = tr_reserve_vert(st, rc);
       PARSE_XYZ(param->type5.xyz, vert->xyz);
       PARSE_UV(param->type5.uv, vert->uv);
       PARSE_FLOAT_COLOR(param->type5.base_color, &vert->color);
@@ -586,7 +1100,7 @@ static void tr_parse_vert_param(struct tr *tr, const struct ta_context *ctx,
     } break;
 
     case 6: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
+      struct ta_vertex *vert = tr_reserve_vert(st, rc);
       PARSE_XYZ(param->type6.xyz, vert->xyz);
       PARSE_UV16(param->type6.uv, vert->uv);
       PARSE_FLOAT_COLOR(param->type6.base_color, &vert->color);
@@ -594,7 +1108,7 @@ static void tr_parse_vert_param(struct tr *tr, const struct ta_context *ctx,
     } break;
 
     case 7: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
+      struct ta_vertex *vert = tr_reserve_vert(st, rc);
       PARSE_XYZ(param->type7.xyz, vert->xyz);
       PARSE_UV(param->type7.uv, vert->uv);
       PARSE_BASE_INTENSITY(param->type7.base_intensity, &vert->color);
@@ -603,7 +1117,7 @@ static void tr_parse_vert_param(struct tr *tr, const struct ta_context *ctx,
     } break;
 
     case 8: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
+      struct ta_vertex *vert = tr_reserve_vert(st, rc);
       PARSE_XYZ(param->type8.xyz, vert->xyz);
       PARSE_UV16(param->type8.uv, vert->uv);
       PARSE_BASE_INTENSITY(param->type8.base_intensity, &vert->color);
@@ -629,30 +1143,30 @@ static void tr_parse_vert_param(struct tr *tr, const struct ta_context *ctx,
        * these need to be calculated, and the quad needs to be converted into a
        * tristrip to match the rest of the ta input
        */
-      struct ta_vertex *va = tr_reserve_vert(tr, rc); /* bottom left */
-      struct ta_vertex *vb = tr_reserve_vert(tr, rc); /* top left */
-      struct ta_vertex *vd = tr_reserve_vert(tr, rc); /* bottom right */
-      struct ta_vertex *vc = tr_reserve_vert(tr, rc); /* top right */
+      struct ta_vertex *va = tr_reserve_vert(st, rc); /* bottom left */
+      struct ta_vertex *vb = tr_reserve_vert(st, rc); /* top left */
+      struct ta_vertex *vd = tr_reserve_vert(st, rc); /* bottom right */
+      struct ta_vertex *vc = tr_reserve_vert(st, rc); /* top right */
 
       PARSE_XYZ(param->sprite1.xyz[0], va->xyz);
       PARSE_UV16(param->sprite1.uv[0], va->uv);
-      va->color = *(uint32_t *)&tr->sprite_color;
-      va->offset_color = *(uint32_t *)&tr->sprite_offset_color;
+      va->color = *(uint32_t *)&st->sprite_color;
+      va->offset_color = *(uint32_t *)&st->sprite_offset_color;
 
       PARSE_XYZ(param->sprite1.xyz[1], vb->xyz);
       PARSE_UV16(param->sprite1.uv[1], vb->uv);
-      vb->color = *(uint32_t *)&tr->sprite_color;
-      vb->offset_color = *(uint32_t *)&tr->sprite_offset_color;
+      vb->color = *(uint32_t *)&st->sprite_color;
+      vb->offset_color = *(uint32_t *)&st->sprite_offset_color;
 
       PARSE_XYZ(param->sprite1.xyz[2], vc->xyz);
       PARSE_UV16(param->sprite1.uv[2], vc->uv);
-      vc->color = *(uint32_t *)&tr->sprite_color;
-      vc->offset_color = *(uint32_t *)&tr->sprite_offset_color;
+      vc->color = *(uint32_t *)&st->sprite_color;
+      vc->offset_color = *(uint32_t *)&st->sprite_offset_color;
 
       vd->xyz[0] = param->sprite1.xyz[3][0];
       vd->xyz[1] = param->sprite1.xyz[3][1];
-      vd->color = *(uint32_t *)&tr->sprite_color;
-      vd->offset_color = *(uint32_t *)&tr->sprite_offset_color;
+      vd->color = *(uint32_t *)&st->sprite_color;
+      vd->offset_color = *(uint32_t *)&st->sprite_offset_color;
 
       /* calculate the sprite's plane from the three complete vertices */
       float xyz_ba[3], xyz_bc[3];
@@ -690,7 +1204,7 @@ static void tr_parse_vert_param(struct tr *tr, const struct ta_context *ctx,
     } break;
 
     default:
-      LOG_FATAL("unsupported vertex type %d", tr->vert_type);
+      LOG_FATAL("unsupported vertex type %d", st->vert_type);
       break;
   }
 
@@ -700,15 +1214,15 @@ static void tr_parse_vert_param(struct tr *tr, const struct ta_context *ctx,
      Parameters were input, the polygon data in question is ignored and
      an interrupt signal is output */
   if (param->type0.pcw.end_of_strip) {
-    tr_commit_surf(tr, rc);
+    tr_commit_surf(st, rc);
   }
 }
 
-static void tr_parse_eol(struct tr *tr, const struct ta_context *ctx,
+static void tr_parse_eol(struct tr_state *st, const struct ta_context *ctx,
                          struct tr_context *rc, const uint8_t *data) {
-  tr->last_vertex = NULL;
-  tr->list_type = TA_NUM_LISTS;
-  tr->vert_type = TA_NUM_VERTS;
+  st->last_vertex = NULL;
+  st->list_type = TA_NUM_LISTS;
+  st->vert_type = TA_NUM_VERTS;
 }
 
 static inline int tr_can_merge_surfs(struct ta_surface *a,
@@ -716,6 +1230,23 @@ static inline int tr_can_merge_surfs(struct ta_surface *a,
   return a->params.full == b->params.full;
 }
 
+static inline void tr_write_triangle(struct tr_context *rc, int a, int b,
+                                     int c) {
+  if (rc->index_size == 2) {
+    uint16_t *indices = (uint16_t *)rc->indices + rc->num_indices;
+    indices[0] = a;
+    indices[1] = b;
+    indices[2] = c;
+  } else {
+    uint32_t *indices = (uint32_t *)rc->indices + rc->num_indices;
+    indices[0] = a;
+    indices[1] = b;
+    indices[2] = c;
+  }
+
+  rc->num_indices += 3;
+}
+
 static void tr_generate_indices(struct tr *tr, struct tr_context *rc,
                                 int list_type) {
   /* polygons are fed to the TA as triangle strips, with the vertices being fed
@@ -750,8 +1281,13 @@ static void tr_generate_indices(struct tr *tr, struct tr_context *rc,
         num_merged++;
       }
 
-      int num_indices = (surf->num_verts - 2) * 3;
-      CHECK_LT(rc->num_indices + num_indices, ARRAY_SIZE(rc->indices));
+      /* the index storage is sized for 32-bit indices, regardless of the
+         size currently in use */
+      int num_indices = rc->num_indices + (surf->num_verts - 2) * 3;
+      if (num_indices > rc->max_indices) {
+        rc->indices = tr_grow_array(rc->indices, &rc->max_indices, num_indices,
+                                    sizeof(uint32_t));
+      }
 
       for (int j = 0; j < surf->num_verts - 2; j++) {
         int strip_offset = surf->strip_offset + j;
@@ -759,13 +1295,11 @@ static void tr_generate_indices(struct tr *tr, struct tr_context *rc,
 
         /* be careful to maintain a CCW winding order */
         if (strip_offset & 1) {
-          rc->indices[rc->num_indices++] = vertex_offset + 0;
-          rc->indices[rc->num_indices++] = vertex_offset + 1;
-          rc->indices[rc->num_indices++] = vertex_offset + 2;
+          tr_write_triangle(rc, vertex_offset + 0, vertex_offset + 1,
+                            vertex_offset + 2);
         } else {
-          rc->indices[rc->num_indices++] = vertex_offset + 0;
-          rc->indices[rc->num_indices++] = vertex_offset + 2;
-          rc->indices[rc->num_indices++] = vertex_offset + 1;
+          tr_write_triangle(rc, vertex_offset + 0, vertex_offset + 2,
+                            vertex_offset + 1);
         }
       }
     }
@@ -781,47 +1315,123 @@ static void tr_generate_indices(struct tr *tr, struct tr_context *rc,
   list->num_surfs -= num_merged;
 }
 
-static int sort_tmp[TR_MAX_SURFS];
-static float sort_minz[TR_MAX_SURFS];
+static void tr_reserve_sort(struct tr *tr, int num) {
+  if (num <= tr->max_sort) {
+    return;
+  }
 
-static int tr_compare_surf(const void *a, const void *b) {
-  int i = *(const int *)a;
-  int j = *(const int *)b;
-  return sort_minz[i] <= sort_minz[j];
+  int max = tr->max_sort;
+  tr->sort_keys = tr_grow_array(tr->sort_keys, &max, num, sizeof(uint32_t));
+  max = tr->max_sort;
+  tr->sort_tmp_keys =
+      tr_grow_array(tr->sort_tmp_keys, &max, num, sizeof(uint32_t));
+  max = tr->max_sort;
+  tr->sort_tmp = tr_grow_array(tr->sort_tmp, &max, num, sizeof(int));
+  tr->max_sort = max;
 }
 
 static void tr_sort_surfaces(struct tr *tr, struct tr_context *rc,
                              int list_type) {
   struct tr_list *list = &rc->lists[list_type];
 
+  tr_reserve_sort(tr, list->num_surfs);
+
   /* sort each surface from back to front based on its minz */
   for (int i = 0; i < list->num_surfs; i++) {
-    int surf_index = list->surfs[i];
-    struct ta_surface *surf = &rc->surfs[surf_index];
-    float *minz = &sort_minz[surf_index];
-
+    struct ta_surface *surf = &rc->surfs[list->surfs[i]];
     struct ta_vertex *verts = &rc->verts[surf->first_vert];
     CHECK_EQ(surf->num_verts, 3);
 
-    *minz = MIN(verts[0].xyz[2], verts[1].xyz[2]);
-    *minz = MIN(*minz, verts[2].xyz[2]);
+    float minz = MIN(verts[0].xyz[2], verts[1].xyz[2]);
+    minz = MIN(minz, verts[2].xyz[2]);
+
+    tr->sort_keys[i] = rsort_float_key(minz);
+  }
+
+  rsort_noalloc(tr->sort_keys, list->surfs, tr->sort_tmp_keys, tr->sort_tmp,
+                list->num_surfs);
+}
+
+/* surfaces which write depth and use a strict depth test produce the same
+   results regardless of the order they're drawn in. tests which pass on
+   ties are left in place, as coplanar surfaces (e.g. decals) drawn with them
+   rely on the later surface winning */
+static inline int tr_can_reorder_surf(const struct ta_surface *surf) {
+  if (!surf->params.depth_write) {
+    return 0;
   }
 
-  msort_noalloc(list->surfs, sort_tmp, list->num_surfs, sizeof(int),
-                &tr_compare_surf);
+  switch (surf->params.depth_func) {
+    case DEPTH_LESS:
+    case DEPTH_GREATER:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static inline uint32_t tr_state_key(const struct ta_surface *surf) {
+  /* order by the parameters selecting the shader program first, then by
+     texture, and finally by the remaining fixed function state. blending is
+     always disabled for the lists being sorted */
+  uint32_t program = surf->params.shade | ((surf->params.texture != 0) << 3) |
+                     (surf->params.ignore_alpha << 4) |
+                     (surf->params.ignore_texture_alpha << 5) |
+                     (surf->params.offset_color << 6) |
+                     (surf->params.alpha_test << 7);
+  uint32_t fixed = (surf->params.depth_func << 3) | (surf->params.cull << 1) |
+                   surf->params.depth_write;
+  return (program << 20) | ((uint32_t)surf->params.texture << 7) | fixed;
+}
+
+static void tr_sort_state_run(struct tr *tr, struct tr_context *rc, int *surfs,
+                              int num_surfs) {
+  if (num_surfs < 2) {
+    return;
+  }
+
+  for (int i = 0; i < num_surfs; i++) {
+    tr->sort_keys[i] = tr_state_key(&rc->surfs[surfs[i]]);
+  }
+
+  rsort_noalloc(tr->sort_keys, surfs, tr->sort_tmp_keys, tr->sort_tmp,
+                num_surfs);
 }
 
-static void tr_reset(struct tr *tr, struct tr_context *rc) {
-  /* reset global state */
-  tr->last_vertex = NULL;
-  tr->list_type = TA_NUM_LISTS;
-  tr->vert_type = TA_NUM_VERTS;
-  memset(tr->face_color, 0, sizeof(tr->face_color));
-  memset(tr->face_offset_color, 0, sizeof(tr->face_offset_color));
-  memset(tr->sprite_color, 0, sizeof(tr->sprite_color));
-  memset(tr->sprite_offset_color, 0, sizeof(tr->sprite_offset_color));
+/* group surfaces with the same render state together, enabling more of them
+   to be merged into a single draw when generating indices. surfaces whose
+   results depend on the draw order are left in place, and act as barriers
+   which no other surface is moved across */
+static void tr_sort_state(struct tr *tr, struct tr_context *rc,
+                          int list_type) {
+  struct tr_list *list = &rc->lists[list_type];
 
-  /* reset render context state */
+  tr_reserve_sort(tr, list->num_surfs);
+
+  /* the background is always drawn first */
+  int begin = list_type == TA_LIST_OPAQUE ? 1 : 0;
+
+  for (int i = begin; i < list->num_surfs; i++) {
+    if (tr_can_reorder_surf(&rc->surfs[list->surfs[i]])) {
+      continue;
+    }
+
+    tr_sort_state_run(tr, rc, &list->surfs[begin], i - begin);
+    begin = i + 1;
+  }
+
+  tr_sort_state_run(tr, rc, &list->surfs[begin], list->num_surfs - begin);
+}
+
+static void tr_init_state(struct tr_state *st, struct tr *tr, int resolved) {
+  memset(st, 0, sizeof(*st));
+  st->tr = tr;
+  st->resolved = resolved;
+  st->list_type = TA_NUM_LISTS;
+  st->vert_type = TA_NUM_VERTS;
+}
+
+static void tr_reset_context(struct tr_context *rc) {
   rc->num_params = 0;
   rc->num_surfs = 0;
   rc->num_verts = 0;
@@ -861,7 +1471,7 @@ void tr_render_context_until(struct render_backend *r,
   int stopped = 0;
 
   r_begin_ta_surfaces(r, rc->width, rc->height, rc->verts, rc->num_verts,
-                      rc->indices, rc->num_indices);
+                      rc->indices, rc->index_size, rc->num_indices);
 
   tr_render_list(r, rc, TA_LIST_OPAQUE, end_surf, &stopped);
   tr_render_list(r, rc, TA_LIST_PUNCH_THROUGH, end_surf, &stopped);
@@ -874,37 +1484,22 @@ void tr_render_context(struct render_backend *r, const struct tr_context *rc) {
   tr_render_context_until(r, rc, -1);
 }
 
-void tr_convert_context(struct render_backend *r, void *userdata,
-                        tr_find_texture_cb find_texture,
-                        const struct ta_context *ctx, struct tr_context *rc) {
-  struct tr tr;
-  tr.r = r;
-  tr.userdata = userdata;
-  tr.find_texture = find_texture;
-
-  const uint8_t *data = ctx->params;
-  const uint8_t *end = ctx->params + ctx->size;
+static void tr_parse_params(struct tr_state *st, const struct ta_context *ctx,
+                            struct tr_context *rc, int begin, int end) {
+  const uint8_t *data = ctx->params + begin;
+  const uint8_t *data_end = ctx->params + end;
 
-  ta_init_tables();
-
-  tr_reset(&tr, rc);
-
-  rc->width = ctx->video_width;
-  rc->height = ctx->video_height;
-
-  tr_parse_bg(&tr, ctx, rc);
-
-  while (data < end) {
+  while (data < data_end) {
     union pcw pcw = *(union pcw *)data;
 
-    if (ta_pcw_list_type_valid(pcw, tr.list_type)) {
-      tr.list_type = pcw.list_type;
+    if (ta_pcw_list_type_valid(pcw, st->list_type)) {
+      st->list_type = pcw.list_type;
     }
 
     switch (pcw.para_type) {
       /* control params */
       case TA_PARAM_END_OF_LIST:
-        tr_parse_eol(&tr, ctx, rc, data);
+        tr_parse_eol(st, ctx, rc, data);
         break;
 
       case TA_PARAM_USER_TILE_CLIP:
@@ -917,33 +1512,350 @@ void tr_convert_context(struct render_backend *r, void *userdata,
       /* global params */
       case TA_PARAM_POLY_OR_VOL:
       case TA_PARAM_SPRITE:
-        tr_parse_poly_param(&tr, ctx, rc, data);
+        tr_parse_poly_param(st, ctx, rc, data);
         break;
 
       /* vertex params */
       case TA_PARAM_VERTEX:
-        tr_parse_vert_param(&tr, ctx, rc, data);
+        tr_parse_vert_param(st, ctx, rc, data);
         break;
     }
 
     /* track info about the parse state for tracer debugging */
+    TR_RESERVE(rc->params, rc->max_params, rc->num_params + 1);
     struct tr_param *rp = &rc->params[rc->num_params++];
     rp->offset = (int)(data - ctx->params);
-    rp->list_type = tr.list_type;
-    rp->vert_type = tr.vert_type;
+    rp->list_type = st->list_type;
+    rp->vert_type = st->vert_type;
     rp->last_surf = rc->num_surfs - 1;
     rp->last_vert = rc->num_verts - 1;
 
-    data += ta_param_size(pcw, tr.vert_type);
+    data += ta_param_size(pcw, st->vert_type);
+  }
+}
+
+/* walk the param stream, splitting it at list boundaries into ranges of
+   roughly equal size. only the global params are decoded, in order to capture
+   the state each range starts with and to convert each texture up front, as
+   the render backend may only be used from the calling thread */
+static int tr_split_params(struct tr *tr, const struct ta_context *ctx,
+                           struct tr_job *jobs, int max_jobs) {
+  int range_size = ctx->size / max_jobs;
+  int num_jobs = 0;
+
+  struct tr_state st;
+  tr_init_state(&st, tr, 1);
+
+  struct tr_job *job = &jobs[num_jobs++];
+  job->ctx = ctx;
+  job->st = st;
+  job->begin = 0;
+
+  int offset = 0;
+
+  while (offset < ctx->size) {
+    const uint8_t *data = &ctx->params[offset];
+    union pcw pcw = *(union pcw *)data;
+
+    switch (pcw.para_type) {
+      case TA_PARAM_END_OF_LIST:
+        tr_parse_eol(&st, ctx, NULL, data);
+        break;
+
+      case TA_PARAM_POLY_OR_VOL:
+      case TA_PARAM_SPRITE: {
+        const union poly_param *param = (const union poly_param *)data;
+
+        st.vert_type = ta_vert_type(pcw);
+
+        if (tr_parse_poly_colors(&st, param) && pcw.texture) {
+          tr_convert_texture(tr, ctx, param->type0.tsp, param->type0.tcw);
+        }
+      } break;
+
+      default:
+        break;
+    }
+
+    offset += ta_param_size(pcw, st.vert_type);
+
+    /* start a new range once this one is large enough */
+    if (pcw.para_type == TA_PARAM_END_OF_LIST && num_jobs < max_jobs &&
+        offset - job->begin >= range_size && offset < ctx->size) {
+      job->end = offset;
+
+      job = &jobs[num_jobs++];
+      job->ctx = ctx;
+      job->st = st;
+      job->begin = offset;
+    }
+  }
+
+  job->end = ctx->size;
+
+  return num_jobs;
+}
+
+/* append the surfaces, vertices and lists parsed by a job, rebasing their
+   indices to follow those already in the context */
+static void tr_merge_context(struct tr_context *rc,
+                             const struct tr_context *src) {
+  int surf_base = rc->num_surfs;
+  int vert_base = rc->num_verts;
+
+  TR_RESERVE(rc->surfs, rc->max_surfs, surf_base + src->num_surfs);
+  TR_RESERVE(rc->verts, rc->max_verts, vert_base + src->num_verts);
+  TR_RESERVE(rc->params, rc->max_params, rc->num_params + src->num_params);
+
+  for (int i = 0; i < src->num_surfs; i++) {
+    struct ta_surface *surf = &rc->surfs[surf_base + i];
+    *surf = src->surfs[i];
+    surf->first_vert += vert_base;
+  }
+  rc->num_surfs += src->num_surfs;
+
+  memcpy(&rc->verts[vert_base], src->verts,
+         src->num_verts * sizeof(struct ta_vertex));
+  rc->num_verts += src->num_verts;
+
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    struct tr_list *list = &rc->lists[i];
+    const struct tr_list *src_list = &src->lists[i];
+
+    TR_RESERVE(list->surfs, list->max_surfs,
+               list->num_surfs + src_list->num_surfs);
+
+    for (int j = 0; j < src_list->num_surfs; j++) {
+      list->surfs[list->num_surfs++] = surf_base + src_list->surfs[j];
+    }
+
+    list->num_orig_surfs += src_list->num_orig_surfs;
+  }
+
+  for (int i = 0; i < src->num_params; i++) {
+    struct tr_param *rp = &rc->params[rc->num_params++];
+    *rp = src->params[i];
+    rp->last_surf += surf_base;
+    rp->last_vert += vert_base;
+  }
+}
+
+static void *tr_worker_thread(void *data) {
+  struct tr_worker *worker = data;
+
+  mutex_lock(worker->mutex);
+
+  while (1) {
+    while (!worker->pending && !worker->shutdown) {
+      cond_wait(worker->cond, worker->mutex);
+    }
+
+    if (worker->shutdown) {
+      break;
+    }
+
+    mutex_unlock(worker->mutex);
+
+    struct tr_job *job = &worker->job;
+    tr_reset_context(worker->rc);
+    tr_parse_params(&job->st, job->ctx, worker->rc, job->begin, job->end);
+
+    mutex_lock(worker->mutex);
+
+    worker->pending = 0;
+    cond_signal(worker->cond);
+  }
+
+  mutex_unlock(worker->mutex);
+
+  return NULL;
+}
+
+static void tr_parse_parallel(struct tr *tr, const struct ta_context *ctx,
+                              struct tr_context *rc) {
+  struct tr_job jobs[TR_MAX_WORKERS + 1];
+  int num_jobs = tr_split_params(tr, ctx, jobs, tr->num_workers + 1);
+
+  /* hand off all but the first range to the workers */
+  for (int i = 1; i < num_jobs; i++) {
+    struct tr_worker *worker = &tr->workers[i - 1];
+
+    mutex_lock(worker->mutex);
+    worker->job = jobs[i];
+    worker->pending = 1;
+    cond_signal(worker->cond);
+    mutex_unlock(worker->mutex);
+  }
+
+  /* parse the first range directly into the context on this thread */
+  struct tr_job *job = &jobs[0];
+  tr_parse_params(&job->st, ctx, rc, job->begin, job->end);
+
+  /* merge the remaining ranges in order as they complete */
+  for (int i = 1; i < num_jobs; i++) {
+    struct tr_worker *worker = &tr->workers[i - 1];
+
+    mutex_lock(worker->mutex);
+    while (worker->pending) {
+      cond_wait(worker->cond, worker->mutex);
+    }
+    mutex_unlock(worker->mutex);
+
+    tr_merge_context(rc, worker->rc);
+  }
+}
+
+void tr_convert_context(struct tr *tr, const struct ta_context *ctx,
+                        struct tr_context *rc) {
+  ta_init_tables();
+
+  tr_reset_context(rc);
+
+  rc->width = ctx->video_width;
+  rc->height = ctx->video_height;
+
+  struct tr_state st;
+  tr_init_state(&st, tr, 0);
+
+  tr_parse_bg(&st, ctx, rc);
+
+  if (tr->parallel && tr->num_workers && ctx->size >= TR_PARALLEL_MIN_SIZE) {
+    tr_parse_parallel(tr, ctx, rc);
+  } else {
+    tr_parse_params(&st, ctx, rc, 0, ctx->size);
   }
 
   /* sort surfaces if requested */
   if (ctx->autosort) {
-    tr_sort_surfaces(&tr, rc, TA_LIST_TRANSLUCENT);
-    tr_sort_surfaces(&tr, rc, TA_LIST_PUNCH_THROUGH);
+    tr_sort_surfaces(tr, rc, TA_LIST_TRANSLUCENT);
+    tr_sort_surfaces(tr, rc, TA_LIST_PUNCH_THROUGH);
+  }
+
+  tr_sort_state(tr, rc, TA_LIST_OPAQUE);
+  tr_sort_state(tr, rc, TA_LIST_PUNCH_THROUGH);
+
+  /* only use 32-bit indices when the vertices can't be addressed otherwise */
+  rc->index_size = rc->num_verts > 0x10000 ? 4 : 2;
+
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    tr_generate_indices(tr, rc, i);
   }
+}
+
+void tr_set_parallel(struct tr *tr, int parallel) {
+  tr->parallel = parallel;
+}
 
+void tr_free_context(struct tr_context *rc) {
   for (int i = 0; i < TA_NUM_LISTS; i++) {
-    tr_generate_indices(&tr, rc, i);
+    free(rc->lists[i].surfs);
+  }
+
+  free(rc->params);
+  free(rc->indices);
+  free(rc->verts);
+  free(rc->surfs);
+
+  memset(rc, 0, sizeof(*rc));
+}
+
+void tr_destroy(struct tr *tr) {
+  for (int i = 0; i < tr->num_workers; i++) {
+    struct tr_worker *worker = &tr->workers[i];
+
+    mutex_lock(worker->mutex);
+    worker->shutdown = 1;
+    cond_signal(worker->cond);
+    mutex_unlock(worker->mutex);
+
+    void *result;
+    thread_join(worker->thread, &result);
+
+    cond_destroy(worker->cond);
+    mutex_destroy(worker->mutex);
+    tr_free_context(worker->rc);
+    free(worker->rc);
+  }
+
+  mutex_lock(tr->stage_mutex);
+  tr->decoders_shutdown = 1;
+  cond_broadcast(tr->stage_queued_cond);
+  mutex_unlock(tr->stage_mutex);
+
+  for (int i = 0; i < tr->num_decoders; i++) {
+    void *result;
+    thread_join(tr->decoders[i], &result);
+  }
+
+  for (int i = 0; i < TR_MAX_STAGED; i++) {
+    free(tr->staged[i].data);
+    free(tr->staged[i].source);
+  }
+
+  cond_destroy(tr->stage_done_cond);
+  cond_destroy(tr->stage_queued_cond);
+  mutex_destroy(tr->stage_mutex);
+
+  /* destroy handles still referenced by the texture cache */
+  for (int i = 0; i < MAX_TEXTURES; i++) {
+    if (tr->cache[i].refs) {
+      r_destroy_texture(tr->r, i);
+    }
   }
+
+  free(tr->sort_tmp);
+  free(tr->sort_tmp_keys);
+  free(tr->sort_keys);
+  free(tr);
+}
+
+struct tr *tr_create(struct render_backend *r, void *userdata,
+                     tr_find_texture_cb find_texture) {
+  struct tr *tr = calloc(1, sizeof(struct tr));
+
+  tr->r = r;
+  tr->userdata = userdata;
+  tr->find_texture = find_texture;
+
+  for (int i = 0; i < TR_MAX_WORKERS; i++) {
+    struct tr_worker *worker = &tr->workers[i];
+
+    worker->mutex = mutex_create();
+    worker->cond = cond_create();
+    worker->rc = calloc(1, sizeof(struct tr_context));
+    worker->thread = thread_create(&tr_worker_thread, "tr", worker);
+
+    if (!worker->thread) {
+      LOG_WARNING("tr_create failed to create worker thread");
+      cond_destroy(worker->cond);
+      mutex_destroy(worker->mutex);
+      free(worker->rc);
+      break;
+    }
+
+    tr->num_workers++;
+  }
+
+  tr->parallel = 1;
+
+  tr->stage_mutex = mutex_create();
+  tr->stage_queued_cond = cond_create();
+  tr->stage_done_cond = cond_create();
+
+  for (int i = 0; i < TR_MAX_STAGED; i++) {
+    list_add(&tr->stage_free, &tr->staged[i].it);
+  }
+
+  for (int i = 0; i < TR_MAX_DECODERS; i++) {
+    thread_t decoder = thread_create(&tr_decoder_thread, "tr decoder", tr);
+
+    if (!decoder) {
+      LOG_WARNING("tr_create failed to create decoder thread");
+      break;
+    }
+
+    tr->decoders[tr->num_decoders++] = decoder;
+  }
+
+  return tr;
 }
@@ -5,8 +5,7 @@
 #include "render/render_backend.h"
 
 struct tr;
-
-#define TR_MAX_SURFS (1024 * 64)
+struct tr_staged_texture;
 
 typedef uint64_t tr_texture_key_t;
 
@@ -16,6 +15,11 @@ struct tr_texture {
   unsigned frame;
   int dirty;
 
+  /* range of source bytes written since the last conversion, an empty range
+     means the entire texture is dirty */
+  int dirty_begin;
+  int dirty_end;
+
   /* source info */
   const uint8_t *texture;
   int texture_size;
@@ -30,6 +34,9 @@ struct tr_texture {
   int width;
   int height;
   texture_handle_t handle;
+
+  /* source data being decoded ahead of conversion */
+  struct tr_staged_texture *staged;
 };
 
 struct tr_param {
@@ -46,45 +53,78 @@ struct tr_param {
 };
 
 struct tr_list {
-  int surfs[TR_MAX_SURFS];
+  int *surfs;
   int num_surfs;
+  int max_surfs;
 
   /* debug info */
   int num_orig_surfs;
 };
 
+/* the arrays in the context are grown as needed and retained between frames,
+   a zero-initialized context is valid and must be freed with
+   tr_free_context */
 struct tr_context {
   /* original video dimensions, needed to project surfaces correctly */
   int width;
   int height;
 
   /* parsed surfaces and vertices, ready to be passed to the render backend */
-  struct ta_surface surfs[TR_MAX_SURFS];
+  struct ta_surface *surfs;
   int num_surfs;
+  int max_surfs;
 
-  struct ta_vertex verts[TR_MAX_SURFS];
+  struct ta_vertex *verts;
   int num_verts;
+  int max_verts;
 
-  uint16_t indices[TR_MAX_SURFS * 3];
+  /* indices are 16-bit, unless there are too many vertices to address */
+  void *indices;
+  int index_size;
   int num_indices;
+  int max_indices;
 
   /* sorted list of surfaces corresponding to each of the ta's polygon lists */
   struct tr_list lists[TA_NUM_LISTS];
 
   /* debug structures for stepping through the param stream in the tracer */
-  struct tr_param params[TA_MAX_PARAMS];
+  struct tr_param *params;
   int num_params;
+  int max_params;
 };
 
 static inline tr_texture_key_t tr_texture_key(union tsp tsp, union tcw tcw) {
   return ((uint64_t)tsp.full << 32) | tcw.full;
 }
 
+/* large contexts are parsed by multiple threads, textures are converted on
+   the calling thread up front, after which the callback may be invoked
+   concurrently from the worker threads to look up their handles */
 typedef struct tr_texture *(*tr_find_texture_cb)(void *, union tsp, union tcw);
 
-void tr_convert_context(struct render_backend *r, void *userdata,
-                        tr_find_texture_cb find_texture,
-                        const struct ta_context *ctx, struct tr_context *rc);
+struct tr *tr_create(struct render_backend *r, void *userdata,
+                     tr_find_texture_cb find_texture);
+void tr_destroy(struct tr *tr);
+
+/* parsing large contexts in parallel is enabled by default. the results are
+   identical either way, disabling it gives a serial parse to compare against */
+void tr_set_parallel(struct tr *tr, int parallel);
+
+/* dirty textures can be staged when their source is registered, decoding them
+   on a background thread while the context waits to be converted. this may be
+   called from a thread other than the one converting contexts, as long as the
+   two are synchronized such that it isn't called during a conversion */
+void tr_stage_texture(struct tr *tr, const struct ta_context *ctx,
+                      struct tr_texture *entry);
+
+/* converted textures may be shared between multiple texture cache entries,
+   entries release their handle and staged data through here instead of
+   destroying the handle directly */
+void tr_release_texture(struct tr *tr, struct tr_texture *entry);
+
+void tr_convert_context(struct tr *tr, const struct ta_context *ctx,
+                        struct tr_context *rc);
+void tr_free_context(struct tr_context *rc);
 void tr_render_context(struct render_backend *r, const struct tr_context *rc);
 void tr_render_context_until(struct render_backend *r,
                              const struct tr_context *rc, int end_surf);
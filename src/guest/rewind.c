@@ -0,0 +1,377 @@
+/*
+ * rewind buffer
+ *
+ * a snapshot of the machine is pushed each frame, and popped to step the
+ * machine backwards in time
+ *
+ * in order to keep the per-frame cost low, only the pages of physical memory
+ * written since the previous snapshot are saved. a shadow copy of physical
+ * memory and of the device state at the newest snapshot (the head) is
+ * maintained, and each entry pushed to the ring buffer is an undo record,
+ * containing the shadow's previous contents for each page about to be updated.
+ * the device state is delta encoded against the head in the same manner, using
+ * fixed size chunks
+ *
+ * the ring buffer is bounded by the configured budget, with the oldest entries
+ * being evicted to make room for new ones
+ */
+
+#include "guest/rewind.h"
+#include "core/core.h"
+#include "guest/dreamcast.h"
+#include "guest/memory.h"
+#include "guest/pvr/pvr.h"
+
+#define REWIND_CHUNK_SIZE 512
+#define REWIND_MAX_ENTRIES 65536
+
+/* each entry is followed by its page and chunk indices, and then the data for
+   each of them */
+struct rewind_entry {
+  int num_pages;
+  int num_chunks;
+  int state_size;
+};
+
+struct rewind {
+  struct dreamcast *dc;
+  struct memory *mem;
+  int tracking;
+  int page_size;
+  int num_pages;
+
+  /* physical memory and device state at the head */
+  int has_head;
+  uint8_t *shadow;
+  uint8_t *state;
+  int state_size;
+  int max_state_size;
+
+  /* scratch buffers */
+  uint8_t *next_state;
+  int *pages;
+  int *chunks;
+
+  /* ring buffer of undo entries */
+  uint8_t *buffer;
+  int buffer_size;
+  int write_offset;
+  int entries[REWIND_MAX_ENTRIES];
+  int first_entry;
+  int num_entries;
+};
+
+static uint8_t *rewind_shadow_page(struct rewind *rw, int page) {
+  return rw->shadow + page * rw->page_size;
+}
+
+static void rewind_write_page(struct rewind *rw, int page,
+                              const uint8_t *data) {
+  uint8_t *ptr = mem_page(rw->mem, page);
+  uint8_t *vram = mem_vram(rw->mem, 0);
+
+  /* restoring memory bypasses the pvr's tracking of vram writes. mark the
+     page and write it through the tracked mapping, like the pvr itself */
+  if (ptr >= vram && ptr < vram + PVR_VRAM_SIZE) {
+    uint32_t addr = (uint32_t)(ptr - vram);
+    pvr_vram_mark_dirty(rw->dc->pvr, addr, rw->page_size);
+    ptr = mem_tracked_vram(rw->mem, addr);
+  }
+
+  memcpy(ptr, data, rw->page_size);
+}
+
+static int rewind_chunk_size(int offset, int size) {
+  return MIN(REWIND_CHUNK_SIZE, size - offset);
+}
+
+static int rewind_dirty_pages(struct rewind *rw) {
+  /* copy off the tracked pages, the list may grow as pages are restored */
+  if (rw->tracking) {
+    const int *pages;
+    int num_pages = mem_dirty_pages(rw->mem, &pages);
+    memcpy(rw->pages, pages, num_pages * sizeof(int));
+    return num_pages;
+  }
+
+  /* fall back to comparing each page against the shadow copy */
+  int num_pages = 0;
+
+  for (int i = 0; i < rw->num_pages; i++) {
+    if (memcmp(mem_page(rw->mem, i), rewind_shadow_page(rw, i),
+               rw->page_size)) {
+      rw->pages[num_pages++] = i;
+    }
+  }
+
+  return num_pages;
+}
+
+static int rewind_dirty_chunks(struct rewind *rw, int next_size) {
+  int num_chunks = 0;
+
+  for (int offset = 0; offset < rw->state_size; offset += REWIND_CHUNK_SIZE) {
+    int len = rewind_chunk_size(offset, rw->state_size);
+
+    if (offset + len > next_size ||
+        memcmp(rw->state + offset, rw->next_state + offset, len)) {
+      rw->chunks[num_chunks++] = offset / REWIND_CHUNK_SIZE;
+    }
+  }
+
+  return num_chunks;
+}
+
+static void rewind_reset(struct rewind *rw) {
+  rw->write_offset = 0;
+  rw->first_entry = 0;
+  rw->num_entries = 0;
+}
+
+static void rewind_evict(struct rewind *rw) {
+  rw->first_entry = (rw->first_entry + 1) % REWIND_MAX_ENTRIES;
+  rw->num_entries--;
+}
+
+static int rewind_oldest_offset(struct rewind *rw) {
+  return rw->entries[rw->first_entry];
+}
+
+static uint8_t *rewind_alloc_entry(struct rewind *rw, int size) {
+  if (size > rw->buffer_size) {
+    return NULL;
+  }
+
+  if (rw->num_entries == REWIND_MAX_ENTRIES) {
+    rewind_evict(rw);
+  }
+
+  int offset = rw->write_offset;
+
+  /* entries are contiguous, if this one doesn't fit at the end of the buffer,
+     evict the entries remaining there and wrap around */
+  if (offset + size > rw->buffer_size) {
+    while (rw->num_entries && rewind_oldest_offset(rw) >= offset) {
+      rewind_evict(rw);
+    }
+
+    offset = 0;
+  }
+
+  /* evict the oldest entries until there is enough room */
+  while (rw->num_entries && rewind_oldest_offset(rw) >= offset &&
+         rewind_oldest_offset(rw) < offset + size) {
+    rewind_evict(rw);
+  }
+
+  int idx = (rw->first_entry + rw->num_entries) % REWIND_MAX_ENTRIES;
+  rw->entries[idx] = offset;
+  rw->num_entries++;
+  rw->write_offset = offset + size;
+
+  return rw->buffer + offset;
+}
+
+static void rewind_swap_state(struct rewind *rw, int state_size) {
+  uint8_t *tmp = rw->state;
+  rw->state = rw->next_state;
+  rw->next_state = tmp;
+  rw->state_size = state_size;
+}
+
+static void rewind_revert(struct rewind *rw) {
+  /* revert any changes made to memory since the head */
+  int num_pages = rewind_dirty_pages(rw);
+
+  for (int i = 0; i < num_pages; i++) {
+    int page = rw->pages[i];
+    rewind_write_page(rw, page, rewind_shadow_page(rw, page));
+  }
+}
+
+static void rewind_load_head(struct rewind *rw) {
+  int res = dc_load_device_state(rw->dc, rw->state, rw->state_size);
+  CHECK(res);
+
+  mem_reset_tracking(rw->mem);
+}
+
+void rewind_restore(struct rewind *rw) {
+  if (!rw->has_head) {
+    return;
+  }
+
+  rewind_revert(rw);
+  rewind_load_head(rw);
+}
+
+int rewind_pop(struct rewind *rw) {
+  if (!rw->has_head) {
+    return 0;
+  }
+
+  rewind_revert(rw);
+
+  /* step the head back by applying the newest undo entry to it */
+  int popped = 0;
+
+  if (rw->num_entries) {
+    int idx = (rw->first_entry + rw->num_entries - 1) % REWIND_MAX_ENTRIES;
+    uint8_t *ptr = rw->buffer + rw->entries[idx];
+    struct rewind_entry *entry = (struct rewind_entry *)ptr;
+    const int *pages = (const int *)(entry + 1);
+    const int *chunks = pages + entry->num_pages;
+    const uint8_t *data = (const uint8_t *)(chunks + entry->num_chunks);
+
+    for (int i = 0; i < entry->num_pages; i++) {
+      int page = pages[i];
+      memcpy(rewind_shadow_page(rw, page), data, rw->page_size);
+      rewind_write_page(rw, page, data);
+      data += rw->page_size;
+    }
+
+    for (int i = 0; i < entry->num_chunks; i++) {
+      int offset = chunks[i] * REWIND_CHUNK_SIZE;
+      int len = rewind_chunk_size(offset, entry->state_size);
+      memcpy(rw->state + offset, data, len);
+      data += len;
+    }
+
+    rw->state_size = entry->state_size;
+    rw->write_offset = rw->entries[idx];
+    rw->num_entries--;
+
+    popped = 1;
+  }
+
+  rewind_load_head(rw);
+
+  return popped;
+}
+
+static void rewind_push_entry(struct rewind *rw, int num_pages,
+                              int state_size) {
+  int num_chunks = rewind_dirty_chunks(rw, state_size);
+
+  int size = (int)sizeof(struct rewind_entry) +
+             (num_pages + num_chunks) * (int)sizeof(int) +
+             num_pages * rw->page_size;
+
+  for (int i = 0; i < num_chunks; i++) {
+    int offset = rw->chunks[i] * REWIND_CHUNK_SIZE;
+    size += rewind_chunk_size(offset, rw->state_size);
+  }
+
+  size = ALIGN_UP(size, 8);
+
+  uint8_t *ptr = rewind_alloc_entry(rw, size);
+
+  if (ptr) {
+    struct rewind_entry *entry = (struct rewind_entry *)ptr;
+    entry->num_pages = num_pages;
+    entry->num_chunks = num_chunks;
+    entry->state_size = rw->state_size;
+
+    int *pages = (int *)(entry + 1);
+    int *chunks = pages + num_pages;
+    uint8_t *data = (uint8_t *)(chunks + num_chunks);
+
+    memcpy(pages, rw->pages, num_pages * sizeof(int));
+    memcpy(chunks, rw->chunks, num_chunks * sizeof(int));
+
+    for (int i = 0; i < num_pages; i++) {
+      memcpy(data, rewind_shadow_page(rw, rw->pages[i]), rw->page_size);
+      data += rw->page_size;
+    }
+
+    for (int i = 0; i < num_chunks; i++) {
+      int offset = rw->chunks[i] * REWIND_CHUNK_SIZE;
+      int len = rewind_chunk_size(offset, rw->state_size);
+      memcpy(data, rw->state + offset, len);
+      data += len;
+    }
+  } else {
+    /* the delta doesn't fit in the buffer at all, the previous snapshots
+       can no longer be reached */
+    LOG_WARNING("rewind_push %d byte snapshot exceeds budget, dropping history",
+                size);
+    rewind_reset(rw);
+  }
+}
+
+void rewind_push(struct rewind *rw) {
+  int state_size =
+      dc_save_device_state(rw->dc, rw->next_state, rw->max_state_size);
+  CHECK(state_size);
+
+  /* the first snapshot initializes the head */
+  if (!rw->has_head) {
+    for (int i = 0; i < rw->num_pages; i++) {
+      memcpy(rewind_shadow_page(rw, i), mem_page(rw->mem, i), rw->page_size);
+    }
+
+    rewind_swap_state(rw, state_size);
+    rw->has_head = 1;
+
+    mem_reset_tracking(rw->mem);
+    return;
+  }
+
+  int num_pages = rewind_dirty_pages(rw);
+
+  /* without a budget, only the head is maintained */
+  if (rw->buffer_size) {
+    rewind_push_entry(rw, num_pages, state_size);
+  }
+
+  /* advance the head */
+  for (int i = 0; i < num_pages; i++) {
+    int page = rw->pages[i];
+    memcpy(rewind_shadow_page(rw, page), mem_page(rw->mem, page),
+           rw->page_size);
+  }
+
+  rewind_swap_state(rw, state_size);
+
+  mem_reset_tracking(rw->mem);
+}
+
+void rewind_destroy(struct rewind *rw) {
+  mem_stop_tracking(rw->mem);
+
+  free(rw->buffer);
+  free(rw->chunks);
+  free(rw->pages);
+  free(rw->next_state);
+  free(rw->state);
+  free(rw->shadow);
+  free(rw);
+}
+
+struct rewind *rewind_create(struct dreamcast *dc, int budget) {
+  struct rewind *rw = calloc(1, sizeof(struct rewind));
+
+  rw->dc = dc;
+  rw->mem = dc->mem;
+  rw->page_size = mem_page_size(rw->mem);
+  rw->num_pages = mem_num_pages(rw->mem);
+  rw->tracking = mem_start_tracking(rw->mem);
+
+  if (!rw->tracking) {
+    LOG_INFO("rewind_create dirty page tracking unavailable, falling back to "
+             "comparing memory");
+  }
+
+  rw->shadow = malloc(rw->num_pages * rw->page_size);
+  rw->max_state_size = dc_device_state_size(dc);
+  rw->state = malloc(rw->max_state_size);
+  rw->next_state = malloc(rw->max_state_size);
+  rw->pages = malloc(rw->num_pages * sizeof(int));
+  rw->chunks =
+      malloc((rw->max_state_size / REWIND_CHUNK_SIZE + 1) * sizeof(int));
+
+  rw->buffer_size = budget;
+  rw->buffer = malloc(rw->buffer_size);
+
+  return rw;
+}
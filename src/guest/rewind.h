@@ -0,0 +1,14 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+struct dreamcast;
+struct rewind;
+
+struct rewind *rewind_create(struct dreamcast *dc, int budget);
+void rewind_destroy(struct rewind *rw);
+
+void rewind_push(struct rewind *rw);
+int rewind_pop(struct rewind *rw);
+void rewind_restore(struct rewind *rw);
+
+#endif
@@ -2,6 +2,7 @@
 #include "core/filesystem.h"
 #include "guest/dreamcast.h"
 #include "guest/memory.h"
+#include "guest/state.h"
 
 #define FLASH_SECTOR_SIZE 0x4000
 
@@ -97,6 +98,15 @@ static void flash_cmd_erase_sector(struct flash *flash, uint32_t addr) {
   flash_erase(flash, addr, FLASH_SECTOR_SIZE);
 }
 
+static void flash_serialize(struct device *dev, struct state *s) {
+  struct flash *flash = (struct flash *)dev;
+
+  /* the rom contents are persisted to disk on each write and are intentionally
+     not restored, keeping them in sync with flash.bin */
+  STATE_FIELD(s, flash->cmd);
+  STATE_FIELD(s, flash->cmd_state);
+}
+
 static int flash_init(struct device *dev) {
   struct flash *flash = (struct flash *)dev;
 
@@ -203,5 +213,9 @@ struct flash *flash_create(struct dreamcast *dc) {
   struct flash *flash =
       dc_create_device(dc, sizeof(struct flash), "flash", &flash_init, NULL);
 
+  /* setup state interface */
+  flash->stateif.enabled = 1;
+  flash->stateif.serialize = &flash_serialize;
+
   return flash;
 }
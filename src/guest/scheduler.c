@@ -3,6 +3,7 @@
 #include "core/core.h"
 #include "core/list.h"
 #include "guest/dreamcast.h"
+#include "guest/state.h"
 
 #define MAX_TIMERS 128
 
@@ -20,6 +21,10 @@ struct scheduler {
   struct list free_timers;
   struct list live_timers;
   int64_t base_time;
+
+  /* the slice currently being ran, and the device running it */
+  int64_t slice_start;
+  struct device *running_dev;
 };
 
 void sched_cancel_timer(struct scheduler *sched, struct timer *timer) {
@@ -32,6 +37,24 @@ void sched_cancel_timer(struct scheduler *sched, struct timer *timer) {
   list_add(&sched->free_timers, &timer->it);
 }
 
+int64_t sched_current_time(struct scheduler *sched) {
+  return sched->base_time;
+}
+
+/* base_time is moved to the end of each slice before devices run it. while
+   running, the time a device has actually reached is the start of the slice
+   plus the time it has executed so far */
+int64_t sched_device_time(struct scheduler *sched) {
+  struct device *dev = sched->running_dev;
+
+  if (!dev || !dev->runif.elapsed) {
+    return sched->base_time;
+  }
+
+  int64_t elapsed = dev->runif.elapsed(dev);
+  return MIN(sched->slice_start + elapsed, sched->base_time);
+}
+
 int64_t sched_remaining_time(struct scheduler *sched, struct timer *timer) {
   return timer->expire - sched->base_time;
 }
@@ -82,15 +105,19 @@ void sched_tick(struct scheduler *sched, int64_t ns) {
     /* update base time before running devices and expiring timers in case one
        of them schedules a new timer */
     int64_t slice = next_time - sched->base_time;
+    sched->slice_start = sched->base_time;
     sched->base_time += slice;
 
     /* execute each device */
     list_for_each_entry(dev, &sched->dc->devices, struct device, it) {
       if (dev->runif.enabled && dev->runif.running) {
+        sched->running_dev = dev;
         dev->runif.run(dev, slice);
       }
     }
 
+    sched->running_dev = NULL;
+
     /* execute expired timers */
     while (1) {
       struct timer *timer =
@@ -108,6 +135,27 @@ void sched_tick(struct scheduler *sched, int64_t ns) {
   }
 }
 
+void sched_serialize(struct scheduler *sched, struct state *s) {
+  STATE_FIELD(s, sched->base_time);
+
+  if (!state_loading(s) || s->error) {
+    return;
+  }
+
+  /* timers are owned and serialized by each device, cancel all live timers
+     so they may be rearmed relative to the restored base time */
+  while (1) {
+    struct timer *timer =
+        list_first_entry(&sched->live_timers, struct timer, it);
+
+    if (!timer) {
+      break;
+    }
+
+    sched_cancel_timer(sched, timer);
+  }
+}
+
 void sched_destroy(struct scheduler *sch) {
   free(sch);
 }
@@ -4,6 +4,7 @@
 #include "guest/dreamcast.h"
 #include "guest/memory.h"
 #include "guest/scheduler.h"
+#include "guest/state.h"
 #include "imgui.h"
 #include "jit/frontend/sh4/sh4_fallback.h"
 #include "jit/frontend/sh4/sh4_frontend.h"
@@ -169,11 +170,20 @@ static void sh4_run(struct device *dev, int64_t ns) {
   int cycles = (int)NANO_TO_CYCLES(ns, SH4_CLOCK_FREQ);
   cycles = MAX(cycles, 1);
 
+  sh4->slice_cycles = cycles;
   jit_run(sh4->jit, cycles);
 
   prof_counter_add(COUNTER_sh4_instrs, sh4->ctx.ran_instrs);
 }
 
+static int64_t sh4_elapsed(struct device *dev) {
+  struct sh4 *sh4 = (struct sh4 *)dev;
+
+  /* the jit counts run_cycles down as each block is entered */
+  int cycles = sh4->slice_cycles - sh4->ctx.run_cycles;
+  return CYCLES_TO_NANO(cycles, SH4_CLOCK_FREQ);
+}
+
 static void sh4_guest_destroy(struct jit_guest *guest) {
   free((struct sh4_guest *)guest);
 }
@@ -216,6 +226,45 @@ static struct jit_guest *sh4_guest_create(struct sh4 *sh4) {
   return (struct jit_guest *)guest;
 }
 
+static void sh4_serialize(struct device *dev, struct state *s) {
+  struct sh4 *sh4 = (struct sh4 *)dev;
+
+  STATE_FIELD(s, sh4->runif.running);
+  STATE_FIELD(s, sh4->ctx);
+  STATE_FIELD(s, sh4->reg);
+  STATE_FIELD(s, sh4->sq);
+
+  /* the sorted interrupt ids are saved as-is, as requested_interrupts is
+     encoded relative to them */
+  STATE_FIELD(s, sh4->sorted_interrupts);
+  STATE_FIELD(s, sh4->sort_id);
+  STATE_FIELD(s, sh4->priority_mask);
+  STATE_FIELD(s, sh4->requested_interrupts);
+
+  STATE_FIELD(s, sh4->utlb_sq_map);
+  STATE_FIELD(s, sh4->utlb);
+
+  STATE_FIELD(s, sh4->SCFSR2_last_read);
+  STATE_FIELD(s, sh4->receive_fifo);
+  STATE_FIELD(s, sh4->transmit_fifo);
+
+  sh4_tmu_serialize(sh4, s);
+
+  /* previously compiled code may not match the restored memory. when memory
+     is left in place (e.g. when rewinding), the code is only discarded if it
+     was already invalidated since the state was saved */
+  uint32_t code_gen = sh4->jit->code_gen;
+  STATE_FIELD(s, code_gen);
+
+  if (state_loading(s) && !s->error) {
+    if (s->with_mem || code_gen != sh4->jit->code_gen) {
+      jit_free_code(sh4->jit);
+    }
+
+    sh4_intc_update_pending(sh4);
+  }
+}
+
 static int sh4_init(struct device *dev) {
   struct sh4 *sh4 = (struct sh4 *)dev;
   struct dreamcast *dc = sh4->dc;
@@ -344,6 +393,11 @@ struct sh4 *sh4_create(struct dreamcast *dc) {
   /* setup run interface */
   sh4->runif.enabled = 1;
   sh4->runif.run = &sh4_run;
+  sh4->runif.elapsed = &sh4_elapsed;
+
+  /* setup state interface */
+  sh4->stateif.enabled = 1;
+  sh4->stateif.serialize = &sh4_serialize;
 
   return sh4;
 }
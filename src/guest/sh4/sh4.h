@@ -43,6 +43,9 @@ struct sh4 {
   struct jit_frontend *frontend;
   struct jit_backend *backend;
 
+  /* cycles requested by the current sh4_run call */
+  int slice_cycles;
+
   /* dbg */
   int log_regs;
   int tmu_stats;
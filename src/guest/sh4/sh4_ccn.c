@@ -57,7 +57,19 @@ void sh4_ccn_pref(struct sh4 *sh4, uint32_t addr) {
     dst |= addr & 0x3ffffe0;
   }
 
-  sh4_memcpy_to_guest(mem, dst, sh4->sq[sqi], 32);
+  /* nearly every flush targets either the ta's fifos / texture memory in area
+     4, or system ram in area 3. route these directly to their destination,
+     avoiding the page table lookup and dispatch of the generic memcpy */
+  const uint8_t *sq = (const uint8_t *)sh4->sq[sqi];
+  uint32_t phys = dst & SH4_ADDR_MASK;
+
+  if (phys >= SH4_AREA4_BEGIN && phys <= SH4_AREA4_END) {
+    sh4_area4_write(sh4, dst, sq, 32);
+  } else if (phys >= SH4_AREA3_BEGIN && phys <= SH4_AREA3_END) {
+    memcpy(mem_ram(mem, dst & SH4_AREA3_ADDR_MASK), sq, 32);
+  } else {
+    sh4_memcpy_to_guest(mem, dst, sq, 32);
+  }
 }
 
 uint32_t sh4_ccn_cache_read(struct sh4 *sh4, uint32_t addr, uint32_t mask) {
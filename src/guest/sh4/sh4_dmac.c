@@ -26,11 +26,12 @@ static void sh4_dmac_check(struct sh4 *sh4, int channel) {
         "sh4_dmac_check only DDT DMA unsupported");
 }
 
-void sh4_dmac_ddt(struct sh4 *sh4, struct sh4_dtr *dtr) {
+int sh4_dmac_ddt(struct sh4 *sh4, struct sh4_dtr *dtr) {
   struct memory *mem = sh4->dc->mem;
 
-  /* FIXME this should be made asynchronous, at which point the significance
-     of the registers / interrupts should be more obvious */
+  /* transfers are made asynchronous by the initiating device, which calls this
+     for each chunk of the transfer, and waits for the time each chunk takes
+     before requesting the next */
 
   if (dtr->data) {
     /* single address mode transfer */
@@ -39,6 +40,8 @@ void sh4_dmac_ddt(struct sh4 *sh4, struct sh4_dtr *dtr) {
     } else {
       sh4_memcpy_to_guest(mem, dtr->addr, dtr->data, dtr->size);
     }
+
+    return dtr->size;
   } else {
     /* dual address mode transfer */
     uint32_t *sar;
@@ -81,23 +84,33 @@ void sh4_dmac_ddt(struct sh4 *sh4, struct sh4_dtr *dtr) {
         break;
     }
 
+    /* DMATCR is in 32-byte units */
+    int size = MIN(dtr->size & ~31, (int)*dmatcr * 32);
+
+    if (!size) {
+      return 0;
+    }
+
     uint32_t src = dtr->dir == SH4_DMA_FROM_ADDR ? dtr->addr : *sar;
     uint32_t dst = dtr->dir == SH4_DMA_FROM_ADDR ? *dar : dtr->addr;
-    int size = *dmatcr * 32;
     sh4_memcpy(mem, dst, src, size);
 
     /* update src / addresses as well as remaining count */
     *sar = src + size;
     *dar = dst + size;
-    *dmatcr = 0;
+    *dmatcr -= size / 32;
 
-    /* signal transfer end */
-    chcr->TE = 1;
+    if (!*dmatcr) {
+      /* signal transfer end */
+      chcr->TE = 1;
 
-    /* raise interrupt if requested */
-    if (chcr->IE) {
-      sh4_raise_interrupt(sh4, dmte);
+      /* raise interrupt if requested */
+      if (chcr->IE) {
+        sh4_raise_interrupt(sh4, dmte);
+      }
     }
+
+    return size;
   }
 }
 
@@ -16,11 +16,17 @@ struct sh4_dtr {
      and SARn / DARn */
   uint8_t *data;
   uint32_t addr;
-  /* size is only valid for single address mode transfers, dual address mode
-     transfers honor DMATCR */
+  /* number of bytes to transfer. dual address mode transfers are additionally
+     limited to the count remaining in DMATCR, enabling the initiating device
+     to perform the transfer in multiple chunks */
   int size;
 };
 
-void sh4_dmac_ddt(struct sh4 *sh, struct sh4_dtr *dtr);
+/* the dmac moves data over the 64-bit external bus at 100mhz, loosely simulate
+   this when timing transfers */
+#define SH4_DMA_BUS_FREQ INT64_C(100000000)
+#define SH4_DMA_TRANSFER_TIME(size) CYCLES_TO_NANO((size) / 8, SH4_DMA_BUS_FREQ)
+
+int sh4_dmac_ddt(struct sh4 *sh, struct sh4_dtr *dtr);
 
 #endif
@@ -174,6 +174,39 @@ uint32_t sh4_area1_read(struct sh4 *sh4, uint32_t addr, uint32_t mask) {
   }
 }
 
+void sh4_holly_reg_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
+                         uint32_t mask) {
+  addr &= SH4_ADDR_MASK;
+  holly_reg_write(sh4->dc->holly, addr - SH4_HOLLY_REG_BEGIN, data, mask);
+}
+
+uint32_t sh4_holly_reg_read(struct sh4 *sh4, uint32_t addr, uint32_t mask) {
+  addr &= SH4_ADDR_MASK;
+  return holly_reg_read(sh4->dc->holly, addr - SH4_HOLLY_REG_BEGIN, mask);
+}
+
+void sh4_pvr_reg_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
+                       uint32_t mask) {
+  addr &= SH4_ADDR_MASK;
+  pvr_reg_write(sh4->dc->pvr, addr - SH4_PVR_REG_BEGIN, data, mask);
+}
+
+uint32_t sh4_pvr_reg_read(struct sh4 *sh4, uint32_t addr, uint32_t mask) {
+  addr &= SH4_ADDR_MASK;
+  return pvr_reg_read(sh4->dc->pvr, addr - SH4_PVR_REG_BEGIN, mask);
+}
+
+void sh4_aica_reg_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
+                        uint32_t mask) {
+  addr &= SH4_ADDR_MASK;
+  aica_reg_write(sh4->dc->aica, addr - SH4_AICA_REG_BEGIN, data, mask);
+}
+
+uint32_t sh4_aica_reg_read(struct sh4 *sh4, uint32_t addr, uint32_t mask) {
+  addr &= SH4_ADDR_MASK;
+  return aica_reg_read(sh4->dc->aica, addr - SH4_AICA_REG_BEGIN, mask);
+}
+
 void sh4_area0_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
                      uint32_t mask) {
   struct dreamcast *dc = sh4->dc;
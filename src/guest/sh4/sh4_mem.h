@@ -119,6 +119,18 @@
 #define SH4_UTLB_END         0xf7ffffff
 /* clang-format on */
 
+uint32_t sh4_holly_reg_read(struct sh4 *sh4, uint32_t addr, uint32_t mask);
+void sh4_holly_reg_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
+                         uint32_t mask);
+
+uint32_t sh4_pvr_reg_read(struct sh4 *sh4, uint32_t addr, uint32_t mask);
+void sh4_pvr_reg_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
+                       uint32_t mask);
+
+uint32_t sh4_aica_reg_read(struct sh4 *sh4, uint32_t addr, uint32_t mask);
+void sh4_aica_reg_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
+                        uint32_t mask);
+
 uint32_t sh4_area0_read(struct sh4 *sh4, uint32_t addr, uint32_t mask);
 void sh4_area0_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
                      uint32_t mask);
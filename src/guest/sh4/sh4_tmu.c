@@ -1,6 +1,7 @@
 #include "guest/sh4/sh4_tmu.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
+#include "guest/state.h"
 #include "imgui.h"
 
 static const int64_t PERIPHERAL_CLOCK_FREQ = SH4_CLOCK_FREQ >> 2;
@@ -135,6 +136,14 @@ static void sh4_tmu_update_tcnt(struct sh4 *sh4, uint32_t n) {
   }
 }
 
+void sh4_tmu_serialize(struct sh4 *sh4, struct state *s) {
+  struct scheduler *sched = sh4->dc->sched;
+
+  state_timer(s, sched, &sh4->tmu_timers[0], &sh4_tmu_expire_0, sh4);
+  state_timer(s, sched, &sh4->tmu_timers[1], &sh4_tmu_expire_1, sh4);
+  state_timer(s, sched, &sh4->tmu_timers[2], &sh4_tmu_expire_2, sh4);
+}
+
 #ifdef HAVE_IMGUI
 void sh4_tmu_debug_menu(struct sh4 *sh4) {
   if (igBegin("tmu stats", NULL, 0)) {
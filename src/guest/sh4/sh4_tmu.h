@@ -2,7 +2,9 @@
 #define SH4_TMU_H
 
 struct sh4;
+struct state;
 
 void sh4_tmu_debug_menu(struct sh4 *sh4);
+void sh4_tmu_serialize(struct sh4 *sh4, struct state *s);
 
 #endif
@@ -0,0 +1,52 @@
+#include <string.h>
+#include "guest/state.h"
+#include "core/core.h"
+
+void state_timer(struct state *s, struct scheduler *sched,
+                 struct timer **timer, timer_cb cb, void *data) {
+  int64_t remaining = -1;
+
+  if (s->mode != STATE_LOAD && *timer) {
+    remaining = sched_remaining_time(sched, *timer);
+  }
+
+  STATE_FIELD(s, remaining);
+
+  if (s->mode != STATE_LOAD || s->error) {
+    return;
+  }
+
+  *timer = NULL;
+
+  if (remaining >= 0) {
+    *timer = sched_start_timer(sched, cb, data, remaining);
+  }
+}
+
+void state_bytes(struct state *s, void *ptr, int size) {
+  if (s->error) {
+    return;
+  }
+
+  if (s->mode != STATE_MEASURE && s->offset + size > s->size) {
+    s->error = 1;
+    return;
+  }
+
+  if (s->mode == STATE_SAVE) {
+    memcpy(s->data + s->offset, ptr, size);
+  } else if (s->mode == STATE_LOAD) {
+    memcpy(ptr, s->data + s->offset, size);
+  }
+
+  s->offset += size;
+}
+
+void state_init(struct state *s, int mode, void *data, int size) {
+  s->mode = mode;
+  s->data = data;
+  s->size = size;
+  s->offset = 0;
+  s->error = 0;
+  s->with_mem = 1;
+}
@@ -0,0 +1,47 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stdint.h>
+#include "guest/scheduler.h"
+
+/*
+ * machine state serialization
+ *
+ * the same serialize routine is used to measure, save and load each device's
+ * state, keeping the three paths from drifting apart. when measuring, no data
+ * is copied and only the offset is advanced
+ */
+enum {
+  STATE_MEASURE,
+  STATE_SAVE,
+  STATE_LOAD,
+};
+
+struct state {
+  int mode;
+  uint8_t *data;
+  int size;
+  int offset;
+  int error;
+
+  /* physical memory is part of the state. when it isn't, a load leaves
+     memory for the caller to restore (e.g. the rewind buffer) */
+  int with_mem;
+};
+
+#define STATE_FIELD(s, field) state_bytes(s, &(field), (int)sizeof(field))
+
+static inline int state_loading(struct state *s) {
+  return s->mode == STATE_LOAD;
+}
+
+void state_init(struct state *s, int mode, void *data, int size);
+void state_bytes(struct state *s, void *ptr, int size);
+
+/* timers are serialized as the time remaining until they expire, and
+   rearmed with the supplied callback when loaded. the scheduler's own state
+   must have been loaded first, cancelling any previously live timers */
+void state_timer(struct state *s, struct scheduler *sched,
+                 struct timer **timer, timer_cb cb, void *data);
+
+#endif
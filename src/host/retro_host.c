@@ -272,15 +272,27 @@ void retro_run() {
 }
 
 size_t retro_serialize_size() {
-  return 0;
+  if (!g_host || !g_host->emu) {
+    return 0;
+  }
+
+  return (size_t)emu_state_size(g_host->emu);
 }
 
 bool retro_serialize(void *data, size_t size) {
-  return false;
+  if (!g_host || !g_host->emu) {
+    return false;
+  }
+
+  return emu_save_state(g_host->emu, data, (int)size) > 0;
 }
 
 bool retro_unserialize(const void *data, size_t size) {
-  return false;
+  if (!g_host || !g_host->emu) {
+    return false;
+  }
+
+  return emu_load_state(g_host->emu, data, (int)size) > 0;
 }
 
 void retro_cheat_reset() {}
@@ -40,6 +40,72 @@ static void armv3_frontend_dump_code(struct jit_frontend *base,
   }
 }
 
+#define REG_OFFSET(n) \
+  (offsetof(struct armv3_context, r) + (n) * sizeof(uint32_t))
+
+/* single data transfers with an immediate offset are translated directly to
+   guest loads and stores, enabling the backend to access memory through the
+   fastmem mapping. all other instructions (and conditional transfers) are
+   still executed through their fallback */
+static int armv3_frontend_translate_xfr(struct ir *ir, uint32_t addr,
+                                        union armv3_instr i) {
+  if (i.xfr.cond != COND_AL || i.xfr.i || i.xfr.rd == 15) {
+    return 0;
+  }
+
+  int writeback = i.xfr.w || !i.xfr.p;
+
+  if (i.xfr.rn == 15 && writeback) {
+    return 0;
+  }
+
+  /* account for instruction prefetching if loading the pc */
+  struct ir_value *base;
+  if (i.xfr.rn == 15) {
+    base = ir_alloc_i32(ir, addr + 8);
+  } else {
+    base = ir_load_context(ir, REG_OFFSET(i.xfr.rn), VALUE_I32);
+  }
+
+  struct ir_value *final = base;
+  if (i.xfr_imm.imm) {
+    struct ir_value *imm = ir_alloc_i32(ir, i.xfr_imm.imm);
+    final = i.xfr.u ? ir_add(ir, base, imm) : ir_sub(ir, base, imm);
+  }
+
+  struct ir_value *ea = i.xfr.p ? final : base;
+
+  /* writeback is applied in pipeline before memory is read. note, post-
+     increment mode always writes back */
+  if (writeback) {
+    ir_store_context(ir, REG_OFFSET(i.xfr.rn), final);
+  }
+
+  if (i.xfr.l) {
+    struct ir_value *data;
+    if (i.xfr.b) {
+      data = ir_zext(ir, ir_load_guest(ir, ea, VALUE_I8), VALUE_I32);
+    } else {
+      data = ir_load_guest(ir, ea, VALUE_I32);
+    }
+
+    ir_store_context(ir, REG_OFFSET(15), ir_alloc_i32(ir, addr + 4));
+    ir_store_context(ir, REG_OFFSET(i.xfr.rd), data);
+  } else {
+    struct ir_value *data =
+        ir_load_context(ir, REG_OFFSET(i.xfr.rd), VALUE_I32);
+    if (i.xfr.b) {
+      ir_store_guest(ir, ea, ir_trunc(ir, data, VALUE_I8));
+    } else {
+      ir_store_guest(ir, ea, data);
+    }
+
+    ir_store_context(ir, REG_OFFSET(15), ir_alloc_i32(ir, addr + 4));
+  }
+
+  return 1;
+}
+
 static void armv3_frontend_translate_code(struct jit_frontend *base,
                                           uint32_t begin_addr, int size,
                                           struct ir *ir) {
@@ -51,10 +117,15 @@ static void armv3_frontend_translate_code(struct jit_frontend *base,
   while (offset < size) {
     uint32_t addr = begin_addr + offset;
     uint32_t data = guest->r32(guest->mem, addr);
+    union armv3_instr i = {data};
     struct jit_opdef *def = armv3_get_opdef(data);
 
     ir_source_info(ir, addr, 12);
-    ir_fallback(ir, def->fallback, addr, data);
+
+    if (!(def->flags & FLAG_XFR) ||
+        !armv3_frontend_translate_xfr(ir, addr, i)) {
+      ir_fallback(ir, def->fallback, addr, data);
+    }
 
     offset += 4;
   }
@@ -219,6 +219,8 @@ void jit_free_code(struct jit *jit) {
 
   /* have the backend reset its code buffers */
   jit->backend->reset(jit->backend);
+
+  jit->code_gen++;
 }
 
 void jit_invalidate_code(struct jit *jit) {
@@ -236,6 +238,8 @@ void jit_invalidate_code(struct jit *jit) {
   }
 
   /* don't reset backend code buffers, code is still running */
+
+  jit->code_gen++;
 }
 
 void jit_link_code(struct jit *jit, void *branch, uint32_t addr) {
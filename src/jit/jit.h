@@ -84,6 +84,10 @@ struct jit {
   struct rb_tree blocks;
   struct rb_tree reverse_blocks;
 
+  /* incremented each time the compiled code is discarded as a whole, letting
+     callers tell if the code is still the same as at an earlier point */
+  uint32_t code_gen;
+
   /* compiled block perf map */
   FILE *perf_map;
 
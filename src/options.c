@@ -101,6 +101,9 @@ DEFINE_PERSISTENT_OPTION_INT(deadzone_3,   DEFAULT_DEADZONE,  "Deadzone for cont
 
 /* emulator */
 DEFINE_PERSISTENT_OPTION_STRING(aspect,    "4:3",             "Video aspect ratio");
+DEFINE_PERSISTENT_OPTION_INT(rewind,       0,                 "Rewind buffer size in MB, 0 to disable");
+DEFINE_PERSISTENT_OPTION_INT(runahead,     0,                 "Frames to run ahead to reduce input latency");
+DEFINE_PERSISTENT_OPTION_INT(texture_cache, 256,              "Texture cache size in MB, 0 for unlimited");
 
 /* bios */
 DEFINE_PERSISTENT_OPTION_STRING(region,    "usa",             "System region");
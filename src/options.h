@@ -62,6 +62,9 @@ DECLARE_OPTION_INT(deadzone_3);
 
 /* emulator */
 DECLARE_OPTION_STRING(aspect);
+DECLARE_OPTION_INT(rewind);
+DECLARE_OPTION_INT(runahead);
+DECLARE_OPTION_INT(texture_cache);
 
 /* bios */
 DECLARE_OPTION_STRING(region);
@@ -1,10 +1,12 @@
 #include <glad/glad.h>
 #include "core/core.h"
+#include "core/math.h"
 #include "host/host.h"
 #include "render/render_backend.h"
 
 enum texture_map {
   MAP_DIFFUSE,
+  MAP_NUM_TEXTURES,
 };
 
 enum uniform_attr {
@@ -44,16 +46,54 @@ struct shader_program {
 
   /* the last global uniforms bound to this program */
   uint64_t uniform_token;
+
+  /* the last per-surface uniforms bound to this program */
+  float alpha_ref;
 };
 
 struct texture {
   GLuint texture;
 };
 
+/* streaming buffers are split into segments which are written to front to
+   back. once every segment has been used, writes wrap around to the first
+   segment whose fence has signaled, or orphan the storage if the gpu is still
+   reading from it */
+#define STREAM_NUM_SEGMENTS 3
+
+struct stream_buffer {
+  GLenum target;
+  GLuint buffer;
+  int segment_size;
+  int segment;
+  int offset;
+  GLsync fences[STREAM_NUM_SEGMENTS];
+};
+
 struct viewport {
   int x, y, w, h;
 };
 
+/* shadow copy of the gl state, enabling redundant calls to be skipped. each
+   field is invalidated by setting it to all ones, forcing the next call to
+   be issued */
+struct gl_state {
+  int depth_mask;
+  int depth_test;
+  GLenum depth_func;
+  int cull_face;
+  GLenum cull_mode;
+  int blend;
+  GLenum src_blend;
+  GLenum dst_blend;
+  int scissor_test;
+  int scissor[4];
+  GLuint program;
+  GLuint vao;
+  GLenum active_texture;
+  GLuint textures[MAP_NUM_TEXTURES];
+};
+
 struct render_backend {
   struct host *host;
   int width, height;
@@ -61,6 +101,9 @@ struct render_backend {
   /* current viewport */
   struct viewport viewport;
 
+  /* current gl state */
+  struct gl_state state;
+
   /* default assets created during intitialization */
   GLuint white_texture;
   struct shader_program ta_programs[ATTR_COUNT];
@@ -69,23 +112,38 @@ struct render_backend {
   /* offscreen framebuffer for blitting raw pixels */
   GLuint pixel_fbo;
   GLuint pixel_texture;
+  int pixel_width;
+  int pixel_height;
+  struct stream_buffer pixel_pbo;
 
   /* texture cache */
   struct texture textures[MAX_TEXTURES];
+  texture_handle_t free_textures[MAX_TEXTURES];
+  int num_free_textures;
 
   /* surface render state */
   GLuint ta_vao;
-  GLuint ta_vbo;
-  GLuint ta_ibo;
+  struct stream_buffer ta_vbo;
+  struct stream_buffer ta_ibo;
+  int ta_base_vert;
+  int ta_index_offset;
+  int ta_index_size;
+  GLenum ta_index_type;
   GLuint ui_vao;
-  GLuint ui_vbo;
-  GLuint ui_ibo;
+  struct stream_buffer ui_vbo;
+  struct stream_buffer ui_ibo;
+  int ui_base_vert;
+  int ui_index_offset;
   int ui_use_ibo;
 
   /* global uniforms that are constant for every surface rendered between a call
      to begin_surfaces and end_surfaces */
   uint64_t uniform_token;
   float uniform_video_scale[4];
+
+  /* stats for the current set of ta surfaces */
+  struct render_stats stats;
+  struct ta_surface last_surf;
 };
 
 #include "render/ta.glsl"
@@ -155,10 +213,128 @@ static GLuint pixel_formats[] = {
     GL_UNSIGNED_SHORT_4_4_4_4, /* PXL_RGBA4444 */
 };
 
+static inline int r_state_changed(struct render_backend *r, int changed) {
+  if (changed) {
+    r->stats.api_calls++;
+  } else {
+    r->stats.skipped_api_calls++;
+  }
+  return changed;
+}
+
+static inline void r_toggle(struct render_backend *r, GLenum cap, int *state,
+                            int enable) {
+  if (!r_state_changed(r, *state != enable)) {
+    return;
+  }
+
+  if (enable) {
+    glEnable(cap);
+  } else {
+    glDisable(cap);
+  }
+  *state = enable;
+}
+
 static inline void r_bind_texture(struct render_backend *r,
                                   enum texture_map map, GLuint tex) {
-  glActiveTexture(GL_TEXTURE0 + map);
-  glBindTexture(GL_TEXTURE_2D, tex);
+  if (r_state_changed(r, r->state.active_texture != GL_TEXTURE0 + map)) {
+    glActiveTexture(GL_TEXTURE0 + map);
+    r->state.active_texture = GL_TEXTURE0 + map;
+  }
+
+  if (r_state_changed(r, r->state.textures[map] != tex)) {
+    glBindTexture(GL_TEXTURE_2D, tex);
+    r->state.textures[map] = tex;
+  }
+}
+
+static inline void r_bind_vao(struct render_backend *r, GLuint vao) {
+  if (r_state_changed(r, r->state.vao != vao)) {
+    glBindVertexArray(vao);
+    r->state.vao = vao;
+  }
+}
+
+static inline void r_use_program(struct render_backend *r, GLuint prog) {
+  if (r_state_changed(r, r->state.program != prog)) {
+    glUseProgram(prog);
+    r->state.program = prog;
+  }
+}
+
+static inline void r_set_depth_mask(struct render_backend *r, int enable) {
+  if (r_state_changed(r, r->state.depth_mask != enable)) {
+    glDepthMask(enable);
+    r->state.depth_mask = enable;
+  }
+}
+
+static void r_set_depth_func(struct render_backend *r, enum depth_func func) {
+  r_toggle(r, GL_DEPTH_TEST, &r->state.depth_test, func != DEPTH_NONE);
+
+  if (func == DEPTH_NONE) {
+    return;
+  }
+
+  GLenum depth_func = depth_funcs[func];
+  if (r_state_changed(r, r->state.depth_func != depth_func)) {
+    glDepthFunc(depth_func);
+    r->state.depth_func = depth_func;
+  }
+}
+
+static void r_set_cull(struct render_backend *r, enum cull_face cull) {
+  r_toggle(r, GL_CULL_FACE, &r->state.cull_face, cull != CULL_NONE);
+
+  if (cull == CULL_NONE) {
+    return;
+  }
+
+  GLenum mode = cull_face[cull];
+  if (r_state_changed(r, r->state.cull_mode != mode)) {
+    glCullFace(mode);
+    r->state.cull_mode = mode;
+  }
+}
+
+static void r_set_blend(struct render_backend *r, enum blend_func src,
+                        enum blend_func dst) {
+  int enable = src != BLEND_NONE && dst != BLEND_NONE;
+  r_toggle(r, GL_BLEND, &r->state.blend, enable);
+
+  if (!enable) {
+    return;
+  }
+
+  GLenum src_blend = blend_funcs[src];
+  GLenum dst_blend = blend_funcs[dst];
+  if (r_state_changed(r, r->state.src_blend != src_blend ||
+                             r->state.dst_blend != dst_blend)) {
+    glBlendFunc(src_blend, dst_blend);
+    r->state.src_blend = src_blend;
+    r->state.dst_blend = dst_blend;
+  }
+}
+
+static void r_set_scissor(struct render_backend *r, const float *rect) {
+  r_toggle(r, GL_SCISSOR_TEST, &r->state.scissor_test, rect != NULL);
+
+  if (!rect) {
+    return;
+  }
+
+  int scissor[4] = {(int)rect[0], (int)rect[1], (int)rect[2], (int)rect[3]};
+  if (r_state_changed(r, memcmp(r->state.scissor, scissor, sizeof(scissor)))) {
+    glScissor(scissor[0], scissor[1], scissor[2], scissor[3]);
+    memcpy(r->state.scissor, scissor, sizeof(scissor));
+  }
+}
+
+/* state may be modified outside of the backend, e.g. by a libretro frontend
+   sharing the context, after which the shadowed state can't be trusted */
+static void r_invalidate_state(struct render_backend *r) {
+  memset(&r->state, 0xff, sizeof(r->state));
 }
 
 static void r_print_shader_log(GLuint shader) {
@@ -220,6 +396,7 @@ static int r_compile_program(struct render_backend *r,
 
   memset(program, 0, sizeof(*program));
   program->prog = glCreateProgram();
+  program->alpha_ref = -1.0f;
 
   if (vertex_source) {
     snprintf(buffer, sizeof(buffer) - 1, "#version " GLSL_VERSION
@@ -267,9 +444,8 @@ static int r_compile_program(struct render_backend *r,
   }
 
   /* bind diffuse sampler once after compile, this currently never changes */
-  glUseProgram(program->prog);
+  r_use_program(r, program->prog);
   glUniform1i(program->loc[UNIFORM_DIFFUSE], MAP_DIFFUSE);
-  glUseProgram(0);
 
   return 1;
 }
@@ -290,11 +466,111 @@ static void r_create_shaders(struct render_backend *r) {
   }
 }
 
+static void r_orphan_stream(struct stream_buffer *s) {
+  for (int i = 0; i < STREAM_NUM_SEGMENTS; i++) {
+    if (s->fences[i]) {
+      glDeleteSync(s->fences[i]);
+      s->fences[i] = 0;
+    }
+  }
+
+  /* allocate new storage for the buffer, the driver will release the old
+     storage once the gpu is done reading from it */
+  glBufferData(s->target, s->segment_size * STREAM_NUM_SEGMENTS, NULL,
+               GL_STREAM_DRAW);
+
+  s->segment = 0;
+  s->offset = 0;
+}
+
+/* copy data into the next free range of the stream, returning the offset it
+   was written to. the stream's buffer is left bound to its target */
+static int r_write_stream(struct stream_buffer *s, const void *data, int size,
+                          int align) {
+  glBindBuffer(s->target, s->buffer);
+
+  if (!size) {
+    return 0;
+  }
+
+  /* offsets are aligned relative to the start of the buffer, such that vertex
+     offsets can be converted to a base vertex */
+  int base = s->segment * s->segment_size;
+  int offset = (base + s->offset + align - 1) / align * align - base;
+
+  if (size + align > s->segment_size) {
+    while (s->segment_size < size + align) {
+      s->segment_size <<= 1;
+    }
+
+    r_orphan_stream(s);
+    base = 0;
+    offset = 0;
+  } else if (offset + size > s->segment_size) {
+    /* every draw sourcing the current segment has been issued, fence it
+       before moving on to the next */
+    s->fences[s->segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    s->segment = (s->segment + 1) % STREAM_NUM_SEGMENTS;
+    s->offset = 0;
+
+    GLsync fence = s->fences[s->segment];
+    s->fences[s->segment] = 0;
+
+    if (fence) {
+      GLenum res = glClientWaitSync(fence, 0, 0);
+      glDeleteSync(fence);
+
+      /* rather than stalling until the gpu is done with the segment, give the
+         buffer new storage */
+      if (res == GL_TIMEOUT_EXPIRED) {
+        r_orphan_stream(s);
+      }
+    }
+
+    base = s->segment * s->segment_size;
+    offset = (base + align - 1) / align * align - base;
+  }
+
+  /* the range being written isn't in use by the gpu, there's no need for the
+     driver to synchronize */
+  void *ptr = glMapBufferRange(s->target, base + offset, size,
+                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                                   GL_MAP_UNSYNCHRONIZED_BIT);
+  CHECK_NOTNULL(ptr);
+  memcpy(ptr, data, size);
+  glUnmapBuffer(s->target);
+
+  s->offset = offset + size;
+
+  return base + offset;
+}
+
+static void r_destroy_stream(struct stream_buffer *s) {
+  for (int i = 0; i < STREAM_NUM_SEGMENTS; i++) {
+    if (s->fences[i]) {
+      glDeleteSync(s->fences[i]);
+    }
+  }
+
+  glDeleteBuffers(1, &s->buffer);
+}
+
+static void r_create_stream(struct stream_buffer *s, GLenum target,
+                            int segment_size) {
+  s->target = target;
+  s->segment_size = segment_size;
+
+  glGenBuffers(1, &s->buffer);
+  glBindBuffer(s->target, s->buffer);
+  r_orphan_stream(s);
+}
+
 static void r_destroy_textures(struct render_backend *r) {
   glDeleteTextures(1, &r->white_texture);
 
   glDeleteFramebuffers(1, &r->pixel_fbo);
   glDeleteTextures(1, &r->pixel_texture);
+  r_destroy_stream(&r->pixel_pbo);
 
   for (int i = 0; i < MAX_TEXTURES; i++) {
     struct texture *tex = &r->textures[i];
@@ -308,6 +584,12 @@ static void r_destroy_textures(struct render_backend *r) {
 }
 
 static void r_create_textures(struct render_backend *r) {
+  /* handles are allocated from the top of the stack, starting with 1 as 0 is
+     reserved as the null handle */
+  for (int i = MAX_TEXTURES - 1; i > 0; i--) {
+    r->free_textures[r->num_free_textures++] = i;
+  }
+
   /* create default all white texture */
   uint8_t pixels[64 * 64 * 4];
   memset(pixels, 0xff, sizeof(pixels));
@@ -344,15 +626,20 @@ static void r_create_textures(struct render_backend *r) {
 
   glBindTexture(GL_TEXTURE_2D, 0);
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  /* raw framebuffers are streamed through a pixel buffer, letting the upload
+     happen asynchronously */
+  r_create_stream(&r->pixel_pbo, GL_PIXEL_UNPACK_BUFFER, 640 * 480 * 4);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
 
 static void r_destroy_vertex_arrays(struct render_backend *r) {
-  glDeleteBuffers(1, &r->ui_ibo);
-  glDeleteBuffers(1, &r->ui_vbo);
+  r_destroy_stream(&r->ui_ibo);
+  r_destroy_stream(&r->ui_vbo);
   glDeleteVertexArrays(1, &r->ui_vao);
 
-  glDeleteBuffers(1, &r->ta_ibo);
-  glDeleteBuffers(1, &r->ta_vbo);
+  r_destroy_stream(&r->ta_ibo);
+  r_destroy_stream(&r->ta_vbo);
   glDeleteVertexArrays(1, &r->ta_vao);
 }
 
@@ -362,11 +649,8 @@ static void r_create_vertex_arrays(struct render_backend *r) {
     glGenVertexArrays(1, &r->ui_vao);
     glBindVertexArray(r->ui_vao);
 
-    glGenBuffers(1, &r->ui_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, r->ui_vbo);
-
-    glGenBuffers(1, &r->ui_ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, r->ui_ibo);
+    r_create_stream(&r->ui_vbo, GL_ARRAY_BUFFER, 0x10000);
+    r_create_stream(&r->ui_ibo, GL_ELEMENT_ARRAY_BUFFER, 0x10000);
 
     /* xy */
     glEnableVertexAttribArray(0);
@@ -393,11 +677,8 @@ static void r_create_vertex_arrays(struct render_backend *r) {
     glGenVertexArrays(1, &r->ta_vao);
     glBindVertexArray(r->ta_vao);
 
-    glGenBuffers(1, &r->ta_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, r->ta_vbo);
-
-    glGenBuffers(1, &r->ta_ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, r->ta_ibo);
+    r_create_stream(&r->ta_vbo, GL_ARRAY_BUFFER, 0x100000);
+    r_create_stream(&r->ta_ibo, GL_ELEMENT_ARRAY_BUFFER, 0x40000);
 
     /* xyz */
     glEnableVertexAttribArray(0);
@@ -428,13 +709,12 @@ static void r_create_vertex_arrays(struct render_backend *r) {
 }
 
 static void r_set_initial_state(struct render_backend *r) {
-  glDepthMask(1);
-  glDisable(GL_DEPTH_TEST);
+  r_invalidate_state(r);
 
-  glEnable(GL_CULL_FACE);
-  glCullFace(GL_BACK);
-
-  glDisable(GL_BLEND);
+  r_set_depth_mask(r, 1);
+  r_set_depth_func(r, DEPTH_NONE);
+  r_set_cull(r, CULL_BACK);
+  r_set_blend(r, BLEND_NONE, BLEND_NONE);
 }
 
 static struct shader_program *r_get_ta_program(struct render_backend *r,
@@ -504,25 +784,13 @@ static struct shader_program *r_get_ta_program(struct render_backend *r,
 }
 
 void r_end_ui_surfaces(struct render_backend *r) {
-  glDisable(GL_SCISSOR_TEST);
+  r_set_scissor(r, NULL);
 }
 
 void r_draw_ui_surface(struct render_backend *r,
                        const struct ui_surface *surf) {
-  if (surf->scissor) {
-    glEnable(GL_SCISSOR_TEST);
-    glScissor((int)surf->scissor_rect[0], (int)surf->scissor_rect[1],
-              (int)surf->scissor_rect[2], (int)surf->scissor_rect[3]);
-  } else {
-    glDisable(GL_SCISSOR_TEST);
-  }
-
-  if (surf->src_blend == BLEND_NONE || surf->dst_blend == BLEND_NONE) {
-    glDisable(GL_BLEND);
-  } else {
-    glEnable(GL_BLEND);
-    glBlendFunc(blend_funcs[surf->src_blend], blend_funcs[surf->dst_blend]);
-  }
+  r_set_scissor(r, surf->scissor ? surf->scissor_rect : NULL);
+  r_set_blend(r, surf->src_blend, surf->dst_blend);
 
   if (surf->texture) {
     struct texture *tex = &r->textures[surf->texture];
@@ -532,12 +800,13 @@ void r_draw_ui_surface(struct render_backend *r,
   }
 
   if (r->ui_use_ibo) {
-    glDrawElements(prim_types[surf->prim_type], surf->num_verts,
-                   GL_UNSIGNED_SHORT,
-                   (void *)(intptr_t)(sizeof(uint16_t) * surf->first_vert));
+    int index_offset = r->ui_index_offset + sizeof(uint16_t) * surf->first_vert;
+    glDrawElementsBaseVertex(prim_types[surf->prim_type], surf->num_verts,
+                             GL_UNSIGNED_SHORT, (void *)(intptr_t)index_offset,
+                             r->ui_base_vert);
   } else {
-    glDrawArrays(prim_types[surf->prim_type], surf->first_vert,
-                 surf->num_verts);
+    glDrawArrays(prim_types[surf->prim_type],
+                 r->ui_base_vert + surf->first_vert, surf->num_verts);
   }
 }
 
@@ -566,27 +835,27 @@ void r_begin_ui_surfaces(struct render_backend *r,
   ortho[11] = 0.0f;
   ortho[15] = 1.0f;
 
-  glDepthMask(0);
-  glDisable(GL_DEPTH_TEST);
-  glDisable(GL_CULL_FACE);
+  r_set_depth_mask(r, 0);
+  r_set_depth_func(r, DEPTH_NONE);
+  r_set_cull(r, CULL_NONE);
 
   struct shader_program *program = &r->ui_program;
-  glBindVertexArray(r->ui_vao);
-  glUseProgram(program->prog);
+  r_bind_vao(r, r->ui_vao);
+  r_use_program(r, program->prog);
   glUniformMatrix4fv(program->loc[UNIFORM_PROJ], 1, GL_FALSE, ortho);
 
-  /* bind buffers */
-  glBindBuffer(GL_ARRAY_BUFFER, r->ui_vbo);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(struct ui_vertex) * num_verts, verts,
-               GL_DYNAMIC_DRAW);
+  /* stream buffers */
+  int vert_size = sizeof(struct ui_vertex);
+  int vert_offset =
+      r_write_stream(&r->ui_vbo, verts, vert_size * num_verts, vert_size);
+  r->ui_base_vert = vert_offset / vert_size;
 
   if (indices) {
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, r->ui_ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * num_indices,
-                 indices, GL_DYNAMIC_DRAW);
+    int index_size = sizeof(uint16_t);
+    r->ui_index_offset = r_write_stream(&r->ui_ibo, indices,
+                                        index_size * num_indices, index_size);
     r->ui_use_ibo = 1;
   } else {
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     r->ui_use_ibo = 0;
   }
 }
@@ -595,58 +864,56 @@ void r_end_ta_surfaces(struct render_backend *r) {}
 
 void r_draw_ta_surface(struct render_backend *r,
                        const struct ta_surface *surf) {
-  glDepthMask(!!surf->params.depth_write);
-
-  if (surf->params.depth_func == DEPTH_NONE) {
-    glDisable(GL_DEPTH_TEST);
-  } else {
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(depth_funcs[surf->params.depth_func]);
+  if (!r->stats.ta_draws || surf->params.full != r->last_surf.params.full) {
+    r->stats.ta_state_changes++;
   }
-
-  if (surf->params.cull == CULL_NONE) {
-    glDisable(GL_CULL_FACE);
-  } else {
-    glEnable(GL_CULL_FACE);
-    glCullFace(cull_face[surf->params.cull]);
+  if (!r->stats.ta_draws ||
+      surf->params.texture != r->last_surf.params.texture) {
+    r->stats.ta_texture_changes++;
   }
+  r->stats.ta_draws++;
+  r->last_surf = *surf;
 
-  if (surf->params.src_blend == BLEND_NONE ||
-      surf->params.dst_blend == BLEND_NONE) {
-    glDisable(GL_BLEND);
-  } else {
-    glEnable(GL_BLEND);
-    glBlendFunc(blend_funcs[surf->params.src_blend],
-                blend_funcs[surf->params.dst_blend]);
-  }
+  r_set_depth_mask(r, !!surf->params.depth_write);
+  r_set_depth_func(r, surf->params.depth_func);
+  r_set_cull(r, surf->params.cull);
+  r_set_blend(r, surf->params.src_blend, surf->params.dst_blend);
 
   struct shader_program *program = r_get_ta_program(r, surf);
 
-  glUseProgram(program->prog);
+  r_use_program(r, program->prog);
 
   /* bind global uniforms if they've changed */
-  if (program->uniform_token != r->uniform_token) {
+  if (r_state_changed(r, program->uniform_token != r->uniform_token)) {
     glUniform4fv(program->loc[UNIFORM_VIDEO_SCALE], 1, r->uniform_video_scale);
     program->uniform_token = r->uniform_token;
   }
 
-  /* bind non-global uniforms every time */
+  /* uniform values are retained by each program, only bind per-surface
+     uniforms when they differ from what was last bound */
   float alpha_ref = surf->params.alpha_ref / 255.0f;
-  glUniform1f(program->loc[UNIFORM_ALPHA_REF], alpha_ref);
+  if (r_state_changed(r, program->alpha_ref != alpha_ref)) {
+    glUniform1f(program->loc[UNIFORM_ALPHA_REF], alpha_ref);
+    program->alpha_ref = alpha_ref;
+  }
 
   if (surf->params.texture) {
     struct texture *tex = &r->textures[surf->params.texture];
     r_bind_texture(r, MAP_DIFFUSE, tex->texture);
   }
 
-  glDrawElements(GL_TRIANGLES, surf->num_verts, GL_UNSIGNED_SHORT,
-                 (void *)(intptr_t)(sizeof(uint16_t) * surf->first_vert));
+  int index_offset = r->ta_index_offset + r->ta_index_size * surf->first_vert;
+  glDrawElementsBaseVertex(GL_TRIANGLES, surf->num_verts, r->ta_index_type,
+                           (void *)(intptr_t)index_offset, r->ta_base_vert);
+  r->stats.api_calls++;
 }
 
 void r_begin_ta_surfaces(struct render_backend *r, int video_width,
                          int video_height, const struct ta_vertex *verts,
-                         int num_verts, const uint16_t *indices,
+                         int num_verts, const void *indices, int index_size,
                          int num_indices) {
+  memset(&r->stats, 0, sizeof(r->stats));
+
   /* uniforms will be lazily bound for each program inside of r_draw_surface */
   r->uniform_token++;
   r->uniform_video_scale[0] = 2.0f / (float)video_width;
@@ -654,23 +921,55 @@ void r_begin_ta_surfaces(struct render_backend *r, int video_width,
   r->uniform_video_scale[2] = -2.0f / (float)video_height;
   r->uniform_video_scale[3] = 1.0f;
 
-  glBindVertexArray(r->ta_vao);
+  r_bind_vao(r, r->ta_vao);
 
-  glBindBuffer(GL_ARRAY_BUFFER, r->ta_vbo);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(struct ta_vertex) * num_verts, verts,
-               GL_DYNAMIC_DRAW);
+  /* stream buffers */
+  int vert_size = sizeof(struct ta_vertex);
+  int vert_offset =
+      r_write_stream(&r->ta_vbo, verts, vert_size * num_verts, vert_size);
+  r->ta_base_vert = vert_offset / vert_size;
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, r->ta_ibo);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * num_indices, indices,
-               GL_DYNAMIC_DRAW);
+  r->ta_index_size = index_size;
+  r->ta_index_type = index_size == 4 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+  r->ta_index_offset = r_write_stream(&r->ta_ibo, indices,
+                                      index_size * num_indices, index_size);
+}
+
+void r_read_pixels(struct render_backend *r, uint8_t *pixels) {
+  int stride = r->width * 4;
+  uint8_t *row = malloc(stride);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  glReadPixels(0, 0, r->width, r->height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+  /* gl's first row is the bottom of the image */
+  for (int y = 0; y < r->height / 2; y++) {
+    uint8_t *top = &pixels[y * stride];
+    uint8_t *bottom = &pixels[(r->height - 1 - y) * stride];
+    memcpy(row, top, stride);
+    memcpy(top, bottom, stride);
+    memcpy(bottom, row, stride);
+  }
+
+  free(row);
 }
 
 void r_draw_pixels(struct render_backend *r, const uint8_t *pixels, int x,
                    int y, int width, int height) {
-  glBindTexture(GL_TEXTURE_2D, r->pixel_texture);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
-               GL_UNSIGNED_BYTE, pixels);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  int offset = r_write_stream(&r->pixel_pbo, pixels, width * height * 4, 4);
+
+  /* only reallocate the texture when the framebuffer dimensions change */
+  r_bind_texture(r, MAP_DIFFUSE, r->pixel_texture);
+  if (width != r->pixel_width || height != r->pixel_height) {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, (void *)(intptr_t)offset);
+    r->pixel_width = width;
+    r->pixel_height = height;
+  } else {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA,
+                    GL_UNSIGNED_BYTE, (void *)(intptr_t)offset);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 
   glBindFramebuffer(GL_READ_FRAMEBUFFER, r->pixel_fbo);
   glReadBuffer(GL_COLOR_ATTACHMENT0);
@@ -691,7 +990,10 @@ void r_viewport(struct render_backend *r, int x, int y, int width, int height) {
 }
 
 void r_clear(struct render_backend *r) {
-  glDepthMask(1);
+  /* resynchronize the shadowed state at the start of each frame */
+  r_invalidate_state(r);
+
+  r_set_depth_mask(r, 1);
   glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
   glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 }
@@ -702,8 +1004,30 @@ void r_destroy_texture(struct render_backend *r, texture_handle_t handle) {
   }
 
   struct texture *tex = &r->textures[handle];
+
+  /* deleting a bound texture implicitly unbinds it */
+  for (int i = 0; i < MAP_NUM_TEXTURES; i++) {
+    if (r->state.textures[i] == tex->texture) {
+      r->state.textures[i] = 0;
+    }
+  }
+
   glDeleteTextures(1, &tex->texture);
   tex->texture = 0;
+
+  r->free_textures[r->num_free_textures++] = handle;
+}
+
+void r_update_texture(struct render_backend *r, texture_handle_t handle,
+                      enum pxl_format format, int x, int y, int width,
+                      int height, const uint8_t *buffer) {
+  GLuint internal_fmt = internal_formats[format];
+  GLuint pixel_fmt = pixel_formats[format];
+
+  struct texture *tex = &r->textures[handle];
+  r_bind_texture(r, MAP_DIFFUSE, tex->texture);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, internal_fmt,
+                  pixel_fmt, buffer);
 }
 
 texture_handle_t r_create_texture(struct render_backend *r,
@@ -712,22 +1036,15 @@ texture_handle_t r_create_texture(struct render_backend *r,
                                   enum wrap_mode wrap_u, enum wrap_mode wrap_v,
                                   int mipmaps, int width, int height,
                                   const uint8_t *buffer) {
-  /* find next open texture entry */
-  texture_handle_t handle;
-  for (handle = 1; handle < MAX_TEXTURES; handle++) {
-    struct texture *tex = &r->textures[handle];
-    if (!tex->texture) {
-      break;
-    }
-  }
-  CHECK_LT(handle, MAX_TEXTURES);
+  CHECK_GT(r->num_free_textures, 0);
+  texture_handle_t handle = r->free_textures[--r->num_free_textures];
 
   GLuint internal_fmt = internal_formats[format];
   GLuint pixel_fmt = pixel_formats[format];
 
   struct texture *tex = &r->textures[handle];
   glGenTextures(1, &tex->texture);
-  glBindTexture(GL_TEXTURE_2D, tex->texture);
+  r_bind_texture(r, MAP_DIFFUSE, tex->texture);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
                   filter_funcs[mipmaps * NUM_FILTER_MODES + filter]);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter_funcs[filter]);
@@ -740,11 +1057,13 @@ texture_handle_t r_create_texture(struct render_backend *r,
     glGenerateMipmap(GL_TEXTURE_2D);
   }
 
-  glBindTexture(GL_TEXTURE_2D, 0);
-
   return handle;
 }
 
+void r_stats(struct render_backend *r, struct render_stats *stats) {
+  *stats = r->stats;
+}
+
 int r_height(struct render_backend *r) {
   return r->height;
 }
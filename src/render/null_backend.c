@@ -0,0 +1,126 @@
+/*
+ * null render backend
+ *
+ * doesn't render anything, but tracks texture handles and records the same
+ * stats as the other backends, enabling the render path to be exercised and
+ * measured headless
+ */
+
+#include "core/core.h"
+#include "render/render_backend.h"
+
+struct render_backend {
+  int width, height;
+
+  /* texture handles currently in use */
+  int textures[MAX_TEXTURES];
+  texture_handle_t free_textures[MAX_TEXTURES];
+  int num_free_textures;
+
+  /* stats for the current set of ta surfaces */
+  struct render_stats stats;
+  struct ta_surface last_surf;
+};
+
+void r_end_ui_surfaces(struct render_backend *r) {}
+
+void r_draw_ui_surface(struct render_backend *r,
+                       const struct ui_surface *surf) {}
+
+void r_begin_ui_surfaces(struct render_backend *r,
+                         const struct ui_vertex *verts, int num_verts,
+                         const uint16_t *indices, int num_indices) {}
+
+void r_end_ta_surfaces(struct render_backend *r) {}
+
+void r_draw_ta_surface(struct render_backend *r,
+                       const struct ta_surface *surf) {
+  if (!r->stats.ta_draws || surf->params.full != r->last_surf.params.full) {
+    r->stats.ta_state_changes++;
+  }
+  if (!r->stats.ta_draws ||
+      surf->params.texture != r->last_surf.params.texture) {
+    r->stats.ta_texture_changes++;
+  }
+  r->stats.ta_draws++;
+  r->last_surf = *surf;
+}
+
+void r_begin_ta_surfaces(struct render_backend *r, int video_width,
+                         int video_height, const struct ta_vertex *verts,
+                         int num_verts, const void *indices, int index_size,
+                         int num_indices) {
+  memset(&r->stats, 0, sizeof(r->stats));
+}
+
+void r_read_pixels(struct render_backend *r, uint8_t *pixels) {
+  memset(pixels, 0, r->width * r->height * 4);
+}
+
+void r_draw_pixels(struct render_backend *r, const uint8_t *pixels, int x,
+                   int y, int width, int height) {}
+
+void r_viewport(struct render_backend *r, int x, int y, int width,
+                int height) {}
+
+void r_clear(struct render_backend *r) {}
+
+void r_destroy_texture(struct render_backend *r, texture_handle_t handle) {
+  if (!handle) {
+    return;
+  }
+
+  CHECK(r->textures[handle]);
+  r->textures[handle] = 0;
+
+  r->free_textures[r->num_free_textures++] = handle;
+}
+
+void r_update_texture(struct render_backend *r, texture_handle_t handle,
+                      enum pxl_format format, int x, int y, int width,
+                      int height, const uint8_t *buffer) {
+  CHECK(r->textures[handle]);
+}
+
+texture_handle_t r_create_texture(struct render_backend *r,
+                                  enum pxl_format format,
+                                  enum filter_mode filter,
+                                  enum wrap_mode wrap_u, enum wrap_mode wrap_v,
+                                  int mipmaps, int width, int height,
+                                  const uint8_t *buffer) {
+  CHECK_GT(r->num_free_textures, 0);
+  texture_handle_t handle = r->free_textures[--r->num_free_textures];
+
+  r->textures[handle] = 1;
+
+  return handle;
+}
+
+void r_stats(struct render_backend *r, struct render_stats *stats) {
+  *stats = r->stats;
+}
+
+int r_height(struct render_backend *r) {
+  return r->height;
+}
+
+int r_width(struct render_backend *r) {
+  return r->width;
+}
+
+void r_destroy(struct render_backend *r) {
+  free(r);
+}
+
+struct render_backend *r_create(int width, int height) {
+  struct render_backend *r = calloc(1, sizeof(struct render_backend));
+
+  r->width = width;
+  r->height = height;
+
+  for (int i = MAX_TEXTURES - 1; i > 0; i--) {
+    r->free_textures[r->num_free_textures++] = i;
+  }
+
+  return r;
+}
@@ -129,11 +129,26 @@ struct ui_surface {
   int num_verts;
 };
 
+/* counters for the ta surfaces drawn since the last call to
+   r_begin_ta_surfaces, used to measure how well surfaces are batched */
+struct render_stats {
+  int ta_draws;
+  int ta_state_changes;
+  int ta_texture_changes;
+
+  /* state and draw calls issued to the underlying api, and the state calls
+     skipped as they wouldn't have changed anything */
+  int api_calls;
+  int skipped_api_calls;
+};
+
 struct render_backend;
 
 struct render_backend *r_create(int width, int height);
 void r_destroy(struct render_backend *r);
 
+void r_stats(struct render_backend *r, struct render_stats *stats);
+
 int r_width(struct render_backend *r);
 int r_height(struct render_backend *r);
 
@@ -143,6 +158,9 @@ texture_handle_t r_create_texture(struct render_backend *r,
                                   enum wrap_mode wrap_u, enum wrap_mode wrap_v,
                                   int mipmaps, int width, int height,
                                   const uint8_t *buffer);
+void r_update_texture(struct render_backend *r, texture_handle_t handle,
+                      enum pxl_format format, int x, int y, int width,
+                      int height, const uint8_t *buffer);
 void r_destroy_texture(struct render_backend *r, texture_handle_t handle);
 
 void r_clear(struct render_backend *r);
@@ -151,9 +169,14 @@ void r_viewport(struct render_backend *r, int x, int y, int width, int height);
 void r_draw_pixels(struct render_backend *r, const uint8_t *pixels, int x,
                    int y, int width, int height);
 
+/* read back the rgba contents of the entire backbuffer, with the first row
+   being the top of the image */
+void r_read_pixels(struct render_backend *r, uint8_t *pixels);
+
+/* indices are either 16 or 32-bit, as specified by index_size */
 void r_begin_ta_surfaces(struct render_backend *r, int video_width,
                          int video_height, const struct ta_vertex *verts,
-                         int num_verts, const uint16_t *indices,
+                         int num_verts, const void *indices, int index_size,
                          int num_indices);
 void r_draw_ta_surface(struct render_backend *r, const struct ta_surface *surf);
 void r_end_ta_surfaces(struct render_backend *r);
@@ -0,0 +1,1191 @@
+/*
+ * software render backend
+ *
+ * rasterizes surfaces on the cpu, enabling tools such as retrace to render
+ * on machines without a gpu. the emulator itself presents through a gl
+ * context, and always uses the gl backend. like the pvr itself, this is a
+ * tile-based renderer. triangles are set up and binned to each tile they
+ * overlap as surfaces are drawn, after which the tiles are rasterized
+ * independently by a pool of worker threads
+ *
+ * the output aims to match the gl backend closely, but not exactly. notably,
+ * textures are always sampled from their base level, ignoring any mipmaps
+ */
+
+#include <math.h>
+#include "core/core.h"
+#include "core/math.h"
+#include "core/thread.h"
+#include "render/render_backend.h"
+
+#if ARCH_X64
+#include <emmintrin.h>
+#endif
+
+/* tiles are square, and rasterized by a single thread at a time */
+#define R_TILE_SIZE 32
+
+/* number of threads rasterizing tiles alongside the calling thread */
+#define R_MAX_WORKERS 3
+
+/* the gl backend writes log2(1 + w) / 17 to its depth buffer, which clamps at
+   1.0. w is written out directly here, clamped to the equivalent value */
+#define R_MAX_DEPTH 131071.0f
+
+/* vertices closer than this can't be projected, and triangles crossing it are
+   clipped, matching gl's clipping of triangles which cross w = 0 */
+#define R_MIN_W 1e-5f
+
+/* attributes interpolated across each triangle. all but 1/w itself are
+   premultiplied by 1/w, making the interpolation perspective-correct */
+enum {
+  ATTR_INVW,
+  ATTR_U,
+  ATTR_V,
+  ATTR_R,
+  ATTR_G,
+  ATTR_B,
+  ATTR_A,
+  ATTR_OFFSET_R,
+  ATTR_OFFSET_G,
+  ATTR_OFFSET_B,
+  ATTR_NUM_ATTRS,
+};
+
+/* a*x + b*y + c, evaluated at pixel centers */
+struct plane {
+  float a, b, c;
+};
+
+/* pixel bounds, with the max being exclusive */
+struct rect {
+  int x0, y0, x1, y1;
+};
+
+struct viewport {
+  int x, y, w, h;
+};
+
+struct texture {
+  /* rgba8, regardless of the format the texture was created with */
+  uint8_t *pixels;
+  int width;
+  int height;
+  enum filter_mode filter;
+  enum wrap_mode wrap_u;
+  enum wrap_mode wrap_v;
+};
+
+/* state shared by all of the triangles set up for a surface */
+struct draw_state {
+  /* ui surfaces modulate their color by the texture, and aren't depth
+     tested */
+  int ui;
+  texture_handle_t texture;
+  enum depth_func depth_func;
+  int depth_write;
+  enum blend_func src_blend;
+  enum blend_func dst_blend;
+  enum shade_mode shade;
+  int ignore_alpha;
+  int ignore_texture_alpha;
+  int offset_color;
+  int alpha_test;
+  float alpha_ref;
+  int debug_depth;
+};
+
+struct raster_vertex {
+  float x, y;
+  float attrs[ATTR_NUM_ATTRS];
+};
+
+/* ta vertex before projection. the attributes aren't premultiplied by 1/w,
+   except for 1/w itself which is 1.0 */
+struct clip_vertex {
+  float x, y, w, invw;
+  float attrs[ATTR_NUM_ATTRS];
+};
+
+struct triangle {
+  struct plane edges[3];
+  int top_left[3];
+  struct plane attrs[ATTR_NUM_ATTRS];
+  struct rect bounds;
+  int state;
+};
+
+struct tile_bin {
+  int *tris;
+  int num_tris;
+  int max_tris;
+};
+
+struct render_backend {
+  int width, height;
+
+  /* current viewport */
+  struct viewport viewport;
+
+  /* color and depth buffers, with the first row being the top of the image */
+  uint8_t *color;
+  float *depth;
+
+  /* texture cache */
+  struct texture textures[MAX_TEXTURES];
+  texture_handle_t free_textures[MAX_TEXTURES];
+  int num_free_textures;
+
+  /* surface render state */
+  int video_width;
+  int video_height;
+  const struct ta_vertex *ta_verts;
+  const void *ta_indices;
+  int ta_index_size;
+  const struct ui_vertex *ui_verts;
+  const uint16_t *ui_indices;
+
+  /* triangles set up for the current set of ta surfaces, each of which is
+     binned to the tiles it overlaps */
+  struct draw_state *states;
+  int num_states;
+  int max_states;
+  struct triangle *tris;
+  int num_tris;
+  int max_tris;
+  struct tile_bin *bins;
+  int tiles_x;
+  int tiles_y;
+
+  /* threads rasterizing the binned tiles */
+  thread_t workers[R_MAX_WORKERS];
+  int num_workers;
+  mutex_t mutex;
+  cond_t work_cond;
+  cond_t done_cond;
+  int generation;
+  int busy_workers;
+  int next_tile;
+  int shutdown;
+
+  /* stats for the current set of ta surfaces */
+  struct render_stats stats;
+  struct ta_surface last_surf;
+};
+
+static void *r_grow_array(void *arr, int *max, int num, int size) {
+  int new_max = MAX(*max * 2, 1024);
+  while (new_max < num) {
+    new_max *= 2;
+  }
+
+  arr = realloc(arr, new_max * size);
+  CHECK_NOTNULL(arr);
+  *max = new_max;
+
+  return arr;
+}
+
+/*
+ * textures
+ */
+static void r_convert_pixels(uint8_t *dst, enum pxl_format format,
+                             const uint8_t *src, int num) {
+  const uint16_t *src16 = (const uint16_t *)src;
+
+  for (int i = 0; i < num; i++, dst += 4) {
+    switch (format) {
+      case PXL_RGB:
+        dst[0] = src[i * 3 + 0];
+        dst[1] = src[i * 3 + 1];
+        dst[2] = src[i * 3 + 2];
+        dst[3] = 0xff;
+        break;
+      case PXL_RGBA:
+        memcpy(dst, &src[i * 4], 4);
+        break;
+      case PXL_RGBA5551: {
+        uint16_t p = src16[i];
+        dst[0] = ((p >> 11) & 0x1f) * 255 / 31;
+        dst[1] = ((p >> 6) & 0x1f) * 255 / 31;
+        dst[2] = ((p >> 1) & 0x1f) * 255 / 31;
+        dst[3] = (p & 0x1) * 255;
+      } break;
+      case PXL_RGB565: {
+        uint16_t p = src16[i];
+        dst[0] = ((p >> 11) & 0x1f) * 255 / 31;
+        dst[1] = ((p >> 5) & 0x3f) * 255 / 63;
+        dst[2] = (p & 0x1f) * 255 / 31;
+        dst[3] = 0xff;
+      } break;
+      case PXL_RGBA4444: {
+        uint16_t p = src16[i];
+        dst[0] = ((p >> 12) & 0xf) * 17;
+        dst[1] = ((p >> 8) & 0xf) * 17;
+        dst[2] = ((p >> 4) & 0xf) * 17;
+        dst[3] = (p & 0xf) * 17;
+      } break;
+      default:
+        LOG_FATAL("unexpected pixel format %d", format);
+        break;
+    }
+  }
+}
+
+static inline int r_wrap_texel(int x, int size, enum wrap_mode mode) {
+  if (mode == WRAP_CLAMP_TO_EDGE) {
+    return CLAMP(x, 0, size - 1);
+  }
+
+  if (mode == WRAP_MIRRORED_REPEAT) {
+    x %= size * 2;
+    if (x < 0) {
+      x += size * 2;
+    }
+    return x < size ? x : size * 2 - 1 - x;
+  }
+
+  x %= size;
+  if (x < 0) {
+    x += size;
+  }
+  return x;
+}
+
+static inline float r_wrap_coord(float u, enum wrap_mode mode) {
+  /* keep coordinates small enough to be converted to integer texels */
+  if (mode == WRAP_CLAMP_TO_EDGE) {
+    return CLAMP(u, -1.0f, 2.0f);
+  } else if (mode == WRAP_MIRRORED_REPEAT) {
+    return u - 2.0f * floorf(u * 0.5f);
+  }
+  return u - floorf(u);
+}
+
+static void r_sample_texture(const struct texture *tex, float u, float v,
+                             float *out) {
+  u = r_wrap_coord(u, tex->wrap_u) * tex->width;
+  v = r_wrap_coord(v, tex->wrap_v) * tex->height;
+
+  if (tex->filter == FILTER_NEAREST) {
+    int x = r_wrap_texel((int)floorf(u), tex->width, tex->wrap_u);
+    int y = r_wrap_texel((int)floorf(v), tex->height, tex->wrap_v);
+    const uint8_t *texel = &tex->pixels[(y * tex->width + x) * 4];
+
+    for (int i = 0; i < 4; i++) {
+      out[i] = texel[i] * (1.0f / 255.0f);
+    }
+    return;
+  }
+
+  u -= 0.5f;
+  v -= 0.5f;
+
+  float fu = floorf(u);
+  float fv = floorf(v);
+  float wu = u - fu;
+  float wv = v - fv;
+  int x0 = r_wrap_texel((int)fu, tex->width, tex->wrap_u);
+  int x1 = r_wrap_texel((int)fu + 1, tex->width, tex->wrap_u);
+  int y0 = r_wrap_texel((int)fv, tex->height, tex->wrap_v);
+  int y1 = r_wrap_texel((int)fv + 1, tex->height, tex->wrap_v);
+
+  const uint8_t *t00 = &tex->pixels[(y0 * tex->width + x0) * 4];
+  const uint8_t *t10 = &tex->pixels[(y0 * tex->width + x1) * 4];
+  const uint8_t *t01 = &tex->pixels[(y1 * tex->width + x0) * 4];
+  const uint8_t *t11 = &tex->pixels[(y1 * tex->width + x1) * 4];
+
+  for (int i = 0; i < 4; i++) {
+    float top = t00[i] + (t10[i] - t00[i]) * wu;
+    float bottom = t01[i] + (t11[i] - t01[i]) * wu;
+    out[i] = (top + (bottom - top) * wv) * (1.0f / 255.0f);
+  }
+}
+
+/*
+ * shading
+ */
+static inline float r_eval_plane(const struct plane *p, float x, float y) {
+  return p->a * x + p->b * y + p->c;
+}
+
+static inline int r_depth_test(enum depth_func func, float a, float b) {
+  switch (func) {
+    case DEPTH_NEVER:
+      return 0;
+    case DEPTH_LESS:
+      return a < b;
+    case DEPTH_EQUAL:
+      return a == b;
+    case DEPTH_LEQUAL:
+      return a <= b;
+    case DEPTH_GREATER:
+      return a > b;
+    case DEPTH_NEQUAL:
+      return a != b;
+    case DEPTH_GEQUAL:
+      return a >= b;
+    default:
+      return 1;
+  }
+}
+
+static inline void r_blend_factor(enum blend_func func, const float *src,
+                                  const float *dst, float *out) {
+  for (int i = 0; i < 4; i++) {
+    switch (func) {
+      case BLEND_ZERO:
+        out[i] = 0.0f;
+        break;
+      case BLEND_ONE:
+        out[i] = 1.0f;
+        break;
+      case BLEND_SRC_COLOR:
+        out[i] = src[i];
+        break;
+      case BLEND_ONE_MINUS_SRC_COLOR:
+        out[i] = 1.0f - src[i];
+        break;
+      case BLEND_SRC_ALPHA:
+        out[i] = src[3];
+        break;
+      case BLEND_ONE_MINUS_SRC_ALPHA:
+        out[i] = 1.0f - src[3];
+        break;
+      case BLEND_DST_ALPHA:
+        out[i] = dst[3];
+        break;
+      case BLEND_ONE_MINUS_DST_ALPHA:
+        out[i] = 1.0f - dst[3];
+        break;
+      case BLEND_DST_COLOR:
+        out[i] = dst[i];
+        break;
+      case BLEND_ONE_MINUS_DST_COLOR:
+        out[i] = 1.0f - dst[i];
+        break;
+      default:
+        out[i] = 1.0f;
+        break;
+    }
+  }
+}
+
+/* mirrors the fragment shaders used by the gl backend */
+static void r_shade_pixel(struct render_backend *r, const struct triangle *tri,
+                          const struct draw_state *state,
+                          const struct texture *tex, int x, int y) {
+  float px = x + 0.5f;
+  float py = y + 0.5f;
+  float invw = r_eval_plane(&tri->attrs[ATTR_INVW], px, py);
+  float w = 1.0f / invw;
+  float depth = MIN(w, R_MAX_DEPTH);
+  float *dst_depth = &r->depth[y * r->width + x];
+  int depth_test = !state->ui && state->depth_func != DEPTH_NONE;
+
+  if (depth_test && !r_depth_test(state->depth_func, depth, *dst_depth)) {
+    return;
+  }
+
+  float col[4];
+  for (int i = 0; i < 4; i++) {
+    col[i] = r_eval_plane(&tri->attrs[ATTR_R + i], px, py) * w;
+  }
+
+  float texcol[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  if (tex) {
+    float u = r_eval_plane(&tri->attrs[ATTR_U], px, py) * w;
+    float v = r_eval_plane(&tri->attrs[ATTR_V], px, py) * w;
+    r_sample_texture(tex, u, v, texcol);
+  }
+
+  float frag[4];
+
+  if (state->ui) {
+    for (int i = 0; i < 4; i++) {
+      frag[i] = col[i] * texcol[i];
+    }
+  } else {
+    if (state->ignore_alpha) {
+      col[3] = 1.0f;
+    }
+
+    if (tex) {
+      if (state->ignore_texture_alpha) {
+        texcol[3] = 1.0f;
+      }
+
+      if (state->alpha_test && texcol[3] < state->alpha_ref) {
+        return;
+      }
+
+      switch (state->shade) {
+        case SHADE_DECAL:
+          memcpy(frag, texcol, sizeof(frag));
+          break;
+        case SHADE_MODULATE:
+          for (int i = 0; i < 3; i++) {
+            frag[i] = texcol[i] * col[i];
+          }
+          frag[3] = texcol[3];
+          break;
+        case SHADE_DECAL_ALPHA:
+          for (int i = 0; i < 3; i++) {
+            frag[i] = texcol[i] * texcol[3] + col[i] * (1.0f - texcol[3]);
+          }
+          frag[3] = col[3];
+          break;
+        case SHADE_MODULATE_ALPHA:
+          for (int i = 0; i < 4; i++) {
+            frag[i] = texcol[i] * col[i];
+          }
+          break;
+      }
+    } else {
+      memcpy(frag, col, sizeof(frag));
+    }
+
+    if (state->offset_color) {
+      for (int i = 0; i < 3; i++) {
+        frag[i] += r_eval_plane(&tri->attrs[ATTR_OFFSET_R + i], px, py) * w;
+      }
+    }
+
+    /* punch through polys are always drawn with an alpha value of 1.0 */
+    if (state->alpha_test) {
+      frag[3] = 1.0f;
+    }
+
+    if (state->debug_depth) {
+      float d = CLAMP(log2f(1.0f + w) / 17.0f, 0.0f, 1.0f);
+      frag[0] = frag[1] = frag[2] = d;
+    }
+  }
+
+  for (int i = 0; i < 4; i++) {
+    frag[i] = CLAMP(frag[i], 0.0f, 1.0f);
+  }
+
+  uint8_t *dst_color = &r->color[(y * r->width + x) * 4];
+
+  if (state->src_blend != BLEND_NONE && state->dst_blend != BLEND_NONE) {
+    float dst[4], src_factor[4], dst_factor[4];
+    for (int i = 0; i < 4; i++) {
+      dst[i] = dst_color[i] * (1.0f / 255.0f);
+    }
+
+    r_blend_factor(state->src_blend, frag, dst, src_factor);
+    r_blend_factor(state->dst_blend, frag, dst, dst_factor);
+
+    for (int i = 0; i < 4; i++) {
+      float c = frag[i] * src_factor[i] + dst[i] * dst_factor[i];
+      frag[i] = CLAMP(c, 0.0f, 1.0f);
+    }
+  }
+
+  for (int i = 0; i < 4; i++) {
+    dst_color[i] = (uint8_t)(frag[i] * 255.0f + 0.5f);
+  }
+
+  /* like gl, depth writes are disabled along with the depth test */
+  if (depth_test && state->depth_write) {
+    *dst_depth = depth;
+  }
+}
+
+/*
+ * rasterization
+ */
+static inline int r_coverage_mask(const struct triangle *tri, int x, float py,
+                                  int x1) {
+#if ARCH_X64
+  __m128 px = _mm_add_ps(_mm_set1_ps((float)x + 0.5f),
+                         _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+  __m128 zero = _mm_setzero_ps();
+  int mask = 0xf;
+
+  for (int i = 0; i < 3; i++) {
+    const struct plane *e = &tri->edges[i];
+    __m128 row = _mm_set1_ps(e->b * py + e->c);
+    __m128 v = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e->a), px), row);
+    __m128 inside = tri->top_left[i] ? _mm_cmpge_ps(v, zero)
+                                     : _mm_cmpgt_ps(v, zero);
+    mask &= _mm_movemask_ps(inside);
+  }
+#else
+  int mask = 0;
+
+  for (int j = 0; j < 4; j++) {
+    float px = (float)(x + j) + 0.5f;
+    int inside = 1;
+
+    for (int i = 0; i < 3; i++) {
+      const struct plane *e = &tri->edges[i];
+      float v = e->a * px + (e->b * py + e->c);
+      inside &= tri->top_left[i] ? v >= 0.0f : v > 0.0f;
+    }
+
+    mask |= inside << j;
+  }
+#endif
+
+  /* mask off pixels past the right edge of the rect being rasterized */
+  if (x1 - x < 4) {
+    mask &= (1 << (x1 - x)) - 1;
+  }
+
+  return mask;
+}
+
+static void r_raster_triangle(struct render_backend *r,
+                              const struct triangle *tri,
+                              const struct rect *clip) {
+  int x0 = MAX(tri->bounds.x0, clip->x0);
+  int y0 = MAX(tri->bounds.y0, clip->y0);
+  int x1 = MIN(tri->bounds.x1, clip->x1);
+  int y1 = MIN(tri->bounds.y1, clip->y1);
+
+  const struct draw_state *state = &r->states[tri->state];
+  const struct texture *tex = NULL;
+  if (state->texture) {
+    tex = &r->textures[state->texture];
+  }
+
+  for (int y = y0; y < y1; y++) {
+    float py = y + 0.5f;
+
+    /* edge functions are evaluated four pixels at a time */
+    for (int x = x0; x < x1; x += 4) {
+      int mask = r_coverage_mask(tri, x, py, x1);
+
+      while (mask) {
+        int i = ctz32(mask);
+        r_shade_pixel(r, tri, state, tex, x + i, y);
+        mask &= mask - 1;
+      }
+    }
+  }
+}
+
+static void r_raster_tile(struct render_backend *r, int tile) {
+  struct tile_bin *bin = &r->bins[tile];
+  struct rect rect;
+  rect.x0 = (tile % r->tiles_x) * R_TILE_SIZE;
+  rect.y0 = (tile / r->tiles_x) * R_TILE_SIZE;
+  rect.x1 = MIN(rect.x0 + R_TILE_SIZE, r->width);
+  rect.y1 = MIN(rect.y0 + R_TILE_SIZE, r->height);
+
+  /* triangles were binned in submission order, preserving the draw order */
+  for (int i = 0; i < bin->num_tris; i++) {
+    r_raster_triangle(r, &r->tris[bin->tris[i]], &rect);
+  }
+
+  bin->num_tris = 0;
+}
+
+static void r_raster_tiles(struct render_backend *r) {
+  int num_tiles = r->tiles_x * r->tiles_y;
+
+  while (1) {
+    mutex_lock(r->mutex);
+    int tile = r->next_tile++;
+    mutex_unlock(r->mutex);
+
+    if (tile >= num_tiles) {
+      break;
+    }
+
+    r_raster_tile(r, tile);
+  }
+}
+
+static void *r_worker_thread(void *data) {
+  struct render_backend *r = data;
+  int generation = 0;
+
+  mutex_lock(r->mutex);
+
+  while (1) {
+    while (r->generation == generation && !r->shutdown) {
+      cond_wait(r->work_cond, r->mutex);
+    }
+
+    if (r->shutdown) {
+      break;
+    }
+
+    generation = r->generation;
+
+    mutex_unlock(r->mutex);
+
+    r_raster_tiles(r);
+
+    mutex_lock(r->mutex);
+
+    if (--r->busy_workers == 0) {
+      cond_signal(r->done_cond);
+    }
+  }
+
+  mutex_unlock(r->mutex);
+
+  return NULL;
+}
+
+/*
+ * setup
+ */
+static void r_project_vertex(const struct clip_vertex *in,
+                             struct raster_vertex *out) {
+  out->x = in->x;
+  out->y = in->y;
+  for (int i = 0; i < ATTR_NUM_ATTRS; i++) {
+    out->attrs[i] = in->attrs[i] * in->invw;
+  }
+}
+
+/* clip the triangle against the w = R_MIN_W plane, returning the projected
+   polygon as a fan of up to 4 vertices */
+static int r_clip_triangle(const struct clip_vertex *in,
+                           struct raster_vertex *out) {
+  int n = 0;
+
+  for (int i = 0; i < 3; i++) {
+    const struct clip_vertex *a = &in[i];
+    const struct clip_vertex *b = &in[(i + 1) % 3];
+    int a_inside = a->w >= R_MIN_W;
+    int b_inside = b->w >= R_MIN_W;
+
+    if (a_inside) {
+      r_project_vertex(a, &out[n++]);
+    }
+
+    if (a_inside == b_inside) {
+      continue;
+    }
+
+    /* positions and attributes are linear along the edge in homogeneous
+       space, where the screen position is scaled by w */
+    float t = (R_MIN_W - a->w) / (b->w - a->w);
+    struct clip_vertex c;
+    c.x = (a->x * a->w + (b->x * b->w - a->x * a->w) * t) / R_MIN_W;
+    c.y = (a->y * a->w + (b->y * b->w - a->y * a->w) * t) / R_MIN_W;
+    c.w = R_MIN_W;
+    c.invw = 1.0f / R_MIN_W;
+    for (int j = 0; j < ATTR_NUM_ATTRS; j++) {
+      c.attrs[j] = a->attrs[j] + (b->attrs[j] - a->attrs[j]) * t;
+    }
+    r_project_vertex(&c, &out[n++]);
+  }
+
+  return n;
+}
+
+static inline float r_area(const struct raster_vertex *a,
+                           const struct raster_vertex *b,
+                           const struct raster_vertex *c) {
+  return (b->x - a->x) * (c->y - a->y) - (c->x - a->x) * (b->y - a->y);
+}
+
+static void r_setup_edge(struct plane *e, int *top_left,
+                         const struct raster_vertex *a,
+                         const struct raster_vertex *b, float sign) {
+  /* evaluate the edge relative to the same endpoint, regardless of direction.
+     this way, triangles sharing the edge produce exactly negated values, and
+     the fill rule assigns pixels on the edge to only one of them */
+  int swap = a->y > b->y || (a->y == b->y && a->x > b->x);
+  const struct raster_vertex *p = swap ? b : a;
+  const struct raster_vertex *q = swap ? a : b;
+
+  e->a = p->y - q->y;
+  e->b = q->x - p->x;
+  e->c = -(e->a * p->x + e->b * p->y);
+
+  if (swap) {
+    sign = -sign;
+  }
+
+  e->a *= sign;
+  e->b *= sign;
+  e->c *= sign;
+
+  /* pixel centers exactly on an edge are only covered by left and top edges,
+     edges are oriented such that the inside is positive, and y points down */
+  *top_left = e->a > 0.0f || (e->a == 0.0f && e->b > 0.0f);
+}
+
+static int r_setup_triangle(struct render_backend *r, int state,
+                            enum cull_face cull,
+                            const struct raster_vertex *v0,
+                            const struct raster_vertex *v1,
+                            const struct raster_vertex *v2,
+                            const struct rect *clip) {
+  float area = r_area(v0, v1, v2);
+
+  /* front faces are wound counter-clockwise in gl's window space, where y
+     points up. y points down here, flipping the sign of the area */
+  if (area == 0.0f || !isfinite(area) ||
+      (cull == CULL_FRONT && area < 0.0f) ||
+      (cull == CULL_BACK && area > 0.0f)) {
+    return -1;
+  }
+
+  /* clipped vertices can be projected far outside of the viewport, clamp
+     before converting to int */
+  struct rect bounds;
+  bounds.x0 = (int)MAX(floorf(MIN(MIN(v0->x, v1->x), v2->x)), clip->x0);
+  bounds.y0 = (int)MAX(floorf(MIN(MIN(v0->y, v1->y), v2->y)), clip->y0);
+  bounds.x1 = (int)MIN(ceilf(MAX(MAX(v0->x, v1->x), v2->x)) + 1, clip->x1);
+  bounds.y1 = (int)MIN(ceilf(MAX(MAX(v0->y, v1->y), v2->y)) + 1, clip->y1);
+
+  if (bounds.x0 >= bounds.x1 || bounds.y0 >= bounds.y1) {
+    return -1;
+  }
+
+  if (r->num_tris >= r->max_tris) {
+    r->tris = r_grow_array(r->tris, &r->max_tris, r->num_tris + 1,
+                           sizeof(struct triangle));
+  }
+
+  int n = r->num_tris++;
+  struct triangle *tri = &r->tris[n];
+  float sign = area < 0.0f ? -1.0f : 1.0f;
+
+  r_setup_edge(&tri->edges[0], &tri->top_left[0], v1, v2, sign);
+  r_setup_edge(&tri->edges[1], &tri->top_left[1], v2, v0, sign);
+  r_setup_edge(&tri->edges[2], &tri->top_left[2], v0, v1, sign);
+
+  /* the edge functions are the barycentric weights of each vertex, scaled by
+     the area of the triangle */
+  float inv_area = 1.0f / (area * sign);
+
+  for (int i = 0; i < ATTR_NUM_ATTRS; i++) {
+    struct plane *p = &tri->attrs[i];
+    float a0 = v0->attrs[i] * inv_area;
+    float a1 = v1->attrs[i] * inv_area;
+    float a2 = v2->attrs[i] * inv_area;
+    p->a = tri->edges[0].a * a0 + tri->edges[1].a * a1 + tri->edges[2].a * a2;
+    p->b = tri->edges[0].b * a0 + tri->edges[1].b * a1 + tri->edges[2].b * a2;
+    p->c = tri->edges[0].c * a0 + tri->edges[1].c * a1 + tri->edges[2].c * a2;
+  }
+
+  tri->bounds = bounds;
+  tri->state = state;
+
+  return n;
+}
+
+static void r_bin_triangle(struct render_backend *r, int n) {
+  const struct rect *bounds = &r->tris[n].bounds;
+  int tx0 = bounds->x0 / R_TILE_SIZE;
+  int ty0 = bounds->y0 / R_TILE_SIZE;
+  int tx1 = (bounds->x1 - 1) / R_TILE_SIZE;
+  int ty1 = (bounds->y1 - 1) / R_TILE_SIZE;
+
+  for (int ty = ty0; ty <= ty1; ty++) {
+    for (int tx = tx0; tx <= tx1; tx++) {
+      struct tile_bin *bin = &r->bins[ty * r->tiles_x + tx];
+
+      if (bin->num_tris >= bin->max_tris) {
+        bin->tris = r_grow_array(bin->tris, &bin->max_tris, bin->num_tris + 1,
+                                 sizeof(int));
+      }
+
+      bin->tris[bin->num_tris++] = n;
+    }
+  }
+}
+
+static struct draw_state *r_push_state(struct render_backend *r) {
+  if (r->num_states >= r->max_states) {
+    r->states = r_grow_array(r->states, &r->max_states, r->num_states + 1,
+                             sizeof(struct draw_state));
+  }
+
+  struct draw_state *state = &r->states[r->num_states++];
+  memset(state, 0, sizeof(*state));
+  return state;
+}
+
+/* area of the color buffer covered by the viewport */
+static void r_viewport_rect(struct render_backend *r, struct rect *rect) {
+  /* the viewport's origin is the bottom-left corner, as with gl */
+  int top = r->height - r->viewport.y - r->viewport.h;
+
+  rect->x0 = MAX(r->viewport.x, 0);
+  rect->y0 = MAX(top, 0);
+  rect->x1 = MIN(r->viewport.x + r->viewport.w, r->width);
+  rect->y1 = MIN(top + r->viewport.h, r->height);
+}
+
+void r_end_ui_surfaces(struct render_backend *r) {}
+
+void r_draw_ui_surface(struct render_backend *r,
+                       const struct ui_surface *surf) {
+  /* only triangles are currently drawn */
+  if (surf->prim_type != PRIM_TRIANGLES) {
+    return;
+  }
+
+  struct draw_state *state = r_push_state(r);
+  state->ui = 1;
+  state->texture = surf->texture;
+  state->src_blend = surf->src_blend;
+  state->dst_blend = surf->dst_blend;
+
+  struct rect clip;
+  r_viewport_rect(r, &clip);
+
+  if (surf->scissor) {
+    /* the scissor rect's origin is the bottom-left corner */
+    int x = (int)surf->scissor_rect[0];
+    int y = r->height - (int)surf->scissor_rect[1] - (int)surf->scissor_rect[3];
+    clip.x0 = MAX(clip.x0, x);
+    clip.y0 = MAX(clip.y0, y);
+    clip.x1 = MIN(clip.x1, x + (int)surf->scissor_rect[2]);
+    clip.y1 = MIN(clip.y1, y + (int)surf->scissor_rect[3]);
+  }
+
+  int top = r->height - r->viewport.y - r->viewport.h;
+
+  /* ui surfaces are drawn immediately on the calling thread */
+  for (int i = 0; i + 2 < surf->num_verts; i += 3) {
+    struct raster_vertex rv[3];
+
+    for (int j = 0; j < 3; j++) {
+      int index = surf->first_vert + i + j;
+      if (r->ui_indices) {
+        index = r->ui_indices[index];
+      }
+
+      const struct ui_vertex *v = &r->ui_verts[index];
+      const uint8_t *color = (const uint8_t *)&v->color;
+      struct raster_vertex *out = &rv[j];
+      out->x = r->viewport.x + v->xy[0];
+      out->y = top + v->xy[1];
+      out->attrs[ATTR_INVW] = 1.0f;
+      out->attrs[ATTR_U] = v->uv[0];
+      out->attrs[ATTR_V] = v->uv[1];
+      for (int k = 0; k < 4; k++) {
+        out->attrs[ATTR_R + k] = color[k] * (1.0f / 255.0f);
+      }
+      for (int k = 0; k < 3; k++) {
+        out->attrs[ATTR_OFFSET_R + k] = 0.0f;
+      }
+    }
+
+    int n = r_setup_triangle(r, r->num_states - 1, CULL_NONE, &rv[0], &rv[1],
+                             &rv[2], &clip);
+    if (n >= 0) {
+      r_raster_triangle(r, &r->tris[n], &clip);
+    }
+  }
+
+  r->num_tris = 0;
+  r->num_states = 0;
+}
+
+void r_begin_ui_surfaces(struct render_backend *r,
+                         const struct ui_vertex *verts, int num_verts,
+                         const uint16_t *indices, int num_indices) {
+  r->ui_verts = verts;
+  r->ui_indices = indices;
+}
+
+void r_end_ta_surfaces(struct render_backend *r) {
+  /* kick off the workers, and rasterize tiles alongside them */
+  mutex_lock(r->mutex);
+  r->next_tile = 0;
+  r->busy_workers = r->num_workers;
+  r->generation++;
+  cond_broadcast(r->work_cond);
+  mutex_unlock(r->mutex);
+
+  r_raster_tiles(r);
+
+  mutex_lock(r->mutex);
+  while (r->busy_workers) {
+    cond_wait(r->done_cond, r->mutex);
+  }
+  mutex_unlock(r->mutex);
+
+  r->num_tris = 0;
+  r->num_states = 0;
+}
+
+void r_draw_ta_surface(struct render_backend *r,
+                       const struct ta_surface *surf) {
+  if (!r->stats.ta_draws || surf->params.full != r->last_surf.params.full) {
+    r->stats.ta_state_changes++;
+  }
+  if (!r->stats.ta_draws ||
+      surf->params.texture != r->last_surf.params.texture) {
+    r->stats.ta_texture_changes++;
+  }
+  r->stats.ta_draws++;
+  r->last_surf = *surf;
+
+  struct draw_state *state = r_push_state(r);
+  state->texture = surf->params.texture;
+  state->depth_func = surf->params.depth_func;
+  state->depth_write = surf->params.depth_write;
+  state->src_blend = surf->params.src_blend;
+  state->dst_blend = surf->params.dst_blend;
+  state->shade = surf->params.shade;
+  state->ignore_alpha = surf->params.ignore_alpha;
+  state->ignore_texture_alpha = surf->params.ignore_texture_alpha;
+  state->offset_color = surf->params.offset_color;
+  state->alpha_test = surf->params.alpha_test;
+  state->alpha_ref = surf->params.alpha_ref / 255.0f;
+  state->debug_depth = surf->params.debug_depth;
+
+  struct rect clip;
+  r_viewport_rect(r, &clip);
+
+  /* scale from the original video dimensions to the viewport */
+  float scale_x = (float)r->viewport.w / r->video_width;
+  float scale_y = (float)r->viewport.h / r->video_height;
+  int top = r->height - r->viewport.y - r->viewport.h;
+
+  for (int i = 0; i + 2 < surf->num_verts; i += 3) {
+    struct clip_vertex cv[3];
+    int num_inside = 0;
+    int valid = 1;
+
+    for (int j = 0; j < 3; j++) {
+      int index = surf->first_vert + i + j;
+      if (r->ta_index_size == 4) {
+        index = ((const uint32_t *)r->ta_indices)[index];
+      } else {
+        index = ((const uint16_t *)r->ta_indices)[index];
+      }
+
+      const struct ta_vertex *v = &r->ta_verts[index];
+      const uint8_t *color = (const uint8_t *)&v->color;
+      const uint8_t *offset_color = (const uint8_t *)&v->offset_color;
+      float invw = v->xyz[2];
+      float w = 1.0f / invw;
+
+      /* a 1/w of zero or nan has no position in homogeneous space */
+      if (!isfinite(w)) {
+        valid = 0;
+        break;
+      }
+
+      struct clip_vertex *out = &cv[j];
+      out->x = r->viewport.x + v->xyz[0] * scale_x;
+      out->y = top + v->xyz[1] * scale_y;
+      out->w = w;
+      out->invw = invw;
+      out->attrs[ATTR_INVW] = 1.0f;
+      out->attrs[ATTR_U] = v->uv[0];
+      out->attrs[ATTR_V] = v->uv[1];
+      for (int k = 0; k < 4; k++) {
+        out->attrs[ATTR_R + k] = color[k] * (1.0f / 255.0f);
+      }
+      for (int k = 0; k < 3; k++) {
+        out->attrs[ATTR_OFFSET_R + k] = offset_color[k] * (1.0f / 255.0f);
+      }
+
+      num_inside += w >= R_MIN_W;
+    }
+
+    if (!valid || !num_inside) {
+      continue;
+    }
+
+    struct raster_vertex rv[4];
+    int num_rv = r_clip_triangle(cv, rv);
+
+    for (int j = 1; j + 1 < num_rv; j++) {
+      int n = r_setup_triangle(r, r->num_states - 1, surf->params.cull,
+                               &rv[0], &rv[j], &rv[j + 1], &clip);
+      if (n >= 0) {
+        r_bin_triangle(r, n);
+      }
+    }
+  }
+}
+
+void r_begin_ta_surfaces(struct render_backend *r, int video_width,
+                         int video_height, const struct ta_vertex *verts,
+                         int num_verts, const void *indices, int index_size,
+                         int num_indices) {
+  memset(&r->stats, 0, sizeof(r->stats));
+
+  r->video_width = video_width;
+  r->video_height = video_height;
+  r->ta_verts = verts;
+  r->ta_indices = indices;
+  r->ta_index_size = index_size;
+}
+
+void r_read_pixels(struct render_backend *r, uint8_t *pixels) {
+  memcpy(pixels, r->color, r->width * r->height * 4);
+}
+
+void r_draw_pixels(struct render_backend *r, const uint8_t *pixels, int x,
+                   int y, int width, int height) {
+  struct rect rect;
+  r_viewport_rect(r, &rect);
+
+  int top = r->height - r->viewport.y - r->viewport.h;
+
+  /* scale the pixels to the viewport, with the first row at the top */
+  for (int dy = rect.y0; dy < rect.y1; dy++) {
+    int sy = y + (dy - top) * height / r->viewport.h;
+    uint8_t *dst = &r->color[(dy * r->width + rect.x0) * 4];
+
+    for (int dx = rect.x0; dx < rect.x1; dx++, dst += 4) {
+      int sx = x + (dx - r->viewport.x) * width / r->viewport.w;
+      memcpy(dst, &pixels[(sy * width + sx) * 4], 4);
+    }
+  }
+}
+
+void r_viewport(struct render_backend *r, int x, int y, int width,
+                int height) {
+  r->viewport.x = x;
+  r->viewport.y = y;
+  r->viewport.w = width;
+  r->viewport.h = height;
+}
+
+void r_clear(struct render_backend *r) {
+  int num_pixels = r->width * r->height;
+
+  memset(r->color, 0, num_pixels * 4);
+
+  for (int i = 0; i < num_pixels; i++) {
+    r->depth[i] = R_MAX_DEPTH;
+  }
+}
+
+void r_destroy_texture(struct render_backend *r, texture_handle_t handle) {
+  if (!handle) {
+    return;
+  }
+
+  struct texture *tex = &r->textures[handle];
+  CHECK_NOTNULL(tex->pixels);
+  free(tex->pixels);
+  tex->pixels = NULL;
+
+  r->free_textures[r->num_free_textures++] = handle;
+}
+
+void r_update_texture(struct render_backend *r, texture_handle_t handle,
+                      enum pxl_format format, int x, int y, int width,
+                      int height, const uint8_t *buffer) {
+  struct texture *tex = &r->textures[handle];
+  CHECK_NOTNULL(tex->pixels);
+
+  int bpp = format == PXL_RGBA ? 4 : (format == PXL_RGB ? 3 : 2);
+
+  for (int row = 0; row < height; row++) {
+    uint8_t *dst = &tex->pixels[((y + row) * tex->width + x) * 4];
+    r_convert_pixels(dst, format, &buffer[row * width * bpp], width);
+  }
+}
+
+texture_handle_t r_create_texture(struct render_backend *r,
+                                  enum pxl_format format,
+                                  enum filter_mode filter,
+                                  enum wrap_mode wrap_u, enum wrap_mode wrap_v,
+                                  int mipmaps, int width, int height,
+                                  const uint8_t *buffer) {
+  CHECK_GT(r->num_free_textures, 0);
+  texture_handle_t handle = r->free_textures[--r->num_free_textures];
+
+  struct texture *tex = &r->textures[handle];
+  tex->pixels = malloc(width * height * 4);
+  tex->width = width;
+  tex->height = height;
+  tex->filter = filter;
+  tex->wrap_u = wrap_u;
+  tex->wrap_v = wrap_v;
+
+  r_convert_pixels(tex->pixels, format, buffer, width * height);
+
+  return handle;
+}
+
+void r_stats(struct render_backend *r, struct render_stats *stats) {
+  *stats = r->stats;
+}
+
+int r_height(struct render_backend *r) {
+  return r->height;
+}
+
+int r_width(struct render_backend *r) {
+  return r->width;
+}
+
+void r_destroy(struct render_backend *r) {
+  mutex_lock(r->mutex);
+  r->shutdown = 1;
+  cond_broadcast(r->work_cond);
+  mutex_unlock(r->mutex);
+
+  for (int i = 0; i < r->num_workers; i++) {
+    thread_join(r->workers[i], NULL);
+  }
+
+  cond_destroy(r->done_cond);
+  cond_destroy(r->work_cond);
+  mutex_destroy(r->mutex);
+
+  for (int i = 0; i < MAX_TEXTURES; i++) {
+    free(r->textures[i].pixels);
+  }
+
+  for (int i = 0; i < r->tiles_x * r->tiles_y; i++) {
+    free(r->bins[i].tris);
+  }
+
+  free(r->bins);
+  free(r->tris);
+  free(r->states);
+  free(r->depth);
+  free(r->color);
+  free(r);
+}
+
+struct render_backend *r_create(int width, int height) {
+  struct render_backend *r = calloc(1, sizeof(struct render_backend));
+
+  r->width = width;
+  r->height = height;
+  r->viewport.w = width;
+  r->viewport.h = height;
+
+  r->color = calloc(width * height, 4);
+  r->depth = calloc(width * height, sizeof(float));
+  r_clear(r);
+
+  r->tiles_x = (width + R_TILE_SIZE - 1) / R_TILE_SIZE;
+  r->tiles_y = (height + R_TILE_SIZE - 1) / R_TILE_SIZE;
+  r->bins = calloc(r->tiles_x * r->tiles_y, sizeof(struct tile_bin));
+
+  for (int i = MAX_TEXTURES - 1; i > 0; i--) {
+    r->free_textures[r->num_free_textures++] = i;
+  }
+
+  r->mutex = mutex_create();
+  r->work_cond = cond_create();
+  r->done_cond = cond_create();
+
+  for (int i = 0; i < R_MAX_WORKERS; i++) {
+    thread_t worker = thread_create(&r_worker_thread, "r", r);
+
+    if (!worker) {
+      LOG_WARNING("r_create failed to create worker thread");
+      break;
+    }
+
+    r->workers[r->num_workers++] = worker;
+  }
+
+  return r;
+}
@@ -8,3 +8,11 @@ DEFINE_AGGREGATE_COUNTER(ta_renders);
 DEFINE_AGGREGATE_COUNTER(sh4_instrs);
 DEFINE_AGGREGATE_COUNTER(mmio_read);
 DEFINE_AGGREGATE_COUNTER(mmio_write);
+DEFINE_AGGREGATE_COUNTER(snapshots);
+DEFINE_AGGREGATE_COUNTER(snapshot_us);
+DEFINE_AGGREGATE_COUNTER(texture_hits);
+DEFINE_AGGREGATE_COUNTER(texture_misses);
+DEFINE_AGGREGATE_COUNTER(texture_evictions);
+DEFINE_AGGREGATE_COUNTER(texture_upload_bytes);
+DEFINE_AGGREGATE_COUNTER(gl_calls);
+DEFINE_AGGREGATE_COUNTER(gl_skipped_calls);
@@ -11,5 +11,13 @@ DECLARE_COUNTER(ta_renders);
 DECLARE_COUNTER(sh4_instrs);
 DECLARE_COUNTER(mmio_read);
 DECLARE_COUNTER(mmio_write);
+DECLARE_COUNTER(snapshots);
+DECLARE_COUNTER(snapshot_us);
+DECLARE_COUNTER(texture_hits);
+DECLARE_COUNTER(texture_misses);
+DECLARE_COUNTER(texture_evictions);
+DECLARE_COUNTER(texture_upload_bytes);
+DECLARE_COUNTER(gl_calls);
+DECLARE_COUNTER(gl_skipped_calls);
 
 #endif
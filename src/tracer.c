@@ -105,6 +105,7 @@ struct tracer {
   int scroll_to_param;
 
   /* render state */
+  struct tr *tr;
   struct tr_context rc;
   int debug_depth;
   struct tracer_texture textures[1024];
@@ -687,8 +688,7 @@ void tracer_render_frame(struct tracer *tracer) {
     end_surf = rp->last_surf;
   }
 
-  tr_convert_context(tracer->r, tracer, &tracer_find_texture, &tracer->ctx,
-                     &tracer->rc);
+  tr_convert_context(tracer->tr, &tracer->ctx, &tracer->rc);
 
   for (int i = 0; i < rc->num_surfs; i++) {
     struct ta_surface *surf = &rc->surfs[i];
@@ -733,8 +733,12 @@ int tracer_keydown(struct tracer *tracer, int key, int16_t value) {
 void tracer_vid_destroyed(struct tracer *tracer) {
   rb_for_each_entry_safe(tex, &tracer->live_textures, struct tracer_texture,
                          live_it) {
-    r_destroy_texture(tracer->r, tex->handle);
-    tex->handle = 0;
+    tr_release_texture(tracer->tr, (struct tr_texture *)tex);
+  }
+
+  if (tracer->tr) {
+    tr_destroy(tracer->tr);
+    tracer->tr = NULL;
   }
 
   tracer->r = NULL;
@@ -742,6 +746,7 @@ void tracer_vid_destroyed(struct tracer *tracer) {
 
 void tracer_vid_created(struct tracer *tracer, struct render_backend *r) {
   tracer->r = r;
+  tracer->tr = tr_create(r, tracer, &tracer_find_texture);
 }
 
 void tracer_destroy(struct tracer *tracer) {
@@ -750,6 +755,7 @@ void tracer_destroy(struct tracer *tracer) {
   }
 
   tracer_vid_destroyed(tracer);
+  tr_free_context(&tracer->rc);
 
   free(tracer);
 }
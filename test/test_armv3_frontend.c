@@ -0,0 +1,223 @@
+#include "core/core.h"
+#include "core/list.h"
+#include "jit/frontend/armv3/armv3_context.h"
+#include "jit/frontend/armv3/armv3_disasm.h"
+#include "jit/frontend/armv3/armv3_frontend.h"
+#include "jit/frontend/armv3/armv3_guest.h"
+#include "jit/ir/ir.h"
+#include "retest.h"
+
+#define RAM_SIZE 0x1000
+#define RAM_MASK (RAM_SIZE - 1)
+
+/* single data transfer encodings, always executed */
+#define XFR(p, u, b, w, l, rn, rd, imm)                                    \
+  (0xe4000000 | ((p) << 24) | ((u) << 23) | ((b) << 22) | ((w) << 21) |   \
+   ((l) << 20) | ((rn) << 16) | ((rd) << 12) | (imm))
+
+struct test_machine {
+  struct armv3_guest guest;
+  struct armv3_context ctx;
+  uint8_t ram[RAM_SIZE];
+};
+
+static uint8_t ir_buffer[1024 * 1024];
+
+static uint8_t test_r8(struct memory *mem, uint32_t addr) {
+  struct test_machine *m = (struct test_machine *)mem;
+  return m->ram[addr & RAM_MASK];
+}
+
+static uint32_t test_r32(struct memory *mem, uint32_t addr) {
+  struct test_machine *m = (struct test_machine *)mem;
+  return *(uint32_t *)&m->ram[addr & RAM_MASK & ~3];
+}
+
+static void test_w8(struct memory *mem, uint32_t addr, uint8_t data) {
+  struct test_machine *m = (struct test_machine *)mem;
+  m->ram[addr & RAM_MASK] = data;
+}
+
+static void test_w32(struct memory *mem, uint32_t addr, uint32_t data) {
+  struct test_machine *m = (struct test_machine *)mem;
+  *(uint32_t *)&m->ram[addr & RAM_MASK & ~3] = data;
+}
+
+static void init_machine(struct test_machine *m, uint32_t instr_addr,
+                         uint32_t instr, uint32_t cpsr) {
+  memset(m, 0, sizeof(*m));
+
+  m->guest.ctx = &m->ctx;
+  m->guest.mem = (struct memory *)m;
+  m->guest.r8 = &test_r8;
+  m->guest.r32 = &test_r32;
+  m->guest.w8 = &test_w8;
+  m->guest.w32 = &test_w32;
+
+  uint32_t seed = 1;
+  for (int i = 0; i < RAM_SIZE; i++) {
+    seed = seed * 1103515245 + 12345;
+    m->ram[i] = (uint8_t)(seed >> 16);
+  }
+
+  /* point each register at its own word aligned slot in ram */
+  for (int i = 0; i < 15; i++) {
+    m->ctx.r[i] = 0x800 + i * 0x40;
+  }
+  m->ctx.r[15] = instr_addr;
+  m->ctx.r[CPSR] = cpsr;
+
+  test_w32(m->guest.mem, instr_addr, instr);
+}
+
+static uint32_t eval_value(const struct ir_value *v) {
+  if (!ir_is_constant(v)) {
+    return (uint32_t)v->tag;
+  }
+
+  switch (v->type) {
+    case VALUE_I8:
+      return (uint8_t)v->i8;
+    case VALUE_I32:
+      return (uint32_t)v->i32;
+    default:
+      LOG_FATAL("unexpected value type");
+  }
+}
+
+/* interpret the subset of the ir emitted by the armv3 frontend, returning the
+   number of guest memory accesses which didn't go through a fallback */
+static int eval_ir(struct test_machine *m, struct ir *ir) {
+  uint8_t *ctx = (uint8_t *)&m->ctx;
+  int num_guest_ops = 0;
+
+  list_for_each_entry(blk, &ir->blocks, struct ir_block, it) {
+    list_for_each_entry(instr, &blk->instrs, struct ir_instr, it) {
+      struct ir_value *res = instr->result;
+
+      switch (instr->op) {
+        case OP_SOURCE_INFO:
+          break;
+        case OP_FALLBACK: {
+          jit_fallback fallback = (jit_fallback)instr->arg[0]->i64;
+          fallback((struct jit_guest *)&m->guest, eval_value(instr->arg[1]),
+                   eval_value(instr->arg[2]));
+        } break;
+        case OP_LOAD_CONTEXT:
+          CHECK_EQ(res->type, VALUE_I32);
+          res->tag = *(uint32_t *)&ctx[eval_value(instr->arg[0])];
+          break;
+        case OP_STORE_CONTEXT:
+          CHECK_EQ(instr->arg[1]->type, VALUE_I32);
+          *(uint32_t *)&ctx[eval_value(instr->arg[0])] =
+              eval_value(instr->arg[1]);
+          break;
+        case OP_LOAD_GUEST:
+          if (res->type == VALUE_I8) {
+            res->tag = test_r8(m->guest.mem, eval_value(instr->arg[0]));
+          } else {
+            res->tag = test_r32(m->guest.mem, eval_value(instr->arg[0]));
+          }
+          num_guest_ops++;
+          break;
+        case OP_STORE_GUEST:
+          if (instr->arg[1]->type == VALUE_I8) {
+            test_w8(m->guest.mem, eval_value(instr->arg[0]),
+                    eval_value(instr->arg[1]));
+          } else {
+            test_w32(m->guest.mem, eval_value(instr->arg[0]),
+                     eval_value(instr->arg[1]));
+          }
+          num_guest_ops++;
+          break;
+        case OP_ADD:
+          res->tag =
+              (uint32_t)(eval_value(instr->arg[0]) + eval_value(instr->arg[1]));
+          break;
+        case OP_SUB:
+          res->tag =
+              (uint32_t)(eval_value(instr->arg[0]) - eval_value(instr->arg[1]));
+          break;
+        case OP_ZEXT:
+        case OP_TRUNC:
+          res->tag = res->type == VALUE_I8 ? (uint8_t)eval_value(instr->arg[0])
+                                           : eval_value(instr->arg[0]);
+          break;
+        default:
+          LOG_FATAL("unexpected op %s", ir_opdefs[instr->op].name);
+      }
+    }
+  }
+
+  return num_guest_ops;
+}
+
+/* run the instruction through both the translated ir and the interpreter
+   fallback, checking that they leave the registers and memory in the same
+   state. returns the number of memory accesses made by the translated ir */
+static int compare_xfr(uint32_t instr, uint32_t cpsr) {
+  static struct test_machine expected;
+  static struct test_machine actual;
+  const uint32_t addr = 0x100;
+
+  init_machine(&expected, addr, instr, cpsr);
+  struct jit_opdef *def = armv3_get_opdef(instr);
+  def->fallback((struct jit_guest *)&expected.guest, addr, instr);
+
+  init_machine(&actual, addr, instr, cpsr);
+  struct jit_frontend *frontend =
+      armv3_frontend_create((struct jit_guest *)&actual.guest);
+  struct ir ir = {0};
+  ir.buffer = ir_buffer;
+  ir.capacity = sizeof(ir_buffer);
+  frontend->translate_code(frontend, addr, 4, &ir);
+  int num_guest_ops = eval_ir(&actual, &ir);
+  frontend->destroy(frontend);
+
+  for (int i = 0; i < 16; i++) {
+    CHECK_EQ(actual.ctx.r[i], expected.ctx.r[i], "instr=0x%08x r%d", instr,
+             i);
+  }
+  CHECK_EQ(memcmp(actual.ram, expected.ram, RAM_SIZE), 0, "instr=0x%08x",
+           instr);
+
+  return num_guest_ops;
+}
+
+TEST(armv3_frontend_xfr_imm) {
+  /* transfers with an immediate offset are translated to guest loads and
+     stores in every addressing mode */
+  for (int p = 0; p <= 1; p++) {
+    for (int u = 0; u <= 1; u++) {
+      for (int b = 0; b <= 1; b++) {
+        for (int w = 0; w <= 1; w++) {
+          for (int l = 0; l <= 1; l++) {
+            CHECK_EQ(compare_xfr(XFR(p, u, b, w, l, 1, 2, 0x24), MODE_SYS), 1);
+            CHECK_EQ(compare_xfr(XFR(p, u, b, w, l, 3, 3, 0x0), MODE_SYS), 1);
+            CHECK_EQ(compare_xfr(XFR(p, u, b, w, l, 4, 5, 0x3), MODE_SYS), 1);
+          }
+        }
+      }
+    }
+  }
+
+  /* pc relative transfers see the prefetched pc */
+  CHECK_EQ(compare_xfr(XFR(1, 1, 0, 0, 1, 15, 0, 0x10), MODE_SYS), 1);
+  CHECK_EQ(compare_xfr(XFR(1, 0, 0, 0, 1, 15, 0, 0x8), MODE_SYS), 1);
+  CHECK_EQ(compare_xfr(XFR(1, 1, 1, 0, 0, 15, 6, 0x21), MODE_SYS), 1);
+}
+
+TEST(armv3_frontend_xfr_fallback) {
+  /* register offsets, conditional transfers, writeback to the pc and pc
+     loads are still executed by the fallback */
+  CHECK_EQ(compare_xfr(XFR(1, 1, 0, 0, 1, 1, 2, 0x003) | (1 << 25), MODE_SYS),
+           0);
+  CHECK_EQ(compare_xfr((XFR(1, 1, 0, 0, 1, 1, 2, 0x24) & ~0xf0000000),
+                       MODE_SYS | Z_MASK),
+           0);
+  CHECK_EQ(compare_xfr((XFR(1, 1, 0, 0, 0, 1, 2, 0x24) & ~0xf0000000),
+                       MODE_SYS),
+           0);
+  CHECK_EQ(compare_xfr(XFR(0, 1, 0, 0, 1, 15, 2, 0x8), MODE_SYS), 0);
+  CHECK_EQ(compare_xfr(XFR(1, 1, 0, 0, 1, 1, 15, 0x24), MODE_SYS), 0);
+}
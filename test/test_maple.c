@@ -0,0 +1,74 @@
+#include "core/core.h"
+#include "guest/dreamcast.h"
+#include "guest/maple/maple.h"
+#include "retest.h"
+
+#define PORT 0
+#define CONTROLLER_UNIT 5
+#define BUTTON_A 2
+
+static int (*controller_frame)(struct maple_device *, const union maple_frame *,
+                               union maple_frame *);
+
+static int frame_then_input(struct maple_device *dev,
+                            const union maple_frame *req,
+                            union maple_frame *res) {
+  int handled = controller_frame(dev, req, res);
+
+  /* the button is pressed after the response was built from the old state,
+     but before it's cached */
+  maple_handle_input(dev->mp, PORT, BUTTON_A, 1);
+
+  return handled;
+}
+
+static uint16_t get_buttons(struct maple *mp) {
+  union maple_frame req = {0};
+  union maple_frame res = {0};
+  req.cmd = MAPLE_REQ_GETCOND;
+  req.dst_addr = maple_encode_addr(PORT, CONTROLLER_UNIT);
+  req.num_words = 1;
+  req.params[0] = MAPLE_FUNC_CONTROLLER;
+
+  CHECK(maple_handle_frame(mp, PORT, &req, &res));
+  CHECK_EQ(res.cmd, MAPLE_RES_TRANSFER);
+
+  struct maple_cond cnd;
+  memcpy(&cnd, res.params, sizeof(cnd));
+  return cnd.buttons;
+}
+
+TEST(maple_input_then_poll) {
+  struct dreamcast dc = {0};
+  struct maple *mp = maple_create(&dc);
+
+  /* the idle response is cached */
+  CHECK_EQ(get_buttons(mp) & (1 << BUTTON_A), 1 << BUTTON_A);
+  CHECK_EQ(get_buttons(mp) & (1 << BUTTON_A), 1 << BUTTON_A);
+
+  /* input for the port must be seen by the next poll */
+  maple_handle_input(mp, PORT, BUTTON_A, 1);
+  CHECK_EQ(get_buttons(mp) & (1 << BUTTON_A), 0);
+
+  maple_handle_input(mp, PORT, BUTTON_A, 0);
+  CHECK_EQ(get_buttons(mp) & (1 << BUTTON_A), 1 << BUTTON_A);
+
+  maple_destroy(mp);
+}
+
+TEST(maple_input_during_poll) {
+  struct dreamcast dc = {0};
+  struct maple *mp = maple_create(&dc);
+  struct maple_device *dev = maple_get_device(mp, PORT, CONTROLLER_UNIT);
+
+  /* input arriving while a response is built must not leave the stale
+     response cached */
+  controller_frame = dev->frame;
+  dev->frame = &frame_then_input;
+  CHECK_EQ(get_buttons(mp) & (1 << BUTTON_A), 1 << BUTTON_A);
+  dev->frame = controller_frame;
+
+  CHECK_EQ(get_buttons(mp) & (1 << BUTTON_A), 0);
+
+  maple_destroy(mp);
+}
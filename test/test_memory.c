@@ -0,0 +1,116 @@
+#include "core/core.h"
+#include "core/memory.h"
+#include "guest/holly/holly.h"
+#include "guest/memory.h"
+#include "guest/pvr/pvr.h"
+#include "guest/scheduler.h"
+#include "guest/sh4/sh4.h"
+#include "guest/sh4/sh4_mem.h"
+#include "retest.h"
+
+static mmio_read_cb lookup_read(struct memory *mem, uint32_t addr) {
+  void *userdata;
+  uint8_t *ptr;
+  mmio_read_cb read;
+  mmio_write_cb write;
+  sh4_lookup(mem, addr, &userdata, &ptr, &read, &write);
+  return ptr ? NULL : read;
+}
+
+static void count_write(const struct exception_state *ex, void *data) {
+  int *num_writes = data;
+  (*num_writes)++;
+}
+
+static void create_machine(struct dreamcast *dc) {
+  memset(dc, 0, sizeof(*dc));
+  dc->mem = mem_create(dc);
+  dc->sched = sched_create(dc);
+  dc->sh4 = sh4_create(dc);
+  dc->holly = holly_create(dc);
+  dc->pvr = pvr_create(dc);
+
+  /* only the address spaces and the devices being accessed are initialized */
+  CHECK(mem_init(dc->mem));
+  CHECK(dc->pvr->init((struct device *)dc->pvr));
+}
+
+static void destroy_machine(struct dreamcast *dc) {
+  pvr_destroy(dc->pvr);
+  holly_destroy(dc->holly);
+  dc_destroy_device((struct device *)dc->sh4);
+  sched_destroy(dc->sched);
+  mem_destroy(dc->mem);
+}
+
+TEST(memory_split_page) {
+  struct dreamcast dc;
+  create_machine(&dc);
+
+  /* the holly and pvr register windows split the page they share with the
+     rest of area 0, each side of the split must reach its own device */
+  CHECK_EQ(lookup_read(dc.mem, 0x005effff), (mmio_read_cb)&sh4_area0_read);
+  CHECK_EQ(lookup_read(dc.mem, 0x005f7ffc), (mmio_read_cb)&sh4_holly_reg_read);
+  CHECK_EQ(lookup_read(dc.mem, 0x005f8000), (mmio_read_cb)&sh4_pvr_reg_read);
+  CHECK_EQ(lookup_read(dc.mem, 0x005fa000), (mmio_read_cb)&sh4_area0_read);
+
+  sh4_write32(dc.mem, 0x005f6800, 0x12345678);
+  sh4_write32(dc.mem, 0x005f8020, 0x00abcd00);
+  CHECK_EQ(dc.holly->reg[SB_C2DSTAT], 0x12345678);
+  CHECK_EQ(dc.pvr->reg[PARAM_BASE], 0x00abcd00);
+  CHECK_EQ(sh4_read32(dc.mem, 0x005f6800), 0x12345678);
+  CHECK_EQ(sh4_read32(dc.mem, 0x005f8020), 0x00abcd00);
+
+  /* the first register after the split */
+  CHECK_EQ(sh4_read32(dc.mem, 0x005f8000), 0x17fd11db);
+
+  /* the windows are mapped in each of the p0-p3 mirrors, and are still
+     reachable through area 0's own mirror */
+  CHECK_EQ(sh4_read32(dc.mem, 0xa05f8020), 0x00abcd00);
+  CHECK_EQ(sh4_read32(dc.mem, 0x025f8020), 0x00abcd00);
+  sh4_write32(dc.mem, 0x825f6800, 0x87654321);
+  CHECK_EQ(dc.holly->reg[SB_C2DSTAT], 0x87654321);
+
+  /* the rest of a split page is still handled by area 0, the modem shares
+     its page with the aica register window */
+  CHECK_EQ(lookup_read(dc.mem, 0x00600000), (mmio_read_cb)&sh4_area0_read);
+  CHECK_EQ(lookup_read(dc.mem, 0x00700000), (mmio_read_cb)&sh4_aica_reg_read);
+  sh4_write32(dc.mem, 0x00600000, 0xffffffff);
+  CHECK_EQ(sh4_read32(dc.mem, 0x00600000), 0);
+
+  /* whole pages of memory are still mapped directly */
+  CHECK_EQ(lookup_read(dc.mem, 0x8c000100), NULL);
+  sh4_write32(dc.mem, 0x8c000100, 0xdeadbeef);
+  CHECK_EQ(*(uint32_t *)mem_ram(dc.mem, 0x100), 0xdeadbeef);
+
+  destroy_machine(&dc);
+}
+
+TEST(memory_tracked_vram_writes) {
+  struct dreamcast dc;
+  create_machine(&dc);
+
+  /* watch a texture in vram the same way the texture cache does */
+  const uint32_t tex_addr = 0x2000;
+  const int tex_size = 0x800;
+  int num_writes = 0;
+  uint32_t begin, end;
+  add_single_write_watch(mem_vram(dc.mem, tex_addr), tex_size, &count_write,
+                         &num_writes);
+
+  /* writes through the pvr are marked dirty, and leave the watch armed */
+  sh4_write32(dc.mem, 0x04000000 + tex_addr, 0x12345678);
+  CHECK_EQ(num_writes, 0);
+  CHECK(pvr_vram_dirty_range(dc.pvr, tex_addr, tex_size, &begin, &end));
+  CHECK_EQ(begin, tex_addr);
+  CHECK_EQ(end, tex_addr + (1 << PVR_VRAM_BLOCK_SHIFT));
+  CHECK_EQ(*(uint32_t *)mem_vram(dc.mem, tex_addr), 0x12345678);
+
+  /* so a later write to the same texture bypassing the pvr is still seen */
+  *(uint32_t *)mem_vram(dc.mem, tex_addr + 0x400) = 0xdeadbeef;
+  CHECK_EQ(num_writes, 1);
+  CHECK(!pvr_vram_dirty_range(dc.pvr, tex_addr + 0x400, 4, &begin, &end));
+  CHECK_EQ(sh4_read32(dc.mem, 0x04000000 + tex_addr + 0x400), 0xdeadbeef);
+
+  destroy_machine(&dc);
+}
@@ -0,0 +1,133 @@
+#include "core/core.h"
+#include "guest/memory.h"
+#include "guest/pvr/pvr.h"
+#include "guest/scheduler.h"
+#include "retest.h"
+
+#define PAGE_SIZE (1 << PVR_VRAM_PAGE_SHIFT)
+#define BLOCK_SIZE (1 << PVR_VRAM_BLOCK_SHIFT)
+
+/* the default 262 line, 15.7 khz ntsc timing */
+#define LINE_NS HZ_TO_NANO(13500000 / 858)
+#define SLICE_NS 1000000
+
+/* stands in for the sh4, reading the scanline partway through its slice */
+struct poller {
+  struct device;
+  int64_t elapsed;
+  int64_t poll_at;
+  uint32_t scanline;
+};
+
+static void poller_run(struct device *dev, int64_t ns) {
+  struct poller *poller = (struct poller *)dev;
+  struct pvr *pvr = dev->dc->pvr;
+
+  poller->elapsed = poller->poll_at;
+  union spg_status status = {pvr_reg_read(pvr, SPG_STATUS << 2, 0xffffffff)};
+  poller->scanline = status.scanline;
+  poller->elapsed = ns;
+}
+
+static int64_t poller_elapsed(struct device *dev) {
+  struct poller *poller = (struct poller *)dev;
+  return poller->elapsed;
+}
+
+TEST(pvr_vram_dirty_blocks) {
+  struct pvr *pvr = calloc(1, sizeof(struct pvr));
+  uint32_t begin, end;
+
+  /* nothing is dirty initially */
+  CHECK(!pvr_vram_dirty_range(pvr, 0, PVR_VRAM_SIZE, &begin, &end));
+
+  /* writes are rounded out to the blocks they touch */
+  pvr_vram_mark_dirty(pvr, PAGE_SIZE + BLOCK_SIZE + 4, 8);
+  CHECK(pvr_vram_dirty_range(pvr, 0, PVR_VRAM_SIZE, &begin, &end));
+  CHECK_EQ(begin, PAGE_SIZE + BLOCK_SIZE);
+  CHECK_EQ(end, PAGE_SIZE + BLOCK_SIZE * 2);
+
+  /* ranges sharing the page, but not the block, aren't dirty */
+  CHECK(!pvr_vram_dirty_range(pvr, PAGE_SIZE, BLOCK_SIZE, &begin, &end));
+  CHECK(!pvr_vram_dirty_range(pvr, PAGE_SIZE + BLOCK_SIZE * 2,
+                              PAGE_SIZE - BLOCK_SIZE * 2, &begin, &end));
+
+  /* the range found is clamped to the range queried */
+  CHECK(pvr_vram_dirty_range(pvr, PAGE_SIZE + BLOCK_SIZE + 16, 4, &begin,
+                             &end));
+  CHECK_EQ(begin, PAGE_SIZE + BLOCK_SIZE + 16);
+  CHECK_EQ(end, PAGE_SIZE + BLOCK_SIZE + 20);
+
+  pvr_vram_reset_dirty(pvr);
+  CHECK(!pvr_vram_dirty_range(pvr, 0, PVR_VRAM_SIZE, &begin, &end));
+
+  free(pvr);
+}
+
+TEST(pvr_vram_dirty_across_pages) {
+  struct pvr *pvr = calloc(1, sizeof(struct pvr));
+  uint32_t begin, end;
+
+  /* a write spanning a page boundary marks the end of the first page and the
+     start of the next */
+  pvr_vram_mark_dirty(pvr, PAGE_SIZE * 3 - BLOCK_SIZE, BLOCK_SIZE * 2);
+  CHECK(pvr_vram_dirty_range(pvr, PAGE_SIZE * 3 - BLOCK_SIZE, BLOCK_SIZE,
+                             &begin, &end));
+  CHECK(pvr_vram_dirty_range(pvr, PAGE_SIZE * 3, BLOCK_SIZE, &begin, &end));
+
+  /* disjoint writes produce a single range spanning both */
+  pvr_vram_mark_dirty(pvr, PAGE_SIZE * 8, 1);
+  CHECK(pvr_vram_dirty_range(pvr, 0, PVR_VRAM_SIZE, &begin, &end));
+  CHECK_EQ(begin, PAGE_SIZE * 3 - BLOCK_SIZE);
+  CHECK_EQ(end, PAGE_SIZE * 8 + BLOCK_SIZE);
+
+  /* a full page write marks every block, and stops at the end of vram */
+  pvr_vram_mark_dirty(pvr, PVR_VRAM_SIZE - PAGE_SIZE, PAGE_SIZE * 2);
+  CHECK(pvr_vram_dirty_range(pvr, PVR_VRAM_SIZE - PAGE_SIZE, PAGE_SIZE,
+                             &begin, &end));
+  CHECK_EQ(begin, PVR_VRAM_SIZE - PAGE_SIZE);
+  CHECK_EQ(end, PVR_VRAM_SIZE);
+
+  pvr_vram_reset_dirty(pvr);
+  CHECK(!pvr_vram_dirty_range(pvr, 0, PVR_VRAM_SIZE, &begin, &end));
+  CHECK_EQ(pvr->num_vram_dirty_pages, 0);
+
+  free(pvr);
+}
+
+TEST(pvr_scanline_mid_slice) {
+  struct dreamcast dc = {0};
+  dc.running = 1;
+  dc.mem = mem_create(&dc);
+  dc.sched = sched_create(&dc);
+  dc.pvr = pvr_create(&dc);
+  dc.pvr->init((struct device *)dc.pvr);
+
+  struct poller *poller =
+      dc_create_device(&dc, sizeof(struct poller), "poller", NULL, NULL);
+  poller->runif.enabled = 1;
+  poller->runif.running = 1;
+  poller->runif.run = &poller_run;
+  poller->runif.elapsed = &poller_elapsed;
+
+  /* the first event line is vblank in, well past the slices run here. the
+     scanline must reflect the time the device has reached within each slice,
+     not the end of the slice */
+  for (int i = 0; i < 4; i++) {
+    poller->poll_at = SLICE_NS * (i + 1) / 5;
+    sched_tick(dc.sched, SLICE_NS);
+
+    int64_t now = i * SLICE_NS + poller->poll_at;
+    CHECK_EQ(poller->scanline, (uint32_t)(now / LINE_NS));
+  }
+
+  /* outside of a slice, the scanline is at the scheduler's time */
+  union spg_status status = {
+      pvr_reg_read(dc.pvr, SPG_STATUS << 2, 0xffffffff)};
+  CHECK_EQ(status.scanline, (uint32_t)(4 * SLICE_NS / LINE_NS));
+
+  dc_destroy_device((struct device *)poller);
+  pvr_destroy(dc.pvr);
+  sched_destroy(dc.sched);
+  free(dc.mem);
+}
@@ -0,0 +1,200 @@
+#include <math.h>
+#include <stdlib.h>
+#include "core/core.h"
+#include "core/time.h"
+#include "render/render_backend.h"
+#include "retest.h"
+
+#define WIDTH 64
+#define HEIGHT 64
+#define MAX_VERTS 0x10000
+#define NUM_ITERATIONS 16
+
+static struct ta_vertex verts[MAX_VERTS];
+static uint16_t indices[MAX_VERTS];
+static uint8_t pixels[WIDTH * HEIGHT * 4];
+static int num_verts;
+
+static void add_vert(float x, float y, float invw, uint32_t color) {
+  struct ta_vertex *v = &verts[num_verts];
+  memset(v, 0, sizeof(*v));
+  v->xyz[0] = x;
+  v->xyz[1] = y;
+  v->xyz[2] = invw;
+  v->color = color;
+  indices[num_verts] = num_verts;
+  num_verts++;
+}
+
+static void add_quad(float x0, float y0, float x1, float y1, float invw,
+                     uint32_t color) {
+  add_vert(x0, y0, invw, color);
+  add_vert(x1, y0, invw, color);
+  add_vert(x0, y1, invw, color);
+  add_vert(x1, y0, invw, color);
+  add_vert(x1, y1, invw, color);
+  add_vert(x0, y1, invw, color);
+}
+
+static struct ta_surface make_surf(int first_vert, int num) {
+  struct ta_surface surf = {0};
+  surf.params.depth_func = DEPTH_LESS;
+  surf.params.depth_write = 1;
+  surf.params.cull = CULL_NONE;
+  surf.params.shade = SHADE_DECAL;
+  surf.first_vert = first_vert;
+  surf.num_verts = num;
+  return surf;
+}
+
+static uint32_t read_pixel(int x, int y) {
+  uint32_t color;
+  memcpy(&color, &pixels[(y * WIDTH + x) * 4], 4);
+  return color;
+}
+
+TEST(soft_backend_depth_test) {
+  struct render_backend *r = r_create(WIDTH, HEIGHT);
+  num_verts = 0;
+
+  /* a fullscreen red quad, a closer green quad, and a blue quad behind both */
+  add_quad(0.0f, 0.0f, WIDTH, HEIGHT, 1.0f, 0xff0000ff);
+  add_quad(16.0f, 16.0f, 48.0f, 48.0f, 2.0f, 0xff00ff00);
+  add_quad(8.0f, 8.0f, 56.0f, 56.0f, 0.5f, 0xffff0000);
+
+  r_clear(r);
+  r_begin_ta_surfaces(r, WIDTH, HEIGHT, verts, num_verts, indices, 2,
+                      num_verts);
+  for (int i = 0; i < 3; i++) {
+    struct ta_surface surf = make_surf(i * 6, 6);
+    r_draw_ta_surface(r, &surf);
+  }
+  r_end_ta_surfaces(r);
+  r_read_pixels(r, pixels);
+
+  CHECK_EQ(read_pixel(0, 0), 0xff0000ff);
+  CHECK_EQ(read_pixel(10, 10), 0xff0000ff);
+  CHECK_EQ(read_pixel(WIDTH / 2, HEIGHT / 2), 0xff00ff00);
+  CHECK_EQ(read_pixel(WIDTH - 1, HEIGHT - 1), 0xff0000ff);
+
+  r_destroy(r);
+}
+
+TEST(soft_backend_shared_edges) {
+  struct render_backend *r = r_create(WIDTH, HEIGHT);
+  num_verts = 0;
+
+  /* a fan of triangles around an off-center point, each adding the same
+     color. pixels covered more than once or not at all would show up as
+     doubled or missing inside of the polygon */
+  const int num_tris = 17;
+  const float cx = 30.3f, cy = 33.7f, radius = 28.0f;
+
+  for (int i = 0; i < num_tris; i++) {
+    float a0 = (float)i / num_tris * 6.2831853f;
+    float a1 = (float)(i + 1) / num_tris * 6.2831853f;
+    add_vert(cx, cy, 1.0f, 0x40404040);
+    add_vert(cx + cosf(a0) * radius, cy + sinf(a0) * radius, 1.0f, 0x40404040);
+    add_vert(cx + cosf(a1) * radius, cy + sinf(a1) * radius, 1.0f, 0x40404040);
+  }
+
+  r_clear(r);
+  r_begin_ta_surfaces(r, WIDTH, HEIGHT, verts, num_verts, indices, 2,
+                      num_verts);
+  struct ta_surface surf = make_surf(0, num_verts);
+  surf.params.depth_func = DEPTH_NONE;
+  surf.params.src_blend = BLEND_ONE;
+  surf.params.dst_blend = BLEND_ONE;
+  r_draw_ta_surface(r, &surf);
+  r_end_ta_surfaces(r);
+  r_read_pixels(r, pixels);
+
+  /* the polygon's inscribed circle must be covered exactly once */
+  float inner = radius * cosf(3.14159265f / num_tris) - 1.0f;
+
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      uint32_t color = read_pixel(x, y);
+      float dx = x + 0.5f - cx;
+      float dy = y + 0.5f - cy;
+
+      CHECK(color == 0 || color == 0x40404040);
+
+      if (dx * dx + dy * dy < inner * inner) {
+        CHECK_EQ(color, 0x40404040);
+      }
+    }
+  }
+
+  r_destroy(r);
+}
+
+TEST(soft_backend_clip_behind_eye) {
+  struct render_backend *r = r_create(WIDTH, HEIGHT);
+  num_verts = 0;
+
+  /* a triangle with an edge on the left of the screen and its third vertex
+     behind the eye. the part in front of the eye is drawn, extending off of
+     the right side of the screen */
+  add_vert(8.0f, 8.0f, 1.0f, 0xff00ff00);
+  add_vert(8.0f, 56.0f, 1.0f, 0xff00ff00);
+  add_vert(-40.0f, 32.0f, -1.0f, 0xff00ff00);
+
+  /* and a triangle entirely behind the eye, which isn't drawn */
+  add_vert(0.0f, 0.0f, -1.0f, 0xffff0000);
+  add_vert(WIDTH, 0.0f, -1.0f, 0xffff0000);
+  add_vert(0.0f, HEIGHT, -1.0f, 0xffff0000);
+
+  r_clear(r);
+  r_begin_ta_surfaces(r, WIDTH, HEIGHT, verts, num_verts, indices, 2,
+                      num_verts);
+  struct ta_surface surf = make_surf(0, num_verts);
+  r_draw_ta_surface(r, &surf);
+  r_end_ta_surfaces(r);
+  r_read_pixels(r, pixels);
+
+  CHECK_EQ(read_pixel(4, 32), 0);
+  CHECK_EQ(read_pixel(4, 4), 0);
+  CHECK_EQ(read_pixel(12, 32), 0xff00ff00);
+  CHECK_EQ(read_pixel(WIDTH - 1, 0), 0xff00ff00);
+  CHECK_EQ(read_pixel(WIDTH - 1, HEIGHT - 1), 0xff00ff00);
+  CHECK_EQ(read_pixel(12, 4), 0);
+
+  r_destroy(r);
+}
+
+TEST(soft_backend_benchmark) {
+  struct render_backend *r = r_create(640, 480);
+  int64_t total = 0;
+
+  /* random, partially overlapping triangles, depth tested against each
+     other */
+  num_verts = 0;
+  while (num_verts + 3 <= MAX_VERTS) {
+    float x = (float)(rand() % 640);
+    float y = (float)(rand() % 480);
+    float invw = 0.1f + (rand() % 100) / 100.0f;
+    uint32_t color = 0xff000000 | (rand() & 0xffffff);
+
+    for (int i = 0; i < 3; i++) {
+      add_vert(x + (rand() % 64) - 32, y + (rand() % 64) - 32, invw, color);
+    }
+  }
+
+  for (int i = 0; i < NUM_ITERATIONS; i++) {
+    int64_t start = time_nanoseconds();
+
+    r_clear(r);
+    r_begin_ta_surfaces(r, 640, 480, verts, num_verts, indices, 2, num_verts);
+    struct ta_surface surf = make_surf(0, num_verts);
+    r_draw_ta_surface(r, &surf);
+    r_end_ta_surfaces(r);
+
+    total += time_nanoseconds() - start;
+  }
+
+  LOG_INFO("%d triangles, %d us", num_verts / 3,
+           (int)(total / NUM_ITERATIONS / 1000));
+
+  r_destroy(r);
+}
@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include "core/core.h"
+#include "core/sort.h"
+#include "core/time.h"
+#include "retest.h"
+
+/* covers the translucent surface counts seen in practice */
+#define MAX_ENTRIES 0x10000
+#define NUM_ITERATIONS 16
+
+static float depths[MAX_ENTRIES];
+static int msort_values[MAX_ENTRIES];
+static int msort_tmp[MAX_ENTRIES];
+static int rsort_values[MAX_ENTRIES];
+static int rsort_tmp[MAX_ENTRIES];
+static uint32_t rsort_keys[MAX_ENTRIES];
+static uint32_t rsort_tmp_keys[MAX_ENTRIES];
+
+static int compare_depth(const void *a, const void *b) {
+  int i = *(const int *)a;
+  int j = *(const int *)b;
+  return depths[i] <= depths[j];
+}
+
+static void init_depths(int num) {
+  for (int i = 0; i < num; i++) {
+    /* quantize the depths to produce duplicates, verifying stability */
+    depths[i] = (float)(rand() % 1024 - 256) / 64.0f;
+  }
+}
+
+static void run_msort(int num) {
+  for (int i = 0; i < num; i++) {
+    msort_values[i] = i;
+  }
+
+  msort_noalloc(msort_values, msort_tmp, num, sizeof(int), &compare_depth);
+}
+
+static void run_rsort(int num) {
+  for (int i = 0; i < num; i++) {
+    rsort_values[i] = i;
+    rsort_keys[i] = rsort_float_key(depths[i]);
+  }
+
+  rsort_noalloc(rsort_keys, rsort_values, rsort_tmp_keys, rsort_tmp, num);
+}
+
+TEST(rsort_float_key) {
+  float values[] = {-1000.0f, -1.5f, -1.0f, -0.25f, 0.0f,
+                    0.25f,    1.0f,  1.5f,  1000.0f};
+
+  for (int i = 1; i < ARRAY_SIZE(values); i++) {
+    CHECK_LT(rsort_float_key(values[i - 1]), rsort_float_key(values[i]));
+  }
+}
+
+TEST(rsort_matches_msort) {
+  int sizes[] = {0, 1, 2, 3, 100, 1000, MAX_ENTRIES};
+
+  for (int i = 0; i < ARRAY_SIZE(sizes); i++) {
+    int num = sizes[i];
+
+    init_depths(num);
+    run_msort(num);
+    run_rsort(num);
+
+    for (int j = 0; j < num; j++) {
+      CHECK_EQ(rsort_values[j], msort_values[j]);
+    }
+  }
+}
+
+TEST(rsort_benchmark) {
+  int sizes[] = {1000, 8000, MAX_ENTRIES};
+
+  for (int i = 0; i < ARRAY_SIZE(sizes); i++) {
+    int num = sizes[i];
+    int64_t msort_time = 0;
+    int64_t rsort_time = 0;
+
+    init_depths(num);
+
+    for (int j = 0; j < NUM_ITERATIONS; j++) {
+      int64_t start = time_nanoseconds();
+      run_msort(num);
+      int64_t mid = time_nanoseconds();
+      run_rsort(num);
+      int64_t end = time_nanoseconds();
+
+      msort_time += mid - start;
+      rsort_time += end - mid;
+    }
+
+    LOG_INFO("%d surfaces, msort %d us, rsort %d us", num,
+             (int)(msort_time / NUM_ITERATIONS / 1000),
+             (int)(rsort_time / NUM_ITERATIONS / 1000));
+  }
+}
@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include "core/core.h"
+#include "core/time.h"
+#include "guest/pvr/ta.h"
+#include "retest.h"
+
+/* a full-screen 640x480 video */
+#define YUV_WIDTH 640
+#define YUV_HEIGHT 480
+#define YUV_STRIDE (YUV_WIDTH * 2)
+#define NUM_MACROBLOCKS ((YUV_WIDTH / 16) * (YUV_HEIGHT / 16))
+#define NUM_ITERATIONS 16
+
+static uint8_t macroblocks[NUM_MACROBLOCKS][384];
+static uint8_t ref_out[YUV_HEIGHT * YUV_STRIDE];
+static uint8_t out[YUV_HEIGHT * YUV_STRIDE];
+
+/* the original conversion, reencoding each 8x8 subblock a pixel at a time */
+static void ref_convert_block(const uint8_t *in_uv, const uint8_t *in_y,
+                              uint8_t *out_uyvy) {
+  uint8_t *out_row0 = out_uyvy;
+  uint8_t *out_row1 = out_uyvy + YUV_STRIDE;
+
+  for (int j = 0; j < 8; j += 2) {
+    for (int i = 0; i < 8; i += 2) {
+      out_row0[0] = in_uv[0];
+      out_row0[1] = in_y[0];
+      out_row0[2] = in_uv[64];
+      out_row0[3] = in_y[1];
+
+      out_row1[0] = in_uv[0];
+      out_row1[1] = in_y[8];
+      out_row1[2] = in_uv[64];
+      out_row1[3] = in_y[9];
+
+      in_uv += 1;
+      in_y += 2;
+      out_row0 += 4;
+      out_row1 += 4;
+    }
+
+    in_uv += 4;
+    in_y += 8;
+    out_row0 += YUV_STRIDE * 2 - 16;
+    out_row1 += YUV_STRIDE * 2 - 16;
+  }
+}
+
+static void ref_convert_macroblock(const uint8_t *in, uint8_t *out) {
+  ref_convert_block(&in[0], &in[128], &out[0]);
+  ref_convert_block(&in[4], &in[192], &out[16]);
+  ref_convert_block(&in[32], &in[256], &out[YUV_STRIDE * 8]);
+  ref_convert_block(&in[36], &in[320], &out[YUV_STRIDE * 8 + 16]);
+}
+
+static uint8_t *macroblock_out(uint8_t *base, int i) {
+  int x = (i % (YUV_WIDTH / 16)) * 16;
+  int y = (i / (YUV_WIDTH / 16)) * 16;
+  return &base[y * YUV_STRIDE + x * 2];
+}
+
+static void run_ref() {
+  for (int i = 0; i < NUM_MACROBLOCKS; i++) {
+    ref_convert_macroblock(macroblocks[i], macroblock_out(ref_out, i));
+  }
+}
+
+static void run_ta() {
+  for (int i = 0; i < NUM_MACROBLOCKS; i++) {
+    ta_yuv_convert_macroblock(macroblocks[i], macroblock_out(out, i),
+                              YUV_STRIDE);
+  }
+}
+
+static void init_macroblocks() {
+  for (int i = 0; i < NUM_MACROBLOCKS; i++) {
+    for (int j = 0; j < 384; j++) {
+      macroblocks[i][j] = rand() & 0xff;
+    }
+  }
+}
+
+TEST(ta_yuv_matches_reference) {
+  init_macroblocks();
+  run_ref();
+  run_ta();
+
+  CHECK_EQ(memcmp(out, ref_out, sizeof(out)), 0);
+}
+
+TEST(ta_yuv_benchmark) {
+  int64_t ref_time = 0;
+  int64_t ta_time = 0;
+
+  init_macroblocks();
+
+  for (int i = 0; i < NUM_ITERATIONS; i++) {
+    int64_t start = time_nanoseconds();
+    run_ref();
+    int64_t mid = time_nanoseconds();
+    run_ta();
+    int64_t end = time_nanoseconds();
+
+    ref_time += mid - start;
+    ta_time += end - mid;
+  }
+
+  LOG_INFO("%d macroblocks, reference %d us, ta %d us", NUM_MACROBLOCKS,
+           (int)(ref_time / NUM_ITERATIONS / 1000),
+           (int)(ta_time / NUM_ITERATIONS / 1000));
+}
@@ -0,0 +1,88 @@
+#include "core/core.h"
+#include "guest/pvr/tex.h"
+#include "retest.h"
+
+#define MAX_WIDTH 64
+#define MAX_HEIGHT 64
+
+/* room for a vq codebook followed by the largest 16-bit texture */
+static uint8_t src[PVR_CODEBOOK_SIZE + MAX_WIDTH * MAX_HEIGHT * 2];
+static uint8_t palette[256 * 4];
+static uint8_t expected[MAX_WIDTH * MAX_HEIGHT * 4];
+static uint8_t actual[MAX_WIDTH * MAX_HEIGHT * 4];
+
+static void fill_random(uint8_t *data, int size, uint32_t seed) {
+  for (int i = 0; i < size; i++) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = (uint8_t)(seed >> 16);
+  }
+}
+
+static void compare_simd(int width, int height, int texture_fmt,
+                         int pixel_fmt, int palette_fmt) {
+  int host_simd = pvr_tex_simd();
+  int size = width * height * 4;
+
+  /* the stride of bitmaps is the width, other formats don't use it */
+  pvr_tex_set_simd(PVR_SIMD_NONE);
+  pvr_tex_decode(src, width, height, width, texture_fmt, pixel_fmt, palette,
+                 palette_fmt, expected, size);
+
+  for (int simd = PVR_SIMD_NONE + 1; simd <= host_simd; simd++) {
+    memset(actual, 0, size);
+    pvr_tex_set_simd(simd);
+    pvr_tex_decode(src, width, height, width, texture_fmt, pixel_fmt, palette,
+                   palette_fmt, actual, size);
+    CHECK_EQ(memcmp(actual, expected, size), 0,
+             "texture_fmt=%d pixel_fmt=%d palette_fmt=%d simd=%d",
+             texture_fmt, pixel_fmt, palette_fmt, simd);
+  }
+
+  pvr_tex_set_simd(host_simd);
+}
+
+TEST(tex_simd_matches_scalar) {
+  static const int pixel_fmts[] = {PVR_PXL_ARGB1555, PVR_PXL_RGB565,
+                                   PVR_PXL_ARGB4444, PVR_PXL_YUV422};
+  static const int texture_fmts[] = {PVR_TEX_TWIDDLED, PVR_TEX_VQ,
+                                     PVR_TEX_BITMAP};
+  static const int palette_fmts[] = {PVR_PAL_ARGB1555, PVR_PAL_RGB565,
+                                     PVR_PAL_ARGB4444, PVR_PAL_ARGB8888};
+
+  /* rectangular sizes decode as a series of square twiddled blocks, and
+     widths which aren't a multiple of the vector width leave a scalar tail
+     on each bitmap row */
+  static const int sizes[][2] = {{8, 8},   {16, 8},  {8, 32},
+                                 {64, 64}, {12, 4},  {40, 8}};
+
+  fill_random(src, sizeof(src), 1);
+  fill_random(palette, sizeof(palette), 2);
+
+  for (int i = 0; i < ARRAY_SIZE(sizes); i++) {
+    int width = sizes[i][0];
+    int height = sizes[i][1];
+    int pow2 = !(width & (width - 1)) && !(height & (height - 1));
+
+    for (int j = 0; j < ARRAY_SIZE(pixel_fmts); j++) {
+      for (int k = 0; k < ARRAY_SIZE(texture_fmts); k++) {
+        /* only bitmaps can have sizes other than powers of two */
+        if (!pow2 && texture_fmts[k] != PVR_TEX_BITMAP) {
+          continue;
+        }
+
+        compare_simd(width, height, texture_fmts[k], pixel_fmts[j], 0);
+      }
+    }
+
+    if (!pow2) {
+      continue;
+    }
+
+    for (int j = 0; j < ARRAY_SIZE(palette_fmts); j++) {
+      compare_simd(width, height, PVR_TEX_PALETTE_4BPP, PVR_PXL_4BPP,
+                   palette_fmts[j]);
+      compare_simd(width, height, PVR_TEX_PALETTE_8BPP, PVR_PXL_8BPP,
+                   palette_fmts[j]);
+    }
+  }
+}
@@ -0,0 +1,442 @@
+#include "core/core.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/tr.h"
+#include "render/render_backend.h"
+#include "retest.h"
+
+#define NUM_TEXTURES 2
+
+/* isp depth compare modes */
+#define DEPTH_COMPARE_GREATER 4
+#define DEPTH_COMPARE_GEQUAL 6
+
+static struct tr_texture textures[NUM_TEXTURES];
+static uint8_t texture_data[8 * 8 * 2];
+static uint8_t separate_data[NUM_TEXTURES][8 * 8 * 2];
+
+static struct tr_texture *find_texture(void *userdata, union tsp tsp,
+                                       union tcw tcw) {
+  /* return a non-dirty entry with an existing handle, so the texture isn't
+     converted */
+  struct tr_texture *tex = &textures[tcw.texture_addr % NUM_TEXTURES];
+  tex->handle = 1 + tcw.texture_addr % NUM_TEXTURES;
+  tex->dirty = 0;
+  return tex;
+}
+
+static struct tr_texture *find_dirty_texture(void *userdata, union tsp tsp,
+                                             union tcw tcw) {
+  /* each texture has the same source data, and is converted when first seen */
+  struct tr_texture *tex = &textures[tcw.texture_addr % NUM_TEXTURES];
+  tex->texture = texture_data;
+  tex->texture_size = sizeof(texture_data);
+  return tex;
+}
+
+static struct tr_texture *find_separate_texture(void *userdata, union tsp tsp,
+                                                union tcw tcw) {
+  /* each texture has its own copy of the source data */
+  struct tr_texture *tex = &textures[tcw.texture_addr % NUM_TEXTURES];
+  tex->texture = separate_data[tcw.texture_addr % NUM_TEXTURES];
+  tex->texture_size = sizeof(separate_data[0]);
+  return tex;
+}
+
+static void write_param(struct ta_context *ctx, const void *param) {
+  memcpy(&ctx->params[ctx->size], param, 32);
+  ctx->size += 32;
+}
+
+static void write_triangle(struct ta_context *ctx, int texture,
+                           int depth_compare, int depth_write) {
+  union poly_param poly = {0};
+  poly.type0.pcw.para_type = TA_PARAM_POLY_OR_VOL;
+  poly.type0.pcw.list_type = TA_LIST_OPAQUE;
+  poly.type0.pcw.texture = 1;
+  poly.type0.isp.depth_compare_mode = depth_compare;
+  poly.type0.isp.z_write_disable = !depth_write;
+  poly.type0.tcw.texture_addr = texture;
+  write_param(ctx, &poly);
+
+  for (int i = 0; i < 3; i++) {
+    union vert_param vert = {0};
+    vert.type3.pcw.para_type = TA_PARAM_VERTEX;
+    vert.type3.pcw.end_of_strip = i == 2;
+    vert.type3.xyz[0] = (float)(i & 1);
+    vert.type3.xyz[1] = (float)(i >> 1);
+    vert.type3.xyz[2] = 1.0f;
+    write_param(ctx, &vert);
+  }
+}
+
+static void write_end_of_list(struct ta_context *ctx) {
+  union pcw pcw = {0};
+  pcw.para_type = TA_PARAM_END_OF_LIST;
+
+  uint8_t param[32] = {0};
+  memcpy(param, &pcw, sizeof(pcw));
+  write_param(ctx, param);
+}
+
+static void render_context(struct ta_context *ctx, tr_find_texture_cb find,
+                           struct render_stats *stats) {
+  struct render_backend *r = r_create(640, 480);
+  struct tr *tr = tr_create(r, NULL, find);
+  struct tr_context rc = {0};
+
+  ctx->video_width = 640;
+  ctx->video_height = 480;
+
+  tr_convert_context(tr, ctx, &rc);
+  tr_render_context(r, &rc);
+  r_stats(r, stats);
+
+  tr_free_context(&rc);
+  tr_destroy(tr);
+  r_destroy(r);
+}
+
+TEST(tr_batch_by_state) {
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+
+  /* alternate between two textures */
+  for (int i = 0; i < 64; i++) {
+    write_triangle(ctx, i % NUM_TEXTURES, DEPTH_COMPARE_GREATER, 1);
+  }
+  write_end_of_list(ctx);
+
+  struct render_stats stats;
+  render_context(ctx, &find_texture, &stats);
+
+  /* the background, followed by a single draw per texture */
+  CHECK_EQ(stats.ta_draws, 1 + NUM_TEXTURES);
+  CHECK_EQ(stats.ta_texture_changes, 1 + NUM_TEXTURES);
+
+  free(ctx);
+}
+
+TEST(tr_batch_preserves_order) {
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+
+  /* surfaces without depth writes depend on what's drawn before them, and
+     nothing should be batched across them */
+  for (int i = 0; i < 16; i++) {
+    write_triangle(ctx, i % NUM_TEXTURES, DEPTH_COMPARE_GREATER, 1);
+  }
+  write_triangle(ctx, 0, DEPTH_COMPARE_GREATER, 0);
+  for (int i = 0; i < 16; i++) {
+    write_triangle(ctx, i % NUM_TEXTURES, DEPTH_COMPARE_GREATER, 1);
+  }
+  write_end_of_list(ctx);
+
+  struct render_stats stats;
+  render_context(ctx, &find_texture, &stats);
+
+  CHECK_EQ(stats.ta_draws, 1 + NUM_TEXTURES + 1 + NUM_TEXTURES);
+
+  free(ctx);
+}
+
+TEST(tr_batch_preserves_coplanar_order) {
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+  struct render_backend *r = r_create(640, 480);
+  struct tr *tr = tr_create(r, NULL, &find_texture);
+  struct tr_context rc = {0};
+
+  /* two coplanar surfaces using a depth test which passes on ties, the one
+     drawn last covers the other. sorting by texture would swap them */
+  write_triangle(ctx, 1, DEPTH_COMPARE_GEQUAL, 1);
+  write_triangle(ctx, 0, DEPTH_COMPARE_GEQUAL, 1);
+  write_end_of_list(ctx);
+
+  ctx->video_width = 640;
+  ctx->video_height = 480;
+
+  tr_convert_context(tr, ctx, &rc);
+
+  /* the background, followed by the surfaces in their original order */
+  struct tr_list *list = &rc.lists[TA_LIST_OPAQUE];
+  CHECK_EQ(list->num_surfs, 3);
+  CHECK_EQ(rc.surfs[list->surfs[1]].params.texture, 2);
+  CHECK_EQ(rc.surfs[list->surfs[2]].params.texture, 1);
+
+  tr_free_context(&rc);
+  tr_destroy(tr);
+  r_destroy(r);
+  free(ctx);
+}
+
+static float next_random(uint32_t *seed) {
+  *seed = *seed * 1103515245 + 12345;
+  return (float)((*seed >> 16) & 0x3ff);
+}
+
+static void write_strips(struct ta_context *ctx, int list_type, int texture,
+                         int num_strips, int num_verts, uint32_t *seed) {
+  union poly_param poly = {0};
+  poly.type0.pcw.para_type = TA_PARAM_POLY_OR_VOL;
+  poly.type0.pcw.list_type = list_type;
+  poly.type0.pcw.texture = texture >= 0;
+  poly.type0.isp.depth_compare_mode = DEPTH_COMPARE_GEQUAL;
+  poly.type0.tcw.texture_addr = MAX(texture, 0);
+  write_param(ctx, &poly);
+
+  /* each strip after the first reuses the global parameters */
+  for (int i = 0; i < num_strips; i++) {
+    for (int j = 0; j < num_verts; j++) {
+      union vert_param vert = {0};
+      vert.type3.pcw.para_type = TA_PARAM_VERTEX;
+      vert.type3.pcw.end_of_strip = j == num_verts - 1;
+      vert.type3.xyz[0] = next_random(seed);
+      vert.type3.xyz[1] = next_random(seed);
+      vert.type3.xyz[2] = 1.0f / (1.0f + next_random(seed));
+      vert.type3.uv[0] = next_random(seed);
+      vert.type3.uv[1] = next_random(seed);
+      vert.type3.base_color = (uint32_t)next_random(seed) * 0x10101;
+      write_param(ctx, &vert);
+    }
+  }
+}
+
+static void check_same_context(const struct tr_context *a,
+                               const struct tr_context *b) {
+  CHECK_EQ(a->num_surfs, b->num_surfs);
+  for (int i = 0; i < a->num_surfs; i++) {
+    const struct ta_surface *sa = &a->surfs[i];
+    const struct ta_surface *sb = &b->surfs[i];
+    CHECK_EQ(sa->params.full, sb->params.full);
+    CHECK_EQ(sa->first_vert, sb->first_vert);
+    CHECK_EQ(sa->num_verts, sb->num_verts);
+    CHECK_EQ(sa->strip_offset, sb->strip_offset);
+  }
+
+  CHECK_EQ(a->num_verts, b->num_verts);
+  CHECK_EQ(memcmp(a->verts, b->verts, a->num_verts * sizeof(*a->verts)), 0);
+
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    const struct tr_list *la = &a->lists[i];
+    const struct tr_list *lb = &b->lists[i];
+    CHECK_EQ(la->num_surfs, lb->num_surfs);
+    CHECK_EQ(la->num_orig_surfs, lb->num_orig_surfs);
+    CHECK_EQ(memcmp(la->surfs, lb->surfs, la->num_surfs * sizeof(int)), 0);
+  }
+
+  CHECK_EQ(a->num_params, b->num_params);
+  for (int i = 0; i < a->num_params; i++) {
+    const struct tr_param *pa = &a->params[i];
+    const struct tr_param *pb = &b->params[i];
+    CHECK_EQ(pa->offset, pb->offset);
+    CHECK_EQ(pa->list_type, pb->list_type);
+    CHECK_EQ(pa->vert_type, pb->vert_type);
+    CHECK_EQ(pa->last_surf, pb->last_surf);
+    CHECK_EQ(pa->last_vert, pb->last_vert);
+  }
+
+  CHECK_EQ(a->num_indices, b->num_indices);
+  CHECK_EQ(a->index_size, b->index_size);
+  CHECK_EQ(memcmp(a->indices, b->indices, a->num_indices * a->index_size), 0);
+}
+
+TEST(tr_parse_parallel_matches_serial) {
+  static const int list_types[] = {TA_LIST_OPAQUE, TA_LIST_PUNCH_THROUGH,
+                                   TA_LIST_TRANSLUCENT};
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+  struct render_backend *r = r_create(640, 480);
+  struct tr *tr = tr_create(r, NULL, &find_texture);
+  struct tr_context serial = {0};
+  struct tr_context parallel = {0};
+  uint32_t seed = 1;
+
+  /* many small lists, so the context is split at list boundaries between
+     strips of varying length, vertex types and textures. the context is
+     well over the size at which it's parsed in parallel */
+  for (int i = 0; i < 24; i++) {
+    int list_type = list_types[i % ARRAY_SIZE(list_types)];
+
+    for (int j = 0; j < 16; j++) {
+      int texture = (i + j) % 3 - 1;
+      write_strips(ctx, list_type, texture, 1 + j % 3, 3 + (i + j) % 5,
+                   &seed);
+    }
+    write_end_of_list(ctx);
+  }
+  CHECK_GE(ctx->size, 128 * 1024);
+
+  ctx->video_width = 640;
+  ctx->video_height = 480;
+
+  tr_set_parallel(tr, 0);
+  tr_convert_context(tr, ctx, &serial);
+
+  /* parse twice, reusing the context's arrays the second time */
+  tr_set_parallel(tr, 1);
+  for (int i = 0; i < 2; i++) {
+    tr_convert_context(tr, ctx, &parallel);
+    check_same_context(&parallel, &serial);
+  }
+
+  tr_free_context(&parallel);
+  tr_free_context(&serial);
+  tr_destroy(tr);
+  r_destroy(r);
+  free(ctx);
+}
+
+TEST(tr_share_identical_textures) {
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+
+  memset(textures, 0, sizeof(textures));
+
+  for (int i = 0; i < NUM_TEXTURES; i++) {
+    write_triangle(ctx, i, DEPTH_COMPARE_GREATER, 1);
+  }
+  write_end_of_list(ctx);
+
+  struct render_stats stats;
+  render_context(ctx, &find_dirty_texture, &stats);
+
+  /* textures with identical source data should be converted once */
+  CHECK_NE(textures[0].handle, 0);
+  for (int i = 1; i < NUM_TEXTURES; i++) {
+    CHECK_EQ(textures[i].handle, textures[0].handle);
+  }
+
+  free(ctx);
+}
+
+TEST(tr_stage_textures) {
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+  struct render_backend *r = r_create(640, 480);
+  struct tr *tr = tr_create(r, NULL, &find_dirty_texture);
+  struct tr_context rc = {0};
+
+  memset(textures, 0, sizeof(textures));
+
+  for (int i = 0; i < NUM_TEXTURES; i++) {
+    write_triangle(ctx, i, DEPTH_COMPARE_GREATER, 1);
+  }
+  write_end_of_list(ctx);
+
+  ctx->video_width = 640;
+  ctx->video_height = 480;
+
+  /* decode each texture ahead of time, as the emulator does when their source
+     is registered */
+  for (int i = 0; i < NUM_TEXTURES; i++) {
+    union tsp tsp = {0};
+    union tcw tcw = {0};
+    tcw.texture_addr = i;
+
+    struct tr_texture *tex = find_dirty_texture(NULL, tsp, tcw);
+    tex->tsp = tsp;
+    tex->tcw = tcw;
+    tr_stage_texture(tr, ctx, tex);
+  }
+
+  tr_convert_context(tr, ctx, &rc);
+
+  /* the staged data is consumed by the conversion */
+  CHECK_NE(textures[0].handle, 0);
+  for (int i = 0; i < NUM_TEXTURES; i++) {
+    CHECK(!textures[i].staged);
+    CHECK_EQ(textures[i].handle, textures[0].handle);
+  }
+
+  for (int i = 0; i < NUM_TEXTURES; i++) {
+    tr_release_texture(tr, &textures[i]);
+  }
+
+  tr_free_context(&rc);
+  tr_destroy(tr);
+  r_destroy(r);
+  free(ctx);
+}
+
+TEST(tr_stage_snapshots_source) {
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+  struct render_backend *r = r_create(640, 480);
+  struct tr *tr = tr_create(r, NULL, &find_separate_texture);
+  struct tr_context rc = {0};
+
+  memset(textures, 0, sizeof(textures));
+  memset(separate_data, 0, sizeof(separate_data));
+
+  for (int i = 0; i < NUM_TEXTURES; i++) {
+    write_triangle(ctx, i, DEPTH_COMPARE_GREATER, 1);
+  }
+  write_end_of_list(ctx);
+
+  ctx->video_width = 640;
+  ctx->video_height = 480;
+
+  union tsp tsp = {0};
+  union tcw tcw = {0};
+  struct tr_texture *tex = find_separate_texture(NULL, tsp, tcw);
+  tex->tsp = tsp;
+  tex->tcw = tcw;
+  tr_stage_texture(tr, ctx, tex);
+
+  /* the guest keeps running while the texture is decoded, and may overwrite
+     its source after it was staged */
+  memset(separate_data[0], 0xff, sizeof(separate_data[0]));
+
+  tr_convert_context(tr, ctx, &rc);
+
+  /* the staged texture's hash and data both describe the source at the time
+     it was staged, identical to the untouched texture */
+  CHECK_NE(textures[0].handle, 0);
+  CHECK_EQ(textures[1].handle, textures[0].handle);
+
+  for (int i = 0; i < NUM_TEXTURES; i++) {
+    tr_release_texture(tr, &textures[i]);
+  }
+
+  tr_free_context(&rc);
+  tr_destroy(tr);
+  r_destroy(r);
+  free(ctx);
+}
+
+TEST(tr_update_dirty_rows) {
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+  struct render_backend *r = r_create(640, 480);
+  struct tr *tr = tr_create(r, NULL, &find_dirty_texture);
+  struct tr_context rc = {0};
+
+  memset(textures, 0, sizeof(textures));
+
+  /* reference a single bitmap texture */
+  write_triangle(ctx, 0, DEPTH_COMPARE_GREATER, 1);
+  union poly_param *poly = (union poly_param *)ctx->params;
+  poly->type0.tcw.scan_order = 1;
+  write_end_of_list(ctx);
+
+  ctx->video_width = 640;
+  ctx->video_height = 480;
+
+  tr_convert_context(tr, ctx, &rc);
+
+  texture_handle_t handle = textures[0].handle;
+  CHECK_NE(handle, 0);
+
+  /* rewrite a single row, it should be uploaded to the existing handle rather
+     than a new one being created for the modified texture */
+  int pitch = 8 * 2;
+  memset(&texture_data[pitch * 2], 0xff, pitch);
+  textures[0].dirty = 1;
+  textures[0].dirty_begin = pitch * 2;
+  textures[0].dirty_end = pitch * 3;
+
+  tr_convert_context(tr, ctx, &rc);
+
+  CHECK_EQ(textures[0].handle, handle);
+  CHECK(!textures[0].dirty);
+
+  tr_release_texture(tr, &textures[0]);
+  memset(texture_data, 0, sizeof(texture_data));
+
+  tr_free_context(&rc);
+  tr_destroy(tr);
+  r_destroy(r);
+  free(ctx);
+}
@@ -1,11 +1,17 @@
 #include <stdio.h>
 #include "core/core.h"
 #include "core/filesystem.h"
+#include "core/option.h"
+#include "core/time.h"
 #include "guest/pvr/tex.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+DEFINE_OPTION_INT(bench, 0,
+                  "Time this many conversions of each texture instead of "
+                  "writing them out");
+
 char *texture_fmt_names[] = {
     NULL,
     "TWIDDLED",
@@ -46,6 +52,26 @@ uint8_t *read_tex(const char *filename) {
   return buffer;
 }
 
+void bench_tex(const struct pvr_tex_header *header, const uint8_t *data,
+               uint8_t *converted, int size) {
+  int width = header->width;
+  int height = header->height;
+
+  /* only the top level is decoded at runtime */
+  int64_t start = time_nanoseconds();
+
+  for (int i = 0; i < OPTION_bench; i++) {
+    pvr_tex_decode(data, width, height, width, header->texture_fmt,
+                   header->pixel_fmt, NULL, 0, converted, size);
+  }
+
+  int64_t elapsed = (time_nanoseconds() - start) / OPTION_bench;
+  int64_t texels = (int64_t)width * height;
+
+  LOG_INFO("decode:       %d ns, %d texels/us", (int)elapsed,
+           (int)(texels * 1000 / MAX(elapsed, 1)));
+}
+
 void convert_tex(const char *texname) {
   LOG_INFO("#==--------------------------------------------------==#");
   LOG_INFO("# %s", texname);
@@ -73,8 +99,15 @@ void convert_tex(const char *texname) {
   LOG_INFO("height:       %d", header->height);
   LOG_INFO("");
 
-  /* convert each mip level to png */
   static uint8_t converted[1024 * 1024 * 4];
+
+  if (OPTION_bench) {
+    bench_tex(header, data, converted, sizeof(converted));
+    free(buffer);
+    return;
+  }
+
+  /* convert each mip level to png */
   int mipmaps = pvr_tex_mipmaps(header->texture_fmt);
   int levels = mipmaps ? ctz32(header->width) + 1 : 1;
 
@@ -100,6 +133,10 @@ void convert_tex(const char *texname) {
 }
 
 int main(int argc, char **argv) {
+  if (!options_parse(&argc, &argv)) {
+    return EXIT_FAILURE;
+  }
+
   for (int i = 1; i < argc; i++) {
     convert_tex(argv[i]);
   }
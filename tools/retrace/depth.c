@@ -55,8 +55,10 @@ static void test_context(struct trace_cmd *cmd, struct test *tests,
   struct tr_context *rc = calloc(1, sizeof(struct tr_context));
 
   /* parse the context */
+  struct tr *tr = tr_create(NULL, NULL, &find_texture);
   trace_copy_context(cmd, ctx);
-  tr_convert_context(NULL, NULL, &find_texture, ctx, rc);
+  tr_convert_context(tr, ctx, rc);
+  tr_destroy(tr);
 
   /* sort each vertex by the original w */
   struct depth_entry *original =
@@ -105,6 +107,7 @@ static void test_context(struct trace_cmd *cmd, struct test *tests,
   }
 
   free(original);
+  tr_free_context(rc);
   free(rc);
   free(ctx);
 }
@@ -1,11 +1,17 @@
 #include "core/core.h"
 
 extern int cmd_depth(int argc, const char **argv);
+#ifdef HAVE_SOFT_RENDER
+extern int cmd_render(int argc, const char **argv);
+#endif
 
 static void print_help() {
   LOG_INFO("usage: retrace <command> [<args> ...]");
   LOG_INFO("the available commands are:");
   LOG_INFO("    depth    compare depth function accuracies");
+#ifdef HAVE_SOFT_RENDER
+  LOG_INFO("    render   render each context to a png in the output directory");
+#endif
 }
 
 int main(int argc, const char **argv) {
@@ -17,6 +23,12 @@ int main(int argc, const char **argv) {
     if (!strcmp(cmd, "depth")) {
       res = cmd_depth(argc - 2, argv + 2);
     }
+
+#ifdef HAVE_SOFT_RENDER
+    if (!strcmp(cmd, "render")) {
+      res = cmd_render(argc - 2, argv + 2);
+    }
+#endif
   }
 
   if (!res) {
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "core/core.h"
+#include "core/filesystem.h"
+#include "file/trace.h"
+#include "guest/pvr/tr.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "../retex/stb_image_write.h"
+
+#define RENDER_WIDTH 640
+#define RENDER_HEIGHT 480
+#define MAX_RENDER_TEXTURES 1024
+
+struct render_state {
+  struct render_backend *r;
+  struct tr *tr;
+  struct tr_texture textures[MAX_RENDER_TEXTURES];
+  int num_textures;
+};
+
+static struct tr_texture *find_texture(void *userdata, union tsp tsp,
+                                       union tcw tcw) {
+  struct render_state *st = userdata;
+  tr_texture_key_t key = tr_texture_key(tsp, tcw);
+
+  for (int i = 0; i < st->num_textures; i++) {
+    struct tr_texture *tex = &st->textures[i];
+
+    if (tr_texture_key(tex->tsp, tex->tcw) == key) {
+      return tex;
+    }
+  }
+
+  return NULL;
+}
+
+static void add_texture(struct render_state *st, const struct trace_cmd *cmd) {
+  CHECK_EQ(cmd->type, TRACE_CMD_TEXTURE);
+
+  struct tr_texture *tex = find_texture(st, cmd->texture.tsp, cmd->texture.tcw);
+
+  if (!tex) {
+    CHECK_LT(st->num_textures, MAX_RENDER_TEXTURES);
+    tex = &st->textures[st->num_textures++];
+    tex->tsp = cmd->texture.tsp;
+    tex->tcw = cmd->texture.tcw;
+  }
+
+  /* an empty dirty range reconverts the entire texture */
+  tex->frame = cmd->texture.frame;
+  tex->dirty = 1;
+  tex->dirty_begin = 0;
+  tex->dirty_end = 0;
+  tex->texture = cmd->texture.texture;
+  tex->texture_size = cmd->texture.texture_size;
+  tex->palette = cmd->texture.palette;
+  tex->palette_size = cmd->texture.palette_size;
+}
+
+static int render_context(struct render_state *st, const struct trace_cmd *cmd,
+                          const char *outdir, int frame, uint8_t *pixels) {
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+  struct tr_context *rc = calloc(1, sizeof(struct tr_context));
+
+  trace_copy_context(cmd, ctx);
+  tr_convert_context(st->tr, ctx, rc);
+
+  r_clear(st->r);
+  tr_render_context(st->r, rc);
+  r_read_pixels(st->r, pixels);
+
+  char filename[PATH_MAX];
+  snprintf(filename, sizeof(filename), "%s" PATH_SEPARATOR "frame_%04d.png",
+           outdir, frame);
+
+  int res = stbi_write_png(filename, RENDER_WIDTH, RENDER_HEIGHT, 4, pixels,
+                           RENDER_WIDTH * 4);
+
+  if (!res) {
+    LOG_WARNING("failed to write %s", filename);
+  }
+
+  tr_free_context(rc);
+  free(rc);
+  free(ctx);
+
+  return res;
+}
+
+int cmd_render(int argc, const char **argv) {
+  if (argc < 1) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+  const char *outdir = argc >= 2 ? argv[1] : ".";
+
+  struct trace *trace = trace_parse(filename);
+
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  struct render_state *st = calloc(1, sizeof(struct render_state));
+  st->r = r_create(RENDER_WIDTH, RENDER_HEIGHT);
+  st->tr = tr_create(st->r, st, &find_texture);
+
+  uint8_t *pixels = malloc(RENDER_WIDTH * RENDER_HEIGHT * 4);
+  int frame = 0;
+  int res = 1;
+
+  /* replay the trace, writing out an image for each context rendered with
+     the textures uploaded up to that point */
+  for (struct trace_cmd *cmd = trace->cmds; cmd && res; cmd = cmd->next) {
+    if (cmd->type == TRACE_CMD_TEXTURE) {
+      add_texture(st, cmd);
+    } else if (cmd->type == TRACE_CMD_CONTEXT) {
+      res = render_context(st, cmd, outdir, frame++, pixels);
+    }
+  }
+
+  LOG_INFO("rendered %d frames to %s", frame, outdir);
+
+  free(pixels);
+
+  for (int i = 0; i < st->num_textures; i++) {
+    tr_release_texture(st->tr, &st->textures[i]);
+  }
+
+  tr_destroy(st->tr);
+  r_destroy(st->r);
+  free(st);
+  trace_destroy(trace);
+
+  return res;
+}